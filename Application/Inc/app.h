@@ -24,6 +24,10 @@ extern "C" {
 #include "proto_types.h"
 #include "message.h"
 #include "proto.h"
+#include "dispatch.h"
+#include "latency.h"
+#include "ccbus.h"
+#include "pool.h"
 
 /* Exported types ------------------------------------------------------------*/
 
@@ -39,6 +43,30 @@ typedef struct
     uint8_t country_code;       /* Country code from ID003 response */
 } bill_denom_t;
 
+/**
+  * @brief  Cached downstream validator settings
+  * @note   Updated from set-command echoes and request responses, invalidated
+  *         on power-up. GET STATUS and the bill table view are served from it.
+  *         ID003 has no escrow setting: the escrow mask is ds_escrowed_bills
+  */
+#define DS_SETTING_INHIBIT      0x01
+#define DS_SETTING_ENABLE       0x02
+#define DS_SETTING_SECURITY     0x04
+#define DS_SETTING_COMM_MODE    0x08
+#define DS_SETTING_DIRECTION    0x10
+#define DS_SETTING_ALL          0x1F
+typedef struct
+{
+    uint8_t valid;              /* DS_SETTING_xxx flags of the fields that are known */
+    uint8_t inhibit;            /* ID003 inhibit: 1 = inhibited (unit disabled) */
+    uint8_t enable[2];          /* ID003 enable: denomination mask (0 = enabled) and reserved byte */
+    uint8_t security[2];        /* ID003 security: high security denomination mask */
+    uint8_t comm_mode;          /* ID003 communication mode */
+    uint8_t direction;          /* ID003 direction: inhibited insertion directions */
+    uint8_t refresh_index;      /* Next setting of the background refresh */
+    uint32_t refresh_time;      /* Time of the last background refresh request */
+} ds_settings_t;
+
 /**
   * @brief  Bill table structure
   */
@@ -53,6 +81,7 @@ typedef struct
     uint32_t escrowed_bills;    /* Escrowed bills in 32 long bitmask bit0 is bill type 0*/
     uint32_t ds_enabled_bills;  /* Downstream perspective. 1=YES, 0=NO*/
     uint32_t ds_escrowed_bills; /* Downstream perspective - escrowed bills in 32 long bitmask bit0 is bill type 0*/
+    ds_settings_t ds_settings;  /* Cached downstream settings */
 } bill_table_t;
 
 /**
@@ -98,7 +127,7 @@ typedef struct
     uint8_t sync_byte2;             /* Second sync byte (if sync_length > 1) */
     int8_t length_offset;           /* Length field offset (0 for CCNET/ID003, -5 for CCTALK) */
     uint8_t crc_length;             /* Number of CRC bytes */
-    uint32_t inter_byte_timeout_ms; /* Inter-byte timeout in milliseconds */
+    uint32_t inter_byte_timeout_ms; /* Unused: replaced by USART receiver timeout. Kept for flash layout */
     uint8_t cctalk_source_address;  /* Source address for ccTalk. Use 0 for broadcast */
     uint8_t cctalk_dest_address;    /* Destination address for ccTalk 1 is default */
     uint8_t cctalk_echo_byte_count; /* Number of ccTalk echo bytes to ignore */
@@ -118,6 +147,50 @@ typedef struct
     datalink_config_t datalink;    /* Datalink layer configuration */
 } interface_config_t;
 
+/**
+  * @brief  CCNET POLL timing report
+  * @note   Times in ms (HAL tick). Response time is from POLL reception to the
+  *         queued answer, status age is the age of the answered status
+  */
+typedef struct
+{
+    uint8_t locked;                 /* Controller POLL cadence learned */
+    uint16_t interval_ms;           /* Controller POLL interval */
+    uint16_t jitter_ms;             /* Controller POLL jitter */
+    uint16_t lead_ms;               /* Downstream poll sent this long before the expected POLL */
+    uint16_t downstream_rtt_ms;     /* Downstream status request to response */
+    uint32_t polls;                 /* CCNET POLLs answered */
+    uint32_t response_time_total_ms;
+    uint32_t response_time_max_ms;
+    uint32_t status_age_total_ms;
+    uint32_t status_age_max_ms;
+} poll_timing_t;
+
+/**
+  * @brief  Upstream response cache statistics
+  */
+typedef struct {
+    uint32_t replays;               /* Repeated requests answered with the cached response */
+    uint32_t nak_retransmits;       /* Cached response sent again after a controller NAK */
+    uint32_t duplicates_dropped;    /* Repeated requests received while the first was still handled */
+    uint32_t frame_hits;            /* Responses sent from a prebuilt frame */
+    uint32_t frame_builds;          /* Response frames built (first use or changed source) */
+} response_cache_stats_t;
+
+/**
+  * @brief  Boot timing report
+  * @note   Times in ms since reset (HAL tick), 0 for a step not reached yet
+  */
+typedef struct {
+    uint32_t links_ms;              /* APP_Init done: CCNET commands are answered from here */
+    uint32_t first_command_ms;      /* First valid CCNET command received */
+    uint32_t first_response_ms;     /* First CCNET response queued */
+    uint32_t validator_ms;          /* First status response of the downstream validator (ID003) */
+    uint32_t bill_table_ms;         /* Downstream bill table loaded (ID003) */
+    uint32_t usb_ms;                /* USB host enumerated the device */
+    uint32_t background_ms;         /* Banner and test suites done */
+} boot_timing_t;
+
 /* Exported constants --------------------------------------------------------*/
 
 /* Exported macro ------------------------------------------------------------*/
@@ -132,10 +205,7 @@ extern UART_HandleTypeDef huart3;
 /* Interface objects */
 extern interface_config_t if_upstream;    /* Upstream interface (CCNET) */
 extern interface_config_t if_downstream;  /* Downstream interface (ID003) */
-
-/* Message objects */
-extern message_t upstream_msg;    /* CCNET messages from upstream */
-extern message_t downstream_msg;  /* ID003 messages from downstream */
+extern interface_config_t if_second;      /* Second downstream validator (ID003 on UART3) */
 
 /* Bill table */
 extern bill_table_t g_bill_table;
@@ -144,8 +214,21 @@ extern bill_table_t g_bill_table;
 void APP_Init(void);
 void APP_Process(void);
 void APP_MCUReset(void);
+void APP_RequestDiscovery(void);
 void APP_ShowConfigMenu(void);
 message_parse_result_t APP_CheckForDownstreamMessage(void);
+void APP_GetPollTiming(poll_timing_t* timing);
+void APP_ResetPollTiming(void);
+uint8_t APP_GetCommandStats(uint8_t index, const char** name, dispatch_stats_t* stats);
+void APP_ResetCommandStats(void);
+uint8_t APP_GetCommandLatency(uint8_t index, const char** name, latency_histogram_t* histogram);
+void APP_ResetCommandLatency(void);
+void APP_GetResponseCacheStats(response_cache_stats_t* stats);
+void APP_GetBootTiming(boot_timing_t* timing);
+uint8_t APP_GetBusDevice(uint8_t index, ccbus_device_t* device);
+uint16_t APP_GetBusUtilisation(void);
+void APP_ResetBusStats(void);
+uint8_t APP_GetPool(pool_t* pool);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file           : cadence.h
+  * @brief          : Poll cadence tracker header file
+  *                   Learns the interval and jitter of periodic events (the
+  *                   controller's CCNET POLL)
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __CADENCE_H
+#define __CADENCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define CADENCE_LOCK_SAMPLES    4       /* Consistent intervals before the cadence is locked */
+#define CADENCE_MAX_INTERVAL_MS 2000    /* Longer gaps are pauses, not a cadence */
+#define CADENCE_FRACTION_BITS   4       /* Interval and jitter are kept in 1/16 ms */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Cadence tracker
+  * @note   Interval and jitter are running averages (1/8 weight per sample).
+  *         Jitter is the mean absolute deviation from the interval
+  */
+typedef struct {
+    uint32_t last_time;             /* Time of the last event (ms) */
+    uint32_t interval;              /* Average interval, fixed point */
+    uint32_t jitter;                /* Average deviation, fixed point */
+    uint32_t events;                /* Events seen */
+    uint32_t unlocks;               /* Lock lost on an interval outside the jitter window */
+    uint8_t samples;                /* Consistent intervals in a row, saturates at 255 */
+} cadence_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void CADENCE_Init(cadence_t* cadence);
+void CADENCE_Update(cadence_t* cadence, uint32_t now);
+uint8_t CADENCE_IsLocked(const cadence_t* cadence, uint32_t now);
+uint32_t CADENCE_NextExpected(const cadence_t* cadence);
+uint16_t CADENCE_GetInterval(const cadence_t* cadence);
+uint16_t CADENCE_GetJitter(const cadence_t* cadence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CADENCE_H */
@@ -0,0 +1,104 @@
+/**
+  ******************************************************************************
+  * @file           : ccbus.h
+  * @brief          : ccTalk multi-drop bus scheduler header file
+  *                   Round-robin polling of several ccTalk peripherals on one
+  *                   bus, one request on the line at a time
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __CCBUS_H
+#define __CCBUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define CCBUS_MAX_DEVICES       4       /* Peripherals on the bus */
+#define CCBUS_NO_DEVICE         0xFF    /* No request on the line, or nothing due */
+#define CCBUS_FRAME_MAX         5       /* Poll frame: dest, length, source, header, checksum */
+#define CCBUS_EVENT_BUFFER      5       /* Events a ccTalk peripheral buffers between two reads */
+#define CCBUS_WINDOW_MS         1000    /* Bus utilisation measurement window */
+#define CCBUS_MAX_RETRIES       2       /* Immediate repeats of a poll after echo collisions */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Peripheral on the bus and how it is polled
+  */
+typedef struct {
+    const char* name;               /* Console name */
+    uint8_t address;                /* ccTalk address, e.g. 2 coin acceptor, 3 hopper, 40 bill validator */
+    uint8_t header;                 /* Poll command header */
+    uint8_t event_counter;          /* 1: the first response byte is the ccTalk event counter */
+    uint16_t period_ms;             /* Poll period */
+    uint16_t timeout_ms;            /* Response deadline, counted from the start of the request */
+} ccbus_device_config_t;
+
+/**
+  * @brief  Peripheral state and statistics
+  */
+typedef struct {
+    ccbus_device_config_t config;
+    uint32_t last_poll;             /* Start of the last poll */
+    uint8_t online;                 /* Answered the last poll */
+    uint8_t counter_valid;          /* counter holds the last event counter */
+    uint8_t counter;                /* Last event counter, 0 after a peripheral reset */
+    uint8_t new_events;             /* Events reported by the last response */
+    uint32_t polls;                 /* Requests sent */
+    uint32_t responses;             /* Responses in time */
+    uint32_t timeouts;              /* No response before the deadline */
+    uint32_t events;                /* Events reported by the event counter */
+    uint32_t lost_events;           /* Events that fell out of the peripheral buffer unread */
+    uint32_t resets;                /* Event counter back to 0: peripheral power-up or reset */
+    uint32_t collisions;            /* Polls corrupted on the line (echo mismatch) */
+    uint8_t retries;                /* Consecutive repeats after a collision */
+    uint32_t latency_total_ms;      /* Sum of request to response times, average = total / responses */
+    uint16_t latency_max_ms;        /* Longest request to response time */
+} ccbus_device_t;
+
+/**
+  * @brief  Bus owner state
+  * @note   Main loop only. active is the device with the request on the line,
+  *         no other request is sent until it answers or times out
+  */
+typedef struct {
+    ccbus_device_t devices[CCBUS_MAX_DEVICES];
+    uint8_t count;                  /* Devices on the bus */
+    uint8_t host_address;           /* Our ccTalk address (source of the requests) */
+    uint8_t active;                 /* Device waiting for its response, CCBUS_NO_DEVICE if the bus is free */
+    uint8_t next;                   /* Round-robin start of the next search */
+    uint32_t request_tick;          /* Start of the active request */
+    uint32_t busy_start;            /* Start of the busy time not yet counted in window_busy_ms */
+    uint32_t window_start;          /* Start of the utilisation window */
+    uint32_t window_busy_ms;        /* Time with a request on the line in this window */
+    uint16_t utilisation;           /* Busy time of the last complete window, permille */
+} ccbus_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void CCBUS_Init(ccbus_t* bus, uint8_t host_address, uint32_t now);
+uint8_t CCBUS_AddDevice(ccbus_t* bus, const ccbus_device_config_t* config);
+uint8_t CCBUS_Next(ccbus_t* bus, uint32_t now, uint8_t* frame);
+uint8_t CCBUS_Response(ccbus_t* bus, uint8_t address, const uint8_t* data, uint8_t data_length, uint32_t now);
+uint8_t CCBUS_Collision(ccbus_t* bus, uint32_t now);
+void CCBUS_Process(ccbus_t* bus, uint32_t now);
+uint8_t CCBUS_IsBusy(const ccbus_t* bus);
+uint8_t CCBUS_IsSilent(const ccbus_t* bus, uint32_t timeouts);
+void CCBUS_ResetStats(ccbus_t* bus, uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CCBUS_H */
@@ -30,8 +30,10 @@
 #define CONFIGUI_MENU_SHOW_BILL_TABLE        9
 #define CONFIGUI_MENU_USB_LOGGING            10
 #define CONFIGUI_MENU_LOG_LEVEL              11
-#define CONFIGUI_MENU_EXIT                   12
-#define CONFIGUI_MENU_SAVE_EXIT              13
+#define CONFIGUI_MENU_ADAPTIVE_POLLING       12
+#define CONFIGUI_MENU_SECOND_VALIDATOR       13
+#define CONFIGUI_MENU_EXIT                   14
+#define CONFIGUI_MENU_SAVE_EXIT              15
 
 /* Exported function prototypes ----------------------------------------------*/
 void CONFIGUI_ShowMenu(void);
@@ -35,10 +35,21 @@ typedef struct
     uint8_t usb_logging_enabled;     /* USB logging enabled flag */
     uint8_t log_level;               /* Log level (LOG_LEVEL_ERROR, WARN, PROTO, INFO) */
     uint8_t bill_table[8];           /* Bill table mapping (8 bits) */
+    uint16_t poll_fast_ms;           /* Adaptive polling: period while a bill is handled, 0 = fixed period */
+    uint16_t poll_slow_ms;           /* Adaptive polling: period while idle, disabled or failed, 0 = fixed period */
+    uint8_t second_validator;        /* CONFIG_SECOND_xxx: second downstream validator, applied at reset */
 } config_settings_t;
 
 /* Exported constants --------------------------------------------------------*/
 
+/* Adaptive polling defaults. Slow period must stay below the downstream status TTL (app.c) */
+#define CONFIG_POLL_FAST_MS_DEFAULT      50
+#define CONFIG_POLL_SLOW_MS_DEFAULT      1000
+
+/* Second downstream validator. ID003 on UART3, only next to an ID003 validator on UART2 */
+#define CONFIG_SECOND_OFF                0
+#define CONFIG_SECOND_ID003              1
+
 /* Configuration menu options */
 #define CONFIG_MENU_UPSTREAM_PROTOCOL    1
 #define CONFIG_MENU_UPSTREAM_BAUDRATE    2
@@ -63,6 +74,9 @@ extern config_settings_t g_config;
 void CONFIG_Init(void);
 void CONFIG_LoadFromNVM(void);
 void CONFIG_SaveToNVM(void);
+void CONFIG_RequestSave(void);
+uint8_t CONFIG_IsSavePending(void);
+void CONFIG_ApplyProtocol(interface_config_t* interface);
 void CONFIG_ShowConfiguration(void);
 void CONFIG_ShowMenu(void);
 void CONFIG_ProcessMenu(void);
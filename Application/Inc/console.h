@@ -0,0 +1,41 @@
+/**
+  ******************************************************************************
+  * @file           : console.h
+  * @brief          : USB console header file
+  *                   Line commands accepted while the application is running
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __CONSOLE_H
+#define __CONSOLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+#define CONSOLE_LINE_LENGTH 32
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void CONSOLE_Process(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CONSOLE_H */
@@ -0,0 +1,45 @@
+/**
+  ******************************************************************************
+  * @file           : discovery.h
+  * @brief          : Downstream auto-discovery header file
+  *                   Probes protocol, baud rate and parity of the validator
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __DISCOVERY_H
+#define __DISCOVERY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "app.h"
+#include "transaction.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+#define DISCOVERY_PROBE_TIMEOUT_MS  100     /* Response timeout per candidate */
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void DISCOVERY_Start(transaction_engine_t* engine, interface_config_t* interface, message_t* message, uint8_t id003_only);
+uint8_t DISCOVERY_Process(void);
+uint8_t DISCOVERY_IsRunning(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DISCOVERY_H */
@@ -0,0 +1,98 @@
+/**
+  ******************************************************************************
+  * @file           : dispatch.h
+  * @brief          : Command dispatcher header file
+  *                   Table driven command handling with allowed states and
+  *                   response deadlines
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __DISPATCH_H
+#define __DISPATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define DISPATCH_UNSUPPORTED    0       /* Command index of opcodes without an entry */
+#define DISPATCH_STATE_ANY      0xFF    /* Allowed in every state */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Command handler, called from the main loop
+  * @note   May respond directly or later from a completion callback
+  */
+typedef void (*dispatch_handler_t)(void);
+
+/**
+  * @brief  Command table entry
+  */
+typedef struct {
+    const char* name;               /* Name for the statistics */
+    dispatch_handler_t handler;     /* NULL: not supported */
+    uint8_t allowed_states;         /* State bits in which the command is legal */
+    uint16_t deadline_ms;           /* Response deadline from reception, 0 = no response */
+    uint8_t replay;                 /* 1: an identical repeat may be answered with the previous response */
+} dispatch_command_t;
+
+/**
+  * @brief  Per command statistics
+  */
+typedef struct {
+    uint32_t calls;                 /* Commands received */
+    uint32_t illegal;               /* Rejected in a state where the command is not allowed */
+    uint32_t responses;             /* Responses sent */
+    uint32_t overruns;              /* Responses later than the deadline */
+    uint32_t unanswered;            /* Superseded by the next command before a response */
+    uint32_t response_max_ms;       /* Slowest response */
+} dispatch_stats_t;
+
+/**
+  * @brief  Dispatch result
+  */
+typedef enum {
+    DISPATCH_OK = 0,                /* Handler called */
+    DISPATCH_NOT_SUPPORTED,         /* No handler for the opcode */
+    DISPATCH_ILLEGAL                /* Handler not called, not allowed in the current state */
+} dispatch_result_t;
+
+/**
+  * @brief  Dispatcher
+  * @note   lut maps every opcode (0-255) to an index in commands, index 0
+  *         (DISPATCH_UNSUPPORTED) is the entry for unknown opcodes. stats has
+  *         one entry per command
+  */
+typedef struct {
+    const uint8_t* lut;             /* Opcode to command index, 256 entries */
+    const dispatch_command_t* commands;
+    dispatch_stats_t* stats;
+    uint8_t count;                  /* Number of commands incl. DISPATCH_UNSUPPORTED */
+    uint8_t pending;                /* Last dispatched command */
+    uint8_t waiting;                /* 1 while pending waits for its response */
+    uint32_t start_time;            /* Reception of the pending command (ms) */
+} dispatcher_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void DISPATCH_Init(dispatcher_t* dispatcher, const uint8_t* lut, const dispatch_command_t* commands,
+                   dispatch_stats_t* stats, uint8_t count);
+dispatch_result_t DISPATCH_Run(dispatcher_t* dispatcher, uint8_t opcode, uint8_t state, uint32_t now);
+void DISPATCH_Responded(dispatcher_t* dispatcher, uint32_t now);
+void DISPATCH_ResetStats(dispatcher_t* dispatcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DISPATCH_H */
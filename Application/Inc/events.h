@@ -0,0 +1,80 @@
+/**
+  ******************************************************************************
+  * @file           : events.h
+  * @brief          : Upstream event queue header file
+  *                   Critical CCNET poll responses that must reach the
+  *                   controller
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __EVENTS_H
+#define __EVENTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define EVENTS_QUEUE_SLOTS      8       /* Power of 2 */
+#define EVENTS_MAX_DATA         2       /* Poll response payload bytes (bill type, reject reason) */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Event priority
+  * @note   Only used when the queue is full: a high priority event evicts the
+  *         oldest low priority event that has not been sent yet
+  */
+typedef enum {
+    EVENT_PRIORITY_LOW = 0,         /* Informative, e.g. REJECTING */
+    EVENT_PRIORITY_HIGH             /* Credit related, e.g. BILL STACKED, BILL RETURNED */
+} event_priority_t;
+
+/**
+  * @brief  Upstream event, sent as CCNET poll response
+  */
+typedef struct {
+    uint8_t opcode;                 /* CCNET status code */
+    uint8_t data[EVENTS_MAX_DATA];  /* Status data */
+    uint8_t data_length;
+    event_priority_t priority;
+} upstream_event_t;
+
+/**
+  * @brief  FIFO of upstream events
+  * @note   Main loop only. Events in [tail, head) are pending, the event at tail
+  *         is the one sent on POLL and stays queued until it is retired (ACK)
+  */
+typedef struct {
+    upstream_event_t slots[EVENTS_QUEUE_SLOTS];
+    uint8_t head;                   /* Free running count of queued events */
+    uint8_t tail;                   /* Free running count of retired or evicted events */
+    uint32_t queued;                /* Events queued */
+    uint32_t retired;               /* Events acknowledged by the controller */
+    uint32_t evicted;               /* Low priority events removed for a high priority event */
+    uint32_t dropped;               /* Events not queued because the queue was full */
+} event_queue_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void EVENTS_Init(event_queue_t* queue);
+uint8_t EVENTS_Push(event_queue_t* queue, uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                    event_priority_t priority);
+const upstream_event_t* EVENTS_Peek(const event_queue_t* queue);
+void EVENTS_Retire(event_queue_t* queue);
+uint8_t EVENTS_Pending(const event_queue_t* queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EVENTS_H */
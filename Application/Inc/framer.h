@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file           : framer.h
+  * @brief          : Sync/length frame extractor header file
+  *                   Fed byte by byte or in chunks
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FRAMER_H
+#define __FRAMER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define FRAMER_MAX_FRAME_LENGTH 256
+#define FRAME_RING_SLOTS        4       /* Power of 2. One slot is always being filled */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Framer receive state enumeration
+  */
+typedef enum {
+    FRAMER_STATE_WAIT_SYNC1,
+    FRAMER_STATE_WAIT_SYNC2,
+    FRAMER_STATE_WAIT_LENGTH,
+    FRAMER_STATE_WAIT_DATA
+} framer_state_t;
+
+/**
+  * @brief  Frame check (CRC) function
+  * @note   Called from interrupt context with the complete frame, returns 1 if valid
+  */
+typedef uint8_t (*framer_check_t)(const uint8_t* frame, uint16_t length);
+
+/**
+  * @brief  Received frame slot
+  */
+typedef struct {
+    uint8_t data[FRAMER_MAX_FRAME_LENGTH];
+    uint16_t length;
+} frame_slot_t;
+
+/**
+  * @brief  Ring of received frame slots
+  * @note   Single producer (framer, ISR) and single consumer (main loop).
+  *         head is only written by the producer, tail only by the consumer.
+  *         Frames in [tail, head) are complete; slot head is being filled.
+  */
+typedef struct {
+    frame_slot_t slots[FRAME_RING_SLOTS];
+    volatile uint8_t head;          /* Free running count of committed frames */
+    volatile uint8_t tail;          /* Free running count of released frames */
+    volatile uint32_t frames;       /* Frames committed */
+    volatile uint32_t overruns;     /* Frames dropped because all slots were in use */
+    uint8_t high_water;             /* Maximum number of pending frames seen */
+} frame_ring_t;
+
+/**
+  * @brief  Framer structure
+  */
+typedef struct {
+    uint8_t sync_length;            /* Number of sync bytes (1 or 2) */
+    uint8_t sync_bytes[2];          /* Sync bytes */
+    int8_t length_offset;           /* Length offset (5 for cctalk (positive nr)) */
+    framer_state_t state;
+    uint16_t index;
+    uint16_t length;                /* Expected frame length incl. sync and CRC */
+    frame_ring_t* ring;             /* Frames are assembled in place in the ring */
+    framer_check_t check;           /* Optional CRC check, enables resync on a bad frame */
+    uint8_t resync[FRAMER_MAX_FRAME_LENGTH]; /* Bytes of a rejected frame that are scanned again */
+    uint32_t sync_drops;            /* Bytes discarded while searching for the sync bytes */
+    uint32_t length_errors;         /* Frames dropped on an invalid length byte */
+    uint32_t check_errors;          /* Complete frames rejected by the check function */
+    uint32_t resyncs;               /* Rejected frames whose bytes were scanned again */
+} framer_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void FRAMER_Init(framer_t* framer, uint8_t sync_length, uint8_t sync_byte1, uint8_t sync_byte2,
+                 int8_t length_offset, frame_ring_t* ring);
+void FRAMER_SetCheck(framer_t* framer, framer_check_t check);
+void FRAMER_Reset(framer_t* framer);
+uint8_t FRAMER_PushByte(framer_t* framer, uint8_t byte);
+uint16_t FRAMER_Feed(framer_t* framer, const uint8_t* data, uint16_t length);
+uint8_t FRAMER_Flush(framer_t* framer);
+uint8_t FRAMER_IsIdle(const framer_t* framer);
+
+void FRAME_RING_Init(frame_ring_t* ring);
+const frame_slot_t* FRAME_RING_Borrow(frame_ring_t* ring);
+void FRAME_RING_Release(frame_ring_t* ring);
+uint8_t FRAME_RING_Pending(const frame_ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FRAMER_H */
@@ -0,0 +1,58 @@
+/**
+  ******************************************************************************
+  * @file           : latency.h
+  * @brief          : Latency histogram header file
+  *                   Response latency distribution with percentiles and
+  *                   budget violations
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __LATENCY_H
+#define __LATENCY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define LATENCY_FINE_BUCKETS    32      /* 0 - 3.2 ms */
+#define LATENCY_FINE_US         100
+#define LATENCY_COARSE_BUCKETS  16      /* 3.2 - 19.2 ms, the last bucket also holds longer latencies */
+#define LATENCY_COARSE_US       1000
+#define LATENCY_BUCKETS         (LATENCY_FINE_BUCKETS + LATENCY_COARSE_BUCKETS)
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Latency histogram
+  * @note   Written from interrupt context, read and cleared from the main loop
+  *         (diagnostics only, no locking)
+  */
+typedef struct {
+    uint32_t count;                     /* Latencies recorded */
+    uint32_t min_us;                    /* Shortest, UINT32_MAX if none */
+    uint32_t max_us;                    /* Longest */
+    uint32_t violations;                /* Latencies above the budget */
+    uint32_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void LATENCY_Reset(latency_histogram_t* histogram);
+void LATENCY_Record(latency_histogram_t* histogram, uint32_t latency_us, uint32_t budget_us);
+uint32_t LATENCY_Percentile(const latency_histogram_t* histogram, uint8_t percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LATENCY_H */
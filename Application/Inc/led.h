@@ -67,6 +67,8 @@ extern TIM_HandleTypeDef htim17;
 
 /* Exported functions prototypes ---------------------------------------------*/
 void LED_Init(void);
+void LED_StartSelfTest(void);
+void LED_Process(void);
 void LED_On(LED_HandleTypeDef* hled);
 void LED_Off(LED_HandleTypeDef* hled);
 void LED_Flash(LED_HandleTypeDef* hled, uint16_t time_ms);
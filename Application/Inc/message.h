@@ -64,6 +64,7 @@ typedef struct message_t {
 } message_t;
 
 /* Exported constants --------------------------------------------------------*/
+#define MESSAGE_CCTALK_PEERS_MAX    4   /* ccTalk peripherals on one bus */
 
 /* Exported macro ------------------------------------------------------------*/
 
@@ -72,6 +73,9 @@ typedef struct message_t {
 /* Exported functions prototypes ---------------------------------------------*/
 void MESSAGE_Init(message_t* msg, proto_name_t protocol, message_direction_t direction);
 message_t MESSAGE_Create(proto_name_t protocol, message_direction_t direction, uint8_t opcode, uint8_t* data, uint8_t data_length);
+uint8_t MESSAGE_BuildFrame(proto_name_t protocol, message_direction_t direction, uint8_t opcode,
+                           const uint8_t* data, uint8_t data_length, uint8_t* raw);
+void MESSAGE_SetCctalkPeers(const uint8_t* addresses, uint8_t count);
 message_parse_result_t MESSAGE_Parse(message_t* msg);
 const char* MESSAGE_GetOpcodeASCII(const message_t* msg);
 message_parse_result_t MESSAGE_ValidateOpcode(message_t* msg);
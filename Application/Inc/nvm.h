@@ -43,14 +43,16 @@ typedef enum
 
 /* Exported constants --------------------------------------------------------*/
 
-/* Flash configuration storage addresses */
+/* Flash configuration storage addresses, kept out of the code by the NVM region of the linker script */
 #define FLASH_CONFIG_BANK1     0x0801F000U  /* Page 126 */
 #define FLASH_CONFIG_BANK2     0x0801F800U  /* Page 127 */
+#define FLASH_SNAPSHOT_PAGE    0x0801E800U  /* Page 125: downstream warm-start snapshot */
 #define NVM_PAGE_SIZE          2048         /* Flash page size in bytes */
 
 /* Configuration storage structure */
 #define CONFIG_MAGIC_NUMBER    0x12345678   /* Magic number for validation */
 #define CONFIG_VERSION         1            /* Configuration version */
+#define SNAPSHOT_MAGIC_NUMBER  0x534E4150   /* "SNAP": warm-start snapshot */
 
 /* Exported macro ------------------------------------------------------------*/
 
@@ -63,6 +65,8 @@ nvm_result_t NVM_Init(void);
 nvm_result_t NVM_ReadConfigData(uint8_t* data, uint32_t max_size, uint32_t* actual_size);
 nvm_result_t NVM_WriteConfigData(const uint8_t* data, uint32_t data_size);
 uint32_t NVM_GetCurrentSequenceNumber(void);
+nvm_result_t NVM_ReadSnapshot(uint8_t* data, uint32_t max_size, uint32_t* actual_size);
+nvm_result_t NVM_WriteSnapshot(const uint8_t* data, uint32_t data_size);
 
 /* Note: Generic flash functions (EraseFlashPage, WriteFlash, ReadFlash, EraseConfig) 
  *       are internal implementation details and not part of the public API */
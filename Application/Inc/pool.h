@@ -0,0 +1,96 @@
+/**
+  ******************************************************************************
+  * @file           : pool.h
+  * @brief          : Downstream acceptor pool header file
+  *                   Up to two downstream validators behind one CCNET bill
+  *                   validator: merged bill types, enable routing, escrow
+  *                   arbitration and the status answered upstream. HAL
+  *                   independent
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __POOL_H
+#define __POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define POOL_MAX_DEVICES        2       /* Downstream validators */
+#define POOL_BILL_TYPES         24      /* CCNET bill types */
+#define POOL_DEVICE_ROWS        16      /* Bill table rows per downstream validator */
+#define POOL_NO_BILL            0xFF    /* Device does not accept the bill type, or unknown bill */
+#define POOL_NO_DEVICE          0xFF    /* No device holds a bill in escrow */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Device state class, ordered: a higher state is answered upstream first
+  */
+typedef enum {
+    POOL_STATE_UNKNOWN = 0,         /* No recent status */
+    POOL_STATE_FAILURE,             /* Jam, stacker full or open, failure */
+    POOL_STATE_POWER_UP,            /* Power up, initializing */
+    POOL_STATE_DISABLED,            /* Inhibited by the controller */
+    POOL_STATE_IDLE,                /* Waiting for a bill */
+    POOL_STATE_BUSY                 /* Accepting, rejecting or returning a bill */
+} pool_state_t;
+
+/**
+  * @brief  CCNET bill type with the bill table row that accepts it per device
+  */
+typedef struct {
+    uint16_t value;                             /* Denomination value in currency units */
+    uint8_t device_row[POOL_MAX_DEVICES];       /* POOL_NO_BILL if the device does not accept it */
+} pool_bill_type_t;
+
+/**
+  * @brief  Acceptor pool
+  * @note   Main loop only. Denominations are set per device, POOL_Merge maps
+  *         them to CCNET bill types: device 0 in its own order, then the values
+  *         device 1 adds. The same value on both devices is one bill type.
+  *         A bill in escrow waits until the bills that reached escrow before
+  *         it on the other device are stacked or returned
+  */
+typedef struct {
+    uint8_t devices;                /* Devices in the pool, 1 or 2 */
+    uint16_t values[POOL_MAX_DEVICES][POOL_DEVICE_ROWS];    /* Value per bill table row, 0 = unused */
+    pool_bill_type_t bill_types[POOL_BILL_TYPES];
+    uint8_t count;                  /* CCNET bill types in use */
+    uint8_t states[POOL_MAX_DEVICES];           /* pool_state_t per device */
+    uint8_t escrow_bill[POOL_MAX_DEVICES];      /* Bill type in escrow per device, POOL_NO_BILL if none */
+    uint32_t escrow_order[POOL_MAX_DEVICES];    /* Arrival of the bill in escrow */
+    uint32_t escrow_arrivals;       /* Bills offered, the order of the next one */
+    uint8_t escrow_owner;           /* Device whose bill the controller handles, POOL_NO_DEVICE if none */
+    uint32_t escrow_waits;          /* Bills that waited for the other device */
+    uint32_t dropped;               /* Denominations not merged: all bill types in use */
+} pool_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void POOL_Init(pool_t* pool, uint8_t devices);
+void POOL_SetDevice(pool_t* pool, uint8_t device, const uint16_t* values, uint8_t count);
+void POOL_Merge(pool_t* pool);
+uint8_t POOL_ToBillType(const pool_t* pool, uint8_t device, uint8_t row);
+uint32_t POOL_RouteEnable(const pool_t* pool, uint8_t device, uint32_t bill_types);
+uint32_t POOL_MergeEnable(const pool_t* pool, uint8_t device, uint32_t rows);
+uint8_t POOL_OfferEscrow(pool_t* pool, uint8_t device, uint8_t bill_type);
+void POOL_ReleaseEscrow(pool_t* pool, uint8_t device);
+void POOL_SetState(pool_t* pool, uint8_t device, pool_state_t state);
+uint8_t POOL_Select(const pool_t* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POOL_H */
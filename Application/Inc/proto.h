@@ -107,6 +107,7 @@ typedef struct message_t message_t;
 #define CCTALK_MODIFY_INHIBIT_STATUS          231
 #define CCTALK_REQUEST_BILL_ID                157
 #define CCTALK_READ_BUFFERED_BILL_EVENTS      159
+#define CCTALK_READ_BUFFERED_CREDIT           229
 #define CCTALK_ROUTE_BILL                      154
 
 //###########################################################################################
@@ -157,6 +158,7 @@ typedef struct message_t message_t;
 #define CCNET_STATUS_ESCROW_POSITION               0x80
 #define CCNET_STATUS_BILL_STACKED                  0x81
 #define CCNET_STATUS_BILL_RETURNED                 0x82
+#define CCNET_STATUS_ILLEGAL_COMMAND               0x30 // response to unsupported or not allowed commands
 
 
 /* CCNET Reject Reasons (when status = 0x1C) */
@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file           : sched.h
+  * @brief          : Main loop scheduler header file
+  *                   Cooperative tasks in priority order, woken early by
+  *                   interrupt notifications, each on its own stack
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SCHED_MAX_TASKS         4
+#define SCHED_STACK_PAINT       0xA5A5A5A5UL    /* Unused stack pattern */
+#define SCHED_STACK_MARGIN      64              /* Bytes below the SP left unpainted at init */
+#define SCHED_SCAN_PERIOD_MS    100             /* Stack high-water scan interval */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Task function, runs to completion and must not block
+  */
+typedef void (*sched_task_fn_t)(void);
+
+/**
+  * @brief  Task table entry, index 0 has the highest priority
+  * @note   The stack must be 8 byte aligned, its size a multiple of 8 bytes.
+  *         Interrupts do not use it, they run on the main stack (MSP)
+  */
+typedef struct {
+    const char* name;
+    sched_task_fn_t run;
+    uint32_t* stack;            /* Lowest word of the task stack */
+    uint32_t stack_size;        /* Bytes */
+} sched_task_t;
+
+/**
+  * @brief  Task statistics
+  */
+typedef struct {
+    uint32_t runs;              /* Runs in task order */
+    uint32_t preemptions;       /* Extra runs on a notification, between lower priority tasks */
+    uint32_t notifications;     /* Notifications from interrupt handlers */
+    uint32_t time_max_ms;       /* Longest run (HAL tick) */
+    uint32_t cycles_max;        /* Longest run in DWT cycles (UART_PROFILE_CYCLES) */
+    uint32_t stack_max;         /* Deepest use of the task stack (bytes) */
+    uint32_t stack_size;        /* Task stack size (bytes) */
+} sched_task_stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void SCHED_Init(const sched_task_t* tasks, uint8_t count);
+void SCHED_Run(void);
+void SCHED_Notify(uint8_t task);
+uint8_t SCHED_GetTaskStats(uint8_t task, const char** name, sched_task_stats_t* stats);
+void SCHED_ResetStats(void);
+uint32_t SCHED_GetStackHighWater(void);
+uint32_t SCHED_GetStackSize(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCHED_H */
@@ -0,0 +1,115 @@
+/**
+  ******************************************************************************
+  * @file           : transaction.h
+  * @brief          : Downstream transaction engine header file
+  *                   Non-blocking request/response exchanges with a
+  *                   downstream validator, one on the line at a time.
+  *                   One engine per downstream link
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __TRANSACTION_H
+#define __TRANSACTION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "app.h"
+#include "message.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TRANSACTION_QUEUE_SLOTS     4       /* Power of 2. Requests waiting for the line, incl. the active one */
+#define TRANSACTION_MAX_DATA        8       /* Request payload bytes */
+#define TRANSACTION_ANY_OPCODE      0x00    /* Any response completes the request. Not a valid ID003 opcode */
+#define TRANSACTION_ANY_LENGTH      0xFF    /* Any response data length (payload is at most 250 bytes) */
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+  * @brief  Transaction completion result
+  */
+typedef enum {
+    TRANSACTION_OK = 0,         /* Expected response received */
+    TRANSACTION_TIMEOUT,        /* No matching response before the deadline */
+    TRANSACTION_ERROR           /* Response received with CRC or data error */
+} transaction_result_t;
+
+/**
+  * @brief  State of the active (oldest) request
+  */
+typedef enum {
+    TRANSACTION_STATE_IDLE = 0,     /* Nothing on the line */
+    TRANSACTION_STATE_SENDING,      /* Request queued for DMA transmission */
+    TRANSACTION_STATE_WAITING       /* Request sent, deadline running */
+} transaction_state_t;
+
+/**
+  * @brief  Completion callback
+  * @note   Called from the main loop. response is the parsed downstream message
+  *         for TRANSACTION_OK and TRANSACTION_ERROR, NULL on a timeout.
+  *         May submit the next request of a sequence.
+  */
+typedef void (*transaction_callback_t)(transaction_result_t result, const message_t* response);
+
+/**
+  * @brief  Request transmit function, queues the request on the downstream interface
+  */
+typedef void (*transaction_send_t)(uint8_t opcode, uint8_t* data, uint8_t data_length);
+
+/**
+  * @brief  Request with its expected response
+  */
+typedef struct {
+    uint8_t opcode;                 /* Request opcode */
+    uint8_t data[TRANSACTION_MAX_DATA]; /* Request payload, copied on submit */
+    uint8_t data_length;            /* Request payload length */
+    uint8_t expected_opcode;        /* Response opcode or TRANSACTION_ANY_OPCODE */
+    uint8_t expected_length;        /* Response data length or TRANSACTION_ANY_LENGTH */
+    uint16_t timeout_ms;            /* Deadline, counted from the end of transmission */
+    transaction_callback_t callback; /* NULL: no completion, the line is still held until done */
+} transaction_t;
+
+/**
+  * @brief  Transaction engine of one downstream link
+  * @note   Main loop only
+  */
+typedef struct {
+    interface_config_t* interface;  /* Downstream interface the requests go out on */
+    transaction_send_t send;        /* Queues a request on the interface */
+    transaction_t queue[TRANSACTION_QUEUE_SLOTS];
+    uint8_t head;                   /* Free running count of submitted requests */
+    uint8_t tail;                   /* Free running count of completed requests */
+    transaction_state_t state;
+    uint32_t start_tick;            /* Start of the response deadline */
+    uint8_t hold;                   /* Line in use by another sender, queued requests wait */
+} transaction_engine_t;
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+void TRANSACTION_Init(transaction_engine_t* engine, interface_config_t* interface, transaction_send_t send);
+uint8_t TRANSACTION_Submit(transaction_engine_t* engine, uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                           uint8_t expected_opcode, uint8_t expected_length,
+                           uint16_t timeout_ms, transaction_callback_t callback);
+void TRANSACTION_Process(transaction_engine_t* engine);
+uint8_t TRANSACTION_HandleResponse(transaction_engine_t* engine, const message_t* response, message_parse_result_t result);
+uint8_t TRANSACTION_IsIdle(const transaction_engine_t* engine);
+void TRANSACTION_SetHold(transaction_engine_t* engine, uint8_t held);
+void TRANSACTION_Abort(transaction_engine_t* engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRANSACTION_H */
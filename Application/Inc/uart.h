@@ -22,22 +22,149 @@ extern "C" {
 #include "main.h"
 #include "app.h"
 #include "message.h"
+#include "framer.h"
 
 /* Exported types ------------------------------------------------------------*/
 
+/**
+  * @brief  Interrupt sources of an interface, for the cycle counters
+  */
+typedef enum {
+    UART_IRQ_USART = 0,     /* USART global interrupt (idle, errors, TC, RTO) */
+    UART_IRQ_DMA_RX,        /* Receive DMA channel (half/full transfer) */
+    UART_IRQ_DMA_TX,        /* Transmit DMA channel */
+    UART_IRQ_SOURCES
+} uart_irq_source_t;
+
+/**
+  * @brief  Interrupt handler cycle counters (UART_PROFILE_CYCLES)
+  */
+typedef struct {
+    uint32_t calls;         /* Interrupts handled */
+    uint32_t cycles_total;  /* Sum of DWT cycles spent in the handler */
+    uint32_t cycles_max;    /* Longest handler run */
+} uart_cycle_stats_t;
+
+/**
+  * @brief  UART receive mode enumeration
+  */
+typedef enum {
+    UART_RX_MODE_IT = 0,    /* One interrupt per received byte (fallback) */
+    UART_RX_MODE_DMA        /* Circular DMA, frames handed over on idle line */
+} uart_rx_mode_t;
+
+/**
+  * @brief  Own echo handling on a single wire bus (ccTalk)
+  */
+typedef enum {
+    UART_ECHO_MODE_COUNT = 0,       /* Echo received on RX, skipped by counting the bytes */
+    UART_ECHO_MODE_HALF_DUPLEX,     /* USART HDSEL single wire, receiver gated during TX: no echo */
+    UART_ECHO_MODE_VERIFY           /* Echo received on RX and compared with the TX bytes */
+} uart_echo_mode_t;
+
+/**
+  * @brief  UART transmit queue statistics
+  */
+typedef struct {
+    uint32_t frames_queued;     /* Frames accepted by UART_TransmitFrame */
+    uint32_t frames_sent;       /* DMA transfers completed */
+    uint32_t frames_dropped;    /* Queue full or DMA could not be started */
+    uint32_t queue_full;        /* UART_TransmitFrame found all descriptors in use (frame dropped) */
+    uint32_t errors;            /* HAL_UART_Transmit_DMA failures */
+    uint8_t max_depth;          /* Highest number of queued descriptors seen */
+    uint8_t depth;              /* Currently queued descriptors */
+} uart_tx_stats_t;
+
+/**
+  * @brief  UART link statistics
+  * @note   Receive side counters plus the frame checks done by the application.
+  *         Separates a noisy line (parity/framing/noise, CRC) from a firmware
+  *         problem (ring overruns, restarts)
+  */
+typedef struct {
+    uint32_t bytes_in;          /* Bytes received, including ccTalk echo */
+    uint32_t bytes_out;         /* Bytes transmitted */
+    uint32_t frames_ok;         /* Frames parsed without error */
+    uint32_t crc_errors;        /* Frames with invalid CRC (framer check and parser) */
+    uint32_t length_errors;     /* Invalid length byte (framer) or length mismatch (parser) */
+    uint32_t parse_errors;      /* Unknown opcode, missing data, invalid header */
+    uint32_t sync_drops;        /* Bytes discarded while searching for sync */
+    uint32_t resyncs;           /* Bad frames rescanned for a real header */
+    uint32_t rx_timeouts;       /* Partial frames dropped on receiver timeout */
+    uint32_t ring_overruns;     /* Frames dropped because the receive ring was full */
+    uint32_t parity_errors;     /* USART PE */
+    uint32_t framing_errors;    /* USART FE */
+    uint32_t noise_errors;      /* USART NE */
+    uint32_t overrun_errors;    /* USART ORE */
+    uint32_t dma_errors;        /* DMA transfer errors */
+    uint32_t restarts;          /* Reception restarted after an error */
+    uint32_t echo_collisions;   /* ccTalk verified echo mismatches */
+} uart_link_stats_t;
+
 /* Exported constants --------------------------------------------------------*/
 
+/* Driver backend, selected at build time (-DUART_BACKEND=1 for LL) */
+#define UART_BACKEND_HAL    0       /* HAL_UART_xxx calls and HAL interrupt handlers */
+#define UART_BACKEND_LL     1       /* Direct USART/DMA register access, DMA reception only */
+#ifndef UART_BACKEND
+#define UART_BACKEND        UART_BACKEND_HAL
+#endif
+
+/* Count DWT cycles spent in the USART and DMA interrupt handlers (-DUART_PROFILE_CYCLES=1) */
+#ifndef UART_PROFILE_CYCLES
+#define UART_PROFILE_CYCLES 0
+#endif
+
+#define UART_RX_MODE_DEFAULT        UART_RX_MODE_DMA
+#define UART_DMA_RX_BUFFER_SIZE     128     /* Circular buffer, half transfer event at 64 bytes */
+
+#define UART_CCTALK_ECHO_MODE_DEFAULT   UART_ECHO_MODE_COUNT
+#define UART_ECHO_BUFFER_SIZE           256     /* Verified echo ring, indexed with uint8_t */
+#define UART_ECHO_MAX_PENDING           255     /* Echo bytes still expected, limit of cctalk_echo_byte_count */
+#define UART_TX_QUEUE_SLOTS             4       /* Power of 2. DMA transmit descriptors per interface */
+
+/* Receiver timeout (frame abort and resync) in character times x2 */
+#define UART_RX_TIMEOUT_CCNET_CHARS_X2   7  /* 3.5 characters */
+#define UART_RX_TIMEOUT_ID003_CHARS_X2   7  /* 3.5 characters */
+#define UART_RX_TIMEOUT_CCTALK_CHARS_X2  7  /* 3.5 characters */
+
 /* Exported macro ------------------------------------------------------------*/
+#if UART_PROFILE_CYCLES
+#define UART_CYCLES_START()                     (DWT->CYCCNT)
+#define UART_CYCLES_RECORD(huart, source, start) UART_RecordCycles(huart, source, start)
+#else
+#define UART_CYCLES_START()                     (0U)
+#define UART_CYCLES_RECORD(huart, source, start) ((void)(start))
+#endif
 
 /* Exported variables --------------------------------------------------------*/
 extern uint8_t downstream_rx_flag;
 
 /* Exported functions prototypes ---------------------------------------------*/
 void UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void UART_RxEventCallback(UART_HandleTypeDef *huart, uint16_t pos);
+void UART_ReceiverTimeoutHandler(UART_HandleTypeDef *huart);
+void UART_ErrorCallback(UART_HandleTypeDef *huart);
+void UART_FrameReceivedCallback(interface_config_t* interface);
+void UART_ResponseStartedCallback(interface_config_t* interface, uint32_t latency_us);
 uint8_t UART_CheckForUpstreamData(void);
-uint8_t UART_CheckForDownstreamData(void);
+uint8_t UART_CheckForDownstreamData(interface_config_t* interface);
 void UART_Init(interface_config_t* interface, message_t* message);
-void UART_TransmitMessage(interface_config_t* interface, message_t* message, uint8_t use_dma, uint8_t* dma_buffer);
+void UART_SetRxMode(interface_config_t* interface, uart_rx_mode_t mode);
+void UART_SetEchoMode(interface_config_t* interface, uart_echo_mode_t mode);
+uint8_t UART_CheckEchoCollision(interface_config_t* interface);
+uint32_t UART_GetEchoCollisions(interface_config_t* interface);
+uint32_t UART_GetRxOverruns(interface_config_t* interface);
+void UART_TxCpltCallback(UART_HandleTypeDef *huart);
+uint8_t UART_TransmitMessage(interface_config_t* interface, message_t* message);
+uint8_t UART_TransmitFrame(interface_config_t* interface, const uint8_t* frame, uint8_t length);
+uint8_t UART_IsTxBusy(interface_config_t* interface);
+void UART_GetTxStats(interface_config_t* interface, uart_tx_stats_t* stats);
+void UART_GetLinkStats(interface_config_t* interface, uart_link_stats_t* stats);
+void UART_ResetStats(interface_config_t* interface);
+void UART_CountParseResult(interface_config_t* interface, message_parse_result_t result);
+void UART_RecordCycles(UART_HandleTypeDef *huart, uart_irq_source_t source, uint32_t start);
+void UART_GetCycleStats(interface_config_t* interface, uart_cycle_stats_t stats[UART_IRQ_SOURCES]);
 
 #ifdef __cplusplus
 }
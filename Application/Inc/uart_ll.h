@@ -0,0 +1,47 @@
+/**
+  ******************************************************************************
+  * @file           : uart_ll.h
+  * @brief          : Register level UART/DMA backend header file
+  *                   Replaces the HAL calls on the receive and transmit hot
+  *                   paths when UART_BACKEND is UART_BACKEND_LL
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __UART_LL_H
+#define __UART_LL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+HAL_StatusTypeDef UART_LL_StartReception(UART_HandleTypeDef *huart, uint8_t *buffer, uint16_t size);
+HAL_StatusTypeDef UART_LL_AbortReception(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef UART_LL_Abort(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef UART_LL_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t length);
+void UART_LL_IRQHandler(UART_HandleTypeDef *huart);
+void UART_LL_DmaRxIRQHandler(UART_HandleTypeDef *huart);
+void UART_LL_DmaTxIRQHandler(UART_HandleTypeDef *huart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UART_LL_H */
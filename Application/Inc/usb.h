@@ -40,6 +40,7 @@ uint8_t USB_GetInputLine(char* buffer, uint8_t max_length);
 void USB_ProcessStatusMessage(void);
 void USB_Tx(uint8_t* buffer, uint16_t length);
 void USB_Flush(void);
+uint8_t USB_IsConfigured(void);
 void USB_CDCTransmitCpltHandler(void);
 
 #ifdef __cplusplus
@@ -20,6 +20,16 @@
 #include "stm32g4xx_hal.h"
 #include "uart.h"
 #include "usb.h"
+#include "console.h"
+#include "discovery.h"
+#include "transaction.h"
+#include "events.h"
+#include "cadence.h"
+#include "dispatch.h"
+#include "sched.h"
+#include "latency.h"
+#include "ccbus.h"
+#include "pool.h"
 #include "log.h"
 #include "config.h"
 #include "config-ui.h"
@@ -29,31 +39,115 @@
 #include "message.h"
 #include "utils.h"
 #include "../Tests/tests.h"
+#include <string.h> /* For memcmp */
 
 
 
 /* Message sending macros ----------------------------------------------------*/
-#define REQUEST(opcode, data, data_length) APP_SendMessage(&if_downstream, opcode, data, data_length, 0)
-#define REQUEST_DMA(opcode, data, data_length) APP_SendMessage(&if_downstream, opcode, data, data_length, 1)
-#define RESPOND(opcode, data, data_length) APP_SendMessage(&if_upstream, opcode, data, data_length, 0)
-#define CREATE_RESP(msg) MESSAGE_Create(PROTO_CCNET, MSG_DIR_TX, msg.opcode, msg.data, msg.data_length);
-#define WAIT_FOR_DS_MSG(timeout, expected_opcode, expected_length) \
-    (APP_WaitForDownstreamMessage(timeout) && \
-     downstream_msg.opcode == (expected_opcode) && \
-     downstream_msg.data_length == (expected_length))
+#define REQUEST(opcode, data, data_length, expected_opcode, expected_length, timeout, callback) \
+    APP_Request(opcode, data, data_length, expected_opcode, expected_length, timeout, callback)
+#define SECOND_REQUEST(opcode, data, data_length, expected_opcode, expected_length, timeout, callback) \
+    TRANSACTION_Submit(&second_transactions, opcode, data, data_length, expected_opcode, expected_length, timeout, callback)
+#define RESPOND(opcode, data, data_length) APP_Respond(opcode, data, data_length)
 
 /* Private defines -----------------------------------------------------------*/
-#define DOWNSTREAM_MSG_TTL_MS 1500  /* Downstream message time to live. Keep larger than asynchronous polling period */
+#define DOWNSTREAM_MSG_TTL_MS 1500  /* Downstream status time to live. Keep larger than the (slow) asynchronous polling period */
+#define DISCOVERY_AFTER_FAILED_POLLS 3  /* Unanswered first polls (ccTalk: polls per device) before auto-discovery runs (once per boot) */
+#define DS_RESPONSE_TIMEOUT_MS 20       /* Status and setting responses */
+#define DS_SERIAL_TIMEOUT_MS 40         /* Serial number response */
+#define DS_VERSION_TIMEOUT_MS (10+50)   /* Version response: up to ~45 ASCII characters */
+#define DS_RESET_TIMEOUT_MS 100         /* Reset acknowledge */
+#define DS_FIRST_POLL_TIMEOUT_MS 200    /* First poll at startup */
+#define DS_BILL_TABLE_TIMEOUT_MS (10+42) /* Currency assignment response is 42ms long */
+#define DS_BILL_TABLE_DELAY_MS 5        /* Gap between the first poll response and the bill table request */
+#define DS_BILL_TABLE_RETRY_MS 1000     /* Bill table request retry after a failure */
+#define DS_SETTINGS_MISSING_MS 200      /* Background request interval while a cached setting is unknown */
+#define DS_SETTINGS_REFRESH_MS 2000     /* Background refresh interval per setting once all are known */
+#define DS_PHASE_GUARD_MS 2             /* Phase-locked polling: margin between the status response and the expected POLL */
+#define CCNET_DEADLINE_MS 10            /* Upstream response budget of commands answered locally */
+#define CCNET_RESPONSE_BUDGET_US 10000  /* CCNET: last request byte to first response byte */
+#define CCNET_REPLAY_WINDOW_MS 500      /* Repeated request or NAK answered from the response cache */
+#define CCNET_REQUEST_MAX_DATA 8        /* Request data kept to recognize a repeat (ENABLE BILL TYPES: 6) */
+#define CCTALK_RESPONSE_TIMEOUT_MS 50   /* ccTalk poll: request, echo and a 16 byte event response at 9600 baud */
+#define CCNET_FRAME_SLOTS 16            /* Power of 2. Prebuilt short responses: statuses, events, GET STATUS */
+#define CCNET_FRAME_MAX_DATA 6          /* Longest short response data (GET STATUS) */
+#define CCNET_FRAME_OVERHEAD 6          /* Sync, address, length, opcode and CRC bytes */
+#define CCNET_BILL_TABLE_DATA (24 * 5)  /* GET BILL TABLE: 24 rows of 5 bytes */
+#define CCNET_IDENTIFICATION_DATA 34    /* IDENTIFICATION: part number, serial number, asset number */
+#define CCNET_FRAME_MAX (CCNET_FRAME_OVERHEAD + CCNET_BILL_TABLE_DATA)
+#define SNAPSHOT_LAYOUT 1               /* Warm-start snapshot layout, bumped when ds_snapshot_t changes */
+#define SNAPSHOT_SERIAL_MAX 20          /* ID003 serial number, the snapshot key */
+#define SNAPSHOT_VERSION_MAX 48         /* ID003 software version */
+#define BOOT_TARGET_MS 100              /* Reset to first CCNET response */
+#define BOOT_USB_WAIT_MS 3000           /* Banner without a USB host after this long, it stays buffered */
+#define MCU_RESET_DELAY_MS 100          /* CCNET ACK and the log line go out before the reset */
+#define MCU_RESET_TIMEOUT_MS 200        /* Reset even if the upstream queue does not drain */
+#define UPSTREAM_STACK_SIZE 1024        /* Task stacks in bytes, multiple of 8. Use is shown by the "tasks" command */
+#define DOWNSTREAM_STACK_SIZE 1536      /* Downstream send path: message_t locals */
+#define SERVICE_STACK_SIZE 1536         /* Configuration menu, console output, CONFIG_SaveToNVM buffers */
+#define FLASH_WRITE_GUARD_MS 50         /* Page erase stalls the CPU: start it only this long before the next expected POLL */
+#define FLASH_WRITE_IDLE_MS 1000        /* No POLL for this long: the controller is not polling, write any time */
+#define FLASH_WRITE_DEFER_MAX_MS 10000  /* Write anyway if no window was found, the controller retries the POLL */
+#define DS_DEVICE 0                     /* Acceptor pool: the validator on if_downstream */
+#define SECOND_DEVICE 1                 /* Acceptor pool: the second validator on if_second */
+#define SECOND_RETRY_MS 1000            /* Second validator: first poll, bill table and power-up reset retry */
+#define SECOND_LOST_POLLS 3             /* Unanswered polls before the second validator is started again */
+
+/* Validator state classes for the CCNET ILLEGAL COMMAND rules, one bit each */
+#define CCNET_STATE_UNKNOWN     0x01    /* No recent status: commands are not restricted */
+#define CCNET_STATE_POWER_UP    0x02    /* Power up, initialize */
+#define CCNET_STATE_DISABLED    0x04    /* Unit disabled */
+#define CCNET_STATE_FAILURE     0x08    /* Failure states (41H-47H) */
+#define CCNET_STATE_ESCROW      0x10    /* Bill in escrow or held */
+#define CCNET_STATE_OPERATING   0x20    /* Idling, accepting, stacking, returning, rejecting */
+#define CCNET_STATES_SETUP      (CCNET_STATE_UNKNOWN | CCNET_STATE_POWER_UP | CCNET_STATE_DISABLED | CCNET_STATE_FAILURE)
+#define CCNET_STATES_ESCROW     (CCNET_STATE_UNKNOWN | CCNET_STATE_ESCROW)
 
 /* Private variables ---------------------------------------------------------*/
-static uint8_t dma_tx_buffer[256];
-static uint32_t last_downstream_msg_time = 0;
 
 /* LED instances */
 LED_HandleTypeDef hled1 = {LD1_GPIO_Port, LD1_Pin, LED_STATE_UNKNOWN};
 LED_HandleTypeDef hled2 = {LD2_GPIO_Port, LD2_Pin, LED_STATE_UNKNOWN};
 LED_HandleTypeDef hled3 = {LD3_GPIO_Port, LD3_Pin, LED_STATE_UNKNOWN};
 
+/**
+  * @brief  Downstream warm-start snapshot, stored in flash
+  * @note   Restored at boot, so GET BILL TABLE and IDENTIFICATION are answered
+  *         before the validator was asked. The startup sequence still fetches
+  *         the bill table, then reads the serial number and version: the
+  *         snapshot is rewritten only if the validator or its data changed.
+  *         Settings only hold the fields flagged in settings_valid
+  */
+typedef struct {
+    uint8_t layout;                 /* SNAPSHOT_LAYOUT */
+    uint8_t serial_length;
+    uint8_t version_length;
+    uint8_t count;                  /* Bill table denominations */
+    uint8_t serial[SNAPSHOT_SERIAL_MAX];    /* ID003 serial number (ASCII) */
+    uint8_t version[SNAPSHOT_VERSION_MAX];  /* ID003 software version (ASCII) */
+    char currency[4];
+    uint8_t settings_valid;         /* DS_SETTING_xxx flags of the last-known settings */
+    uint8_t inhibit;
+    uint8_t enable[2];
+    uint8_t security[2];
+    uint8_t comm_mode;
+    uint8_t direction;
+    bill_denom_t denoms[MAX_BILL_DENOMS];
+    uint32_t ds_enabled_bills;
+    uint32_t ds_escrowed_bills;
+} ds_snapshot_t;
+
+/**
+  * @brief  Background boot stages, run by the service task once CCNET is answered
+  */
+typedef enum {
+    BOOT_STAGE_INIT = 0,            /* APP_Init running */
+    BOOT_STAGE_USB,                 /* Waiting for USB enumeration, output is buffered */
+    BOOT_STAGE_BANNER,              /* Configuration and startup messages */
+    BOOT_STAGE_TESTS,               /* Test suites enabled in tests.c */
+    BOOT_STAGE_DONE
+} boot_stage_t;
+
 /* Protocol state management */
 typedef enum {
     POLL_IDLE = 0,
@@ -66,6 +160,9 @@ typedef struct {
     uint32_t last_poll_time;
     message_t last_msg;
     uint8_t last_opcode;
+    uint8_t poll_now;           /* command sent: poll as soon as the line is free */
+    uint32_t phase_events;      /* cadence event count of the last phase-locked poll */
+    uint16_t rtt_ms;            /* status request to response, running average, 0 = not measured */
 } poller_t;
 
 typedef enum {
@@ -78,6 +175,12 @@ typedef enum {
     // DS_STARTUP_ERROR_NO_BILL_TABLE
 } startup_state_t;
 
+typedef enum {
+    BILL_TABLE_IDLE = 0,
+    BILL_TABLE_FETCHING,
+    BILL_TABLE_FAILED,
+} bill_table_fetch_t;
+
 typedef enum {
     DS_NOT_CONNECTED = 0,
     DS_CONNECTED,
@@ -88,7 +191,6 @@ typedef enum {
     ESCROW_IN_ESCROW,
     ESCROW_IN_STACK,
     ESCROW_STACKING,
-    ESCROW_STACKED,
 } escrow_state_t;
 
 typedef struct {
@@ -98,7 +200,19 @@ typedef struct {
     message_t last_req_msg; /* last request sent downstream to check for ID003 echo*/
     uint32_t last_req_time; /* last request sent time*/
     escrow_state_t escrow_state;
-    uint8_t escrow_bill_type_nr;  /* bill type in CCNET 0-23 format*/
+    uint8_t escrow_device;        /* validator the escrow state belongs to */
+    uint8_t event_sent;           /* last POLL was answered with the front upstream event */
+    uint32_t poll_rx_time;        /* reception of the CCNET POLL being answered */
+    uint8_t first_poll_failures;  /* unanswered first polls during startup */
+    uint8_t discovery_done;       /* auto-discovery already ran after failed first polls */
+    uint8_t discovery_requested;  /* auto-discovery requested from the USB console */
+    uint32_t startup_tick;        /* startup: time of the first poll response or bill table failure */
+    uint32_t startup_delay_ms;    /* startup: wait before the bill table request */
+    bill_table_fetch_t bill_table_fetch; /* bill table request sequence state */
+    uint8_t bill_table_respond;   /* respond upstream once the bill table request sequence is done */
+    uint8_t enable_request[6];    /* CCNET ENABLE BILL TYPES data while the ID003 sequence runs */
+    uint8_t enable_outstanding;   /* ENABLE BILL TYPES: validator sequences still running */
+    uint8_t enable_failed;        /* ENABLE BILL TYPES: a validator sequence failed */
 } downstream_context_t;
 
 downstream_context_t ds_context = {
@@ -112,9 +226,127 @@ downstream_context_t ds_context = {
 
 };
 
-/* Message structures for UART data reception */
-message_t upstream_msg;    /* CCNET messages from upstream */
-message_t downstream_msg;  /* ID003 messages from downstream */
+/**
+  * @brief  Downstream status mirror, one per validator
+  * @note   Fed only by ID003 status frames. Command echoes, ACKs and responses
+  *         to setting requests also pass through downstream_msg but never here,
+  *         so POLL always finds the last real status
+  */
+typedef struct {
+    message_t status;       /* Last status frame (opcode and data) */
+    uint32_t time;          /* Reception time of the last status frame */
+    uint32_t sequence;      /* Status frames received, 0 = none yet */
+    uint8_t changed;        /* Opcode or data differ from the previous status, cleared by POLL */
+    uint8_t bill_type;      /* CCNET bill type of the last escrow, POOL_NO_BILL if unknown */
+    uint8_t bill_credited;  /* BILL STACKED event queued for the bill in escrow */
+} status_mirror_t;
+
+static status_mirror_t status_mirror[POOL_MAX_DEVICES];
+
+/**
+  * @brief  Second validator link state
+  */
+typedef enum {
+    SECOND_OFF = 0,             /* Not configured, or the downstream is not ID003 */
+    SECOND_FIRST_POLL,          /* Status requests until the validator answers */
+    SECOND_BILL_TABLE,          /* Currency assignment request */
+    SECOND_RUNNING              /* Polled, enables follow the controller */
+} second_state_t;
+
+/**
+  * @brief  Second ID003 validator on UART3
+  * @note   Started by the converter, the controller only sees one bill
+  *         validator. Its denominations join the acceptor pool, the controller
+  *         ENABLE BILL TYPES mask is routed to it as well
+  */
+typedef struct {
+    second_state_t state;
+    uint32_t retry_tick;        /* first poll or bill table: last attempt */
+    uint32_t retry_delay_ms;    /* first poll or bill table: wait before the next attempt */
+    uint32_t last_poll_time;
+    uint8_t poll_now;           /* command sent or synchronous POLL: poll as soon as the line is free */
+    uint8_t failed_polls;       /* unanswered polls in a row */
+    uint32_t reset_tick;        /* last RESET after a power-up status */
+    uint8_t denoms[POOL_DEVICE_ROWS];   /* ID003 denomination code per bill table row */
+    uint8_t count;              /* bill table rows */
+    uint8_t enable_known;       /* the controller sent ENABLE BILL TYPES */
+    uint8_t enable_pending;     /* the controller mask is not applied yet */
+    uint8_t join_requested;     /* the ENABLE BILL TYPES response waits for the next sequence */
+    uint8_t enable_join;        /* the ENABLE BILL TYPES response waits for the sequence on the line */
+    uint8_t rows;               /* enabled bill table rows, as acknowledged */
+    uint8_t inhibit;            /* inhibit, as acknowledged */
+} second_context_t;
+
+static second_context_t second;
+
+/* Downstream requests, one on the line at a time per validator */
+static transaction_engine_t ds_transactions;
+static transaction_engine_t second_transactions;
+
+/* Validators behind the one CCNET bill validator: merged bill types, enables, escrow order */
+static pool_t bill_pool;
+
+/* Critical poll responses, retired by the controller ACK */
+static event_queue_t upstream_events;
+
+/* Warm-start snapshot as stored in flash (layout 0: none) and the validator identity */
+static ds_snapshot_t ds_snapshot;
+static uint8_t snapshot_write_pending = 0;  /* ds_snapshot changed, written in a flash window */
+static uint32_t flash_pending_tick = 0;     /* Oldest flash write waiting for a window */
+static uint8_t ds_serial[SNAPSHOT_SERIAL_MAX];
+static uint8_t ds_serial_length = 0;    /* 0 = serial number not known */
+static uint8_t ds_version[SNAPSHOT_VERSION_MAX];
+static uint8_t ds_version_length = 0;
+
+/* ccTalk peripherals on a multi-drop downstream bus. Address 0 (broadcast): the configured destination */
+static ccbus_t cctalk_bus;
+static const ccbus_device_config_t cctalk_devices[] = {
+    {"Bill",   0, CCTALK_READ_BUFFERED_BILL_EVENTS, 1,  200, CCTALK_RESPONSE_TIMEOUT_MS},
+    {"Coin",   2, CCTALK_READ_BUFFERED_CREDIT,      1,  200, CCTALK_RESPONSE_TIMEOUT_MS},
+    {"Hopper", 3, CCTALK_SIMPLE_POLL,               0, 1000, CCTALK_RESPONSE_TIMEOUT_MS},
+};
+
+/* Controller POLL cadence and the resulting POLL timing */
+static cadence_t upstream_cadence;
+static poll_timing_t poll_timing;
+
+/* Boot sequence and its timing since reset */
+static boot_stage_t boot_stage = BOOT_STAGE_INIT;
+static boot_timing_t boot_timing;
+static uint8_t boot_reported = 0;       /* First response time logged */
+
+/* CCNET RESET acknowledged: the MCU resets from the service task */
+static uint8_t mcu_reset_pending = 0;
+static uint32_t mcu_reset_tick = 0;
+
+/**
+  * @brief  Downstream setting: set command, request command and data length
+  */
+typedef struct {
+    uint8_t set_opcode;
+    uint8_t req_opcode;
+    uint8_t length;
+    uint8_t flag;       /* DS_SETTING_xxx */
+} ds_setting_t;
+
+static const ds_setting_t ds_settings[] = {
+    {ID003_INHIBIT,   ID003_INHIBIT_REQ,   1, DS_SETTING_INHIBIT},
+    {ID003_ENABLE,    ID003_ENABLE_REQ,    2, DS_SETTING_ENABLE},
+    {ID003_SECURITY,  ID003_SECURITY_REQ,  2, DS_SETTING_SECURITY},
+    {ID003_COMM_MODE, ID003_COMM_MODE_REQ, 1, DS_SETTING_COMM_MODE},
+    {ID003_DIRECTION, ID003_DIRECTION_REQ, 1, DS_SETTING_DIRECTION},
+};
+#define DS_SETTINGS_COUNT (sizeof(ds_settings) / sizeof(ds_settings[0]))
+
+/* ENABLE BILL TYPES error handling: NAK first, then let the controller time out */
+static uint8_t CCNET_ENABLE_BILL_TYPES_errors = 0;
+static uint32_t CCNET_ENABLE_BILL_TYPES_last_error_time_ms = 0;
+
+/* Received messages. The interrupts queue frames in the UART frame rings, each task
+   copies the oldest frame of its interface into its own message */
+static message_t upstream_msg;      /* Upstream task only: CCNET command being handled */
+static message_t downstream_msg;    /* Downstream task only: last downstream frame */
+static message_t second_msg;        /* Downstream task only: last frame of the second validator */
 
 /* Global bill table */
 bill_table_t g_bill_table = {
@@ -156,16 +388,240 @@ interface_config_t if_downstream = {
     .datalink.polling_period_ms = 100,       /* 100ms polling period */
 };
 
+/* Second ID003 interface on UART3: if_downstream settings, set up at boot if configured */
+interface_config_t if_second;
+
 /* Private function prototypes -----------------------------------------------*/
 message_parse_result_t APP_CheckForUpstreamMessage(void);
 message_parse_result_t APP_CheckForDownstreamMessage(void);
-static uint32_t APP_GetDownstreamMessageAge(void);
-static message_parse_result_t APP_WaitForDownstreamMessage(uint32_t timeout_ms);
-static void APP_DownstreamStartup(void);
+static uint32_t APP_GetStatusAge(uint8_t device);
+static void APP_UpdateStatusMirror(uint8_t device, const message_t* msg);
+static void APP_QueueEvents(uint8_t device, uint8_t previous_opcode);
+static void APP_PushEvent(uint8_t opcode, uint8_t* data, uint8_t data_length, event_priority_t priority);
+static void APP_BootDownstream(void);
 static void APP_DownstreamPolling(uint16_t polling_period_ms);
-static void APP_SendMessage(interface_config_t* interface, uint8_t opcode, uint8_t* data, uint8_t data_length, uint8_t use_dma);
-static void APP_GetBillTable(void);
+static void APP_StartCctalkBus(void);
+static void APP_BootMark(uint32_t* mark);
+static void APP_BootProcess(void);
+static void APP_CctalkBusPolling(void);
+static void APP_CctalkBusResponse(void);
+static void APP_StartSecondLink(void);
+static void APP_SecondLinkProcess(void);
+static void APP_CheckForSecondMessage(void);
+static void APP_SecondEnable(void);
+static void APP_SecondEnableFinished(uint8_t ok);
+static void APP_SecondLost(void);
+static pool_state_t APP_GetPoolState(uint8_t device);
+static uint8_t APP_SelectDevice(void);
+static uint8_t APP_GetEscrowBillType(uint8_t device, uint8_t denom_nr);
+static void APP_MergeBillTables(void);
+static uint32_t APP_RouteEnable(uint8_t device, uint32_t bill_types);
+static uint32_t APP_MergeEnable(uint8_t device, uint32_t rows);
+static uint16_t APP_DenomValue(uint8_t coefficient, uint8_t exponent);
+static uint16_t APP_GetPollingPeriod(uint8_t device);
+static uint8_t APP_GetPhaseSlot(uint32_t* slot);
+static uint16_t APP_GetPollLead(void);
+static void APP_RecordPollTiming(uint8_t device);
+static void APP_PollDone(transaction_result_t result, const message_t* response);
+static void APP_SendMessage(interface_config_t* interface, uint8_t opcode, uint8_t* data, uint8_t data_length);
+static void APP_Respond(uint8_t opcode, const uint8_t* data, uint8_t data_length);
+static void APP_SendFrame(uint8_t opcode, const uint8_t* raw, uint8_t length);
+static void APP_LogFrame(uint8_t opcode, const uint8_t* raw, uint8_t length);
+static void APP_SendRequest(uint8_t opcode, uint8_t* data, uint8_t data_length);
+static void APP_SendSecondRequest(uint8_t opcode, uint8_t* data, uint8_t data_length);
+static uint8_t APP_Request(uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                           uint8_t expected_opcode, uint8_t expected_length,
+                           uint16_t timeout_ms, transaction_callback_t callback);
+static uint8_t APP_DeviceRequest(uint8_t device, uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                                 uint8_t expected_opcode, uint8_t expected_length,
+                                 uint16_t timeout_ms, transaction_callback_t callback);
+static void APP_GetBillTable(uint8_t respond);
 static void APP_RespondBillTable(void);
+static void APP_RespondPoll(void);
+static void APP_RespondStatus(void);
+static void APP_RespondEnableStatus(uint8_t inhibit, uint8_t enable);
+static void APP_UpdateSettings(const message_t* msg);
+static void APP_RefreshSettings(void);
+static void APP_RespondIdentification(void);
+static void APP_SetSerial(const uint8_t* serial, uint8_t length);
+static void APP_LoadSnapshot(void);
+static void APP_RevalidateSnapshot(void);
+static void APP_SaveSnapshot(void);
+static void APP_WriteSnapshot(void);
+static void APP_FlashProcess(void);
+static uint8_t APP_IsFlashWindow(void);
+static void APP_EnableBillTypes(void);
+static void APP_GetEnableData(uint8_t device, uint8_t* enable_data);
+static void APP_EnableBillTypesDone(uint8_t ok);
+static void APP_BillTableDone(uint8_t ok);
+static void APP_FirstPollDone(transaction_result_t result, const message_t* response);
+static void APP_SyncPollDone(transaction_result_t result, const message_t* response);
+static void APP_ResetDone(transaction_result_t result, const message_t* response);
+static void APP_StatusInhibitDone(transaction_result_t result, const message_t* response);
+static void APP_StatusEnableDone(transaction_result_t result, const message_t* response);
+static void APP_EnableDisableAllDone(transaction_result_t result, const message_t* response);
+static void APP_EnableBillsDone(transaction_result_t result, const message_t* response);
+static void APP_EnableInhibitDone(transaction_result_t result, const message_t* response);
+static void APP_StackDone(transaction_result_t result, const message_t* response);
+static void APP_ReturnDone(transaction_result_t result, const message_t* response);
+static void APP_IdentificationDone(transaction_result_t result, const message_t* response);
+static void APP_SnapshotSerialDone(transaction_result_t result, const message_t* response);
+static void APP_SnapshotVersionDone(transaction_result_t result, const message_t* response);
+static void APP_CurrencyAssignDone(transaction_result_t result, const message_t* response);
+static void APP_BillTableInhibitDone(transaction_result_t result, const message_t* response);
+static void APP_BillTableEnableDone(transaction_result_t result, const message_t* response);
+static void APP_SecondFirstPollDone(transaction_result_t result, const message_t* response);
+static void APP_SecondBillTableDone(transaction_result_t result, const message_t* response);
+static void APP_SecondPollDone(transaction_result_t result, const message_t* response);
+static void APP_SecondEnableDone(transaction_result_t result, const message_t* response);
+static void APP_SecondInhibitDone(transaction_result_t result, const message_t* response);
+static void APP_UpstreamTask(void);
+static void APP_DownstreamTask(void);
+static void APP_ServiceTask(void);
+static void APP_ResetProcess(void);
+static void APP_DispatchCommand(void);
+static uint8_t APP_ReplayRequest(void);
+static void APP_KeepRequest(void);
+static void APP_Retransmit(void);
+static uint8_t APP_GetCcnetState(void);
+static void APP_HandleAck(void);
+static void APP_HandleReset(void);
+static void APP_HandleStatusRequest(void);
+static void APP_HandlePoll(void);
+static void APP_HandleEnableBillTypes(void);
+static void APP_HandleStack(void);
+static void APP_HandleReturn(void);
+static void APP_HandleIdentification(void);
+static void APP_HandleBillTable(void);
+static void APP_HandleNak(void);
+
+/* CCNET command table -------------------------------------------------------*/
+
+/**
+  * @brief  Index of the CCNET commands in ccnet_commands
+  */
+typedef enum {
+    CCNET_CMD_UNSUPPORTED = DISPATCH_UNSUPPORTED,
+    CCNET_CMD_ACK,
+    CCNET_CMD_RESET,
+    CCNET_CMD_STATUS_REQUEST,
+    CCNET_CMD_POLL,
+    CCNET_CMD_ENABLE_BILL_TYPES,
+    CCNET_CMD_STACK,
+    CCNET_CMD_RETURN,
+    CCNET_CMD_IDENTIFICATION,
+    CCNET_CMD_BILL_TABLE,
+    CCNET_CMD_NAK,
+    CCNET_CMD_COUNT
+} ccnet_command_index_t;
+
+/* Opcode to command index, unlisted opcodes are 0 (unsupported) */
+static const uint8_t ccnet_command_lut[256] = {
+    [CCNET_ACK]               = CCNET_CMD_ACK,
+    [CCNET_RESET]             = CCNET_CMD_RESET,
+    [CCNET_STATUS_REQUEST]    = CCNET_CMD_STATUS_REQUEST,
+    [CCNET_POLL]              = CCNET_CMD_POLL,
+    [CCNET_ENABLE_BILL_TYPES] = CCNET_CMD_ENABLE_BILL_TYPES,
+    [CCNET_STACK]             = CCNET_CMD_STACK,
+    [CCNET_RETURN]            = CCNET_CMD_RETURN,
+    [CCNET_IDENTIFICATION]    = CCNET_CMD_IDENTIFICATION,
+    [CCNET_BILL_TABLE]        = CCNET_CMD_BILL_TABLE,
+    [CCNET_NAK]               = CCNET_CMD_NAK,
+};
+
+/* Handler, allowed states, response deadline and replay. Commands that wait for the
+   downstream validator get its response timeout on top of the local budget. POLL is
+   never replayed: every POLL gets the current status */
+static const dispatch_command_t ccnet_commands[CCNET_CMD_COUNT] = {
+    [CCNET_CMD_UNSUPPORTED]       = {"unsupported", NULL,                       DISPATCH_STATE_ANY,  CCNET_DEADLINE_MS, 1},
+    [CCNET_CMD_ACK]               = {"ACK",         APP_HandleAck,              DISPATCH_STATE_ANY,  0, 0},
+    [CCNET_CMD_RESET]             = {"RESET",       APP_HandleReset,            DISPATCH_STATE_ANY,  CCNET_DEADLINE_MS + DS_RESET_TIMEOUT_MS, 1},
+    [CCNET_CMD_STATUS_REQUEST]    = {"STATUS",      APP_HandleStatusRequest,    DISPATCH_STATE_ANY,  CCNET_DEADLINE_MS, 1},
+    [CCNET_CMD_POLL]              = {"POLL",        APP_HandlePoll,             DISPATCH_STATE_ANY,  CCNET_DEADLINE_MS, 0},
+    [CCNET_CMD_ENABLE_BILL_TYPES] = {"ENABLE",      APP_HandleEnableBillTypes,  DISPATCH_STATE_ANY,  CCNET_DEADLINE_MS + 3 * DS_RESPONSE_TIMEOUT_MS, 1},
+    [CCNET_CMD_STACK]             = {"STACK",       APP_HandleStack,            CCNET_STATES_ESCROW, CCNET_DEADLINE_MS + DS_RESPONSE_TIMEOUT_MS, 1},
+    [CCNET_CMD_RETURN]            = {"RETURN",      APP_HandleReturn,           CCNET_STATES_ESCROW, CCNET_DEADLINE_MS + DS_RESPONSE_TIMEOUT_MS, 1},
+    [CCNET_CMD_IDENTIFICATION]    = {"IDENT",       APP_HandleIdentification,   CCNET_STATES_SETUP,  CCNET_DEADLINE_MS + DS_SERIAL_TIMEOUT_MS, 1},
+    [CCNET_CMD_BILL_TABLE]        = {"BILL TABLE",  APP_HandleBillTable,        CCNET_STATES_SETUP,  CCNET_DEADLINE_MS, 1},
+    [CCNET_CMD_NAK]               = {"NAK",         APP_HandleNak,              DISPATCH_STATE_ANY,  0, 0},
+};
+
+static dispatch_stats_t ccnet_command_stats[CCNET_CMD_COUNT];
+static dispatcher_t ccnet_dispatcher;
+
+/* Upstream response latency per command, filled from the UART interrupt */
+static latency_histogram_t ccnet_latency[CCNET_CMD_COUNT];
+
+/**
+  * @brief  CCNET request, kept to recognize a retransmission
+  */
+typedef struct {
+    uint8_t opcode;
+    uint8_t data[CCNET_REQUEST_MAX_DATA];
+    uint8_t data_length;
+    uint8_t valid;          /* 0: no request or data too long to compare */
+} ccnet_request_t;
+
+/**
+  * @brief  Last upstream response with the request that produced it
+  * @note   Replaced by every response, invalidated by the controller ACK
+  */
+typedef struct {
+    ccnet_request_t request;
+    uint8_t opcode;         /* Response opcode, for the protocol log */
+    uint8_t raw[CCNET_FRAME_MAX];   /* Frame as sent, retransmitted as is */
+    uint8_t length;
+    uint32_t time;          /* Time the response was sent */
+    uint8_t valid;
+} response_cache_t;
+
+/**
+  * @brief  Prebuilt short CCNET response, keyed by opcode and data
+  * @note   Constant answers (ACK, NAK, ILLEGAL COMMAND, IDLING...), the last
+  *         statuses and events and GET STATUS are built once and sent as is
+  */
+typedef struct {
+    uint8_t opcode;
+    uint8_t data[CCNET_FRAME_MAX_DATA];
+    uint8_t data_length;
+    uint8_t length;         /* Frame length, 0 = empty slot */
+    uint8_t raw[CCNET_FRAME_OVERHEAD + CCNET_FRAME_MAX_DATA];
+} ccnet_frame_t;
+
+/**
+  * @brief  Prebuilt CCNET response derived from slowly changing data
+  * @note   Cleared (length 0) when its source changes, rebuilt on the next request
+  */
+typedef struct {
+    uint8_t length;
+    uint8_t raw[CCNET_FRAME_MAX];
+} ccnet_block_frame_t;
+
+static ccnet_request_t ccnet_request;       /* Request being answered */
+static response_cache_t response_cache;
+static response_cache_stats_t response_cache_stats;
+static ccnet_frame_t ccnet_frames[CCNET_FRAME_SLOTS];
+static ccnet_block_frame_t bill_table_frame;        /* From the merged bill types and the currency */
+static ccnet_block_frame_t identification_frame;    /* From the serial number and downstream protocol */
+
+/* Main loop tasks, highest priority first, each on its own stack */
+typedef enum {
+    APP_TASK_UPSTREAM = 0,
+    APP_TASK_DOWNSTREAM,
+    APP_TASK_SERVICE,
+    APP_TASK_COUNT
+} app_task_t;
+
+static uint32_t upstream_stack[UPSTREAM_STACK_SIZE / 4] __attribute__((aligned(8)));
+static uint32_t downstream_stack[DOWNSTREAM_STACK_SIZE / 4] __attribute__((aligned(8)));
+static uint32_t service_stack[SERVICE_STACK_SIZE / 4] __attribute__((aligned(8)));
+
+static const sched_task_t app_tasks[APP_TASK_COUNT] = {
+    [APP_TASK_UPSTREAM]   = {"upstream",   APP_UpstreamTask,   upstream_stack,   UPSTREAM_STACK_SIZE},
+    [APP_TASK_DOWNSTREAM] = {"downstream", APP_DownstreamTask, downstream_stack, DOWNSTREAM_STACK_SIZE},
+    [APP_TASK_SERVICE]    = {"service",    APP_ServiceTask,    service_stack,    SERVICE_STACK_SIZE},
+};
+
 /* Exported functions --------------------------------------------------------*/
 
 /**
@@ -179,6 +635,152 @@ void APP_MCUReset(void)
     HAL_NVIC_SystemReset();
 }
 
+/**
+  * @brief  Request downstream auto-discovery
+  * @note   Runs from the main loop, the startup sequence restarts afterwards
+  * @retval None
+  */
+void APP_RequestDiscovery(void)
+{
+    ds_context.discovery_requested = 1;
+}
+
+/**
+  * @brief  Get the CCNET POLL timing report
+  * @param  timing: Filled with the learned cadence and the answer statistics
+  * @retval None
+  */
+void APP_GetPollTiming(poll_timing_t* timing)
+{
+    *timing = poll_timing;
+    timing->locked = CADENCE_IsLocked(&upstream_cadence, HAL_GetTick());
+    timing->interval_ms = CADENCE_GetInterval(&upstream_cadence);
+    timing->jitter_ms = CADENCE_GetJitter(&upstream_cadence);
+    timing->lead_ms = APP_GetPollLead();
+    timing->downstream_rtt_ms = ds_context.poller.rtt_ms;
+}
+
+/**
+  * @brief  Clear the CCNET POLL answer statistics
+  * @note   The learned cadence is kept
+  * @retval None
+  */
+void APP_ResetPollTiming(void)
+{
+    utils_zero((uint8_t*)&poll_timing, sizeof(poll_timing));
+}
+
+/**
+  * @brief  Get the statistics of a CCNET command
+  * @param  index: Command index, 0 is the entry for unsupported opcodes
+  * @param  name: Set to the command name
+  * @param  stats: Filled with the command statistics
+  * @retval uint8_t: 1 if index is valid, 0 past the last command
+  */
+uint8_t APP_GetCommandStats(uint8_t index, const char** name, dispatch_stats_t* stats)
+{
+    if (index >= CCNET_CMD_COUNT) return 0;
+    *name = ccnet_commands[index].name;
+    *stats = ccnet_command_stats[index];
+    return 1;
+}
+
+/**
+  * @brief  Clear the CCNET command and response cache statistics
+  * @retval None
+  */
+void APP_ResetCommandStats(void)
+{
+    DISPATCH_ResetStats(&ccnet_dispatcher);
+    utils_zero((uint8_t*)&response_cache_stats, sizeof(response_cache_stats));
+}
+
+/**
+  * @brief  Get the response cache statistics
+  * @param  stats: Filled with the replay and retransmit counts
+  * @retval None
+  */
+void APP_GetResponseCacheStats(response_cache_stats_t* stats)
+{
+    *stats = response_cache_stats;
+}
+
+/**
+  * @brief  Get the upstream response latency histogram of a CCNET command
+  * @param  index: Command index, 0 is the entry for unsupported opcodes
+  * @param  name: Set to the command name
+  * @param  histogram: Filled with the latency histogram
+  * @retval uint8_t: 1 if index is valid, 0 past the last command
+  */
+uint8_t APP_GetCommandLatency(uint8_t index, const char** name, latency_histogram_t* histogram)
+{
+    if (index >= CCNET_CMD_COUNT) return 0;
+    *name = ccnet_commands[index].name;
+    *histogram = ccnet_latency[index];
+    return 1;
+}
+
+/**
+  * @brief  Clear the upstream response latency histograms
+  * @retval None
+  */
+void APP_ResetCommandLatency(void)
+{
+    for (uint8_t i = 0; i < CCNET_CMD_COUNT; i++) LATENCY_Reset(&ccnet_latency[i]);
+}
+
+/**
+  * @brief  Get the boot timing
+  * @param  timing: Filled with the times since reset, 0 for a step not reached yet
+  * @retval None
+  */
+void APP_GetBootTiming(boot_timing_t* timing)
+{
+    *timing = boot_timing;
+}
+
+/**
+  * @brief  Get the state and poll statistics of a ccTalk bus peripheral
+  * @param  index: Device index
+  * @param  device: Filled with the device state and statistics
+  * @retval uint8_t: 1 if index is valid, 0 past the last device or no ccTalk bus
+  */
+uint8_t APP_GetBusDevice(uint8_t index, ccbus_device_t* device)
+{
+    if (index >= cctalk_bus.count) return 0;
+    *device = cctalk_bus.devices[index];
+    return 1;
+}
+
+/**
+  * @brief  Get the ccTalk bus utilisation
+  * @retval uint16_t: Time with a request on the line in the last second, permille
+  */
+uint16_t APP_GetBusUtilisation(void)
+{
+    return cctalk_bus.utilisation;
+}
+
+/**
+  * @brief  Clear the ccTalk bus poll statistics
+  * @retval None
+  */
+void APP_ResetBusStats(void)
+{
+    CCBUS_ResetStats(&cctalk_bus, HAL_GetTick());
+}
+
+/**
+  * @brief  Get the acceptor pool: merged bill types, escrow order and selection
+  * @param  pool: Filled with a copy of the pool
+  * @retval uint8_t: 1 if the second validator is running
+  */
+uint8_t APP_GetPool(pool_t* pool)
+{
+    *pool = bill_pool;
+    return (second.state == SECOND_RUNNING);
+}
+
 
 
 /**
@@ -187,17 +789,13 @@ void APP_MCUReset(void)
   */
 void APP_Init(void)
 {
-    /* Initialize LEDs first (blocking) */
+    /* Initialize LEDs first. The self-test runs in the background */
     LED_Init();
+    LED_StartSelfTest();
 
-    
-    /* Initialize USB VCP */
+    /* Initialize USB VCP. Output is buffered until the host has enumerated the device */
     USB_Init();
     
-    /* Wait for USB to be ready - longer delay for consistency */
-    HAL_Delay(500);
-    
-    
     /* Initialize Log module */
     LOG_Init();
  
@@ -210,71 +808,203 @@ void APP_Init(void)
     /* Initialize NVM module */
     NVM_Init();
     
-    /* Initialize UARTs with message structures */
-    UART_Init(&if_upstream, &upstream_msg);
-    UART_Init(&if_downstream, &downstream_msg);
-       
-    
     /* Load configuration from Flash */
     CONFIG_Init();
 
-    /* for test cctalk interface*/
+    /* One validator, or a second ID003 validator on UART3 next to the first one */
+    POOL_Init(&bill_pool, (g_config.second_validator == CONFIG_SECOND_ID003 &&
+                           if_downstream.protocol == PROTO_ID003) ? POOL_MAX_DEVICES : 1);
+
+    /* Bill table and identity of the last validator, until the validator confirms them */
+    APP_LoadSnapshot();
+
+    /* Initialize UARTs with message structures. After CONFIG_Init: the framer takes its datalink settings once here */
+    UART_Init(&if_upstream, &upstream_msg);
     UART_Init(&if_downstream, &downstream_msg);
 
-    /* Display current settings */
-    CONFIGUI_ShowConfiguration();
-    
+    /* Downstream requests are sent and matched by the transaction engine */
+    TRANSACTION_Init(&ds_transactions, &if_downstream, APP_SendRequest);
+    APP_StartCctalkBus();
+    if (bill_pool.devices > 1) APP_StartSecondLink();
+    EVENTS_Init(&upstream_events);
+    CADENCE_Init(&upstream_cadence);
+    DISPATCH_Init(&ccnet_dispatcher, ccnet_command_lut, ccnet_commands, ccnet_command_stats, CCNET_CMD_COUNT);
+    APP_ResetCommandLatency();
+
     /* Initialize Button module */
     BTN_Init();
 
-    /* Run all tests that are enabled in tests.c */
-    TESTS_RunAll();
-    
-    /* Log application startup */
-    LOG_Info("Application started");
-    LOG_Info("Press button for configuration menu (will stop application)");
-    LOG_Info("Long press for reset (will restart application)");
-    LOG_Info("Polling downstream validator for status and bill table\r\n");
-    
+    /* Main loop tasks. Paints the unused stack for the high-water mark */
+    SCHED_Init(app_tasks, APP_TASK_COUNT);
+
+    /* CCNET is answered from here. Banner and tests follow in the background */
+    APP_BootMark(&boot_timing.links_ms);
+    boot_stage = BOOT_STAGE_USB;
 }
 
 /**
   * @brief  Main application process
+  * @note   One pass of the tasks in priority order: upstream (CCNET commands),
+  *         downstream (requests, polling, responses), service (button,
+  *         configuration menu, console). A received CCNET frame wakes the
+  *         upstream task between the other tasks
   * @retval None
   */
 void APP_Process(void)
+{
+    SCHED_Run();
+}
+
+/**
+  * @brief  Frame received callback (called from interrupt context)
+  * @note   Wakes the task that reads the interface
+  * @param  interface: Interface configuration
+  * @retval None
+  */
+void UART_FrameReceivedCallback(interface_config_t* interface)
+{
+    SCHED_Notify((interface == &if_upstream) ? APP_TASK_UPSTREAM : APP_TASK_DOWNSTREAM);
+}
+
+/**
+  * @brief  Response started callback (called from interrupt or main loop context)
+  * @note   Upstream: the latency is counted for the command being answered
+  * @param  interface: Interface configuration
+  * @param  latency_us: Last received byte to first transmitted byte in us
+  * @retval None
+  */
+void UART_ResponseStartedCallback(interface_config_t* interface, uint32_t latency_us)
+{
+    if (interface != &if_upstream) return;
+    LATENCY_Record(&ccnet_latency[ccnet_dispatcher.pending], latency_us, CCNET_RESPONSE_BUDGET_US);
+}
+
+/**
+  * @brief  Upstream task: answer CCNET commands
+  * @retval None
+  */
+static void APP_UpstreamTask(void)
 {
     message_parse_result_t msg_received_status;
-    uint8_t downstream_opcode;
-    uint8_t data_buf[6];    /* used for: CCNNET Status and ID003 Enable Request*/
-    static uint8_t CCNET_ENABLE_BILL_TYPES_errors = 0;   /* used for: if downstream bill enabling fails respond with NACK first and timeout afterwards*/
-    static uint32_t CCNET_ENABLE_BILL_TYPES_last_error_time_ms = 0;  /* used for: timeout if Controller keeps retransmitting request */
 
-    /* Process config/reset button */
-    BTN_ProcessConfigResetButton();
-    
-    /* If config menu is active, don't process other functions */
-    if (BTN_IsConfigMenuActive())
+    /* Configuration menu active: the converter is stopped */
+    if (BTN_IsConfigMenuActive()) return;
+
+    /* Check for upstream message */
+    if ((msg_received_status = APP_CheckForUpstreamMessage()) != MSG_NO_MESSAGE)
     {
-        /* Process configuration menu */
-        CONFIGUI_ProcessMenu();
-        return; /* Exit early - don't process USB status messages */
+        if (msg_received_status == MSG_OK || msg_received_status == MSG_UNKNOWN_OPCODE)
+        {
+            APP_BootMark(&boot_timing.first_command_ms);
+        }
+
+        /* message received */
+        switch (msg_received_status)
+        {
+            case MSG_OK:
+                // TODO: process upstream message
+                LOG_Debug("CCNET message received OK");
+                LOG_Proto(&upstream_msg);
+                
+                /* Anything but an ACK after an event response (POLL again): the event is sent again.
+                   A NAK retransmits the cached response, the event is still on the line */
+                if (upstream_msg.opcode != CCNET_ACK && upstream_msg.opcode != CCNET_NAK)
+                {
+                    ds_context.event_sent = 0;
+                }
+
+                /* Commands that need the downstream validator submit a request and
+                   respond from its completion callback: the main loop keeps running */
+                APP_DispatchCommand();
+                break;
+                
+            case MSG_CRC_INVALID:
+                // TODO: send NACK message
+                /* 2.6.4 CCNET documenation*/
+                LOG_Warn("Upstream IN message CRC invalid");
+                break;
+                
+            case MSG_UNKNOWN_OPCODE:
+                /* 2.3.5 CCNET documenation: answered with ILLEGAL COMMAND */
+                APP_DispatchCommand();
+                break;
+
+            case MSG_DATA_MISSING_FOR_OPCODE:
+                /* 2.3.5 CCNET documenation*/
+                LOG_Warn("Upstream message unknown opcode or data missing for opcode");
+                break;
+                
+            default:
+                // No action needed
+                LOG_Warn("Upstream message parse failed without CRC invalid or unknown opcode or data missing for opcode");
+                break;
+        }
+    }
+}
+
+/**
+  * @brief  Downstream task: requests, polling and downstream responses
+  * @retval None
+  */
+static void APP_DownstreamTask(void)
+{
+    message_parse_result_t msg_received_status;
+
+    /* Configuration menu active: the converter is stopped */
+    if (BTN_IsConfigMenuActive()) return;
+
+    if (ds_context.discovery_requested)
+    {
+        ds_context.discovery_requested = 0;
+        /* Discovery takes over the downstream interface: drop pending requests */
+        TRANSACTION_Abort(&ds_transactions);
+        TRANSACTION_SetHold(&ds_transactions, 0);
+        ds_context.bill_table_fetch = BILL_TABLE_IDLE;
+        g_bill_table.ds_settings.valid = 0;
+        identification_frame.length = 0;    /* the protocol may change */
+        status_mirror[DS_DEVICE].sequence = 0;
+        EVENTS_Init(&upstream_events);
+        CADENCE_Init(&upstream_cadence);
+        /* UART3 stays with the second validator: no ccTalk candidates */
+        DISCOVERY_Start(&ds_transactions, &if_downstream, &downstream_msg, bill_pool.devices > 1);
     }
+
+    /* Downstream requests: start the response deadline, time out, send the next one */
+    TRANSACTION_Process(&ds_transactions);
     
-    /* Handle startup: get first poll response and bill table*/
-    if (ds_context.startup < DS_STARTUP_OK)
+    /* Auto-discovery: one probe per run, CCNET is answered in between */
+    if (DISCOVERY_IsRunning())
+    {
+        if (DISCOVERY_Process())
+        {
+            APP_StartCctalkBus();
+            ds_context.startup = DS_NOT_STARTED;
+        }
+    }
+    /* ccTalk: the bus owner polls every peripheral on the multi-drop bus */
+    else if (if_downstream.protocol == PROTO_CCTALK)
     {
-        APP_DownstreamStartup();
+        APP_CctalkBusPolling();
     }
-    else 
+    else
     {
-        /* Send out downstream polls. periodic and using DMA */
-        APP_DownstreamPolling(if_downstream.datalink.polling_period_ms);
+        /* Boot handshake: first poll, then bill table and identity between the polls */
+        APP_BootDownstream();
+
+        /* Validator answered: send out downstream polls. periodic */
+        if (ds_context.startup >= DS_FIRST_POLL_RECEIVED_OK)
+        {
+            APP_DownstreamPolling(APP_GetPollingPeriod(DS_DEVICE));
+            /* Keep the settings cache fresh while the line is idle */
+            APP_RefreshSettings();
+        }
     }
     
     /* Check for downstream message */
     if ((msg_received_status = APP_CheckForDownstreamMessage()) != MSG_NO_MESSAGE)
     {
+        uint8_t answered;
+
         LOG_Debug("APP_CheckForDownstreamMessage True");
         /* Update state on first message */
         if (ds_context.state == DS_NOT_CONNECTED)
@@ -282,6 +1012,9 @@ void APP_Process(void)
             LOG_Debug("Downstream validator connected");
             ds_context.state = DS_CONNECTED;
         }
+
+        /* Response to a pending request: completes it and runs its callback */
+        answered = TRANSACTION_HandleResponse(&ds_transactions, &downstream_msg, msg_received_status);
         
         /* message received */
         switch (msg_received_status)
@@ -290,11 +1023,15 @@ void APP_Process(void)
                 LOG_Debug("Downstream message received OK");
                 LOG_Proto(&downstream_msg);
 
-                if (PROTO_IsId003StatusCode(downstream_msg.opcode))
+                if (downstream_msg.protocol == PROTO_CCTALK)
+                {
+                    if (!answered && !DISCOVERY_IsRunning()) APP_CctalkBusResponse();
+                }
+                else if (PROTO_IsId003StatusCode(downstream_msg.opcode))
                 {
                     LOG_Debug("Downstream ID003 status code parsed to upstream msg object");
                 }
-                else
+                else if (!answered)
                 {
                     LOG_Warn("Downstream message is not a ID003 status code");
                 }
@@ -321,744 +1058,2713 @@ void APP_Process(void)
                 break;
         }
     }
-    
-    /* Check for upstream message */
-    if ((msg_received_status = APP_CheckForUpstreamMessage()) != MSG_NO_MESSAGE)
+
+    /* Second validator on UART3: its own requests, polls and responses */
+    if (second.state != SECOND_OFF)
     {
-        message_t new_us_msg;      /* new upstream message created by mapping status code and data*/
+        TRANSACTION_Process(&second_transactions);
+        APP_SecondLinkProcess();
+        APP_CheckForSecondMessage();
+    }
+}
 
-        /* message received */
-        switch (msg_received_status)
-        {
-            case MSG_OK:
-                // TODO: process upstream message
-                LOG_Debug("CCNET message received OK");
-                LOG_Proto(&upstream_msg);
-                
-                switch (upstream_msg.opcode)
-                {
-                    case CCNET_ACK:                    /* 0x00 - ACK */
-                        LOG_Debug("CCNET_ACK received");
-                        break;
-
-                    case CCNET_RESET:                  /* 0x30 - Reset */
-                        REQUEST(ID003_RESET, NULL, 0);
-                        if(WAIT_FOR_DS_MSG(100, ID003_STATUS_ACK, 0))
-                        {
-                            RESPOND(CCNET_STATUS_ACK, NULL, 0);
-                            /* reset MCU */
-                            LOG_Warn("Resetting MCU");
-                            USB_Flush();
-                            HAL_Delay(100);
-                            APP_MCUReset();
-                            
-                        }
-                        else
-                        {
-                            RESPOND(CCNET_STATUS_NAK, NULL, 0);
-                        }
-                        break;
-
-                    case CCNET_STATUS_REQUEST:         /* 0x31 - Get Status */
-                        /* check enabled denominators */
-                        if (downstream_msg.protocol == PROTO_ID003)
-                        {
-                            /* check inhibit status first*/
-                            REQUEST(ID003_INHIBIT_REQ, NULL, 0);
-                            APP_WaitForDownstreamMessage(20);
-                            if (downstream_msg.length > 0)
-                            {
-                                if (downstream_msg.opcode == ID003_INHIBIT_REQ && downstream_msg.data_length == 1)
-                                {
-                                    if (downstream_msg.data[0] == 1)
-                                    {
-                                        /* inhibit is enabled - respond with zeros (unit disabled) and break*/
-                                        utils_zero(data_buf, 6);
-                                        RESPOND(CCNET_STATUS_REQUEST, data_buf, 6);
-                                        if (g_config.log_level >= LOG_LEVEL_INFO) TABLE_UI_DisplayBillTable();
-                                        break;
-                                    }
-                                }
-                            }
-                            REQUEST(ID003_ENABLE_REQ, NULL, 0);
-                            APP_WaitForDownstreamMessage(20);
-                            if (downstream_msg.length > 0)
-                            {
-                                if (downstream_msg.opcode == ID003_ENABLE_REQ && downstream_msg.data_length == 2)
-                                {   /* first byte of ID003 response is enabled denominators */
-                                    /* response is 2x3 bytes */
-                                    data_buf[0] = 0;
-                                    data_buf[1] = 0;
-                                    data_buf[2] = downstream_msg.data[0];
-                                    data_buf[2] = ~data_buf[2];      /* ID003 0 means enabled, CCNET 1 means enabled*/
-                                    data_buf[2] = data_buf[2]>>1;    /* ID003 first bill starts at bit 1*/
-                                    data_buf[3] = 0xFF;              /* all escrow for now*/
-                                    data_buf[4] = 0xFF;
-                                    data_buf[5] = 0xFF;
-                                    RESPOND(CCNET_STATUS_REQUEST, data_buf, 6);
-                                }
-                            }
-                            
-                            /* Display bill table if log level is INFO */
-                            if (g_config.log_level >= LOG_LEVEL_INFO)
-                            {
-                                TABLE_UI_DisplayBillTable();
-                            }
-                        }
-                        break;
-
-                    case CCNET_POLL:                   /* 0x33 - Poll */
-                        {
-                            /* Determine if we should poll downstream validator */
-                            uint8_t synchronous_polling = (if_downstream.datalink.polling_period_ms == 0);
-                            uint8_t asynchronous_polling = !synchronous_polling;
-                            uint8_t downstream_not_connected = (ds_context.state != DS_NOT_CONNECTED);
-
-                            /* Respond to CCNET_POLL if:
-                            * - Device is connected so a status is known, OR
-                            * - Polling is synchronous and we do not want to block the first downstream poll 
-                            * if not connected, just let CCNET POLL timeout
-                            */
-                            if (downstream_not_connected && asynchronous_polling)
-                            {
-                                LOG_Warn("No bill validator connected. CCNET POLL timeout");
-                            }
-                            else
-                            {
-                                /* manually request status each time */
-                                if (synchronous_polling)
-                                {
-                                    REQUEST(ID003_STATUS_REQ, NULL, 0);
-                                    if (APP_WaitForDownstreamMessage(20)==0)
-                                    {
-                                        LOG_Warn("No bill validator connected. CCNET POLL timeout");
-                                        break;
-                                    }
-                                }
-                            }
-                            /* Check if downstream message is fresh and valid */
-                            if (!(downstream_msg.length > 0 && APP_GetDownstreamMessageAge() < DOWNSTREAM_MSG_TTL_MS))
-                            {
-                                LOG_Warn("Downstream status is not recent and valid. CCNET POLL timeout");
-                                break;
-                            }
-                            
-                            PROTO_MapStatusCode(&downstream_msg, &new_us_msg);   /* updates opcode and data */
-    
-                            switch(ds_context.escrow_state)
-                            {                                
-                                case ESCROW_IDLE:
-                                    /* handle all non escrow related messages. Status, Rejection, Failures. But also detect if getting into escrow */
-                                    if (downstream_msg.opcode != ID003_STATUS_ESCROW)
-                                    {
-                                        CREATE_RESP(new_us_msg);
-                                        RESPOND(new_us_msg.opcode, new_us_msg.data, new_us_msg.data_length);
-                                    }
-                                    else
-                                    {
-                                        ds_context.escrow_state = ESCROW_IN_ESCROW;
-                                        uint8_t id003_denom_nr = downstream_msg.data[0];
-                                        ds_context.escrow_bill_type_nr = id003_denom_nr - g_bill_table.denoms[0].id003_denom_nr;
-                                        RESPOND(CCNET_STATUS_ESCROW_POSITION, &ds_context.escrow_bill_type_nr, 1);
-                                    }
-                                    break;
-
-
-                                case ESCROW_IN_ESCROW:
-                                    /* make sure it is still in escrow*/
-                                    if (downstream_msg.opcode != ID003_STATUS_ESCROW)
-                                    {
-                                        /* handle returning, rejection, failure, etc. as normal cases*/
-                                        CREATE_RESP(new_us_msg);
-                                        RESPOND(new_us_msg.opcode, new_us_msg.data, new_us_msg.data_length);
-                                        ds_context.escrow_state = ESCROW_IDLE;
-                                    }
-                                    else
-                                    {
-                                        RESPOND(CCNET_STATUS_ESCROW_POSITION, &ds_context.escrow_bill_type_nr, 1);
-                                    }
-                                    break;
-                                case ESCROW_IN_STACK:
-                                    RESPOND(CCNET_STATUS_STACKING, NULL, 0);
-                                    ds_context.escrow_state = ESCROW_STACKING;
-                                    break;
-                                case ESCROW_STACKING:
-                                    /* if downstream status is still stacking */
-                                    if (downstream_msg.opcode == ID003_STATUS_STACKING)
-                                    {
-                                        RESPOND(CCNET_STATUS_STACKING, NULL, 0);
-                                    }
-                                    /* critical path. Automate sending the ACK. But only in synchronous mode. This SHALL not work asynchronously*/
-                                    if (downstream_msg.opcode == ID003_STATUS_VEND_VALID)
-                                    {
-                                        RESPOND(CCNET_STATUS_STACKING, NULL, 0);
-                                        REQUEST(ID003_ACK_TO_VEND_VALID, NULL, 0); /* no response expected*/
-                                        WAIT_FOR_DS_MSG(20, 0, 0);
-                                        /* there will be no response to ACK_TO_VEND_VALID */                                        
-                                    }
-                                    if (downstream_msg.opcode == ID003_STATUS_STACKED || downstream_msg.opcode == ID003_STATUS_IDLING)
-                                    {
-
-                                        RESPOND(CCNET_STATUS_BILL_STACKED, &ds_context.escrow_bill_type_nr, 1);
-                                        ds_context.escrow_state = ESCROW_STACKED;
-                                    }
-                                    break;
-                                case ESCROW_STACKED:
-                                    /* no further action needed*/
-                                    if (downstream_msg.opcode != ID003_STATUS_ESCROW)
-                                    {
-                                        CREATE_RESP(new_us_msg);
-                                        RESPOND(new_us_msg.opcode, new_us_msg.data, new_us_msg.data_length);
-                                    }
-                                    else
-                                    {
-                                        RESPOND(CCNET_NAK, NULL, 0);
-                                    }
-                                    ds_context.escrow_state = ESCROW_IDLE;
-                                    break;
-                            } /* end switch */
-                        }
-                        break; 
-
-                    case CCNET_ENABLE_BILL_TYPES:      /* 0x34 - Enable Bill Types */
-                        {
-                            uint8_t* b = upstream_msg.data;
-                            uint32_t enabled_bills = b[2] + (b[1]<<8) + (b[0]<<16);  /* 23 bits of CCNET enabled bills (1=enabled)*/
-                            uint8_t ack = 0;
-
-                            if (downstream_msg.protocol == PROTO_ID003)
-                            {
-                                /* first: disable all bill types. If this sequence fails there is a risk of wrong Controller state */
-                                /* error flow: first downstream error: NACK, subsequent errors: timeout */ 
-                                uint8_t enable_data[2] = {0xFF,0};   /* first byte: enabled bills (0=enable), second 0 by spec)*/
-                                REQUEST(ID003_ENABLE, enable_data, 2);
-                                if(WAIT_FOR_DS_MSG(20, ID003_ENABLE, 2))
-                                {
-                                    enable_data[0] = enabled_bills & 0xff;
-                                    enable_data[0] = ~enable_data[0];  /* ID003 0 means enabled*/
-                                    enable_data[0] = enable_data[0]<<1;  /* ID003 first bill starts at bit 1*/
-
-                                    REQUEST(ID003_ENABLE, enable_data, 2); /* second: enable bills*/
-                                    if(WAIT_FOR_DS_MSG(20, ID003_ENABLE, 2)) 
-                                    {                                    
-                                        /* second: de-inibit*/
-                                        uint8_t inhibit_data[1] ={0};  /* 0: de-inhibit*/
-                                        REQUEST(ID003_INHIBIT, inhibit_data, 1); /* third: de-inhibit*/
-                                        if(WAIT_FOR_DS_MSG(20, ID003_INHIBIT, 1)) ack++; /* only ack if all three successful*/
-                                    }
-                                }
-                            }
-
-                            if (ack == 1) /* process successful*/
-                            {
-                                /* store response in bill table*/
-                                g_bill_table.enabled_bills = b[2] + (b[1]<<8) + (b[0]<<16);  /* 23 bits of CCNET enabled bills (1=enabled)*/
-                                g_bill_table.escrowed_bills = b[5] + (b[4]<<8) + (b[3]<<16);
-                                g_bill_table.escrowed_bills = 0xffffff; /* ID003 does not handle non escrowed bills. Automation for it possible though*/
-    
-                                g_bill_table.escrowed_bills = 0x00007f;    /* ID003 does not handle non escrowed bills. Automation for it possible though*/
-                                g_bill_table.ds_escrowed_bills = 0x00007f;
-                                g_bill_table.ds_enabled_bills = g_bill_table.enabled_bills & 0x7f;  /* ID003: max 7 bills */
-
-                                RESPOND(CCNET_ACK, NULL, 0); 
-                                if (g_config.log_level >= LOG_LEVEL_INFO)
-                                {
-                                    LOG_Info("Updated enable data in bill table:");
-                                    TABLE_UI_DisplayBillTable();
-                                }
-                            }
-                            else 
-                            {
-                                /* start with couple NAK respones. if Controller retransmits follow up by timeouts*/
-                                if (CCNET_ENABLE_BILL_TYPES_errors++ < 2){
-                                    RESPOND(CCNET_NAK, NULL, 0);    /* NAK for first 2 subsequent transmissions */
-                                }
-                                else {
-                                    __NOP(); /* in principle do nothing. signal the error by just timing out*/
-                                    if (HAL_GetTick() - CCNET_ENABLE_BILL_TYPES_last_error_time_ms > 10000){
-                                        RESPOND(CCNET_NAK, NULL, 0);    /* new error. first one in 10000ms */
-                                        CCNET_ENABLE_BILL_TYPES_errors = 0; 
-                                    }
-                                }
-                                CCNET_ENABLE_BILL_TYPES_last_error_time_ms = HAL_GetTick();
-                            }                              
-                        }
-                        break;
-
-                    case CCNET_STACK:                  /* 0x35 - Stack */
-                        REQUEST(ID003_STACK_1, NULL, 0);
-                        if(WAIT_FOR_DS_MSG(20, ID003_STATUS_ACK, 0)) /* STACK_1 returns ACK... */
-                        {
-                            if (downstream_msg.opcode == ID003_STATUS_ACK)
-                            {
-                                RESPOND(CCNET_ACK, NULL, 0);
-                                ds_context.escrow_state = ESCROW_IN_STACK;
-                            }
-                            else
-                            {
-                                RESPOND(CCNET_NAK, NULL, 0);
-                                ds_context.escrow_state = ESCROW_IDLE;
-                            }
-                        }
-                        else
-                        {
-                            RESPOND(CCNET_NAK, NULL, 0);
-                            ds_context.escrow_state = ESCROW_IDLE;
-                        }
-                        break;
-
-                    case CCNET_RETURN:                 /* 0x36 - Return */
-                        REQUEST(ID003_RETURN, NULL, 0);
-                        break;
-
-                    case CCNET_IDENTIFICATION:         /* 0x37 - Identification */
-                        {
-                            uint8_t ident_data[34];  /* CCNET identification response: 34 bytes */
-                            /* Initialize all data to zero */
-                            utils_zero(ident_data, 34);
-                            
-                            /* Z1-Z15: Part Number (ASCII) - initialize with spaces */
-                            const char spaces[] = "               ";  /* 15 spaces */
-                            utils_memcpy(ident_data, (uint8_t*)spaces, 15);
-                            
-                            if (downstream_msg.protocol == PROTO_ID003)
-                            {
-                                /* Model: "ID003" */
-                                utils_memcpy(ident_data, (uint8_t*)"ID003", 5);
-                                
-                                /* Request serial number from ID003 validator */
-                                REQUEST(ID003_SERIAL_NUMBER_REQ, NULL, 0);
-                                APP_WaitForDownstreamMessage(40);
-                                
-                                /* Z16-Z27: Serial Number (ASCII) - copy up to 12 chars from ID003 response */
-                                if (downstream_msg.length > 0 && downstream_msg.opcode == ID003_SERIAL_NUMBER_REQ && downstream_msg.data_length > 0)
-                                {
-                                    uint8_t serial_len = (downstream_msg.data_length > 12) ? 12 : downstream_msg.data_length;
-                                    utils_memcpy(&ident_data[15], downstream_msg.data, serial_len);
-                                }
-                            }
-                            
-                            /* Z28-Z34: Asset Number (Binary) - zeros (already set by utils_zero) */
-                            RESPOND(CCNET_IDENTIFICATION, ident_data, 34);
-                        }
-                        break;
-
-                    case CCNET_BILL_TABLE:             /* 0x41 - Get Bill Table */
-                        APP_RespondBillTable();
-                        break;
-
-                    case CCNET_NAK:                    /* 0xFF - NAK */
-                        LOG_Warn("CCNET_NAK received");
-                        break;
-
-                    default:
-                        if (IsSupportedCcnetCommand(upstream_msg.opcode))
-                        {
-                            LOG_Warn("Supported CCNET opcode received but not implemented");
-                        }
-                        else
-                        {
-                            LOG_Warn("Unsupported CCNET opcode received");
-                        }
-                        break;
-                }
+/**
+  * @brief  Service task: button, configuration menu, USB console and log output
+  * @retval None
+  */
+static void APP_ServiceTask(void)
+{
+    /* Acknowledged CCNET RESET */
+    APP_ResetProcess();
+
+    /* Flash writes between controller POLLs */
+    APP_FlashProcess();
+
+    /* Process config/reset button */
+    BTN_ProcessConfigResetButton();
+    
+    /* If config menu is active, don't process other functions */
+    if (BTN_IsConfigMenuActive())
+    {
+        /* Process configuration menu */
+        CONFIGUI_ProcessMenu();
+        return; /* Exit early - don't process USB status messages */
+    }
+
+    /* Background boot stages: LED self-test, banner, tests */
+    LED_Process();
+    APP_BootProcess();
+
+    /* USB console commands (statistics, discovery) */
+    CONSOLE_Process();
+
+    /* Flush USB TX ring buffer */
+    USB_Flush();
+    
+    // USB_ProcessStatusMessage();
+}
+
+/**
+  * @brief  Reset the MCU after an acknowledged CCNET RESET
+  * @note   Waits without blocking until the ACK is on the line and the log
+  *         output had time to go out
+  * @retval None
+  */
+static void APP_ResetProcess(void)
+{
+    uint32_t elapsed;
+
+    if (!mcu_reset_pending) return;
+
+    elapsed = HAL_GetTick() - mcu_reset_tick;
+    if (elapsed < MCU_RESET_DELAY_MS) return;
+    if (UART_IsTxBusy(&if_upstream) && elapsed < MCU_RESET_TIMEOUT_MS) return;
+    APP_MCUReset();
+}
+
+/**
+  * @brief  Dispatch the received CCNET command to its handler
+  * @note   Opcode lookup, state rules and response timing are table driven
+  *         (ccnet_commands). Unsupported commands and commands that are not
+  *         allowed in the current state are answered with ILLEGAL COMMAND
+  * @retval None
+  */
+static void APP_DispatchCommand(void)
+{
+    /* retransmitted request: no second execution downstream */
+    if (APP_ReplayRequest()) return;
+    APP_KeepRequest();
+
+    switch (DISPATCH_Run(&ccnet_dispatcher, upstream_msg.opcode, APP_GetCcnetState(), HAL_GetTick()))
+    {
+        case DISPATCH_NOT_SUPPORTED:
+            LOG_Warn("Unsupported CCNET opcode received. ILLEGAL COMMAND");
+            RESPOND(CCNET_STATUS_ILLEGAL_COMMAND, NULL, 0);
+            break;
+
+        case DISPATCH_ILLEGAL:
+            LOG_Warn("CCNET command not allowed in the current validator state. ILLEGAL COMMAND");
+            RESPOND(CCNET_STATUS_ILLEGAL_COMMAND, NULL, 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+  * @brief  Get the validator state class for the ILLEGAL COMMAND rules
+  * @note   Derived from the status mirror of the validator answered to POLL.
+  *         Without a recent status the state is unknown and commands are not
+  *         restricted
+  * @retval uint8_t: CCNET_STATE_xxx
+  */
+static uint8_t APP_GetCcnetState(void)
+{
+    uint8_t device = APP_SelectDevice();
+
+    if (APP_GetStatusAge(device) >= DOWNSTREAM_MSG_TTL_MS) return CCNET_STATE_UNKNOWN;
+
+    switch (status_mirror[device].status.opcode)
+    {
+        case ID003_STATUS_POWER_UP:
+        case ID003_STATUS_POWER_UP_BIA:
+        case ID003_STATUS_POWER_UP_BIS:
+        case ID003_STATUS_INITIALIZE:
+            return CCNET_STATE_POWER_UP;
+
+        case ID003_STATUS_DISABLE_INHIBIT:
+            return CCNET_STATE_DISABLED;
+
+        case ID003_STATUS_STACKER_FULL:
+        case ID003_STATUS_STACKER_OPEN:
+        case ID003_STATUS_ACCEPTOR_JAM:
+        case ID003_STATUS_STACKER_JAM:
+        case ID003_STATUS_PAUSE:
+        case ID003_STATUS_CHEATED:
+        case ID003_STATUS_FAILURE:
+        case ID003_STATUS_COMM_ERROR:
+            return CCNET_STATE_FAILURE;
+
+        case ID003_STATUS_ESCROW:
+        case ID003_STATUS_HOLDING:
+            /* a bill that is not offered to the controller is being returned */
+            return (bill_pool.escrow_owner == device) ? CCNET_STATE_ESCROW : CCNET_STATE_OPERATING;
+
+        default:
+            return CCNET_STATE_OPERATING;
+    }
+}
+
+/**
+  * @brief  CCNET ACK (0x00)
+  * @retval None
+  */
+static void APP_HandleAck(void)
+{
+    LOG_Debug("CCNET_ACK received");
+    /* the response arrived: an identical request from now on is a new one */
+    response_cache.valid = 0;
+    /* the controller received the event: deliver the next one on the next POLL */
+    if (ds_context.event_sent)
+    {
+        EVENTS_Retire(&upstream_events);
+        ds_context.event_sent = 0;
+    }
+}
+
+/**
+  * @brief  CCNET RESET (0x30)
+  * @retval None
+  */
+static void APP_HandleReset(void)
+{
+    g_bill_table.ds_settings.valid = 0;
+    /* the second validator starts over too, the MCU reset follows the first acknowledge */
+    if (second.state != SECOND_OFF)
+    {
+        SECOND_REQUEST(ID003_RESET, NULL, 0, ID003_STATUS_ACK, 0, DS_RESET_TIMEOUT_MS, NULL);
+    }
+    REQUEST(ID003_RESET, NULL, 0, ID003_STATUS_ACK, 0, DS_RESET_TIMEOUT_MS, APP_ResetDone);
+}
+
+/**
+  * @brief  CCNET GET STATUS (0x31)
+  * @retval None
+  */
+static void APP_HandleStatusRequest(void)
+{
+    /* check enabled denominators */
+    if (if_downstream.protocol == PROTO_ID003)
+    {
+        APP_RespondStatus();
+    }
+}
+
+/**
+  * @brief  CCNET POLL (0x33)
+  * @retval None
+  */
+static void APP_HandlePoll(void)
+{
+    ds_context.poll_rx_time = HAL_GetTick();
+    CADENCE_Update(&upstream_cadence, ds_context.poll_rx_time);
+
+    /* Determine if we should poll downstream validator */
+    uint8_t synchronous_polling = (if_downstream.datalink.polling_period_ms == 0);
+    uint8_t asynchronous_polling = !synchronous_polling;
+    uint8_t downstream_not_connected = (ds_context.state == DS_NOT_CONNECTED);
+
+    /* the second validator is polled on every POLL too, its status answers the next one */
+    if (synchronous_polling) second.poll_now = 1;
+
+    /* Respond to CCNET_POLL if:
+    * - Device is connected so a status is known, OR
+    * - Polling is synchronous and we do not want to block the first downstream poll 
+    * if not connected, just let CCNET POLL timeout
+    */
+    if (downstream_not_connected && asynchronous_polling)
+    {
+        LOG_Warn("No bill validator connected. CCNET POLL timeout");
+    }
+    else
+    {
+        /* manually request status each time, respond when it arrives.
+           Not needed if a phase-locked poll was just answered */
+        if (synchronous_polling &&
+            !(CADENCE_IsLocked(&upstream_cadence, ds_context.poll_rx_time) &&
+              APP_GetStatusAge(DS_DEVICE) <= APP_GetPollLead()))
+        {
+            REQUEST(ID003_STATUS_REQ, NULL, 0, TRANSACTION_ANY_OPCODE, TRANSACTION_ANY_LENGTH,
+                    DS_RESPONSE_TIMEOUT_MS, APP_SyncPollDone);
+            return;
+        }
+    }
+    APP_RespondPoll();
+}
+
+/**
+  * @brief  CCNET ENABLE BILL TYPES (0x34)
+  * @retval None
+  */
+static void APP_HandleEnableBillTypes(void)
+{
+    /* upstream_msg is overwritten by the next command before the sequence completes */
+    utils_memcpy(ds_context.enable_request, upstream_msg.data, sizeof(ds_context.enable_request));
+    ds_context.enable_outstanding = 1;
+    ds_context.enable_failed = 0;
+
+    /* The second validator gets its part of the mask too. Answered once both
+       sequences are done, unless it is not up: it follows when it is */
+    if (second.state != SECOND_OFF)
+    {
+        second.enable_known = 1;
+        second.enable_pending = 1;
+        if (second.state == SECOND_RUNNING && APP_GetPoolState(SECOND_DEVICE) >= POOL_STATE_DISABLED)
+        {
+            second.join_requested = 1;
+            ds_context.enable_outstanding++;
+        }
+    }
+
+    if (if_downstream.protocol == PROTO_ID003)
+    {
+        /* error flow: first downstream error: NACK, subsequent errors: timeout */ 
+        APP_EnableBillTypes();
+    }
+    else
+    {
+        APP_EnableBillTypesDone(0);
+    }
+}
+
+/**
+  * @brief  CCNET STACK (0x35), bill in escrow only
+  * @note   Sent to the validator whose bill the controller sees in escrow
+  * @retval None
+  */
+static void APP_HandleStack(void)
+{
+    uint8_t device = (bill_pool.escrow_owner == SECOND_DEVICE) ? SECOND_DEVICE : DS_DEVICE;
+
+    APP_DeviceRequest(device, ID003_STACK_1, NULL, 0, ID003_STATUS_ACK, 0, DS_RESPONSE_TIMEOUT_MS, APP_StackDone); /* STACK_1 returns ACK... */
+}
+
+/**
+  * @brief  CCNET RETURN (0x36), bill in escrow only
+  * @note   Sent to the validator whose bill the controller sees in escrow
+  * @retval None
+  */
+static void APP_HandleReturn(void)
+{
+    uint8_t device = (bill_pool.escrow_owner == SECOND_DEVICE) ? SECOND_DEVICE : DS_DEVICE;
+
+    APP_DeviceRequest(device, ID003_RETURN, NULL, 0, ID003_STATUS_ACK, 0, DS_RESPONSE_TIMEOUT_MS, APP_ReturnDone); /* RETURN returns ACK */
+}
+
+/**
+  * @brief  CCNET IDENTIFICATION (0x37), power up, disabled or failure only
+  * @retval None
+  */
+static void APP_HandleIdentification(void)
+{
+    if (ds_serial_length > 0 || if_downstream.protocol != PROTO_ID003)
+    {
+        /* Known from the snapshot or an earlier request: no downstream wait */
+        APP_RespondIdentification();
+    }
+    else
+    {
+        /* Request serial number from ID003 validator */
+        REQUEST(ID003_SERIAL_NUMBER_REQ, NULL, 0, ID003_SERIAL_NUMBER_REQ, TRANSACTION_ANY_LENGTH,
+                DS_SERIAL_TIMEOUT_MS, APP_IdentificationDone);
+    }
+}
+
+/**
+  * @brief  CCNET GET BILL TABLE (0x41), power up, disabled or failure only
+  * @note   The deadline assumes the loaded table, a fetch first shows up as overrun
+  * @retval None
+  */
+static void APP_HandleBillTable(void)
+{
+    /* If bill table not loaded yet, request it first and respond when done */
+    if (g_bill_table.is_loaded == 0)
+    {
+        APP_GetBillTable(1);
+    }
+    else
+    {
+        APP_RespondBillTable();
+    }
+}
+
+/**
+  * @brief  CCNET NAK (0xFF)
+  * @retval None
+  */
+static void APP_HandleNak(void)
+{
+    LOG_Warn("CCNET_NAK received");
+    if (response_cache.valid && HAL_GetTick() - response_cache.time <= CCNET_REPLAY_WINDOW_MS)
+    {
+        response_cache_stats.nak_retransmits++;
+        APP_Retransmit();
+        return;
+    }
+    ds_context.event_sent = 0;
+}
+
+/**
+  * @brief  Answer a retransmitted CCNET request without executing it again
+  * @note   A repeat while the first one is still being handled is dropped, the
+  *         pending response answers it. A repeat of an answered request within
+  *         CCNET_REPLAY_WINDOW_MS gets the cached response, for commands marked
+  *         replay in ccnet_commands. Identical means same opcode and data
+  * @retval uint8_t: 1 if the request was handled here
+  */
+static uint8_t APP_ReplayRequest(void)
+{
+    const ccnet_request_t* previous;
+    uint8_t waiting = ccnet_dispatcher.waiting && HAL_GetTick() - ccnet_dispatcher.start_time <= CCNET_REPLAY_WINDOW_MS;
+
+    if (!ccnet_commands[ccnet_command_lut[upstream_msg.opcode]].replay) return 0;
+
+    if (waiting)
+    {
+        previous = &ccnet_request;
+    }
+    else if (response_cache.valid && HAL_GetTick() - response_cache.time <= CCNET_REPLAY_WINDOW_MS)
+    {
+        previous = &response_cache.request;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (!previous->valid || previous->opcode != upstream_msg.opcode || previous->data_length != upstream_msg.data_length ||
+        memcmp(previous->data, upstream_msg.data, upstream_msg.data_length) != 0)
+    {
+        return 0;
+    }
+
+    if (waiting)
+    {
+        LOG_Debug("Repeated CCNET request while the first is handled, dropped");
+        response_cache_stats.duplicates_dropped++;
+    }
+    else
+    {
+        LOG_Debug("Repeated CCNET request, cached response sent");
+        response_cache_stats.replays++;
+        APP_Retransmit();
+    }
+    return 1;
+}
+
+/**
+  * @brief  Keep the received request, cached with its response once sent
+  * @retval None
+  */
+static void APP_KeepRequest(void)
+{
+    ccnet_request.opcode = upstream_msg.opcode;
+    ccnet_request.data_length = upstream_msg.data_length;
+    ccnet_request.valid = (upstream_msg.data_length <= CCNET_REQUEST_MAX_DATA);
+    if (ccnet_request.valid) utils_memcpy(ccnet_request.data, upstream_msg.data, upstream_msg.data_length);
+}
+
+/**
+  * @brief  Send the cached response frame again
+  * @retval None
+  */
+static void APP_Retransmit(void)
+{
+    LED_Flash(&hled1, 10);
+    UART_TransmitFrame(&if_upstream, response_cache.raw, response_cache.length);
+    APP_LogFrame(response_cache.opcode, response_cache.raw, response_cache.length);
+}
+
+/**
+  * @brief  Check for downstream message and parse if available
+  * @retval message_parse_result_t: MSG_NO_MESSAGE if no data, or parse result
+  */
+  message_parse_result_t APP_CheckForDownstreamMessage(void)
+  {
+      /* Check for downstream data (tested for datalink validity) and parse if available */
+      if (UART_CheckForDownstreamData(&if_downstream))
+      {
+          /* Parse the received message */
+          message_parse_result_t result = MESSAGE_Parse(&downstream_msg);
+          UART_CountParseResult(&if_downstream, result);
+          
+          /* Update status mirror and settings cache if message was parsed successfully */
+          if (result == MSG_OK)
+          {
+              APP_UpdateStatusMirror(DS_DEVICE, &downstream_msg);
+              APP_UpdateSettings(&downstream_msg);
+          }
+          
+          return result;
+      }
+      
+      /* No message received */
+      return MSG_NO_MESSAGE;
+  }
+
+/**
+  * @brief  Get age of last downstream status in milliseconds
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @retval uint32_t: Age in milliseconds, or UINT32_MAX if no status received yet
+  */
+static uint32_t APP_GetStatusAge(uint8_t device)
+{
+    if (status_mirror[device].sequence == 0)
+    {
+        return UINT32_MAX;  /* No status received yet */
+    }
+    
+    uint32_t current_time = HAL_GetTick();
+    return (current_time - status_mirror[device].time);
+}
+
+/**
+  * @brief  Copy a downstream status frame into the status mirror of a validator
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @param  msg: Parsed downstream message, ignored if not an ID003 status
+  * @retval None
+  */
+static void APP_UpdateStatusMirror(uint8_t device, const message_t* msg)
+{
+    status_mirror_t* mirror = &status_mirror[device];
+    message_t* status = &mirror->status;
+
+    uint8_t previous_opcode = (mirror->sequence != 0) ? status->opcode : 0;
+
+    if (msg->protocol != PROTO_ID003 || !PROTO_IsId003StatusCode(msg->opcode)) return;
+
+    if (mirror->sequence == 0 || status->opcode != msg->opcode || status->data_length != msg->data_length ||
+        memcmp(status->data, msg->data, msg->data_length) != 0)
+    {
+        mirror->changed = 1;
+    }
+    *status = *msg;
+    mirror->time = HAL_GetTick();
+    mirror->sequence++;
+    APP_QueueEvents(device, previous_opcode);
+}
+
+/**
+  * @brief  Record response time and status age of a POLL answer
+  * @param  device: Validator whose status answered the POLL
+  * @retval None
+  */
+static void APP_RecordPollTiming(uint8_t device)
+{
+    uint32_t response_time = HAL_GetTick() - ds_context.poll_rx_time;
+    uint32_t status_age = APP_GetStatusAge(device);
+
+    poll_timing.polls++;
+    poll_timing.response_time_total_ms += response_time;
+    if (response_time > poll_timing.response_time_max_ms) poll_timing.response_time_max_ms = response_time;
+    poll_timing.status_age_total_ms += status_age;
+    if (status_age > poll_timing.status_age_max_ms) poll_timing.status_age_max_ms = status_age;
+}
+
+/**
+  * @brief  Queue the upstream events of a downstream status transition
+  * @note   Called for every status frame, after the mirror is updated. The
+  *         transient ID003 states (REJECTING, VEND VALID, STACKED, RETURNING)
+  *         can be shorter than the controller poll interval: queued events are
+  *         answered to POLL until the controller acknowledged them.
+  *         VEND VALID is acknowledged here, on every frame, so the validator
+  *         does not depend on the controller poll rate either. A bill in
+  *         escrow is offered to the acceptor pool, which hands the bills of
+  *         the validators to the controller one at a time
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @param  previous_opcode: Previous status, 0 if none
+  * @retval None
+  */
+static void APP_QueueEvents(uint8_t device, uint8_t previous_opcode)
+{
+    status_mirror_t* mirror = &status_mirror[device];
+    message_t* status = &mirror->status;
+    uint8_t transition = (status->opcode != previous_opcode);
+
+    switch (status->opcode)
+    {
+        case ID003_STATUS_ESCROW:
+            mirror->bill_type = APP_GetEscrowBillType(device, status->data[0]);
+            mirror->bill_credited = 0;
+            if (mirror->bill_type != POOL_NO_BILL)
+            {
+                POOL_OfferEscrow(&bill_pool, device, mirror->bill_type);
+            }
+            else if (transition)
+            {
+                /* no CCNET bill type: the controller could not credit it */
+                LOG_Warn("Bill in escrow is not in the bill table, returned");
+                APP_DeviceRequest(device, ID003_RETURN, NULL, 0, ID003_STATUS_ACK, 0, DS_RESPONSE_TIMEOUT_MS, NULL);
+            }
+            break;
+
+        case ID003_STATUS_REJECTING:
+            if (transition)
+            {
+                message_t reject;
+
+                PROTO_MapStatusCode(status, &reject);   /* reject reason in data[0] */
+                APP_PushEvent(reject.opcode, reject.data, 1, EVENT_PRIORITY_LOW);
+            }
+            break;
+
+        case ID003_STATUS_VEND_VALID:
+            /* there will be no response to ACK_TO_VEND_VALID: the line is held for the timeout */
+            APP_DeviceRequest(device, ID003_ACK_TO_VEND_VALID, NULL, 0, TRANSACTION_ANY_OPCODE, TRANSACTION_ANY_LENGTH,
+                              DS_RESPONSE_TIMEOUT_MS, NULL);
+            /* fall through: credit on the first of VEND VALID or STACKED */
+        case ID003_STATUS_STACKED:
+            if (!mirror->bill_credited && mirror->bill_type != POOL_NO_BILL)
+            {
+                APP_PushEvent(CCNET_STATUS_BILL_STACKED, &mirror->bill_type, 1, EVENT_PRIORITY_HIGH);
+                mirror->bill_credited = 1;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (transition && previous_opcode == ID003_STATUS_RETURNING && mirror->bill_type != POOL_NO_BILL)
+    {
+        APP_PushEvent(CCNET_STATUS_BILL_RETURNED, &mirror->bill_type, 1, EVENT_PRIORITY_HIGH);
+    }
+
+    /* Bill stacked or returned: the bill waiting on the other validator is next */
+    switch (status->opcode)
+    {
+        case ID003_STATUS_ESCROW:
+        case ID003_STATUS_HOLDING:
+        case ID003_STATUS_STACKING:
+        case ID003_STATUS_VEND_VALID:
+        case ID003_STATUS_STACKED:
+        case ID003_STATUS_RETURNING:
+        case ID003_STATUS_PAUSE:
+            break;
+
+        default:
+            POOL_ReleaseEscrow(&bill_pool, device);
+            break;
+    }
+}
+
+/**
+  * @brief  Queue an upstream event, log if it is lost
+  * @param  opcode: CCNET status code
+  * @param  data: Status data
+  * @param  data_length: Status data length
+  * @param  priority: Event priority
+  * @retval None
+  */
+static void APP_PushEvent(uint8_t opcode, uint8_t* data, uint8_t data_length, event_priority_t priority)
+{
+    if (!EVENTS_Push(&upstream_events, opcode, data, data_length, priority))
+    {
+        LOG_Warn("Upstream event dropped, event queue full");
+    }
+}
+
+/**
+  * @brief  Check for upstream message and parse if available
+  * @retval message_parse_result_t: MSG_NO_MESSAGE if no data, or parse result
+  */
+message_parse_result_t APP_CheckForUpstreamMessage(void)
+{
+    /* Check for upstream data and parse if available */
+    if (UART_CheckForUpstreamData())
+    {
+        /* Parse the received message */
+        message_parse_result_t result = MESSAGE_Parse(&upstream_msg);
+        UART_CountParseResult(&if_upstream, result);
+        return result;
+    }
+    
+    /* No message received */
+    return MSG_NO_MESSAGE;
+}
+
+
+
+/**
+  * @brief  Send a message to specified interface
+  * @param  interface: Pointer to interface configuration (upstream or downstream)
+  * @param  opcode: Message opcode
+  * @param  data: Pointer to message data (NULL if no data)
+  * @param  data_length: Length of data (0 if no data)
+  * @note   Non-blocking: the message is queued for DMA transmission
+  * @retval None
+  */
+static void APP_SendMessage(interface_config_t* interface, uint8_t opcode, uint8_t* data, uint8_t data_length)
+{
+    message_t tx_msg;
+
+    /* Upstream responses are sent from prebuilt frames */
+    if (interface == &if_upstream)
+    {
+        APP_Respond(opcode, data, data_length);
+        return;
+    }
+    LED_Flash(&hled2, 10);
+    
+    /* Create message ready for transmission (TX to downstream device) */
+    tx_msg = MESSAGE_Create(interface->protocol, MSG_DIR_TX, opcode, data, data_length);
+    /* create a copy of last request message and store to check for echo*/
+    ds_context.last_req_msg = MESSAGE_Create(interface->protocol, MSG_DIR_RX, tx_msg.opcode, tx_msg.data, tx_msg.length);
+
+    /* Log the message */
+    LOG_Debug("app.c: Sending message");
+    LOG_Proto(&tx_msg);
+
+    /* queue message for transmission. Dropped (queue full): the transaction times out */
+    UART_TransmitMessage(interface, &tx_msg);
+    
+
+}
+
+/**
+  * @brief  Respond upstream from a prebuilt frame
+  * @note   Short responses live in a direct mapped cache keyed by opcode and
+  *         data: a repeated status, event or GET STATUS answer costs a compare
+  *         and the DMA start. A miss builds the frame into its slot. Longer
+  *         responses have their own prebuilt frame, see APP_RespondBillTable
+  * @param  opcode: CCNET response opcode
+  * @param  data: Response data (NULL if no data)
+  * @param  data_length: Response data length
+  * @retval None
+  */
+static void APP_Respond(uint8_t opcode, const uint8_t* data, uint8_t data_length)
+{
+    ccnet_frame_t* frame;
+
+    if (data_length > CCNET_FRAME_MAX_DATA)
+    {
+        uint8_t raw[CCNET_FRAME_MAX];
+
+        if (data_length > CCNET_BILL_TABLE_DATA) return;
+        response_cache_stats.frame_builds++;
+        APP_SendFrame(opcode, raw, MESSAGE_BuildFrame(PROTO_CCNET, MSG_DIR_RX, opcode, data, data_length, raw));
+        return;
+    }
+
+    frame = &ccnet_frames[(uint8_t)(opcode + (opcode >> 4) + (data_length ? data[0] : 0)) % CCNET_FRAME_SLOTS];
+    if (frame->length == 0 || frame->opcode != opcode || frame->data_length != data_length ||
+        (data_length && memcmp(frame->data, data, data_length) != 0))
+    {
+        frame->opcode = opcode;
+        frame->data_length = data_length;
+        if (data_length) utils_memcpy(frame->data, data, data_length);
+        frame->length = MESSAGE_BuildFrame(PROTO_CCNET, MSG_DIR_RX, opcode, data, data_length, frame->raw);
+        response_cache_stats.frame_builds++;
+    }
+    else
+    {
+        response_cache_stats.frame_hits++;
+    }
+    APP_SendFrame(opcode, frame->raw, frame->length);
+}
+
+/**
+  * @brief  Send a complete response frame upstream
+  * @note   Queued for DMA first, then kept with its request for a
+  *         retransmission (NAK, repeated request) and logged
+  * @param  opcode: CCNET response opcode
+  * @param  raw: Frame bytes
+  * @param  length: Frame length
+  * @retval None
+  */
+static void APP_SendFrame(uint8_t opcode, const uint8_t* raw, uint8_t length)
+{
+    LED_Flash(&hled1, 10);
+    /* Dropped (queue full): the command stays unanswered, the repeat is answered from the cache */
+    if (UART_TransmitFrame(&if_upstream, raw, length))
+    {
+        APP_BootMark(&boot_timing.first_response_ms);
+        /* response time of the command being answered */
+        DISPATCH_Responded(&ccnet_dispatcher, HAL_GetTick());
+    }
+
+    response_cache.request = ccnet_request;
+    response_cache.opcode = opcode;
+    utils_memcpy(response_cache.raw, raw, length);
+    response_cache.length = length;
+    response_cache.time = HAL_GetTick();
+    response_cache.valid = 1;
+
+    APP_LogFrame(opcode, raw, length);
+}
+
+/**
+  * @brief  Log an upstream frame at protocol log level
+  * @note   The message structure is only filled in when the frame is logged
+  * @param  opcode: CCNET response opcode
+  * @param  raw: Frame bytes
+  * @param  length: Frame length
+  * @retval None
+  */
+static void APP_LogFrame(uint8_t opcode, const uint8_t* raw, uint8_t length)
+{
+    message_t msg;
+
+    if (g_config.log_level < LOG_LEVEL_PROTO) return;
+
+    msg.protocol = PROTO_CCNET;
+    msg.direction = MSG_DIR_RX;
+    msg.opcode = opcode;
+    msg.data_length = 0;
+    msg.length = length;
+    utils_memcpy(msg.raw, raw, length);
+    LOG_Proto(&msg);
+}
+
+/**
+  * @brief  Send a request to the downstream validator
+  * @note   Transmit function of the transaction engine
+  * @param  opcode: Request opcode
+  * @param  data: Pointer to request data (NULL if no data)
+  * @param  data_length: Length of data (0 if no data)
+  * @retval None
+  */
+static void APP_SendRequest(uint8_t opcode, uint8_t* data, uint8_t data_length)
+{
+    ds_context.last_req_time = HAL_GetTick();
+    /* operation (0x40-0x50) and setting (0xC0-0xC5) commands change the status: poll right after */
+    if ((opcode >= ID003_RESET && opcode <= ID003_ACK_TO_VEND_VALID) || (opcode >= ID003_ENABLE && opcode <= ID003_OPT_FUNC))
+    {
+        ds_context.poller.poll_now = 1;
+    }
+    APP_SendMessage(&if_downstream, opcode, data, data_length);
+}
+
+/**
+  * @brief  Queue a request for the downstream validator
+  * @note   Refused while auto-discovery switches the downstream interface: the
+  *         request would go out on a candidate protocol or baud rate. The
+  *         CCNET command then gets no answer and the controller repeats it
+  * @param  opcode: Request opcode
+  * @param  data: Request payload (NULL if no data)
+  * @param  data_length: Payload length
+  * @param  expected_opcode: Response opcode or TRANSACTION_ANY_OPCODE
+  * @param  expected_length: Response data length or TRANSACTION_ANY_LENGTH
+  * @param  timeout_ms: Response deadline
+  * @param  callback: Completion callback, NULL if the response is not needed
+  * @retval uint8_t: 1 if queued
+  */
+static uint8_t APP_Request(uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                           uint8_t expected_opcode, uint8_t expected_length,
+                           uint16_t timeout_ms, transaction_callback_t callback)
+{
+    if (DISCOVERY_IsRunning()) return 0;
+    return TRANSACTION_Submit(&ds_transactions, opcode, data, data_length, expected_opcode, expected_length,
+                              timeout_ms, callback);
+}
+
+/**
+  * @brief  Send a request to the second validator
+  * @note   Transmit function of the second transaction engine
+  * @param  opcode: Request opcode
+  * @param  data: Pointer to request data (NULL if no data)
+  * @param  data_length: Length of data (0 if no data)
+  * @retval None
+  */
+static void APP_SendSecondRequest(uint8_t opcode, uint8_t* data, uint8_t data_length)
+{
+    /* operation (0x40-0x50) and setting (0xC0-0xC5) commands change the status: poll right after */
+    if ((opcode >= ID003_RESET && opcode <= ID003_ACK_TO_VEND_VALID) || (opcode >= ID003_ENABLE && opcode <= ID003_OPT_FUNC))
+    {
+        second.poll_now = 1;
+    }
+    APP_SendMessage(&if_second, opcode, data, data_length);
+}
+
+/**
+  * @brief  Queue a request for one of the validators in the acceptor pool
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @param  opcode: Request opcode
+  * @param  data: Request payload (NULL if no data)
+  * @param  data_length: Payload length
+  * @param  expected_opcode: Response opcode or TRANSACTION_ANY_OPCODE
+  * @param  expected_length: Response data length or TRANSACTION_ANY_LENGTH
+  * @param  timeout_ms: Response deadline
+  * @param  callback: Completion callback, NULL if the response is not needed
+  * @retval uint8_t: 1 if queued
+  */
+static uint8_t APP_DeviceRequest(uint8_t device, uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                                 uint8_t expected_opcode, uint8_t expected_length,
+                                 uint16_t timeout_ms, transaction_callback_t callback)
+{
+    if (device == SECOND_DEVICE)
+    {
+        return SECOND_REQUEST(opcode, data, data_length, expected_opcode, expected_length, timeout_ms, callback);
+    }
+    return REQUEST(opcode, data, data_length, expected_opcode, expected_length, timeout_ms, callback);
+}
+
+
+/**
+  * @brief  Run the downstream handshake stage of the boot sequence
+  * @note   Downstream task, next to the background stages of APP_BootProcess.
+  *         Requests complete in APP_FirstPollDone and the bill table
+  *         callbacks, this function only advances the stage. Nothing waits
+  *         for the handshake: status polling starts with the first answered
+  *         poll, the bill table and identity requests go out between polls.
+  *         ID003 only: a ccTalk downstream is started by the bus owner
+  * @retval None
+  */
+static void APP_BootDownstream(void)
+{
+    static uint32_t last_warning_time = 0;
+
+    switch (ds_context.startup)
+    {
+        case DS_NOT_STARTED:
+        {
+            /* Send out first poll request */
+            if (!REQUEST(ID003_STATUS_REQ, NULL, 0, TRANSACTION_ANY_OPCODE, TRANSACTION_ANY_LENGTH,
+                         DS_FIRST_POLL_TIMEOUT_MS, APP_FirstPollDone)) break;
+            if (HAL_GetTick() - last_warning_time > 5000)
+            {
+                LOG_Warn("MCU startup sequence: waiting for downstream validator response");
+                last_warning_time = HAL_GetTick();
+            }
+            ds_context.startup = DS_FIRST_POLL_SENT;
+            break;
+        }
+
+        case DS_FIRST_POLL_SENT:
+            /* Waiting for first poll response. APP_FirstPollDone advances the state */
+            break;
+        
+        case DS_FIRST_POLL_RECEIVED_OK:
+            /* short delay after the validator response (or a failed bill table request) */
+            if (HAL_GetTick() - ds_context.startup_tick < ds_context.startup_delay_ms) break;
+            /* Send out bill table request */
+            ds_context.startup = DS_BILL_TABLE_REQUEST_SENT;
+            APP_GetBillTable(0);
+            break;
+
+        case DS_BILL_TABLE_REQUEST_SENT:
+            /* Wait for bill table response and downstream enable status */
+            if (ds_context.bill_table_fetch == BILL_TABLE_FETCHING) break;
+            /* A failed request is retried, also while the snapshot bill table is served */
+            if (ds_context.bill_table_fetch == BILL_TABLE_FAILED)
+            {
+                ds_context.startup = DS_FIRST_POLL_RECEIVED_OK;
+                ds_context.startup_tick = HAL_GetTick();
+                ds_context.startup_delay_ms = DS_BILL_TABLE_RETRY_MS;
+            }
+            else if (g_bill_table.is_loaded == 1)
+            {
+                ds_context.startup = DS_BILL_TABLE_RECEIVED_OK;
+                APP_BootMark(&boot_timing.bill_table_ms);
+                TABLE_UI_DisplayBillTable();
+            }
+            break;
+
+        case DS_BILL_TABLE_RECEIVED_OK:
+            /* Identity requests in the background, the snapshot is saved when they are done */
+            APP_RevalidateSnapshot();
+            ds_context.startup = DS_STARTUP_OK;
+            break;
+
+        default:
+            /* Startup is completed */
+            ds_context.startup = DS_STARTUP_OK;
+            break;
+    } /* end switch */
+}
+
+/**
+  * @brief  Process downstream polling based on configured period
+  * @note   A poll is only sent while no other request is pending, so the
+  *         response of a command sequence is never mixed up with a status.
+  *         Once the controller POLL cadence is learned, the poll is phase
+  *         locked: sent APP_GetPollLead() before the expected POLL, in the
+  *         last POLL interval before the polling period runs out. The status
+  *         is then fresh when the POLL arrives. Synchronous polling (period 0)
+  *         also polls ahead, every POLL, and answers without waiting.
+  * @param  polling_period_ms: Polling period, 0 for synchronous polling
+  * @retval None
+  */
+static void APP_DownstreamPolling(uint16_t polling_period_ms)
+{
+    uint32_t current_time = HAL_GetTick();
+    uint32_t elapsed = current_time - ds_context.poller.last_poll_time;
+    uint8_t phase_locked;
+    uint8_t due;
+    uint32_t slot;
+
+    phase_locked = APP_GetPhaseSlot(&slot) && (int32_t)(current_time - slot) >= 0;
+    
+    /* Periodic polling, skipped if disabled (period = 0) */
+    due = (polling_period_ms != 0) && (ds_context.poller.poll_now || elapsed >= polling_period_ms);
+
+    /* Phase-locked poll, once per expected POLL */
+    if (phase_locked && ds_context.poller.phase_events != upstream_cadence.events &&
+        (polling_period_ms == 0 || elapsed + CADENCE_GetInterval(&upstream_cadence) >= polling_period_ms))
+    {
+        due = 1;
+    }
+    
+    if (due && TRANSACTION_IsIdle(&ds_transactions))
+        {
+            /* Send status request. The response updates downstream_msg */
+            if (REQUEST(ID003_STATUS_REQ, NULL, 0, TRANSACTION_ANY_OPCODE, TRANSACTION_ANY_LENGTH,
+                        DS_RESPONSE_TIMEOUT_MS, APP_PollDone))
+            {
+                /* Set state to sent */
+                ds_context.poller.state = POLL_SENT;
+                ds_context.poller.last_poll_time = current_time;
+                ds_context.poller.poll_now = 0;
+                if (phase_locked) ds_context.poller.phase_events = upstream_cadence.events;
+            }
+        }
+}
+
+/**
+  * @brief  Record the time since reset of a boot step, once
+  * @note   HAL tick, started by HAL_Init right after reset. Clamped to 1 ms:
+  *         0 means not reached
+  * @param  mark: Boot timing field
+  * @retval None
+  */
+static void APP_BootMark(uint32_t* mark)
+{
+    uint32_t now = HAL_GetTick();
+
+    if (*mark == 0) *mark = (now == 0) ? 1 : now;
+}
+
+/**
+  * @brief  Run the next background boot stage
+  * @note   APP_Init only brings up what CCNET needs. USB enumeration, the
+  *         configuration banner and the test suites follow here, while the
+  *         upstream task already answers the controller. One test suite per
+  *         pass. The downstream handshake runs in APP_BootDownstream
+  * @retval None
+  */
+static void APP_BootProcess(void)
+{
+    switch (boot_stage)
+    {
+        case BOOT_STAGE_USB:
+            if (USB_IsConfigured()) APP_BootMark(&boot_timing.usb_ms);
+            else if (HAL_GetTick() - boot_timing.links_ms < BOOT_USB_WAIT_MS) break;
+            boot_stage = BOOT_STAGE_BANNER;
+            break;
+
+        case BOOT_STAGE_BANNER:
+            CONFIGUI_ShowConfiguration();
+            LOG_Info("Application started");
+            LOG_InfoUint("CCNET answered from (ms after reset): ", boot_timing.links_ms);
+            LOG_Info("Press button for configuration menu (will stop application)");
+            LOG_Info("Long press for reset (will restart application)");
+            LOG_Info("Polling downstream validator for status and bill table\r\n");
+            boot_stage = BOOT_STAGE_TESTS;
+            break;
+
+        case BOOT_STAGE_TESTS:
+            /* Tests that are enabled in tests.c, one suite per pass */
+            if (!TESTS_RunStep()) break;
+            APP_BootMark(&boot_timing.background_ms);
+            boot_stage = BOOT_STAGE_DONE;
+            break;
+
+        case BOOT_STAGE_DONE:
+            if (boot_reported || boot_timing.first_response_ms == 0) break;
+            boot_reported = 1;
+            LOG_InfoUint("Reset to first CCNET response (ms): ", boot_timing.first_response_ms);
+            if (boot_timing.first_response_ms > BOOT_TARGET_MS) LOG_Warn("First CCNET response later than the boot target");
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+  * @brief  Put the ccTalk peripherals on the bus owner
+  * @note   At startup and after discovery. Only on a ccTalk downstream: the
+  *         parser then accepts responses from every peripheral address
+  * @retval None
+  */
+static void APP_StartCctalkBus(void)
+{
+    uint8_t addresses[CCBUS_MAX_DEVICES];
+
+    CCBUS_Init(&cctalk_bus, if_downstream.datalink.cctalk_source_address, HAL_GetTick());
+    if (if_downstream.protocol != PROTO_CCTALK)
+    {
+        MESSAGE_SetCctalkPeers(NULL, 0);
+        return;
+    }
+
+    for (uint8_t i = 0; i < sizeof(cctalk_devices) / sizeof(cctalk_devices[0]); i++)
+    {
+        ccbus_device_config_t device = cctalk_devices[i];
+
+        if (device.address == 0) device.address = if_downstream.datalink.cctalk_dest_address;
+        if (CCBUS_AddDevice(&cctalk_bus, &device) == CCBUS_NO_DEVICE)
+        {
+            LOG_Warn("ccTalk peripheral not added: address in use");
+            continue;
+        }
+        addresses[cctalk_bus.count - 1] = device.address;
+    }
+    MESSAGE_SetCctalkPeers(addresses, cctalk_bus.count);
+}
+
+/**
+  * @brief  Send the next due ccTalk poll
+  * @note   The bus owner times out the request on the line first and sends
+  *         nothing while a request waits for its response. The bus owner and
+  *         the transaction engine share the line: a poll is only sent while
+  *         the engine is idle, and the engine is held while a poll is on the
+  *         line. A response therefore always belongs to exactly one of them
+  * @retval None
+  */
+static void APP_CctalkBusPolling(void)
+{
+    uint8_t frame[CCBUS_FRAME_MAX];
+    uint32_t now = HAL_GetTick();
+
+    /* Verified echo mode: a poll corrupted on the line is repeated */
+    if (UART_CheckEchoCollision(&if_downstream))
+    {
+        uint8_t index = CCBUS_Collision(&cctalk_bus, now);
+
+        if (index != CCBUS_NO_DEVICE)
+        {
+            LOG_InfoUint("ccTalk echo collision, peripheral address ", cctalk_bus.devices[index].config.address);
+        }
+    }
+    CCBUS_Process(&cctalk_bus, now);
+    /* No peripheral ever answered: probe the other protocol, baud rates and parity */
+    if (!ds_context.discovery_done && CCBUS_IsSilent(&cctalk_bus, DISCOVERY_AFTER_FAILED_POLLS))
+    {
+        ds_context.discovery_done = 1;
+        ds_context.discovery_requested = 1;     /* runs from the main loop */
+        return;
+    }
+    if (TRANSACTION_IsIdle(&ds_transactions) && CCBUS_Next(&cctalk_bus, now, frame) != CCBUS_NO_DEVICE)
+    {
+        /* Dropped (queue full): the poll times out */
+        UART_TransmitFrame(&if_downstream, frame, CCBUS_FRAME_MAX);
+    }
+    TRANSACTION_SetHold(&ds_transactions, CCBUS_IsBusy(&cctalk_bus));
+}
+
+/**
+  * @brief  Hand a ccTalk response to the bus owner
+  * @note   The source address (raw[2]) tells which peripheral answered
+  * @retval None
+  */
+static void APP_CctalkBusResponse(void)
+{
+    uint8_t index = CCBUS_Response(&cctalk_bus, downstream_msg.raw[2], downstream_msg.data,
+                                   downstream_msg.data_length, HAL_GetTick());
+
+    /* Line free again: queued transactions may go */
+    TRANSACTION_SetHold(&ds_transactions, CCBUS_IsBusy(&cctalk_bus));
+    if (index == CCBUS_NO_DEVICE)
+    {
+        LOG_Warn("ccTalk response without a request on the line");
+    }
+    else if (cctalk_bus.devices[index].new_events)
+    {
+        LOG_InfoUint("ccTalk events, peripheral address ", cctalk_bus.devices[index].config.address);
+    }
+}
+
+/**
+  * @brief  Start the second ID003 validator on UART3
+  * @note   Same protocol settings as the validator on UART2. First poll, bill
+  *         table and enables follow from APP_SecondLinkProcess
+  * @retval None
+  */
+static void APP_StartSecondLink(void)
+{
+    if_second = if_downstream;
+    if_second.phy.uart_handle = &huart3;
+    MESSAGE_Init(&second_msg, PROTO_ID003, MSG_DIR_RX);
+    UART_Init(&if_second, &second_msg);
+    TRANSACTION_Init(&second_transactions, &if_second, APP_SendSecondRequest);
+
+    second.state = SECOND_FIRST_POLL;
+    second.inhibit = 1;
+    second.reset_tick = HAL_GetTick() - SECOND_RETRY_MS;
+    LOG_Info("Second validator: ID003 on UART3");
+}
+
+/**
+  * @brief  Run the second validator link
+  * @note   Downstream task, one request at a time on its own engine. The bill
+  *         table is merged into the acceptor pool once, then the validator is
+  *         polled like the first one (same period, adapted to its own status;
+  *         synchronous polling: on every controller POLL). The controller mask
+  *         is applied once the validator is initialized
+  * @retval None
+  */
+static void APP_SecondLinkProcess(void)
+{
+    uint32_t now = HAL_GetTick();
+    uint8_t retry_due = (now - second.retry_tick >= second.retry_delay_ms);
+    uint16_t polling_period_ms;
+
+    if (!TRANSACTION_IsIdle(&second_transactions)) return;
+
+    switch (second.state)
+    {
+        case SECOND_FIRST_POLL:
+            if (!retry_due) break;
+            SECOND_REQUEST(ID003_STATUS_REQ, NULL, 0, TRANSACTION_ANY_OPCODE, TRANSACTION_ANY_LENGTH,
+                           DS_FIRST_POLL_TIMEOUT_MS, APP_SecondFirstPollDone);
+            break;
+
+        case SECOND_BILL_TABLE:
+            if (!retry_due) break;
+            SECOND_REQUEST(ID003_CURRENCY_ASSIGN_REQ, NULL, 0, ID003_CURRENCY_ASSIGN_REQ, TRANSACTION_ANY_LENGTH,
+                           DS_BILL_TABLE_TIMEOUT_MS, APP_SecondBillTableDone);
+            break;
+
+        case SECOND_RUNNING:
+            if (second.enable_pending && APP_GetPoolState(SECOND_DEVICE) >= POOL_STATE_DISABLED)
+            {
+                APP_SecondEnable();
+                break;
+            }
+            if (second.join_requested)
+            {
+                /* Failed or restarted since ENABLE BILL TYPES: NAK, the mask follows its initialization */
+                second.join_requested = 0;
+                APP_EnableBillTypesDone(0);
+            }
+            polling_period_ms = APP_GetPollingPeriod(SECOND_DEVICE);
+            if (second.poll_now || (polling_period_ms != 0 && now - second.last_poll_time >= polling_period_ms))
+            {
+                if (SECOND_REQUEST(ID003_STATUS_REQ, NULL, 0, TRANSACTION_ANY_OPCODE, TRANSACTION_ANY_LENGTH,
+                                   DS_RESPONSE_TIMEOUT_MS, APP_SecondPollDone))
+                {
+                    second.last_poll_time = now;
+                    second.poll_now = 0;
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+  * @brief  Handle a frame of the second validator
+  * @note   Statuses feed its status mirror. The controller does not see a
+  *         power-up of the second validator while the first one answers POLL,
+  *         so it is reset from here and gets the controller mask again
+  * @retval None
+  */
+static void APP_CheckForSecondMessage(void)
+{
+    message_parse_result_t result;
+
+    if (!UART_CheckForDownstreamData(&if_second)) return;
+
+    result = MESSAGE_Parse(&second_msg);
+    UART_CountParseResult(&if_second, result);
+    if (result == MSG_OK)
+    {
+        LOG_Proto(&second_msg);
+        APP_UpdateStatusMirror(SECOND_DEVICE, &second_msg);
+
+        if (PROTO_IsId003StatusCode(second_msg.opcode) && second_msg.opcode != ID003_STATUS_INITIALIZE &&
+            APP_GetPoolState(SECOND_DEVICE) == POOL_STATE_POWER_UP &&
+            HAL_GetTick() - second.reset_tick >= SECOND_RETRY_MS)
+        {
+            second.reset_tick = HAL_GetTick();
+            second.rows = 0;
+            second.inhibit = 1;
+            second.enable_pending = second.enable_known;
+            SECOND_REQUEST(ID003_RESET, NULL, 0, ID003_STATUS_ACK, 0, DS_RESET_TIMEOUT_MS, NULL);
+        }
+    }
+    TRANSACTION_HandleResponse(&second_transactions, &second_msg, result);
+}
+
+/**
+  * @brief  Apply the controller ENABLE BILL TYPES mask to the second validator
+  * @note   ENABLE with its bill table rows, then INHIBIT: inhibited if it takes
+  *         none of the enabled bill types, so it reports disabled
+  * @retval None
+  */
+static void APP_SecondEnable(void)
+{
+    uint8_t enable_data[2];
+
+    APP_GetEnableData(SECOND_DEVICE, enable_data);
+    second.enable_pending = 0;
+    second.enable_join = second.join_requested;
+    second.join_requested = 0;
+    if (!SECOND_REQUEST(ID003_ENABLE, enable_data, 2, ID003_ENABLE, 2, DS_RESPONSE_TIMEOUT_MS, APP_SecondEnableDone))
+    {
+        APP_SecondEnableFinished(0);
+    }
+}
+
+/**
+  * @brief  End of an enable sequence of the second validator
+  * @note   A failed sequence is not repeated: the controller repeats ENABLE
+  *         BILL TYPES after the NAK, and a restarted validator gets the mask
+  * @param  ok: 1 if ENABLE and INHIBIT were acknowledged
+  * @retval None
+  */
+static void APP_SecondEnableFinished(uint8_t ok)
+{
+    if (!second.enable_join) return;
+    second.enable_join = 0;
+    APP_EnableBillTypesDone(ok);
+}
+
+/**
+  * @brief  Start the second validator again after unanswered polls
+  * @note   First poll and bill table again, then the controller mask. Its bill
+  *         in escrow no longer holds up the first validator
+  * @retval None
+  */
+static void APP_SecondLost(void)
+{
+    LOG_Warn("Second validator not answering, starting it again");
+    second.state = SECOND_FIRST_POLL;
+    second.retry_tick = HAL_GetTick();
+    second.retry_delay_ms = SECOND_RETRY_MS;
+    second.failed_polls = 0;
+    second.rows = 0;
+    second.inhibit = 1;
+    second.enable_pending = second.enable_known;
+    POOL_ReleaseEscrow(&bill_pool, SECOND_DEVICE);
+    if (second.join_requested)
+    {
+        second.join_requested = 0;
+        APP_EnableBillTypesDone(0);
+    }
+}
+
+/**
+  * @brief  Get the acceptor pool state class of a validator
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @retval pool_state_t: From its last status, unknown without a recent one
+  */
+static pool_state_t APP_GetPoolState(uint8_t device)
+{
+    if (APP_GetStatusAge(device) >= DOWNSTREAM_MSG_TTL_MS) return POOL_STATE_UNKNOWN;
+
+    switch (status_mirror[device].status.opcode)
+    {
+        case ID003_STATUS_POWER_UP:
+        case ID003_STATUS_POWER_UP_BIA:
+        case ID003_STATUS_POWER_UP_BIS:
+        case ID003_STATUS_INITIALIZE:
+            return POOL_STATE_POWER_UP;
+
+        case ID003_STATUS_DISABLE_INHIBIT:
+            return POOL_STATE_DISABLED;
+
+        case ID003_STATUS_STACKER_FULL:
+        case ID003_STATUS_STACKER_OPEN:
+        case ID003_STATUS_ACCEPTOR_JAM:
+        case ID003_STATUS_STACKER_JAM:
+        case ID003_STATUS_PAUSE:
+        case ID003_STATUS_CHEATED:
+        case ID003_STATUS_FAILURE:
+        case ID003_STATUS_COMM_ERROR:
+            return POOL_STATE_FAILURE;
+
+        case ID003_STATUS_IDLING:
+            return POOL_STATE_IDLE;
+
+        default:
+            return POOL_STATE_BUSY;     /* accepting, escrow, stacking, rejecting, returning */
+    }
+}
+
+/**
+  * @brief  Select the validator whose status answers the controller
+  * @note   A validator without a recent status gives up its escrow, so the
+  *         bill of the other one is not held up
+  * @retval uint8_t: DS_DEVICE or SECOND_DEVICE
+  */
+static uint8_t APP_SelectDevice(void)
+{
+    for (uint8_t device = 0; device < bill_pool.devices; device++)
+    {
+        pool_state_t state = APP_GetPoolState(device);
+
+        if (state == POOL_STATE_UNKNOWN) POOL_ReleaseEscrow(&bill_pool, device);
+        POOL_SetState(&bill_pool, device, state);
+    }
+    return POOL_Select(&bill_pool);
+}
+
+/**
+  * @brief  CCNET bill type of the bill a validator holds in escrow
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @param  denom_nr: ID003 denomination code of the escrow status
+  * @retval uint8_t: Bill type, POOL_NO_BILL if not in the bill table
+  */
+static uint8_t APP_GetEscrowBillType(uint8_t device, uint8_t denom_nr)
+{
+    uint8_t count = (device == SECOND_DEVICE) ? second.count : g_bill_table.count;
+
+    for (uint8_t row = 0; row < count; row++)
+    {
+        uint8_t code = (device == SECOND_DEVICE) ? second.denoms[row] : g_bill_table.denoms[row].id003_denom_nr;
+
+        if (code == denom_nr) return POOL_ToBillType(&bill_pool, device, row);
+    }
+    return POOL_NO_BILL;
+}
+
+/**
+  * @brief  Merge the bill tables of the validators into the CCNET bill types
+  * @note   After either bill table changed. The first validator keeps its bill
+  *         types, the second one adds its other values after them
+  * @retval None
+  */
+static void APP_MergeBillTables(void)
+{
+    uint16_t values[POOL_DEVICE_ROWS];
+    uint8_t count = (g_bill_table.count < POOL_DEVICE_ROWS) ? g_bill_table.count : POOL_DEVICE_ROWS;
+
+    for (uint8_t row = 0; row < count; row++) values[row] = g_bill_table.denoms[row].value;
+    POOL_SetDevice(&bill_pool, DS_DEVICE, values, count);
+    POOL_Merge(&bill_pool);
+    if (bill_pool.dropped) LOG_Warn("Acceptor pool: more denominations than CCNET bill types");
+    bill_table_frame.length = 0;    /* rebuilt on the next GET BILL TABLE */
+}
+
+/**
+  * @brief  Enabled bill table rows of a validator for a CCNET bill type mask
+  * @note   No bill table known yet: bill type n is row n of the first
+  *         validator, as without the pool
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @param  bill_types: CCNET enabled bill types
+  * @retval uint32_t: Enabled rows, bit n is bill table row n
+  */
+static uint32_t APP_RouteEnable(uint8_t device, uint32_t bill_types)
+{
+    if (bill_pool.count == 0) return (device == DS_DEVICE) ? bill_types : 0;
+    return POOL_RouteEnable(&bill_pool, device, bill_types);
+}
+
+/**
+  * @brief  CCNET bill types enabled by the bill table rows of a validator
+  * @note   The reverse of APP_RouteEnable
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @param  rows: Enabled rows, bit n is bill table row n
+  * @retval uint32_t: CCNET enabled bill types
+  */
+static uint32_t APP_MergeEnable(uint8_t device, uint32_t rows)
+{
+    if (bill_pool.count == 0) return (device == DS_DEVICE) ? rows : 0;
+    return POOL_MergeEnable(&bill_pool, device, rows);
+}
+
+/**
+  * @brief  Value of an ID003 denomination: coefficient * 10^exponent
+  * @param  coefficient: Currency assignment coefficient
+  * @param  exponent: Currency assignment exponent
+  * @retval uint16_t: Value in currency units
+  */
+static uint16_t APP_DenomValue(uint8_t coefficient, uint8_t exponent)
+{
+    uint16_t value = coefficient;
+
+    for (uint8_t e = 0; e < exponent; e++)
+    {
+        value *= 10;
+    }
+    return value;
+}
+
+/**
+  * @brief  Get the time of the next phase-locked poll
+  * @param  slot: Filled with the send time (ms) if the POLL cadence is locked
+  * @retval uint8_t: 1 if locked
+  */
+static uint8_t APP_GetPhaseSlot(uint32_t* slot)
+{
+    if (!CADENCE_IsLocked(&upstream_cadence, HAL_GetTick())) return 0;
+
+    *slot = CADENCE_NextExpected(&upstream_cadence) - APP_GetPollLead();
+    return 1;
+}
+
+/**
+  * @brief  Get how long before the expected POLL the phase-locked poll is sent
+  * @note   Downstream response time plus twice the POLL jitter and a guard.
+  *         Until a response time is measured the response timeout is used
+  * @retval uint16_t: Lead time in ms
+  */
+static uint16_t APP_GetPollLead(void)
+{
+    uint16_t rtt_ms = ds_context.poller.rtt_ms ? ds_context.poller.rtt_ms : DS_RESPONSE_TIMEOUT_MS;
+
+    return rtt_ms + 2 * CADENCE_GetJitter(&upstream_cadence) + DS_PHASE_GUARD_MS;
+}
+
+/**
+  * @brief  Periodic poll completion, measures the downstream response time
+  * @param  result: Transaction result
+  * @param  response: Status response (updates the status mirror on its own)
+  * @retval None
+  */
+static void APP_PollDone(transaction_result_t result, const message_t* response)
+{
+    uint16_t sample = (uint16_t)(HAL_GetTick() - ds_context.poller.last_poll_time);
+
+    (void)response;
+    if (result != TRANSACTION_OK) return;
+
+    /* running average, 1/4 weight, rounded up */
+    if (ds_context.poller.rtt_ms == 0) ds_context.poller.rtt_ms = sample ? sample : 1;
+    else ds_context.poller.rtt_ms = (uint16_t)((3 * ds_context.poller.rtt_ms + sample + 3) / 4);
+}
+
+/**
+  * @brief  Get the downstream polling period for the current status
+  * @note   Adaptive polling (both bounds in g_config set): fast while a bill
+  *         is handled, where the validator waits for the next command, slow
+  *         while idle, disabled or failed. The configured polling period is
+  *         used for all other states and when adaptive polling is off.
+  *         0 is synchronous polling and is never adapted.
+  * @param  device: DS_DEVICE or SECOND_DEVICE, adapted to its own status
+  * @retval uint16_t: Polling period in milliseconds
+  */
+static uint16_t APP_GetPollingPeriod(uint8_t device)
+{
+    uint16_t polling_period_ms = if_downstream.datalink.polling_period_ms;
+
+    if (polling_period_ms == 0 || g_config.poll_fast_ms == 0 || g_config.poll_slow_ms == 0 ||
+        status_mirror[device].sequence == 0)
+    {
+        return polling_period_ms;
+    }
+
+    switch (status_mirror[device].status.opcode)
+    {
+        case ID003_STATUS_ACCEPTING:
+        case ID003_STATUS_ESCROW:
+        case ID003_STATUS_STACKING:
+        case ID003_STATUS_VEND_VALID:
+        case ID003_STATUS_STACKED:
+        case ID003_STATUS_REJECTING:
+        case ID003_STATUS_RETURNING:
+            return g_config.poll_fast_ms;
+
+        case ID003_STATUS_IDLING:
+        case ID003_STATUS_DISABLE_INHIBIT:
+        case ID003_STATUS_STACKER_FULL:
+        case ID003_STATUS_STACKER_OPEN:
+        case ID003_STATUS_ACCEPTOR_JAM:
+        case ID003_STATUS_STACKER_JAM:
+        case ID003_STATUS_CHEATED:
+        case ID003_STATUS_FAILURE:
+            return g_config.poll_slow_ms;
+
+        default:
+            return polling_period_ms;   /* power up, initialize, holding, pause */
+    }
+}
+
+/**
+  * @brief  Get bill table from downstream validator
+  * @note   Non-blocking: currency assignment, inhibit and enable status are
+  *         requested in sequence, APP_BillTableDone is called at the end
+  * @param  respond: 1 to respond with the bill table upstream when done
+  * @retval None
+  */
+static void APP_GetBillTable(uint8_t respond)
+{
+    ds_context.bill_table_respond |= respond;
+    if (ds_context.bill_table_fetch == BILL_TABLE_FETCHING) return;
+
+    /* Check protocol type */
+    if (if_downstream.protocol == PROTO_ID003)
+    {
+        /* Request currency assignment/bill table from ID003 validator */
+        ds_context.bill_table_fetch = BILL_TABLE_FETCHING;
+        if (!REQUEST(ID003_CURRENCY_ASSIGN_REQ, NULL, 0, ID003_CURRENCY_ASSIGN_REQ, TRANSACTION_ANY_LENGTH,
+                     DS_BILL_TABLE_TIMEOUT_MS, APP_CurrencyAssignDone))
+        {
+            APP_BillTableDone(0);
+        }
+    } /* end if PROTO_ID003 */
+    else
+    {
+        APP_BillTableDone(0);
+    }
+}
+
+/**
+  * @brief  End of the bill table request sequence
+  * @param  ok: 1 if the bill table was loaded
+  * @retval None
+  */
+static void APP_BillTableDone(uint8_t ok)
+{
+    ds_context.bill_table_fetch = ok ? BILL_TABLE_IDLE : BILL_TABLE_FAILED;
+    if (ds_context.bill_table_respond)
+    {
+        ds_context.bill_table_respond = 0;
+        APP_RespondBillTable();
+    }
+}
+
+/**
+  * @brief  Currency assignment response: parse the ID003 bill table
+  * @param  result: Transaction result
+  * @param  response: ID003 currency assignment response
+  * @retval None
+  */
+static void APP_CurrencyAssignDone(transaction_result_t result, const message_t* response)
+{
+    if (result != TRANSACTION_OK)
+    {
+        LOG_Warn("APP_GET_BILL_TABLE: failed");
+        APP_BillTableDone(0);
+        return;
+    }
+
+    LOG_Debug("APP_GET_BILL_TABLE: parsing ID003 bill table");
+    
+    /* Parse ID003 currency assignment data */
+    /* Format: groups of 4 bytes: denom_nr, country_code, coefficient, exponent */
+    uint8_t num_denoms = response->data_length / 4;
+    g_bill_table.count = 0;
+    
+    for (uint8_t i = 0; i < num_denoms; i++)
+    {
+        uint8_t offset = i * 4;
+        uint8_t denom_nr = response->data[offset];
+        uint8_t country_code = response->data[offset + 1];
+        uint8_t coefficient = response->data[offset + 2];
+        uint8_t exponent = response->data[offset + 3];
+        
+        /* Skip if coefficient is zero */
+        if (coefficient == 0)
+        {
+            continue;
+        }
+        
+        /* Calculate value: coefficient * 10^exponent */
+        uint16_t value = APP_DenomValue(coefficient, exponent);
+        
+        /* Store in bill table */
+        if (g_bill_table.count < MAX_BILL_DENOMS)
+        {
+            g_bill_table.denoms[g_bill_table.count].id003_denom_nr = denom_nr;
+            g_bill_table.denoms[g_bill_table.count].id003_denom_bitnr = (denom_nr & 0x0F) - 1; /* Extract bit number from denom_nr */
+            g_bill_table.denoms[g_bill_table.count].value = value;
+            g_bill_table.denoms[g_bill_table.count].ccnet_bitnr = g_bill_table.count; /* CCNET bit number maps sequentially */
+            g_bill_table.denoms[g_bill_table.count].country_code = country_code;
+            g_bill_table.count++;
+        }
+        
+    }
+    
+    LOG_Info("Bill table loaded from downstream validator");
+    g_bill_table.is_loaded = 1;
+    APP_MergeBillTables();
+
+    /* Get downstream bill status. Mainly for bill table display at startup and in config menu */
+    g_bill_table.ds_enabled_bills = 0;
+
+    /* first: request inhibit status*/
+    if (!REQUEST(ID003_INHIBIT_REQ, NULL, 0, ID003_INHIBIT_REQ, 1, DS_RESPONSE_TIMEOUT_MS, APP_BillTableInhibitDone))
+    {
+        APP_BillTableDone(1);
+    }
+}
+
+/**
+  * @brief  Inhibit status response of the bill table request sequence
+  * @param  result: Transaction result
+  * @param  response: ID003 inhibit status response
+  * @retval None
+  */
+static void APP_BillTableInhibitDone(transaction_result_t result, const message_t* response)
+{
+    if (result != TRANSACTION_OK)
+    {
+        LOG_Warn("No ID003_INHIBIT_REQ response");
+        APP_BillTableDone(1);
+        return;
+    }
+
+    /* second: request enable status*/
+    if (response->data[0] != 0 ||
+        !REQUEST(ID003_ENABLE_REQ, NULL, 0, ID003_ENABLE_REQ, 2, DS_RESPONSE_TIMEOUT_MS, APP_BillTableEnableDone))
+    {
+        APP_BillTableDone(1);
+    }
+}
+
+/**
+  * @brief  Enable status response of the bill table request sequence
+  * @param  result: Transaction result
+  * @param  response: ID003 enable status response
+  * @retval None
+  */
+static void APP_BillTableEnableDone(transaction_result_t result, const message_t* response)
+{
+    (void)response;
+
+    /* ds_enabled_bills is updated by APP_UpdateSettings */
+    if (result == TRANSACTION_OK)
+    {
+        g_bill_table.ds_escrowed_bills = 0x00007f;
+    }
+    APP_BillTableDone(1);
+}
+
+/**
+  * @brief  Respond with bill table to upstream CCNET controller
+  * @retval None
+  */
+static void APP_RespondBillTable(void)
+{
+    /* Create 24 rows of 5 bytes CCNET response payload */
+    uint8_t data[CCNET_BILL_TABLE_DATA];
+    uint8_t data_length = CCNET_BILL_TABLE_DATA;
+
+    /* Prebuilt until the bill table changes */
+    if (bill_table_frame.length != 0)
+    {
+        response_cache_stats.frame_hits++;
+        APP_SendFrame(CCNET_BILL_TABLE, bill_table_frame.raw, bill_table_frame.length);
+        return;
+    }
+    
+    /* Initialize all data to zero */
+    for (uint8_t i = 0; i < data_length; i++)
+    {
+        data[i] = 0;
+    }
+    
+    /* Fill in the bill table data from the bill types of the acceptor pool */
+    for (uint8_t i = 0; i < bill_pool.count && i < 24; i++)
+    {
+        uint8_t offset = i * 5;
+        uint16_t value = bill_pool.bill_types[i].value;
+        
+        /* Calculate coefficient and exponent from value */
+        uint8_t exponent = 0;
+        uint16_t coefficient = value;
+        while (coefficient >= 10 && exponent < 9)
+        {
+            coefficient /= 10;
+            exponent++;
+        }
+        
+        /* Row format: coefficient, currency[0], currency[1], currency[2], exponent */
+        data[offset + 0] = (uint8_t)coefficient;
+        data[offset + 1] = g_bill_table.currency[0];
+        data[offset + 2] = g_bill_table.currency[1];
+        data[offset + 3] = g_bill_table.currency[2];
+        data[offset + 4] = exponent;
+    }
+
+    bill_table_frame.length = MESSAGE_BuildFrame(PROTO_CCNET, MSG_DIR_RX, CCNET_BILL_TABLE, data, data_length, bill_table_frame.raw);
+    response_cache_stats.frame_builds++;
+    APP_SendFrame(CCNET_BILL_TABLE, bill_table_frame.raw, bill_table_frame.length);
+}
+
+/**
+  * @brief  Respond to CCNET POLL with the oldest upstream event or the last downstream status
+  * @note   An event is answered until the controller ACKs it, the status is
+  *         answered once the event queue is empty. With two validators the
+  *         acceptor pool selects the status: the validator whose bill the
+  *         controller handles, otherwise the one in the highest state
+  * @retval None
+  */
+static void APP_RespondPoll(void)
+{
+    message_t new_us_msg;      /* new upstream message created by mapping status code and data*/
+    uint8_t device = APP_SelectDevice();
+    status_mirror_t* mirror = &status_mirror[device];
+    message_t* status = &mirror->status;
+    const upstream_event_t* event;
+    uint8_t in_escrow;
+
+    /* Check if downstream status is fresh */
+    if (APP_GetStatusAge(device) >= DOWNSTREAM_MSG_TTL_MS)
+    {
+        LOG_Warn("Downstream status is not recent and valid. CCNET POLL timeout");
+        return;
+    }
+    APP_RecordPollTiming(device);
+
+    /* Queued events first, in order */
+    if ((event = EVENTS_Peek(&upstream_events)) != NULL)
+    {
+        RESPOND(event->opcode, (uint8_t*)event->data, event->data_length);
+        ds_context.event_sent = 1;
+        return;
+    }
+    mirror->changed = 0;
+
+    /* Another validator answers from here: its bill starts its own escrow sequence */
+    if (device != ds_context.escrow_device)
+    {
+        ds_context.escrow_device = device;
+        ds_context.escrow_state = ESCROW_IDLE;
+    }
+    in_escrow = (status->opcode == ID003_STATUS_ESCROW && bill_pool.escrow_owner == device);
+    
+    PROTO_MapStatusCode(status, &new_us_msg);   /* updates opcode and data */
+    if (status->opcode == ID003_STATUS_VEND_VALID)
+    {
+        /* the credit (BILL STACKED) is an upstream event, the bill is still being stacked */
+        new_us_msg.opcode = CCNET_STATUS_STACKING;
+        new_us_msg.data_length = 0;
+    }
+    else if (status->opcode == ID003_STATUS_ESCROW && !in_escrow)
+    {
+        /* bill without a CCNET bill type, being returned: never offered to the controller */
+        new_us_msg.opcode = CCNET_STATUS_ACCEPTING;
+        new_us_msg.data_length = 0;
+    }
+
+    switch(ds_context.escrow_state)
+    {                                
+        case ESCROW_IDLE:
+            /* handle all non escrow related messages. Status, Rejection, Failures. But also detect if getting into escrow */
+            if (!in_escrow)
+            {
+                RESPOND(new_us_msg.opcode, new_us_msg.data, new_us_msg.data_length);
+            }
+            else
+            {
+                /* bill_type is set by the status mirror */
+                ds_context.escrow_state = ESCROW_IN_ESCROW;
+                RESPOND(CCNET_STATUS_ESCROW_POSITION, &mirror->bill_type, 1);
+            }
+            break;
+
+
+        case ESCROW_IN_ESCROW:
+            /* make sure it is still in escrow*/
+            if (!in_escrow)
+            {
+                /* handle returning, rejection, failure, etc. as normal cases*/
+                RESPOND(new_us_msg.opcode, new_us_msg.data, new_us_msg.data_length);
+                ds_context.escrow_state = ESCROW_IDLE;
+            }
+            else
+            {
+                RESPOND(CCNET_STATUS_ESCROW_POSITION, &mirror->bill_type, 1);
+            }
+            break;
+        case ESCROW_IN_STACK:
+            RESPOND(CCNET_STATUS_STACKING, NULL, 0);
+            ds_context.escrow_state = ESCROW_STACKING;
+            break;
+        case ESCROW_STACKING:
+            /* still stacking (escrow: the stack command is not seen in a status yet).
+               VEND VALID is acknowledged by the status mirror, BILL STACKED is an upstream event */
+            if (status->opcode == ID003_STATUS_STACKING || status->opcode == ID003_STATUS_VEND_VALID ||
+                status->opcode == ID003_STATUS_ESCROW)
+            {
+                RESPOND(CCNET_STATUS_STACKING, NULL, 0);
+            }
+            else
+            {
+                /* stacked, idling or a failure: the bill is done */
+                RESPOND(new_us_msg.opcode, new_us_msg.data, new_us_msg.data_length);
+                ds_context.escrow_state = ESCROW_IDLE;
+            }
+            break;
+    } /* end switch */
+}
+
+/**
+  * @brief  Respond to CCNET IDENTIFICATION
+  * @note   Prebuilt until the serial number or the downstream protocol changes.
+  *         The serial number is left blank if it is not known
+  * @retval None
+  */
+static void APP_RespondIdentification(void)
+{
+    uint8_t ident_data[CCNET_IDENTIFICATION_DATA];  /* CCNET identification response: 34 bytes */
+
+    if (identification_frame.length != 0)
+    {
+        response_cache_stats.frame_hits++;
+        APP_SendFrame(CCNET_IDENTIFICATION, identification_frame.raw, identification_frame.length);
+        return;
+    }
+
+    /* Initialize all data to zero */
+    utils_zero(ident_data, 34);
+    
+    /* Z1-Z15: Part Number (ASCII) - initialize with spaces */
+    const char spaces[] = "               ";  /* 15 spaces */
+    utils_memcpy(ident_data, (uint8_t*)spaces, 15);
+    
+    if (if_downstream.protocol == PROTO_ID003)
+    {
+        /* Model: "ID003" */
+        utils_memcpy(ident_data, (uint8_t*)"ID003", 5);
+        
+        /* Z16-Z27: Serial Number (ASCII) - copy up to 12 chars from ID003 response */
+        if (ds_serial_length > 0)
+        {
+            uint8_t serial_len = (ds_serial_length > 12) ? 12 : ds_serial_length;
+            utils_memcpy(&ident_data[15], ds_serial, serial_len);
+        }
+    }
+    
+    /* Z28-Z34: Asset Number (Binary) - zeros (already set by utils_zero) */
+    identification_frame.length = MESSAGE_BuildFrame(PROTO_CCNET, MSG_DIR_RX, CCNET_IDENTIFICATION,
+                                                     ident_data, CCNET_IDENTIFICATION_DATA, identification_frame.raw);
+    response_cache_stats.frame_builds++;
+    APP_SendFrame(CCNET_IDENTIFICATION, identification_frame.raw, identification_frame.length);
+}
+
+/**
+  * @brief  Keep the validator serial number
+  * @note   The identification frame is rebuilt on the next request
+  * @param  serial: ID003 serial number (ASCII)
+  * @param  length: Serial number length, truncated to SNAPSHOT_SERIAL_MAX
+  * @retval None
+  */
+static void APP_SetSerial(const uint8_t* serial, uint8_t length)
+{
+    ds_serial_length = (length > SNAPSHOT_SERIAL_MAX) ? SNAPSHOT_SERIAL_MAX : length;
+    utils_memcpy(ds_serial, serial, ds_serial_length);
+    identification_frame.length = 0;
+}
+
+/**
+  * @brief  End of the ENABLE BILL TYPES sequence: update the bill table and respond
+  * @param  ok: 1 if all three ID003 requests were acknowledged
+  * @retval None
+  */
+static void APP_EnableBillTypesDone(uint8_t ok)
+{
+    uint8_t* b = ds_context.enable_request;
+
+    /* Two validators: respond once both sequences are done, ACK only if both succeeded */
+    if (ds_context.enable_outstanding == 0) return;
+    if (!ok) ds_context.enable_failed = 1;
+    if (--ds_context.enable_outstanding > 0) return;
+    ok = !ds_context.enable_failed;
+
+    if (ok) /* process successful*/
+    {
+        /* store response in bill table*/
+        g_bill_table.enabled_bills = b[2] + (b[1]<<8) + (b[0]<<16);  /* 23 bits of CCNET enabled bills (1=enabled)*/
+        g_bill_table.escrowed_bills = b[5] + (b[4]<<8) + (b[3]<<16);
+        g_bill_table.escrowed_bills = 0xffffff; /* ID003 does not handle non escrowed bills. Automation for it possible though*/
+
+        g_bill_table.escrowed_bills = 0x00007f;    /* ID003 does not handle non escrowed bills. Automation for it possible though*/
+        g_bill_table.ds_escrowed_bills = 0x00007f;
+        g_bill_table.ds_enabled_bills = g_bill_table.enabled_bills & 0x7f;  /* ID003: max 7 bills */
+
+        RESPOND(CCNET_ACK, NULL, 0); 
+        if (g_config.log_level >= LOG_LEVEL_INFO)
+        {
+            LOG_Info("Updated enable data in bill table:");
+            TABLE_UI_DisplayBillTable();
+        }
+    }
+    else 
+    {
+        /* start with couple NAK respones. if Controller retransmits follow up by timeouts*/
+        if (CCNET_ENABLE_BILL_TYPES_errors++ < 2){
+            RESPOND(CCNET_NAK, NULL, 0);    /* NAK for first 2 subsequent transmissions */
+        }
+        else {
+            __NOP(); /* in principle do nothing. signal the error by just timing out*/
+            if (HAL_GetTick() - CCNET_ENABLE_BILL_TYPES_last_error_time_ms > 10000){
+                RESPOND(CCNET_NAK, NULL, 0);    /* new error. first one in 10000ms */
+                CCNET_ENABLE_BILL_TYPES_errors = 0; 
+            }
+        }
+        CCNET_ENABLE_BILL_TYPES_last_error_time_ms = HAL_GetTick();
+    }                              
+}
+
+/**
+  * @brief  Apply a CCNET ENABLE BILL TYPES request to the ID003 validator
+  * @note   Only the commands that change the cached validator state are sent:
+  *         a controller re-sending the same mask is acknowledged without
+  *         downstream traffic. With an unknown enable state the full sequence
+  *         runs: disable all, enable the requested bills, de-inhibit
+  * @retval None
+  */
+static void APP_EnableBillTypes(void)
+{
+    const ds_settings_t* settings = &g_bill_table.ds_settings;
+    uint8_t enable_data[2];
+    uint8_t inhibit_data[1] = {0};  /* 0: de-inhibit*/
+    uint8_t queued;
+
+    APP_GetEnableData(DS_DEVICE, enable_data);
+
+    if (!(settings->valid & DS_SETTING_ENABLE))
+    {
+        /* first: disable all bill types. If this sequence fails there is a risk of wrong Controller state */
+        uint8_t disable_data[2] = {0xFF,0};   /* first byte: enabled bills (0=enable), second 0 by spec)*/
+        queued = REQUEST(ID003_ENABLE, disable_data, 2, ID003_ENABLE, 2, DS_RESPONSE_TIMEOUT_MS, APP_EnableDisableAllDone);
+    }
+    else if (settings->enable[0] != enable_data[0] || settings->enable[1] != enable_data[1])
+    {
+        /* known mask: switch to the new one in one command, no all disabled window */
+        queued = REQUEST(ID003_ENABLE, enable_data, 2, ID003_ENABLE, 2, DS_RESPONSE_TIMEOUT_MS, APP_EnableBillsDone);
+    }
+    else if (!(settings->valid & DS_SETTING_INHIBIT) || settings->inhibit != 0)
+    {
+        queued = REQUEST(ID003_INHIBIT, inhibit_data, 1, ID003_INHIBIT, 1, DS_RESPONSE_TIMEOUT_MS, APP_EnableInhibitDone);
+    }
+    else
+    {
+        LOG_Debug("ENABLE BILL TYPES unchanged, no downstream commands");
+        queued = 1;
+        APP_EnableBillTypesDone(1);
+    }
+
+    if (!queued)
+    {
+        APP_EnableBillTypesDone(0);
+    }
+}
+
+/**
+  * @brief  ID003 ENABLE data for the pending CCNET ENABLE BILL TYPES request
+  * @note   The bill types are routed to the bill table rows of the validator
+  * @param  device: DS_DEVICE or SECOND_DEVICE
+  * @param  enable_data: Filled with the 2 ENABLE data bytes
+  * @retval None
+  */
+static void APP_GetEnableData(uint8_t device, uint8_t* enable_data)
+{
+    const uint8_t* b = ds_context.enable_request;
+    uint32_t bill_types = b[2] + (b[1] << 8) + ((uint32_t)b[0] << 16);
+
+    enable_data[0] = (uint8_t)APP_RouteEnable(device, bill_types);  /* 8 lowest bill table rows */
+    enable_data[0] = ~enable_data[0];  /* ID003 0 means enabled*/
+    enable_data[0] = enable_data[0]<<1;  /* ID003 first bill starts at bit 1*/
+    enable_data[1] = 0;
+}
+
+/**
+  * @brief  Respond to CCNET GET STATUS
+  * @note   Served from the settings cache. Only a cold cache costs the inhibit
+  *         and enable requests, their responses fill the cache
+  * @retval None
+  */
+static void APP_RespondStatus(void)
+{
+    const ds_settings_t* settings = &g_bill_table.ds_settings;
+
+    if ((settings->valid & DS_SETTING_INHIBIT) && settings->inhibit == 1)
+    {
+        APP_RespondEnableStatus(1, 0xFF);
+    }
+    else if ((settings->valid & (DS_SETTING_INHIBIT | DS_SETTING_ENABLE)) == (DS_SETTING_INHIBIT | DS_SETTING_ENABLE))
+    {
+        APP_RespondEnableStatus(0, settings->enable[0]);
+    }
+    else
+    {
+        /* cold cache: check inhibit status first*/
+        REQUEST(ID003_INHIBIT_REQ, NULL, 0, ID003_INHIBIT_REQ, 1, DS_RESPONSE_TIMEOUT_MS, APP_StatusInhibitDone);
+        return;
+    }
+
+    if (g_config.log_level >= LOG_LEVEL_INFO) TABLE_UI_DisplayBillTable();
+}
+
+/**
+  * @brief  Respond to CCNET GET STATUS with the enabled bill types of the pool
+  * @note   The first validator from its settings, the second one from the
+  *         ENABLE and INHIBIT it acknowledged last. Disabled (all zeros) only
+  *         if no validator is de-inhibited
+  * @param  inhibit: Inhibit setting of the first validator
+  * @param  enable: ENABLE data byte 0 of the first validator
+  * @retval None
+  */
+static void APP_RespondEnableStatus(uint8_t inhibit, uint8_t enable)
+{
+    uint8_t data_buf[6];
+    uint32_t bill_types = 0;
+    uint8_t disabled = inhibit;
+
+    if (!inhibit)
+    {
+        bill_types = APP_MergeEnable(DS_DEVICE, (uint8_t)(~enable) >> 1);  /* ID003 0 means enabled, first bill at bit 1 */
+    }
+    if (second.state == SECOND_RUNNING && second.inhibit == 0)
+    {
+        bill_types |= APP_MergeEnable(SECOND_DEVICE, second.rows);
+        disabled = 0;
+    }
+
+    if (disabled)
+    {
+        /* inhibit is enabled - respond with zeros (unit disabled) */
+        utils_zero(data_buf, 6);
+    }
+    else
+    {
+        data_buf[0] = (uint8_t)(bill_types >> 16);
+        data_buf[1] = (uint8_t)(bill_types >> 8);
+        data_buf[2] = (uint8_t)bill_types;
+        data_buf[3] = 0xFF;              /* all escrow for now*/
+        data_buf[4] = 0xFF;
+        data_buf[5] = 0xFF;
+    }
+    RESPOND(CCNET_STATUS_REQUEST, data_buf, 6);
+}
+
+/**
+  * @brief  Update the settings cache from a downstream message
+  * @note   Set commands are echoed with their data, request responses carry the
+  *         current setting. A power-up status means the settings were lost
+  * @param  msg: Parsed downstream message
+  * @retval None
+  */
+static void APP_UpdateSettings(const message_t* msg)
+{
+    ds_settings_t* settings = &g_bill_table.ds_settings;
+
+    if (msg->protocol != PROTO_ID003) return;
+
+    switch (msg->opcode)
+    {
+        case ID003_STATUS_POWER_UP:
+        case ID003_STATUS_POWER_UP_BIA:
+        case ID003_STATUS_POWER_UP_BIS:
+            if (settings->valid) LOG_Debug("Downstream power-up: settings cache invalidated");
+            settings->valid = 0;
+            return;
+        default:
+            break;
+    }
+
+    for (uint8_t i = 0; i < DS_SETTINGS_COUNT; i++)
+    {
+        const ds_setting_t* setting = &ds_settings[i];
+
+        if ((msg->opcode != setting->set_opcode && msg->opcode != setting->req_opcode) ||
+            msg->data_length != setting->length) continue;
+
+        switch (setting->flag)
+        {
+            case DS_SETTING_INHIBIT:
+                settings->inhibit = msg->data[0];
                 break;
-                
-            case MSG_CRC_INVALID:
-                // TODO: send NACK message
-                /* 2.6.4 CCNET documenation*/
-                LOG_Warn("Upstream IN message CRC invalid");
+            case DS_SETTING_ENABLE:
+                settings->enable[0] = msg->data[0];
+                settings->enable[1] = msg->data[1];
+                g_bill_table.ds_enabled_bills = (uint8_t)(~msg->data[0]) >> 1;
                 break;
-                
-            case MSG_UNKNOWN_OPCODE:
-            case MSG_DATA_MISSING_FOR_OPCODE:
-                // TODO: send 0x30 message
-                /* 2.3.5 CCNET documenation*/
-                LOG_Warn("Upstream message unknown opcode or data missing for opcode");
+            case DS_SETTING_SECURITY:
+                settings->security[0] = msg->data[0];
+                settings->security[1] = msg->data[1];
+                break;
+            case DS_SETTING_COMM_MODE:
+                settings->comm_mode = msg->data[0];
+                break;
+            case DS_SETTING_DIRECTION:
+                settings->direction = msg->data[0];
                 break;
-                
             default:
-                // No action needed
-                LOG_Warn("Upstream message parse failed without CRC invalid or unknown opcode or data missing for opcode");
                 break;
         }
+        settings->valid |= setting->flag;
+        return;
+    }
+}
+
+/**
+  * @brief  Background refresh of the settings cache
+  * @note   Lowest priority: one request at a time and only when no poll or
+  *         command sequence is pending. Unknown settings are requested first
+  * @retval None
+  */
+static void APP_RefreshSettings(void)
+{
+    ds_settings_t* settings = &g_bill_table.ds_settings;
+    uint32_t interval = (settings->valid == DS_SETTING_ALL) ? DS_SETTINGS_REFRESH_MS : DS_SETTINGS_MISSING_MS;
+    const ds_setting_t* setting;
+    uint32_t slot;
+
+    if (if_downstream.protocol != PROTO_ID003 || !TRANSACTION_IsIdle(&ds_transactions)) return;
+    if (HAL_GetTick() - settings->refresh_time < interval) return;
+    /* never delay the next periodic poll */
+    if (if_downstream.datalink.polling_period_ms != 0 &&
+        (ds_context.poller.poll_now ||
+         HAL_GetTick() - ds_context.poller.last_poll_time + DS_RESPONSE_TIMEOUT_MS >= APP_GetPollingPeriod(DS_DEVICE))) return;
+    /* nor the next phase-locked poll */
+    if (APP_GetPhaseSlot(&slot) && ds_context.poller.phase_events != upstream_cadence.events &&
+        (int32_t)(slot - HAL_GetTick()) < DS_RESPONSE_TIMEOUT_MS) return;
+
+    /* first unknown setting, otherwise the next one in turn */
+    for (uint8_t i = 0; i < DS_SETTINGS_COUNT; i++)
+    {
+        if (!(settings->valid & ds_settings[i].flag))
+        {
+            settings->refresh_index = i;
+            break;
+        }
+    }
+    setting = &ds_settings[settings->refresh_index % DS_SETTINGS_COUNT];
+    settings->refresh_index = (settings->refresh_index + 1) % DS_SETTINGS_COUNT;
+    settings->refresh_time = HAL_GetTick();
+
+    REQUEST(setting->req_opcode, NULL, 0, setting->req_opcode, setting->length, DS_RESPONSE_TIMEOUT_MS, NULL);
+}
+
+/**
+  * @brief  Restore the bill table and the validator identity from the snapshot
+  * @note   The validator powers up with its default settings: the last-known
+  *         settings are not restored into the settings cache, which is read
+  *         back from the validator as before
+  * @retval None
+  */
+static void APP_LoadSnapshot(void)
+{
+    uint32_t size = 0;
+
+    utils_zero((uint8_t*)&ds_snapshot, sizeof(ds_snapshot));
+    if (NVM_ReadSnapshot((uint8_t*)&ds_snapshot, sizeof(ds_snapshot), &size) != NVM_OK ||
+        size != sizeof(ds_snapshot) || ds_snapshot.layout != SNAPSHOT_LAYOUT ||
+        ds_snapshot.count > MAX_BILL_DENOMS || ds_snapshot.serial_length > SNAPSHOT_SERIAL_MAX ||
+        ds_snapshot.version_length > SNAPSHOT_VERSION_MAX)
+    {
+        utils_zero((uint8_t*)&ds_snapshot, sizeof(ds_snapshot));
+        LOG_Info("No warm-start snapshot: bill table from the validator");
+        return;
+    }
+
+    utils_memcpy((uint8_t*)g_bill_table.currency, (const uint8_t*)ds_snapshot.currency, sizeof(g_bill_table.currency));
+    utils_memcpy((uint8_t*)g_bill_table.denoms, (const uint8_t*)ds_snapshot.denoms, sizeof(g_bill_table.denoms));
+    g_bill_table.count = ds_snapshot.count;
+    g_bill_table.ds_enabled_bills = ds_snapshot.ds_enabled_bills;
+    g_bill_table.ds_escrowed_bills = ds_snapshot.ds_escrowed_bills;
+    g_bill_table.is_loaded = (ds_snapshot.count > 0);
+    APP_MergeBillTables();
+
+    APP_SetSerial(ds_snapshot.serial, ds_snapshot.serial_length);
+    utils_memcpy(ds_version, ds_snapshot.version, ds_snapshot.version_length);
+    ds_version_length = ds_snapshot.version_length;
+
+    LOG_Info("Warm-start snapshot loaded: bill table and identification served until the validator is checked");
+}
+
+/**
+  * @brief  Start the background check of the snapshot
+  * @note   After the startup bill table request: serial number, then version,
+  *         then APP_SaveSnapshot. Lowest priority, polls are not delayed
+  * @retval None
+  */
+static void APP_RevalidateSnapshot(void)
+{
+    if (if_downstream.protocol != PROTO_ID003) return;
+
+    REQUEST(ID003_SERIAL_NUMBER_REQ, NULL, 0, ID003_SERIAL_NUMBER_REQ, TRANSACTION_ANY_LENGTH,
+            DS_SERIAL_TIMEOUT_MS, APP_SnapshotSerialDone);
+}
+
+/**
+  * @brief  Update the snapshot if the validator, its bill table or settings changed
+  * @note   The flash write waits for APP_FlashProcess
+  * @retval None
+  */
+static void APP_SaveSnapshot(void)
+{
+    const ds_settings_t* settings = &g_bill_table.ds_settings;
+    ds_snapshot_t snapshot;
+
+    if (!g_bill_table.is_loaded || ds_serial_length == 0) return;
+
+    utils_zero((uint8_t*)&snapshot, sizeof(snapshot));
+    snapshot.layout = SNAPSHOT_LAYOUT;
+    snapshot.serial_length = ds_serial_length;
+    utils_memcpy(snapshot.serial, ds_serial, ds_serial_length);
+    snapshot.version_length = ds_version_length;
+    utils_memcpy(snapshot.version, ds_version, ds_version_length);
+    utils_memcpy((uint8_t*)snapshot.currency, (const uint8_t*)g_bill_table.currency, sizeof(snapshot.currency));
+    snapshot.count = g_bill_table.count;
+    utils_memcpy((uint8_t*)snapshot.denoms, (const uint8_t*)g_bill_table.denoms, sizeof(snapshot.denoms));
+    snapshot.ds_enabled_bills = g_bill_table.ds_enabled_bills;
+    snapshot.ds_escrowed_bills = g_bill_table.ds_escrowed_bills;
+
+    /* settings not read back yet keep their last-known value, so they never count as a change */
+    if (ds_snapshot.layout == SNAPSHOT_LAYOUT)
+    {
+        snapshot.settings_valid = ds_snapshot.settings_valid;
+        snapshot.inhibit = ds_snapshot.inhibit;
+        utils_memcpy(snapshot.enable, ds_snapshot.enable, sizeof(snapshot.enable));
+        utils_memcpy(snapshot.security, ds_snapshot.security, sizeof(snapshot.security));
+        snapshot.comm_mode = ds_snapshot.comm_mode;
+        snapshot.direction = ds_snapshot.direction;
+    }
+    snapshot.settings_valid |= settings->valid;
+    if (settings->valid & DS_SETTING_INHIBIT) snapshot.inhibit = settings->inhibit;
+    if (settings->valid & DS_SETTING_ENABLE) utils_memcpy(snapshot.enable, settings->enable, sizeof(snapshot.enable));
+    if (settings->valid & DS_SETTING_SECURITY) utils_memcpy(snapshot.security, settings->security, sizeof(snapshot.security));
+    if (settings->valid & DS_SETTING_COMM_MODE) snapshot.comm_mode = settings->comm_mode;
+    if (settings->valid & DS_SETTING_DIRECTION) snapshot.direction = settings->direction;
+
+    if (memcmp(&snapshot, &ds_snapshot, sizeof(snapshot)) == 0)
+    {
+        LOG_Info("Warm-start snapshot confirmed by the validator");
+        return;
+    }
+
+    if (ds_snapshot.layout == SNAPSHOT_LAYOUT &&
+        (ds_snapshot.serial_length != snapshot.serial_length ||
+         memcmp(ds_snapshot.serial, snapshot.serial, snapshot.serial_length) != 0))
+    {
+        LOG_Info("Different validator connected: warm-start snapshot replaced");
+    }
+
+    utils_memcpy((uint8_t*)&ds_snapshot, (const uint8_t*)&snapshot, sizeof(snapshot));
+    snapshot_write_pending = 1;
+}
+
+/**
+  * @brief  Write the changed snapshot to flash
+  * @note   Called from APP_FlashProcess in a flash window
+  * @retval None
+  */
+static void APP_WriteSnapshot(void)
+{
+    snapshot_write_pending = 0;
+    if (NVM_WriteSnapshot((const uint8_t*)&ds_snapshot, sizeof(ds_snapshot)) == NVM_OK)
+    {
+        LOG_Info("Warm-start snapshot saved");
+    }
+    else
+    {
+        LOG_Warn("Warm-start snapshot not saved");
+    }
+}
+
+/**
+  * @brief  Write pending snapshot and configuration changes to flash
+  * @note   Service task. One page per run, each one in its own flash window
+  * @retval None
+  */
+static void APP_FlashProcess(void)
+{
+    if (!snapshot_write_pending && !CONFIG_IsSavePending())
+    {
+        flash_pending_tick = HAL_GetTick();
+        return;
     }
+    if (!APP_IsFlashWindow() && HAL_GetTick() - flash_pending_tick < FLASH_WRITE_DEFER_MAX_MS) return;
 
-    /* Flush USB TX ring buffer */
-    USB_Flush();
-    
-    // USB_ProcessStatusMessage();
+    if (CONFIG_IsSavePending()) CONFIG_SaveToNVM();
+    else APP_WriteSnapshot();
+    flash_pending_tick = HAL_GetTick();
 }
 
 /**
-  * @brief  Check for downstream message and parse if available
-  * @retval message_parse_result_t: MSG_NO_MESSAGE if no data, or parse result
+  * @brief  Check if a flash page can be erased and programmed now
+  * @note   Erase and program stall every instruction fetch from flash,
+  *         interrupts included, ~22 ms per page erase. Allowed while no CCNET
+  *         command is being answered and the next POLL is expected at least
+  *         FLASH_WRITE_GUARD_MS away, or while the controller is not polling
+  * @retval uint8_t: 1 if a write fits now
   */
-  message_parse_result_t APP_CheckForDownstreamMessage(void)
-  {
-      /* Check for downstream data (tested for datalink validity) and parse if available */
-      if (UART_CheckForDownstreamData())
-      {
-          /* Parse the received message */
-          message_parse_result_t result = MESSAGE_Parse(&downstream_msg);
-          
-          /* Update timestamp if message was parsed successfully */
-          if (result == MSG_OK)
-          {
-            
-              last_downstream_msg_time = HAL_GetTick();
-          }
-          
-          return result;
-      }
-      
-      /* No message received */
-      return MSG_NO_MESSAGE;
-  }
+static uint8_t APP_IsFlashWindow(void)
+{
+    uint32_t now = HAL_GetTick();
+
+    if (ccnet_dispatcher.waiting || UART_IsTxBusy(&if_upstream)) return 0;
+    if (now - upstream_cadence.last_time >= FLASH_WRITE_IDLE_MS) return 1;
+    return CADENCE_IsLocked(&upstream_cadence, now) &&
+           (int32_t)(CADENCE_NextExpected(&upstream_cadence) - now) >= FLASH_WRITE_GUARD_MS;
+}
+
+/* Transaction completion callbacks ------------------------------------------*/
 
 /**
-  * @brief  Get age of last downstream message in milliseconds
-  * @retval uint32_t: Age in milliseconds, or UINT32_MAX if no message received yet
+  * @brief  First poll response at startup
+  * @param  result: Transaction result
+  * @param  response: Poll response (unused)
+  * @retval None
   */
-static uint32_t APP_GetDownstreamMessageAge(void)
+static void APP_FirstPollDone(transaction_result_t result, const message_t* response)
 {
-    if (last_downstream_msg_time == 0)
+    (void)response;
+
+    if (result == TRANSACTION_OK)
     {
-        return UINT32_MAX;  /* No message received yet */
+        ds_context.startup = DS_FIRST_POLL_RECEIVED_OK;
+        ds_context.startup_tick = HAL_GetTick();
+        ds_context.startup_delay_ms = DS_BILL_TABLE_DELAY_MS;
+        APP_BootMark(&boot_timing.validator_ms);
+        LOG_Debug("DS_FIRST_POLL_RECEIVED_OK");
+    }
+    else
+    {
+        ds_context.startup = DS_NOT_STARTED;
+        /* No answer on the configured settings: probe the other protocol, baud rates and parity */
+        if (++ds_context.first_poll_failures >= DISCOVERY_AFTER_FAILED_POLLS && !ds_context.discovery_done)
+        {
+            ds_context.discovery_done = 1;
+            ds_context.discovery_requested = 1;     /* runs from the main loop */
+        }
     }
-    
-    uint32_t current_time = HAL_GetTick();
-    return (current_time - last_downstream_msg_time);
 }
 
 /**
-  * @brief  Check for upstream message and parse if available
-  * @retval message_parse_result_t: MSG_NO_MESSAGE if no data, or parse result
+  * @brief  Status response for a CCNET POLL in synchronous polling mode
+  * @param  result: Transaction result
+  * @param  response: Status response (also in downstream_msg)
+  * @retval None
   */
-message_parse_result_t APP_CheckForUpstreamMessage(void)
+static void APP_SyncPollDone(transaction_result_t result, const message_t* response)
 {
-    /* Check for upstream data and parse if available */
-    if (UART_CheckForUpstreamData())
+    (void)response;
+
+    if (result != TRANSACTION_OK && second.state != SECOND_RUNNING)
     {
-        /* Parse the received message */
-        return MESSAGE_Parse(&upstream_msg);
+        LOG_Warn("No bill validator connected. CCNET POLL timeout");
+        return;
     }
-    
-    /* No message received */
-    return MSG_NO_MESSAGE;
+    /* no answer from the first validator: the second one may still answer */
+    APP_RespondPoll();
 }
 
-
-
 /**
-  * @brief  Wait for downstream message with timeout
-  * @param  timeout_ms: Timeout in milliseconds
-  * @retval message_parse_result_t: MSG_NO_MESSAGE if timeout, or parse result
-  *         downstream_msg populated
+  * @brief  Reset acknowledge: respond upstream and reset the MCU
+  * @param  result: Transaction result
+  * @param  response: Unused
+  * @retval None
   */
-static message_parse_result_t APP_WaitForDownstreamMessage(uint32_t timeout_ms)
-{  /* note: take note of expected message length to avoid timeout*/
-    uint32_t start_tick = HAL_GetTick();
-    message_parse_result_t msg_result = MSG_NO_MESSAGE;
-    /* qualified parse results for a retransmit */
-    uint8_t result_arr[] = {MSG_CRC_INVALID, MSG_DATA_MISSING_FOR_OPCODE};
-    LOG_Debug("In APP_WaitForDownstreamMessage");
+static void APP_ResetDone(transaction_result_t result, const message_t* response)
+{
+    (void)response;
 
-    /* reset downstream message */
-    downstream_msg.length = 0;
+    if (result == TRANSACTION_OK)
+    {
+        RESPOND(CCNET_STATUS_ACK, NULL, 0);
+        /* reset MCU from the service task once the ACK is sent */
+        LOG_Warn("Resetting MCU");
+        mcu_reset_pending = 1;
+        mcu_reset_tick = HAL_GetTick();
+    }
+    else
+    {
+        RESPOND(CCNET_STATUS_NAK, NULL, 0);
+    }
+}
 
-    while (1)
+/**
+  * @brief  Inhibit status for CCNET GET STATUS
+  * @param  result: Transaction result
+  * @param  response: ID003 inhibit status response
+  * @retval None
+  */
+static void APP_StatusInhibitDone(transaction_result_t result, const message_t* response)
+{
+    if (result == TRANSACTION_OK && response->data[0] == 1)
     {
-        /* Check for downstream data and parse if available */
-        if (UART_CheckForDownstreamData())
-        {
-            /* Parse the received message */
-            msg_result = MESSAGE_Parse(&downstream_msg);
-            LOG_Proto(&downstream_msg); 
-            
-            /* return parse result if OK */
-            if (msg_result == MSG_OK)
-            {
-                last_downstream_msg_time = HAL_GetTick();
-                return MSG_OK;
-            }
-            
-            else if (utils_is_member(msg_result, result_arr, sizeof(result_arr)))
-            {
-                /* retransmit the message */
-                __NOP();
-                return MSG_NO_MESSAGE;
-            } 
-            
-        }
-        
-        /* Check if timeout has occurred */
-        if ((HAL_GetTick() - start_tick) >= timeout_ms)
-        {
-            /* Timeout occurred */
-            return MSG_NO_MESSAGE;    /* 0x00 is not a valid id003 opcode */
-        }
+        APP_RespondEnableStatus(1, 0xFF);
+        if (g_config.log_level >= LOG_LEVEL_INFO) TABLE_UI_DisplayBillTable();
+        return;
     }
+    REQUEST(ID003_ENABLE_REQ, NULL, 0, ID003_ENABLE_REQ, 2, DS_RESPONSE_TIMEOUT_MS, APP_StatusEnableDone);
 }
 
 /**
-  * @brief  Send a message to specified interface
-  * @param  interface: Pointer to interface configuration (upstream or downstream)
-  * @param  opcode: Message opcode
-  * @param  data: Pointer to message data (NULL if no data)
-  * @param  data_length: Length of data (0 if no data)
+  * @brief  Enable status for CCNET GET STATUS
+  * @param  result: Transaction result
+  * @param  response: ID003 enable status response
   * @retval None
   */
-static void APP_SendMessage(interface_config_t* interface, uint8_t opcode, uint8_t* data, uint8_t data_length, uint8_t use_dma)
+static void APP_StatusEnableDone(transaction_result_t result, const message_t* response)
 {
-    message_t tx_msg;
-    message_direction_t direction;
-    
-    /* Determine direction based on interface */
-    if (interface == &if_downstream) {
-        direction = MSG_DIR_TX;  /* TX to downstream device */
-        LED_Flash(&hled2, 10);
-    } else {
-        direction = MSG_DIR_RX;  /* RX as seen by upstream controller */
-        LED_Flash(&hled1, 10);
+    if (result == TRANSACTION_OK)
+    {   /* first byte of ID003 response is enabled denominators */
+        APP_RespondEnableStatus(0, response->data[0]);
     }
     
-    /* Create message ready for transmission */
-    tx_msg = MESSAGE_Create(interface->protocol, direction, opcode, data, data_length);
-    if (interface == &if_downstream) {
-        /* create a copy of last request message and store to check for echo*/
-        message_t last_ds_msg;
-        last_ds_msg = MESSAGE_Create(interface->protocol, MSG_DIR_RX, tx_msg.opcode, tx_msg.data, tx_msg.length);
-        ds_context.last_req_msg = last_ds_msg;
+    /* Display bill table if log level is INFO */
+    if (g_config.log_level >= LOG_LEVEL_INFO)
+    {
+        TABLE_UI_DisplayBillTable();
     }
+}
 
-    /* Log the message */
-    LOG_Debug("app.c: Sending message");
-    LOG_Proto(&tx_msg);
+/**
+  * @brief  ENABLE BILL TYPES step 1: all bill types disabled
+  * @param  result: Transaction result
+  * @param  response: Unused
+  * @retval None
+  */
+static void APP_EnableDisableAllDone(transaction_result_t result, const message_t* response)
+{
+    (void)response;
 
-    /* transmit message */
-    UART_TransmitMessage(interface, &tx_msg, use_dma, dma_tx_buffer);
-    
+    if (result != TRANSACTION_OK)
+    {
+        APP_EnableBillTypesDone(0);
+        return;
+    }
 
-}
+    uint8_t enable_data[2];
+    APP_GetEnableData(DS_DEVICE, enable_data);
 
+    /* second: enable bills*/
+    if (!REQUEST(ID003_ENABLE, enable_data, 2, ID003_ENABLE, 2, DS_RESPONSE_TIMEOUT_MS, APP_EnableBillsDone))
+    {
+        APP_EnableBillTypesDone(0);
+    }
+}
 
 /**
-  * @brief  Process downstream startup
+  * @brief  ENABLE BILL TYPES step 2: requested bill types enabled
+  * @param  result: Transaction result
+  * @param  response: Unused
   * @retval None
   */
-static void APP_DownstreamStartup(void)
+static void APP_EnableBillsDone(transaction_result_t result, const message_t* response)
 {
-    switch (ds_context.startup)
-    {
-        case DS_NOT_STARTED:
-            /* Send out first poll request */
-            if (if_downstream.protocol == PROTO_ID003) REQUEST_DMA(ID003_STATUS_REQ, NULL, 0);
-            if (if_downstream.protocol == PROTO_CCTALK) REQUEST_DMA(CCTALK_SIMPLE_POLL, NULL, 0);
-            if (HAL_GetTick() - ds_context.last_req_time > 5000)
-            {
-                LOG_Warn("MCU startup sequence: waiting for downstream validator response");
-                ds_context.last_req_time = HAL_GetTick();
-            }
-            ds_context.startup = DS_FIRST_POLL_SENT;
-            break;
+    const ds_settings_t* settings = &g_bill_table.ds_settings;
+    uint8_t inhibit_data[1] = {0};  /* 0: de-inhibit*/
 
-        case DS_FIRST_POLL_SENT:
-            /* Wait for first poll response. 200ms. */
-            if (APP_WaitForDownstreamMessage(200) == MSG_OK)
-            {
-                ds_context.startup = DS_FIRST_POLL_RECEIVED_OK;
-                LOG_Debug("DS_FIRST_POLL_RECEIVED_OK");
-            }
-            else
-            	ds_context.startup = DS_NOT_STARTED;
-            break;
-        
-        case DS_FIRST_POLL_RECEIVED_OK:
-            /* Send out bill table request */
-        	HAL_Delay(5);  /* short delay after the validator response */
-            ds_context.startup = DS_BILL_TABLE_REQUEST_SENT;   /**/
-            APP_GetBillTable();
-            
+    (void)response;
 
-            break;
-        case DS_BILL_TABLE_REQUEST_SENT:
-            /* Wait for bill table response */
-            if (g_bill_table.is_loaded == 1)
-            {
-                ds_context.startup = DS_BILL_TABLE_RECEIVED_OK;
-                TABLE_UI_DisplayBillTable();
-            }
-            break;
+    /* already de-inhibited: done */
+    if (result == TRANSACTION_OK && (settings->valid & DS_SETTING_INHIBIT) && settings->inhibit == 0)
+    {
+        APP_EnableBillTypesDone(1);
+        return;
+    }
 
-        default:
-            /* Startup is completed */
-            ds_context.startup = DS_STARTUP_OK;
-            break;
-    } /* end switch */
+    /* third: de-inhibit*/
+    if (result != TRANSACTION_OK ||
+        !REQUEST(ID003_INHIBIT, inhibit_data, 1, ID003_INHIBIT, 1, DS_RESPONSE_TIMEOUT_MS, APP_EnableInhibitDone))
+    {
+        APP_EnableBillTypesDone(0);
+    }
 }
 
+/**
+  * @brief  ENABLE BILL TYPES step 3: validator de-inhibited
+  * @param  result: Transaction result
+  * @param  response: Unused
+  * @retval None
+  */
+static void APP_EnableInhibitDone(transaction_result_t result, const message_t* response)
+{
+    (void)response;
+
+    APP_EnableBillTypesDone(result == TRANSACTION_OK); /* only ack if all three successful*/
+}
 
+/**
+  * @brief  Stack acknowledge for CCNET STACK
+  * @param  result: Transaction result
+  * @param  response: Unused
+  * @retval None
+  */
+static void APP_StackDone(transaction_result_t result, const message_t* response)
+{
+    (void)response;
 
+    if (result == TRANSACTION_OK)
+    {
+        RESPOND(CCNET_ACK, NULL, 0);
+        ds_context.escrow_state = ESCROW_IN_STACK;
+    }
+    else
+    {
+        RESPOND(CCNET_NAK, NULL, 0);
+        ds_context.escrow_state = ESCROW_IDLE;
+    }
+}
 
+/**
+  * @brief  Return acknowledge for CCNET RETURN
+  * @note   The escrow state follows the RETURNING status of the validator
+  * @param  result: Transaction result
+  * @param  response: Unused
+  * @retval None
+  */
+static void APP_ReturnDone(transaction_result_t result, const message_t* response)
+{
+    (void)response;
 
+    RESPOND((result == TRANSACTION_OK) ? CCNET_ACK : CCNET_NAK, NULL, 0);
+}
 
+/**
+  * @brief  Serial number for CCNET IDENTIFICATION
+  * @param  result: Transaction result
+  * @param  response: ID003 serial number response
+  * @retval None
+  */
+static void APP_IdentificationDone(transaction_result_t result, const message_t* response)
+{
+    if (result == TRANSACTION_OK) APP_SetSerial(response->data, response->data_length);
+    APP_RespondIdentification();
+}
 
 /**
-  * @brief  Process downstream polling based on configured period
+  * @brief  Serial number for the warm-start snapshot, requests the version next
+  * @param  result: Transaction result
+  * @param  response: ID003 serial number response
   * @retval None
   */
-static void APP_DownstreamPolling(uint16_t polling_period_ms)
+static void APP_SnapshotSerialDone(transaction_result_t result, const message_t* response)
 {
-    uint32_t current_time = HAL_GetTick();
-    
-    /* Skip polling if disabled (period = 0) and startup is completed */
-    if ((if_downstream.datalink.polling_period_ms == 0) && (ds_context.startup >= DS_STARTUP_OK))
+    if (result != TRANSACTION_OK)
     {
+        LOG_Warn("Snapshot: no serial number response, snapshot not checked");
         return;
     }
-    
-    if ((current_time - ds_context.poller.last_poll_time) >= polling_period_ms)
-        {
-            /* Send status request */
-            REQUEST_DMA(ID003_STATUS_REQ, NULL, 0);
-                            
-            /* Set state to sent */
-            ds_context.poller.state = POLL_SENT;
-            ds_context.poller.last_poll_time = current_time;
-        }
+    APP_SetSerial(response->data, response->data_length);
+
+    if (!REQUEST(ID003_VERSION_REQ, NULL, 0, ID003_VERSION_REQ, TRANSACTION_ANY_LENGTH,
+                 DS_VERSION_TIMEOUT_MS, APP_SnapshotVersionDone))
+    {
+        APP_SaveSnapshot();
+    }
 }
 
 /**
-  * @brief  Get bill table from downstream validator
+  * @brief  Version for the warm-start snapshot, then save it if changed
+  * @param  result: Transaction result
+  * @param  response: ID003 version response
   * @retval None
   */
-static void APP_GetBillTable(void)
+static void APP_SnapshotVersionDone(transaction_result_t result, const message_t* response)
 {
-    /* Check protocol type */
-    if (if_downstream.protocol == PROTO_ID003)
+    if (result == TRANSACTION_OK)
     {
-        /* Request currency assignment/bill table from ID003 validator */
-        REQUEST(ID003_CURRENCY_ASSIGN_REQ, NULL, 0);
-        
-        /* Wait for response */
-        if(APP_WaitForDownstreamMessage(10+42)) /* response is 42ms long */
-        {
-            LOG_Debug("APP_GET_BILL_TABLE: parsing ID003 bill table");
-            
-            /* Parse ID003 currency assignment data */
-            /* Format: groups of 4 bytes: denom_nr, country_code, coefficient, exponent */
-            uint8_t num_denoms = downstream_msg.data_length / 4;
-            g_bill_table.count = 0;
-            
-            for (uint8_t i = 0; i < num_denoms; i++)
-            {
-                uint8_t offset = i * 4;
-                uint8_t denom_nr = downstream_msg.data[offset];
-                uint8_t country_code = downstream_msg.data[offset + 1];
-                uint8_t coefficient = downstream_msg.data[offset + 2];
-                uint8_t exponent = downstream_msg.data[offset + 3];
-                
-                /* Skip if coefficient is zero */
-                if (coefficient == 0)
-                {
-                    continue;
-                }
-                
-                /* Calculate value: coefficient * 10^exponent */
-                uint16_t value = coefficient;
-                for (uint8_t e = 0; e < exponent; e++)
-                {
-                    value *= 10;
-                }
-                
-                /* Store in bill table */
-                if (g_bill_table.count < MAX_BILL_DENOMS)
-                {
-                    g_bill_table.denoms[g_bill_table.count].id003_denom_nr = denom_nr;
-                    g_bill_table.denoms[g_bill_table.count].id003_denom_bitnr = (denom_nr & 0x0F) - 1; /* Extract bit number from denom_nr */
-                    g_bill_table.denoms[g_bill_table.count].value = value;
-                    g_bill_table.denoms[g_bill_table.count].ccnet_bitnr = g_bill_table.count; /* CCNET bit number maps sequentially */
-                    g_bill_table.denoms[g_bill_table.count].country_code = country_code;
-                    g_bill_table.count++;
-                }
-                
-            }
-            
-            LOG_Info("Bill table loaded from downstream validator");
-            g_bill_table.is_loaded = 1;
-
-            /* Get downstream bill status. Mainly for bill table display at startup and in config menu */
-            g_bill_table.ds_enabled_bills = 0;
-
-            /* first: request inhibit status*/
-            REQUEST(ID003_INHIBIT_REQ, NULL, 0);
-            if(WAIT_FOR_DS_MSG(20, ID003_INHIBIT_REQ, 1))
-            {
-                /* second: request enable status*/
-                if (downstream_msg.data[0] == 0)
-                {
-                    REQUEST(ID003_ENABLE_REQ, NULL, 0);
-                    if(WAIT_FOR_DS_MSG(20, ID003_ENABLE_REQ, 2))
-                    {
-                        g_bill_table.ds_enabled_bills = (~downstream_msg.data[0])>>1;
-                        g_bill_table.ds_escrowed_bills = 0x00007f;
-                    }
-                }
-            } else LOG_Warn("No ID003_INHIBIT_REQ response");         
-        } 
-        else {
-            LOG_Warn("APP_GET_BILL_TABLE: failed");
-        }
-    } /* end if PROTO_ID003 */
+        ds_version_length = (response->data_length > SNAPSHOT_VERSION_MAX) ? SNAPSHOT_VERSION_MAX : response->data_length;
+        utils_memcpy(ds_version, response->data, ds_version_length);
+    }
+    APP_SaveSnapshot();
 }
 
 /**
-  * @brief  Respond with bill table to upstream CCNET controller
+  * @brief  First poll of the second validator, requests its bill table next
+  * @param  result: Transaction result
+  * @param  response: Unused
   * @retval None
   */
-static void APP_RespondBillTable(void)
+static void APP_SecondFirstPollDone(transaction_result_t result, const message_t* response)
 {
-    /* If bill table not loaded yet, request it first */
-    if (g_bill_table.is_loaded == 0)
+    (void)response;
+
+    second.retry_tick = HAL_GetTick();
+    if (result != TRANSACTION_OK)
     {
-        APP_GetBillTable();
+        second.retry_delay_ms = SECOND_RETRY_MS;
+        return;
     }
+    LOG_Info("Second validator connected");
+    second.state = SECOND_BILL_TABLE;
+    second.retry_delay_ms = DS_BILL_TABLE_DELAY_MS;
+}
 
-    /* Create 24 rows of 5 bytes CCNET response payload */
-    uint8_t data[24*5];
-    uint8_t data_length = 24 * 5;
-    
-    /* Initialize all data to zero */
-    for (uint8_t i = 0; i < data_length; i++)
+/**
+  * @brief  Currency assignment of the second validator: merge its bill table
+  * @note   Denominations of another currency than the first validator are
+  *         left out, the controller knows one currency
+  * @param  result: Transaction result
+  * @param  response: ID003 currency assignment response
+  * @retval None
+  */
+static void APP_SecondBillTableDone(transaction_result_t result, const message_t* response)
+{
+    uint16_t values[POOL_DEVICE_ROWS];
+    uint8_t other_currency = 0;
+
+    if (result != TRANSACTION_OK)
     {
-        data[i] = 0;
+        LOG_Warn("Second validator: no bill table");
+        second.retry_tick = HAL_GetTick();
+        second.retry_delay_ms = SECOND_RETRY_MS;
+        return;
     }
-    
-    /* Fill in the bill table data from g_bill_table */
-    for (uint8_t i = 0; i < g_bill_table.count && i < 24; i++)
+
+    /* Format: groups of 4 bytes: denom_nr, country_code, coefficient, exponent */
+    second.count = 0;
+    for (uint8_t i = 0; i < response->data_length / 4 && second.count < POOL_DEVICE_ROWS; i++)
     {
-        uint8_t offset = i * 5;
-        uint16_t value = g_bill_table.denoms[i].value;
-        
-        /* Calculate coefficient and exponent from value */
-        uint8_t exponent = 0;
-        uint16_t coefficient = value;
-        while (coefficient >= 10 && exponent < 9)
+        const uint8_t* group = &response->data[i * 4];
+
+        if (group[2] == 0) continue;
+        if (g_bill_table.count > 0 && group[1] != g_bill_table.denoms[0].country_code)
         {
-            coefficient /= 10;
-            exponent++;
+            other_currency = 1;
+            continue;
         }
-        
-        /* Row format: coefficient, currency[0], currency[1], currency[2], exponent */
-        data[offset + 0] = (uint8_t)coefficient;
-        data[offset + 1] = g_bill_table.currency[0];
-        data[offset + 2] = g_bill_table.currency[1];
-        data[offset + 3] = g_bill_table.currency[2];
-        data[offset + 4] = exponent;
+        second.denoms[second.count] = group[0];
+        values[second.count] = APP_DenomValue(group[2], group[3]);
+        second.count++;
     }
+    if (other_currency) LOG_Warn("Second validator: denominations of another currency left out");
+
+    POOL_SetDevice(&bill_pool, SECOND_DEVICE, values, second.count);
+    APP_MergeBillTables();
+
+    second.state = SECOND_RUNNING;
+    second.retry_delay_ms = 0;
+    second.failed_polls = 0;
+    second.poll_now = 1;
+    LOG_Info("Second validator: bill table merged");
+}
+
+/**
+  * @brief  Poll of the second validator, its status reaches the mirror on reception
+  * @param  result: Transaction result
+  * @param  response: Unused
+  * @retval None
+  */
+static void APP_SecondPollDone(transaction_result_t result, const message_t* response)
+{
+    (void)response;
 
-    RESPOND(CCNET_BILL_TABLE, data, data_length);
+    if (result == TRANSACTION_OK)
+    {
+        second.failed_polls = 0;
+        return;
+    }
+    if (++second.failed_polls >= SECOND_LOST_POLLS) APP_SecondLost();
 }
 
+/**
+  * @brief  Enable response of the second validator, sets the inhibit next
+  * @param  result: Transaction result
+  * @param  response: ID003 enable echo
+  * @retval None
+  */
+static void APP_SecondEnableDone(transaction_result_t result, const message_t* response)
+{
+    uint8_t inhibit;
+
+    if (result != TRANSACTION_OK)
+    {
+        APP_SecondEnableFinished(0);
+        return;
+    }
+
+    second.rows = (uint8_t)(~response->data[0]) >> 1;
+    inhibit = (second.rows == 0);
+    if (!SECOND_REQUEST(ID003_INHIBIT, &inhibit, 1, ID003_INHIBIT, 1, DS_RESPONSE_TIMEOUT_MS, APP_SecondInhibitDone))
+    {
+        APP_SecondEnableFinished(0);
+    }
+}
 
+/**
+  * @brief  Inhibit response of the second validator, ends the enable sequence
+  * @param  result: Transaction result
+  * @param  response: ID003 inhibit echo
+  * @retval None
+  */
+static void APP_SecondInhibitDone(transaction_result_t result, const message_t* response)
+{
+    if (result == TRANSACTION_OK) second.inhibit = response->data[0];
+    APP_SecondEnableFinished(result == TRANSACTION_OK);
+}
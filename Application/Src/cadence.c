@@ -0,0 +1,140 @@
+/**
+  ******************************************************************************
+  * @file           : cadence.c
+  * @brief          : Poll cadence tracker implementation
+  *                   The controller polls at a fixed rate of its own choice.
+  *                   Once that rate is learned, the downstream status request
+  *                   can be timed so the answer is fresh when the next POLL
+  *                   arrives.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "cadence.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define CADENCE_ONE_MS          (1UL << CADENCE_FRACTION_BITS)
+#define CADENCE_AVERAGE_SHIFT   3       /* Running average weight 1/8 */
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize a cadence tracker, nothing learned
+  * @param  cadence: Cadence tracker
+  * @retval None
+  */
+void CADENCE_Init(cadence_t* cadence)
+{
+    cadence->last_time = 0;
+    cadence->interval = 0;
+    cadence->jitter = 0;
+    cadence->events = 0;
+    cadence->unlocks = 0;
+    cadence->samples = 0;
+}
+
+/**
+  * @brief  Record an event
+  * @note   An interval outside the jitter window (a quarter of the interval,
+  *         at least 4x the jitter + 2 ms) or longer than CADENCE_MAX_INTERVAL_MS
+  *         restarts learning from that interval
+  * @param  cadence: Cadence tracker
+  * @param  now: Event time in ms
+  * @retval None
+  */
+void CADENCE_Update(cadence_t* cadence, uint32_t now)
+{
+    uint32_t sample = (now - cadence->last_time) << CADENCE_FRACTION_BITS;
+    uint32_t deviation;
+    uint32_t window;
+
+    cadence->events++;
+    if (cadence->events == 1 || now - cadence->last_time > CADENCE_MAX_INTERVAL_MS)
+    {
+        /* first event or a pause: no interval yet */
+        cadence->last_time = now;
+        cadence->samples = 0;
+        return;
+    }
+    cadence->last_time = now;
+
+    if (cadence->samples == 0)
+    {
+        cadence->interval = sample;
+        cadence->jitter = 0;
+        cadence->samples = 1;
+        return;
+    }
+
+    deviation = (sample > cadence->interval) ? sample - cadence->interval : cadence->interval - sample;
+    window = 4 * cadence->jitter + 2 * CADENCE_ONE_MS;
+    if (window < cadence->interval / 4) window = cadence->interval / 4;
+
+    if (deviation > window)
+    {
+        if (cadence->samples >= CADENCE_LOCK_SAMPLES) cadence->unlocks++;
+        cadence->interval = sample;
+        cadence->jitter = 0;
+        cadence->samples = 1;
+        return;
+    }
+
+    /* running averages, signed step on the unsigned interval */
+    if (sample > cadence->interval) cadence->interval += (sample - cadence->interval) >> CADENCE_AVERAGE_SHIFT;
+    else cadence->interval -= (cadence->interval - sample) >> CADENCE_AVERAGE_SHIFT;
+    if (deviation > cadence->jitter) cadence->jitter += (deviation - cadence->jitter) >> CADENCE_AVERAGE_SHIFT;
+    else cadence->jitter -= (cadence->jitter - deviation) >> CADENCE_AVERAGE_SHIFT;
+
+    if (cadence->samples < 255) cadence->samples++;
+}
+
+/**
+  * @brief  Check if the cadence is known and still running
+  * @note   Not locked once an expected event is late by more than half an interval
+  * @param  cadence: Cadence tracker
+  * @param  now: Current time in ms
+  * @retval uint8_t: 1 if locked
+  */
+uint8_t CADENCE_IsLocked(const cadence_t* cadence, uint32_t now)
+{
+    uint32_t interval_ms = cadence->interval >> CADENCE_FRACTION_BITS;
+
+    if (cadence->samples < CADENCE_LOCK_SAMPLES || interval_ms == 0) return 0;
+    return (now - cadence->last_time <= interval_ms + interval_ms / 2);
+}
+
+/**
+  * @brief  Expected time of the next event
+  * @param  cadence: Cadence tracker
+  * @retval uint32_t: Time in ms, only meaningful while locked
+  */
+uint32_t CADENCE_NextExpected(const cadence_t* cadence)
+{
+    return cadence->last_time + ((cadence->interval + CADENCE_ONE_MS / 2) >> CADENCE_FRACTION_BITS);
+}
+
+/**
+  * @brief  Average interval
+  * @param  cadence: Cadence tracker
+  * @retval uint16_t: Interval in ms (rounded)
+  */
+uint16_t CADENCE_GetInterval(const cadence_t* cadence)
+{
+    return (uint16_t)((cadence->interval + CADENCE_ONE_MS / 2) >> CADENCE_FRACTION_BITS);
+}
+
+/**
+  * @brief  Average deviation from the interval
+  * @param  cadence: Cadence tracker
+  * @retval uint16_t: Jitter in ms (rounded up)
+  */
+uint16_t CADENCE_GetJitter(const cadence_t* cadence)
+{
+    return (uint16_t)((cadence->jitter + CADENCE_ONE_MS - 1) >> CADENCE_FRACTION_BITS);
+}
@@ -0,0 +1,341 @@
+/**
+  ******************************************************************************
+  * @file           : ccbus.c
+  * @brief          : ccTalk multi-drop bus scheduler implementation
+  *                   Several peripherals (bill validator, coin acceptor,
+  *                   hopper) share one ccTalk bus. The bus owner polls them
+  *                   round-robin, each at its own period, and never has more
+  *                   than one request on the line: the next poll waits for
+  *                   the response or the deadline of the current one.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ccbus.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static void CCBUS_Complete(ccbus_t* bus, uint32_t now);
+static void CCBUS_CountEvents(ccbus_device_t* device, uint8_t counter);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize an empty bus
+  * @param  bus: Bus
+  * @param  host_address: Our ccTalk address, source of the requests
+  * @param  now: Current time in ms
+  * @retval None
+  */
+void CCBUS_Init(ccbus_t* bus, uint8_t host_address, uint32_t now)
+{
+    bus->count = 0;
+    bus->host_address = host_address;
+    bus->active = CCBUS_NO_DEVICE;
+    bus->next = 0;
+    bus->request_tick = now;
+    bus->busy_start = now;
+    bus->window_start = now;
+    bus->window_busy_ms = 0;
+    bus->utilisation = 0;
+}
+
+/**
+  * @brief  Add a peripheral to the bus
+  * @note   The first poll is due immediately
+  * @param  bus: Bus
+  * @param  config: Peripheral address, poll command, period and deadline, copied
+  * @retval uint8_t: Device index, CCBUS_NO_DEVICE if the bus is full or the address is in use
+  */
+uint8_t CCBUS_AddDevice(ccbus_t* bus, const ccbus_device_config_t* config)
+{
+    ccbus_device_t* device;
+
+    if (bus->count >= CCBUS_MAX_DEVICES) return CCBUS_NO_DEVICE;
+    for (uint8_t i = 0; i < bus->count; i++)
+    {
+        if (bus->devices[i].config.address == config->address) return CCBUS_NO_DEVICE;
+    }
+
+    device = &bus->devices[bus->count];
+    device->config = *config;
+    device->online = 0;
+    device->counter_valid = 0;
+    device->counter = 0;
+    device->new_events = 0;
+    device->last_poll = 0;
+    device->polls = 0;
+    device->responses = 0;
+    device->timeouts = 0;
+    device->events = 0;
+    device->lost_events = 0;
+    device->resets = 0;
+    device->collisions = 0;
+    device->retries = 0;
+    device->latency_total_ms = 0;
+    device->latency_max_ms = 0;
+    return bus->count++;
+}
+
+/**
+  * @brief  Take the bus for the next due poll
+  * @note   The search starts after the last polled device, so a device with a
+  *         short period cannot starve the others. Nothing is due while a
+  *         request is on the line
+  * @param  bus: Bus
+  * @param  now: Current time in ms
+  * @param  frame: Poll frame, CCBUS_FRAME_MAX bytes, to be sent by the caller
+  * @retval uint8_t: Polled device index, CCBUS_NO_DEVICE if the bus is busy or no poll is due
+  */
+uint8_t CCBUS_Next(ccbus_t* bus, uint32_t now, uint8_t* frame)
+{
+    uint8_t sum = 0;
+
+    if (bus->active != CCBUS_NO_DEVICE) return CCBUS_NO_DEVICE;
+
+    for (uint8_t n = 0; n < bus->count; n++)
+    {
+        uint8_t index = (uint8_t)((bus->next + n) % bus->count);
+        ccbus_device_t* device = &bus->devices[index];
+
+        if (device->polls != 0 && now - device->last_poll < device->config.period_ms) continue;
+
+        frame[0] = device->config.address;
+        frame[1] = 0;                       /* No data */
+        frame[2] = bus->host_address;
+        frame[3] = device->config.header;
+        for (uint8_t i = 0; i < CCBUS_FRAME_MAX - 1; i++) sum += frame[i];
+        frame[4] = (uint8_t)(0 - sum);      /* Frame sums to 0 mod 256 */
+
+        device->last_poll = now;
+        device->polls++;
+        bus->active = index;
+        bus->next = (uint8_t)(index + 1);
+        bus->request_tick = now;
+        bus->busy_start = now;
+        return index;
+    }
+    return CCBUS_NO_DEVICE;
+}
+
+/**
+  * @brief  Offer a parsed ccTalk response to the bus
+  * @note   Only the device with the request on the line can answer. A late
+  *         answer after the deadline is ignored
+  * @param  bus: Bus
+  * @param  address: Source address of the response
+  * @param  data: Response data
+  * @param  data_length: Response data length
+  * @param  now: Current time in ms
+  * @retval uint8_t: Device index, CCBUS_NO_DEVICE if the response was not expected
+  */
+uint8_t CCBUS_Response(ccbus_t* bus, uint8_t address, const uint8_t* data, uint8_t data_length, uint32_t now)
+{
+    uint8_t index = bus->active;
+    ccbus_device_t* device;
+    uint32_t latency;
+
+    if (index == CCBUS_NO_DEVICE || bus->devices[index].config.address != address) return CCBUS_NO_DEVICE;
+
+    device = &bus->devices[index];
+    latency = now - bus->request_tick;
+    device->responses++;
+    device->latency_total_ms += latency;
+    if (latency > device->latency_max_ms) device->latency_max_ms = (uint16_t)(latency > 0xFFFF ? 0xFFFF : latency);
+    device->online = 1;
+    device->new_events = 0;
+    device->retries = 0;
+    if (device->config.event_counter && data_length > 0) CCBUS_CountEvents(device, data[0]);
+
+    CCBUS_Complete(bus, now);
+    return index;
+}
+
+/**
+  * @brief  Drop the request on the line after an echo collision
+  * @note   Another sender drove the bus while the poll was sent, the
+  *         peripheral did not get it. The poll is repeated right away, up to
+  *         CCBUS_MAX_RETRIES times in a row, then at the normal period
+  * @param  bus: Bus
+  * @param  now: Current time in ms
+  * @retval uint8_t: Device index, CCBUS_NO_DEVICE if no request was on the line
+  */
+uint8_t CCBUS_Collision(ccbus_t* bus, uint32_t now)
+{
+    uint8_t index = bus->active;
+    ccbus_device_t* device;
+
+    if (index == CCBUS_NO_DEVICE) return CCBUS_NO_DEVICE;
+
+    device = &bus->devices[index];
+    device->collisions++;
+    if (device->retries < CCBUS_MAX_RETRIES)
+    {
+        device->retries++;
+        device->last_poll = now - device->config.period_ms;     /* Due again */
+        bus->next = index;
+    }
+    else
+    {
+        device->retries = 0;
+    }
+    CCBUS_Complete(bus, now);
+    return index;
+}
+
+/**
+  * @brief  Run the bus owner
+  * @note   Called from the main loop: times out the request on the line and
+  *         closes the utilisation window
+  * @param  bus: Bus
+  * @param  now: Current time in ms
+  * @retval None
+  */
+void CCBUS_Process(ccbus_t* bus, uint32_t now)
+{
+    if (bus->active != CCBUS_NO_DEVICE &&
+        now - bus->request_tick >= bus->devices[bus->active].config.timeout_ms)
+    {
+        ccbus_device_t* device = &bus->devices[bus->active];
+
+        device->timeouts++;
+        device->online = 0;
+        device->new_events = 0;
+        device->retries = 0;
+        CCBUS_Complete(bus, now);
+    }
+
+    if (now - bus->window_start >= CCBUS_WINDOW_MS)
+    {
+        uint32_t window = now - bus->window_start;
+
+        if (bus->active != CCBUS_NO_DEVICE)
+        {
+            bus->window_busy_ms += now - bus->busy_start;
+            bus->busy_start = now;
+        }
+        bus->utilisation = (uint16_t)(bus->window_busy_ms >= window ? 1000 : bus->window_busy_ms * 1000 / window);
+        bus->window_busy_ms = 0;
+        bus->window_start = now;
+    }
+}
+
+/**
+  * @brief  Check if a request is on the line
+  * @param  bus: Bus
+  * @retval uint8_t: 1 if waiting for a response
+  */
+uint8_t CCBUS_IsBusy(const ccbus_t* bus)
+{
+    return (bus->active != CCBUS_NO_DEVICE);
+}
+
+/**
+  * @brief  Check if no peripheral has ever answered
+  * @note   Wrong baud rate, parity or protocol: every device timed out at
+  *         least timeouts times and none responded
+  * @param  bus: Bus
+  * @param  timeouts: Timeouts each device must have
+  * @retval uint8_t: 1 if the bus has devices and all of them are silent
+  */
+uint8_t CCBUS_IsSilent(const ccbus_t* bus, uint32_t timeouts)
+{
+    if (bus->count == 0) return 0;
+
+    for (uint8_t i = 0; i < bus->count; i++)
+    {
+        if (bus->devices[i].responses || bus->devices[i].timeouts < timeouts) return 0;
+    }
+    return 1;
+}
+
+/**
+  * @brief  Clear the statistics of all devices and restart the utilisation window
+  * @note   Poll schedule and event counters are kept
+  * @param  bus: Bus
+  * @param  now: Current time in ms
+  * @retval None
+  */
+void CCBUS_ResetStats(ccbus_t* bus, uint32_t now)
+{
+    for (uint8_t i = 0; i < bus->count; i++)
+    {
+        ccbus_device_t* device = &bus->devices[i];
+
+        device->polls = 0;
+        device->responses = 0;
+        device->timeouts = 0;
+        device->events = 0;
+        device->lost_events = 0;
+        device->resets = 0;
+        device->collisions = 0;
+        device->latency_total_ms = 0;
+        device->latency_max_ms = 0;
+    }
+    bus->busy_start = now;
+    bus->window_start = now;
+    bus->window_busy_ms = 0;
+    bus->utilisation = 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Free the bus after a response or a timeout
+  * @param  bus: Bus
+  * @param  now: Current time in ms
+  * @retval None
+  */
+static void CCBUS_Complete(ccbus_t* bus, uint32_t now)
+{
+    bus->window_busy_ms += now - bus->busy_start;
+    bus->active = CCBUS_NO_DEVICE;
+}
+
+/**
+  * @brief  Count the events behind a new ccTalk event counter
+  * @note   The counter runs 1..255 and wraps to 1, 0 only after a reset. The
+  *         first counter read only synchronises: the events before it are
+  *         unknown. A jump of more than CCBUS_EVENT_BUFFER lost events
+  * @param  device: Device
+  * @param  counter: Event counter of the response
+  * @retval None
+  */
+static void CCBUS_CountEvents(ccbus_device_t* device, uint8_t counter)
+{
+    uint8_t delta;
+
+    if (counter == 0)
+    {
+        if (!device->counter_valid || device->counter != 0) device->resets++;
+        delta = 0;
+    }
+    else if (!device->counter_valid)
+    {
+        delta = 0;
+    }
+    else if (device->counter == 0)
+    {
+        delta = counter;                    /* Events since the reset */
+    }
+    else
+    {
+        delta = (uint8_t)(counter >= device->counter ? counter - device->counter
+                                                     : counter + 255 - device->counter);
+    }
+
+    if (delta > CCBUS_EVENT_BUFFER)
+    {
+        device->lost_events += delta - CCBUS_EVENT_BUFFER;
+        delta = CCBUS_EVENT_BUFFER;
+    }
+    device->events += delta;
+    device->new_events = delta;
+    device->counter = counter;
+    device->counter_valid = 1;
+}
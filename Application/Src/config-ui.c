@@ -48,6 +48,9 @@ static void UpdateDownstreamPolling(void);
 static void ShowBillTable(void);
 static void UpdateUsbLogging(void);
 static void UpdateProtocolLogging(void);
+static void UpdateAdaptivePolling(void);
+static void SetAdaptivePolling(uint16_t fast_ms, uint16_t slow_ms);
+static void UpdateSecondValidator(void);
 static void DisplaySeparator(void);
 static void DisplayEnterChoice(uint8_t max_choice);
 static uint8_t WaitForInput(void);
@@ -61,10 +64,10 @@ void CONFIGUI_ShowMenu(void)
     CONFIGUI_ShowConfiguration();
     HAL_Delay(100); /* 100ms delay to ensure the configuration is displayed */
     
-    USB_TransmitString("12. Exit and Restart\r\n");
-    USB_TransmitString("13. Save, Exit and Restart\r\n");
+    USB_TransmitString("14. Exit and Restart\r\n");
+    USB_TransmitString("15. Save, Exit and Restart\r\n");
     USB_TransmitString("======================================================\r\n");
-    DisplayEnterChoice(13);
+    DisplayEnterChoice(15);
     HAL_Delay(100);
     USB_Flush();
 }
@@ -132,6 +135,21 @@ void CONFIGUI_ShowConfiguration(void)
     }
     snprintf(config_line, sizeof(config_line), "11. Log Level                : %s\r\n", log_level_str);
     USB_TransmitString(config_line);
+
+    if (g_config.poll_fast_ms == 0 || g_config.poll_slow_ms == 0)
+    {
+        snprintf(config_line, sizeof(config_line), "12. Adaptive Polling         : Off (fixed period)\r\n");
+    }
+    else
+    {
+        snprintf(config_line, sizeof(config_line), "12. Adaptive Polling         : %ums fast, %ums slow\r\n",
+                 g_config.poll_fast_ms, g_config.poll_slow_ms);
+    }
+    USB_TransmitString(config_line);
+
+    USB_TransmitString("13. Second Validator         : ");
+    USB_TransmitString(g_config.second_validator == CONFIG_SECOND_ID003 ? "ID003 on UART3" : "Off");
+    USB_TransmitString("\r\n");
     USB_TransmitString("======================================================\r\n\r\n");
 }
 
@@ -151,7 +169,7 @@ void CONFIGUI_ProcessMenu(void)
         if (USB_GetInputLine(input_buffer, sizeof(input_buffer)) > 0)
         {
             // Parse the choice
-            uint8_t choice = ParseChoice(input_buffer, 1, 13);
+            uint8_t choice = ParseChoice(input_buffer, 1, 15);
             
             // Process the choice
             if (choice > 0)
@@ -191,6 +209,12 @@ void CONFIGUI_ProcessMenu(void)
                     case CONFIGUI_MENU_LOG_LEVEL:
                         UpdateProtocolLogging();
                         break;
+                    case CONFIGUI_MENU_ADAPTIVE_POLLING:
+                        UpdateAdaptivePolling();
+                        break;
+                    case CONFIGUI_MENU_SECOND_VALIDATOR:
+                        UpdateSecondValidator();
+                        break;
                     case CONFIGUI_MENU_EXIT:
                         ExitMenu();
                         return; // Exit immediately, don't show menu again
@@ -208,7 +232,7 @@ void CONFIGUI_ProcessMenu(void)
             }
             else
             {
-                USB_TransmitString("Invalid choice! Please enter a number between 1 and 13: ");
+                USB_TransmitString("Invalid choice! Please enter a number between 1 and 15: ");
             }
         }
     }
@@ -734,8 +758,118 @@ static void UpdateProtocolLogging(void)
     }
 }
 
+/**
+  * @brief  Update adaptive polling bounds
+  * @note   Only used with asynchronous polling: fast while a bill is handled,
+  *         slow while idle, disabled or failed. The polling period (item 8)
+  *         is used for all other states
+  * @retval None
+  */
+static void UpdateAdaptivePolling(void)
+{
+    USB_TransmitString("\r\nSelect adaptive polling (fast / slow):\r\n");
+    USB_TransmitString("1. Off (fixed period)\r\n");
+    USB_TransmitString("2. 20ms / 500ms\r\n");
+    USB_TransmitString("3. 50ms / 1000ms\r\n");
+    USB_TransmitString("4. 100ms / 1000ms\r\n");
+    DisplayEnterChoice(4);
+    
+    // Wait for user input
+    if (WaitForInput())
+    {
+        char input_buffer[16];
+        if (USB_GetInputLine(input_buffer, sizeof(input_buffer)) > 0)
+        {
+            uint8_t choice = ParseChoice(input_buffer, 1, 4);
+            if (choice > 0)
+            {
+                switch (choice)
+                {
+                    case 1: SetAdaptivePolling(0, 0); break;
+                    case 2: SetAdaptivePolling(20, 500); break;
+                    case 3: SetAdaptivePolling(50, 1000); break;
+                    case 4: SetAdaptivePolling(100, 1000); break;
+                }
+            }
+            else
+            {
+                USB_TransmitString("Invalid choice! Using default (50ms / 1000ms).\r\n");
+                SetAdaptivePolling(CONFIG_POLL_FAST_MS_DEFAULT, CONFIG_POLL_SLOW_MS_DEFAULT);
+            }
+        }
+        else
+        {
+            USB_TransmitString("No input received. Using default (50ms / 1000ms).\r\n");
+            SetAdaptivePolling(CONFIG_POLL_FAST_MS_DEFAULT, CONFIG_POLL_SLOW_MS_DEFAULT);
+        }
+    }
+    else
+    {
+        USB_TransmitString("No input received. Using default (50ms / 1000ms).\r\n");
+        SetAdaptivePolling(CONFIG_POLL_FAST_MS_DEFAULT, CONFIG_POLL_SLOW_MS_DEFAULT);
+    }
+}
+
 /* Private functions ---------------------------------------------------------*/
 
+/**
+  * @brief  Set the adaptive polling bounds
+  * @param  fast_ms: Period while a bill is handled, 0 = off
+  * @param  slow_ms: Period while idle, disabled or failed, 0 = off
+  * @retval None
+  */
+static void SetAdaptivePolling(uint16_t fast_ms, uint16_t slow_ms)
+{
+    g_config.poll_fast_ms = fast_ms;
+    g_config.poll_slow_ms = slow_ms;
+}
+
+/**
+  * @brief  Update the second downstream validator setting
+  * @note   An ID003 validator on UART3 next to the ID003 validator on UART2,
+  *         behind the same CCNET bill validator. Applied after the restart.
+  *         UART3 then no longer carries a ccTalk bus
+  * @retval None
+  */
+static void UpdateSecondValidator(void)
+{
+    USB_TransmitString("\r\nSecond Validator: ");
+    USB_TransmitString(g_config.second_validator == CONFIG_SECOND_ID003 ? "ID003 on UART3" : "Off");
+    USB_TransmitString("\r\n");
+    USB_TransmitString("1. Off\r\n");
+    USB_TransmitString("2. ID003 on UART3\r\n");
+    DisplayEnterChoice(2);
+    
+    // Wait for user input
+    if (WaitForInput())
+    {
+        char input_buffer[16];
+        if (USB_GetInputLine(input_buffer, sizeof(input_buffer)) > 0)
+        {
+            uint8_t choice = ParseChoice(input_buffer, 1, 2);
+            if (choice > 0)
+            {
+                g_config.second_validator = (choice == 2) ? CONFIG_SECOND_ID003 : CONFIG_SECOND_OFF;
+            }
+            else
+            {
+                USB_TransmitString("Invalid choice! Using default (Off).\r\n");
+                g_config.second_validator = CONFIG_SECOND_OFF;
+            }
+        }
+        else
+        {
+            USB_TransmitString("No input received. Using default (Off).\r\n");
+            g_config.second_validator = CONFIG_SECOND_OFF;
+        }
+    }
+    else
+    {
+        USB_TransmitString("No input received. Using default (Off).\r\n");
+        g_config.second_validator = CONFIG_SECOND_OFF;
+    }
+}
+
 /**
   * @brief  Display baudrate options
   * @retval None
@@ -31,6 +31,9 @@ extern LED_HandleTypeDef hled3;
 /* Global configuration settings */
 config_settings_t g_config;
 
+/* Save requested while the converter runs, written by the application between POLLs */
+static uint8_t config_save_pending = 0;
+
 
 
 /* Private function prototypes -----------------------------------------------*/
@@ -60,6 +63,11 @@ void CONFIG_Init(void)
     {
         g_config.bill_table[i] = 0;
     }
+
+    /* Kept when an older configuration without polling bounds is loaded */
+    g_config.poll_fast_ms = CONFIG_POLL_FAST_MS_DEFAULT;
+    g_config.poll_slow_ms = CONFIG_POLL_SLOW_MS_DEFAULT;
+    g_config.second_validator = CONFIG_SECOND_OFF;
     
     /* Load settings from NVM and store in if_upstream and if_downstream */
     CONFIG_LoadFromNVM();
@@ -106,6 +114,18 @@ void CONFIG_LoadFromNVM(void)
     }
 }
 
+/**
+  * @brief  Set UART handle and datalink parameters for the interface protocol
+  * @param  interface: Pointer to interface configuration structure
+  * @note   Used when the protocol changes at runtime (auto-discovery)
+  * @retval None
+  */
+void CONFIG_ApplyProtocol(interface_config_t* interface)
+{
+    CONFIG_SetPhy(interface);
+    CONFIG_SetDataLink(interface);
+}
+
 /**
   * @brief  Set protocol-specific phy (uart) configuration for interface
   * @param  interface: Pointer to interface configuration structure
@@ -135,8 +155,9 @@ static void CONFIG_SetPhy(interface_config_t* interface)
 /**
   * @brief  Set protocol-specific datalink configuration for interface
   * @param  interface: Pointer to interface configuration structure
-  * @note   Sets sync bytes, length offset, CRC length, and timeout based on protocol.
-  *         Polling period is preserved from flash storage.
+  * @note   Sets sync bytes, length offset and CRC length based on protocol.
+  *         Polling period is preserved from flash storage. The inter-byte timeout
+  *         is the USART receiver timeout, set per protocol in uart.c.
   * @retval None
   */
   static void CONFIG_SetDataLink(interface_config_t* interface)
@@ -151,7 +172,6 @@ static void CONFIG_SetPhy(interface_config_t* interface)
               interface->datalink.sync_byte2 = 0x03;
               interface->datalink.length_offset = 0;
               interface->datalink.crc_length = 2;
-              interface->datalink.inter_byte_timeout_ms = 5;
               break;
           case PROTO_ID003:
               interface->datalink.sync_length = 1;
@@ -159,7 +179,6 @@ static void CONFIG_SetPhy(interface_config_t* interface)
               interface->datalink.sync_byte2 = 0x00;
               interface->datalink.length_offset = 0;
               interface->datalink.crc_length = 2;
-              interface->datalink.inter_byte_timeout_ms = 5;
               break;
           case PROTO_CCTALK:
               interface->datalink.sync_length = 1;
@@ -167,7 +186,6 @@ static void CONFIG_SetPhy(interface_config_t* interface)
               interface->datalink.sync_byte2 = 0x00;
               interface->datalink.length_offset = 5;
               interface->datalink.crc_length = 1;
-              interface->datalink.inter_byte_timeout_ms = 5;
               interface->datalink.cctalk_echo_byte_count = 0;
               break;
           default:
@@ -186,6 +204,8 @@ void CONFIG_SaveToNVM(void)
     uint8_t buffer[512];
     uint32_t buffer_size;
     
+    config_save_pending = 0;
+
     /* Serialize configuration to buffer */
     result = CONFIG_SerializeToBuffer(buffer, &buffer_size);
     if (result == NVM_OK)
@@ -209,6 +229,25 @@ void CONFIG_SaveToNVM(void)
     }
 }
 
+/**
+  * @brief  Request a configuration save without writing the flash now
+  * @note   The page erase stalls the CPU, the application picks the moment
+  *         (CONFIG_IsSavePending, CONFIG_SaveToNVM)
+  * @retval None
+  */
+void CONFIG_RequestSave(void)
+{
+    config_save_pending = 1;
+}
+
+/**
+  * @brief  Check for a requested configuration save
+  * @retval uint8_t: 1 if CONFIG_RequestSave was called since the last save
+  */
+uint8_t CONFIG_IsSavePending(void)
+{
+    return config_save_pending;
+}
 
 /**
   * @brief  Serialize configuration to buffer
@@ -256,6 +295,15 @@ static nvm_result_t CONFIG_SerializeToBuffer(uint8_t* buffer, uint32_t* buffer_s
     {
         buffer[offset++] = g_config.bill_table[i];
     }
+
+    /* Serialize adaptive polling bounds (little endian) */
+    buffer[offset++] = (uint8_t)(g_config.poll_fast_ms & 0xFF);
+    buffer[offset++] = (uint8_t)(g_config.poll_fast_ms >> 8);
+    buffer[offset++] = (uint8_t)(g_config.poll_slow_ms & 0xFF);
+    buffer[offset++] = (uint8_t)(g_config.poll_slow_ms >> 8);
+
+    /* Serialize second validator */
+    buffer[offset++] = g_config.second_validator;
     
     *buffer_size = offset;
     return NVM_OK;
@@ -274,10 +322,12 @@ static nvm_result_t CONFIG_DeserializeFromBuffer(const uint8_t* buffer, uint32_t
         return NVM_INVALID_PARAM;
     }
     
-    /* Calculate expected buffer size: 2x interface_config_t + 2 bytes + 8 bytes bill table */
+    /* Calculate expected buffer size: 2x interface_config_t + 2 bytes + 8 bytes bill table,
+       followed by 4 bytes polling bounds and 1 byte second validator (absent in configurations
+       saved by older firmware) */
     uint32_t expected_size = (2 * sizeof(interface_config_t)) + 2 + 8;
     
-    if (buffer_size != expected_size)
+    if (buffer_size != expected_size && buffer_size != expected_size + 4 && buffer_size != expected_size + 5)
     {
         LOG_Error("Buffer size does not match expected config size");
         return NVM_INVALID_PARAM;
@@ -316,6 +366,21 @@ static nvm_result_t CONFIG_DeserializeFromBuffer(const uint8_t* buffer, uint32_t
     {
         g_config.bill_table[i] = buffer[offset++];
     }
+
+    /* Deserialize adaptive polling bounds, defaults are kept for an older configuration */
+    if (buffer_size >= expected_size + 4)
+    {
+        g_config.poll_fast_ms = (uint16_t)(buffer[offset] | (buffer[offset + 1] << 8));
+        g_config.poll_slow_ms = (uint16_t)(buffer[offset + 2] | (buffer[offset + 3] << 8));
+        offset += 4;
+    }
+
+    /* Deserialize second validator, off for an older configuration */
+    if (buffer_size == expected_size + 5)
+    {
+        g_config.second_validator = (buffer[offset] == CONFIG_SECOND_ID003) ? CONFIG_SECOND_ID003 : CONFIG_SECOND_OFF;
+        offset += 1;
+    }
     
     return NVM_OK;
 }
@@ -0,0 +1,485 @@
+/**
+  ******************************************************************************
+  * @file           : console.c
+  * @brief          : USB console implementation
+  *                   Line commands accepted while the application is running.
+  *                   The configuration menu (button) stops the application,
+  *                   these commands do not.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "console.h"
+#include "app.h"
+#include "config.h"
+#include "sched.h"
+#include "uart.h"
+#include "usb.h"
+#include "utils.h"
+#include <stdio.h>  /* For snprintf */
+#include <string.h> /* For strcmp */
+
+/* Private function prototypes -----------------------------------------------*/
+static void CONSOLE_ShowHelp(void);
+static void CONSOLE_ShowStats(const char* name, interface_config_t* interface);
+static void CONSOLE_ShowCounter(const char* name, uint32_t value);
+static void CONSOLE_ShowCycles(const char* name, interface_config_t* interface);
+static void CONSOLE_ShowPollTiming(void);
+static void CONSOLE_ShowCommands(void);
+static void CONSOLE_ShowTasks(void);
+static void CONSOLE_ShowLatency(void);
+static void CONSOLE_ShowBus(void);
+static void CONSOLE_ShowPool(void);
+static void CONSOLE_ShowBoot(void);
+static void CONSOLE_SetEchoMode(const char* mode);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Process a pending USB input line
+  * @note   Called from the main loop while the configuration menu is not active
+  * @retval None
+  */
+void CONSOLE_Process(void)
+{
+    char line[CONSOLE_LINE_LENGTH];
+
+    if (!USB_IsInputReady()) return;
+    if (USB_GetInputLine(line, sizeof(line)) == 0) return;
+
+    if (strcmp(line, "stats") == 0)
+    {
+        CONSOLE_ShowStats("Upstream", g_config.upstream);
+        CONSOLE_ShowStats("Downstream", g_config.downstream);
+        if (g_config.second_validator != CONFIG_SECOND_OFF) CONSOLE_ShowStats("Second", &if_second);
+    }
+    else if (strcmp(line, "stats reset") == 0)
+    {
+        UART_ResetStats(g_config.upstream);
+        UART_ResetStats(g_config.downstream);
+        if (g_config.second_validator != CONFIG_SECOND_OFF) UART_ResetStats(&if_second);
+        APP_ResetPollTiming();
+        APP_ResetCommandStats();
+        SCHED_ResetStats();
+        APP_ResetCommandLatency();
+        APP_ResetBusStats();
+        USB_TransmitString("Statistics cleared\r\n");
+    }
+    else if (strcmp(line, "cycles") == 0)
+    {
+        CONSOLE_ShowCycles("Upstream", g_config.upstream);
+        CONSOLE_ShowCycles("Downstream", g_config.downstream);
+    }
+    else if (strcmp(line, "poll") == 0)
+    {
+        CONSOLE_ShowPollTiming();
+    }
+    else if (strcmp(line, "commands") == 0)
+    {
+        CONSOLE_ShowCommands();
+    }
+    else if (strcmp(line, "tasks") == 0)
+    {
+        CONSOLE_ShowTasks();
+    }
+    else if (strcmp(line, "latency") == 0)
+    {
+        CONSOLE_ShowLatency();
+    }
+    else if (strcmp(line, "latency reset") == 0)
+    {
+        APP_ResetCommandLatency();
+        USB_TransmitString("Latency histograms cleared\r\n");
+    }
+    else if (strcmp(line, "bus") == 0)
+    {
+        CONSOLE_ShowBus();
+    }
+    else if (strcmp(line, "pool") == 0)
+    {
+        CONSOLE_ShowPool();
+    }
+    else if (strcmp(line, "boot") == 0)
+    {
+        CONSOLE_ShowBoot();
+    }
+    else if (strcmp(line, "discover") == 0)
+    {
+        APP_RequestDiscovery();
+    }
+    else if (strncmp(line, "echo ", 5) == 0)
+    {
+        CONSOLE_SetEchoMode(&line[5]);
+    }
+    else
+    {
+        CONSOLE_ShowHelp();
+    }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  List the console commands
+  * @retval None
+  */
+static void CONSOLE_ShowHelp(void)
+{
+    USB_TransmitString("Commands:\r\n");
+    USB_TransmitString("  stats        Show link statistics\r\n");
+    USB_TransmitString("  stats reset  Clear link statistics, cycle counters, POLL, command, task, latency and bus timing\r\n");
+    USB_TransmitString("  cycles       Show UART interrupt handler cycles\r\n");
+    USB_TransmitString("  poll         Show controller POLL cadence and answer timing\r\n");
+    USB_TransmitString("  commands     Show CCNET command counts and response times\r\n");
+    USB_TransmitString("  tasks        Show main loop task timing and stack use\r\n");
+    USB_TransmitString("  latency      Show CCNET response latency per command (us)\r\n");
+    USB_TransmitString("  latency reset Clear the latency histograms\r\n");
+    USB_TransmitString("  bus          Show ccTalk bus utilisation and poll timing per peripheral\r\n");
+    USB_TransmitString("  pool         Show the merged bill types and escrow order of the downstream validators\r\n");
+    USB_TransmitString("  boot         Show the boot steps in ms after reset\r\n");
+    USB_TransmitString("  discover     Probe downstream protocol, baud rate and parity\r\n");
+    USB_TransmitString("  echo <mode>  ccTalk own echo: count, verify (retry polls on collision) or halfduplex\r\n");
+}
+
+/**
+  * @brief  Show link and transmit queue statistics of an interface
+  * @param  name: Interface name
+  * @param  interface: Interface configuration
+  * @retval None
+  */
+static void CONSOLE_ShowStats(const char* name, interface_config_t* interface)
+{
+    uart_link_stats_t link;
+    uart_tx_stats_t tx;
+
+    UART_GetLinkStats(interface, &link);
+    UART_GetTxStats(interface, &tx);
+
+    USB_TransmitString("\r\n=== ");
+    USB_TransmitString(name);
+    USB_TransmitString(" link statistics ===\r\n");
+    CONSOLE_ShowCounter("Bytes in", link.bytes_in);
+    CONSOLE_ShowCounter("Bytes out", link.bytes_out);
+    CONSOLE_ShowCounter("Frames OK", link.frames_ok);
+    CONSOLE_ShowCounter("CRC errors", link.crc_errors);
+    CONSOLE_ShowCounter("Length errors", link.length_errors);
+    CONSOLE_ShowCounter("Parse errors", link.parse_errors);
+    CONSOLE_ShowCounter("Sync drops (bytes)", link.sync_drops);
+    CONSOLE_ShowCounter("Resyncs", link.resyncs);
+    CONSOLE_ShowCounter("Inter-byte timeouts", link.rx_timeouts);
+    CONSOLE_ShowCounter("RX ring overruns", link.ring_overruns);
+    CONSOLE_ShowCounter("Parity errors", link.parity_errors);
+    CONSOLE_ShowCounter("Framing errors", link.framing_errors);
+    CONSOLE_ShowCounter("Noise errors", link.noise_errors);
+    CONSOLE_ShowCounter("Overrun errors", link.overrun_errors);
+    CONSOLE_ShowCounter("DMA errors", link.dma_errors);
+    CONSOLE_ShowCounter("RX restarts", link.restarts);
+    if (interface->protocol == PROTO_CCTALK)
+    {
+        CONSOLE_ShowCounter("Echo collisions", link.echo_collisions);
+    }
+    CONSOLE_ShowCounter("TX frames sent", tx.frames_sent);
+    CONSOLE_ShowCounter("TX frames dropped", tx.frames_dropped);
+    CONSOLE_ShowCounter("TX queue full", tx.queue_full);
+    CONSOLE_ShowCounter("TX max queue depth", tx.max_depth);
+    USB_Flush();
+}
+
+/**
+  * @brief  Show one counter line
+  * @param  name: Counter name
+  * @param  value: Counter value
+  * @retval None
+  */
+static void CONSOLE_ShowCounter(const char* name, uint32_t value)
+{
+    char line[48];
+
+    snprintf(line, sizeof(line), "%-22s: %lu\r\n", name, (unsigned long)value);
+    USB_TransmitString(line);
+}
+
+/**
+  * @brief  Show the interrupt handler cycle counters of an interface
+  * @note   Only counted in a build with UART_PROFILE_CYCLES
+  * @param  name: Interface name
+  * @param  interface: Interface configuration
+  * @retval None
+  */
+static void CONSOLE_ShowCycles(const char* name, interface_config_t* interface)
+{
+    static const char* const sources[UART_IRQ_SOURCES] = { "USART", "DMA RX", "DMA TX" };
+    uart_cycle_stats_t cycles[UART_IRQ_SOURCES];
+    char line[64];
+
+    utils_zero((uint8_t*)cycles, sizeof(cycles));
+    UART_GetCycleStats(interface, cycles);
+
+    USB_TransmitString("\r\n=== ");
+    USB_TransmitString(name);
+    USB_TransmitString(UART_BACKEND == UART_BACKEND_LL ? " IRQ cycles (LL) ===\r\n" : " IRQ cycles (HAL) ===\r\n");
+    if (!UART_PROFILE_CYCLES)
+    {
+        USB_TransmitString("Not counted, build with UART_PROFILE_CYCLES=1\r\n");
+        USB_Flush();
+        return;
+    }
+    for (uint8_t i = 0; i < UART_IRQ_SOURCES; i++)
+    {
+        uint32_t average = cycles[i].calls ? cycles[i].cycles_total / cycles[i].calls : 0;
+
+        snprintf(line, sizeof(line), "%-7s calls %-8lu avg %-6lu max %lu\r\n", sources[i],
+                 (unsigned long)cycles[i].calls, (unsigned long)average, (unsigned long)cycles[i].cycles_max);
+        USB_TransmitString(line);
+    }
+    USB_Flush();
+}
+
+/**
+  * @brief  Show the controller POLL cadence and the POLL answer timing
+  * @note   Times are in ms (HAL tick)
+  * @retval None
+  */
+static void CONSOLE_ShowPollTiming(void)
+{
+    poll_timing_t timing;
+    char line[64];
+
+    APP_GetPollTiming(&timing);
+
+    USB_TransmitString("\r\n=== CCNET POLL timing (ms) ===\r\n");
+    USB_TransmitString(timing.locked ? "Cadence               : locked\r\n" : "Cadence               : not locked\r\n");
+    CONSOLE_ShowCounter("POLL interval", timing.interval_ms);
+    CONSOLE_ShowCounter("POLL jitter", timing.jitter_ms);
+    CONSOLE_ShowCounter("Downstream poll lead", timing.lead_ms);
+    CONSOLE_ShowCounter("Downstream response", timing.downstream_rtt_ms);
+    CONSOLE_ShowCounter("POLLs answered", timing.polls);
+    snprintf(line, sizeof(line), "%-22s: avg %lu max %lu\r\n", "Response time",
+             (unsigned long)(timing.polls ? timing.response_time_total_ms / timing.polls : 0),
+             (unsigned long)timing.response_time_max_ms);
+    USB_TransmitString(line);
+    snprintf(line, sizeof(line), "%-22s: avg %lu max %lu\r\n", "Status age",
+             (unsigned long)(timing.polls ? timing.status_age_total_ms / timing.polls : 0),
+             (unsigned long)timing.status_age_max_ms);
+    USB_TransmitString(line);
+    USB_Flush();
+}
+
+/**
+  * @brief  Show the CCNET command statistics
+  * @note   Response times are in ms (HAL tick), from reception to the queued
+  *         response. Overruns are responses later than the command deadline
+  * @retval None
+  */
+static void CONSOLE_ShowCommands(void)
+{
+    dispatch_stats_t stats;
+    response_cache_stats_t cache;
+    const char* name;
+    char line[96];
+
+    USB_TransmitString("\r\n=== CCNET commands ===\r\n");
+    for (uint8_t i = 0; APP_GetCommandStats(i, &name, &stats); i++)
+    {
+        snprintf(line, sizeof(line), "%-11s calls %-7lu illegal %-5lu max %-5lu overruns %-5lu unanswered %lu\r\n",
+                 name, (unsigned long)stats.calls, (unsigned long)stats.illegal, (unsigned long)stats.response_max_ms,
+                 (unsigned long)stats.overruns, (unsigned long)stats.unanswered);
+        USB_TransmitString(line);
+    }
+
+    APP_GetResponseCacheStats(&cache);
+    CONSOLE_ShowCounter("Repeats replayed", cache.replays);
+    CONSOLE_ShowCounter("NAK retransmits", cache.nak_retransmits);
+    CONSOLE_ShowCounter("Repeats dropped", cache.duplicates_dropped);
+    CONSOLE_ShowCounter("Prebuilt frames sent", cache.frame_hits);
+    CONSOLE_ShowCounter("Frames built", cache.frame_builds);
+    USB_Flush();
+}
+
+/**
+  * @brief  Show the main loop task statistics and the stack high-water marks
+  * @note   Run times are in ms (HAL tick) and in DWT cycles when built with
+  *         UART_PROFILE_CYCLES. Stack is the deepest use of the task stack,
+  *         updated every SCHED_SCAN_PERIOD_MS. The main stack is used by
+  *         interrupts and init
+  * @retval None
+  */
+static void CONSOLE_ShowTasks(void)
+{
+    sched_task_stats_t stats;
+    const char* name;
+    char line[128];
+
+    USB_TransmitString("\r\n=== Tasks ===\r\n");
+    for (uint8_t i = 0; SCHED_GetTaskStats(i, &name, &stats); i++)
+    {
+        snprintf(line, sizeof(line), "%-10s runs %-9lu woken %-7lu notified %-7lu max %lu ms %lu cycles stack %lu of %lu\r\n",
+                 name, (unsigned long)stats.runs, (unsigned long)stats.preemptions, (unsigned long)stats.notifications,
+                 (unsigned long)stats.time_max_ms, (unsigned long)stats.cycles_max, (unsigned long)stats.stack_max,
+                 (unsigned long)stats.stack_size);
+        USB_TransmitString(line);
+    }
+    snprintf(line, sizeof(line), "%-22s: %lu of %lu bytes\r\n", "Main stack high-water",
+             (unsigned long)SCHED_GetStackHighWater(), (unsigned long)SCHED_GetStackSize());
+    USB_TransmitString(line);
+    USB_Flush();
+}
+
+/**
+  * @brief  Show the CCNET response latency per command
+  * @note   Last request byte to first response byte in us. Percentiles have the
+  *         histogram bucket resolution (100 us below 3.2 ms, 1 ms above).
+  *         Over budget: longer than the 10 ms CCNET response time
+  * @retval None
+  */
+static void CONSOLE_ShowLatency(void)
+{
+    latency_histogram_t histogram;
+    const char* name;
+    char line[112];
+
+    USB_TransmitString("\r\n=== CCNET response latency (us) ===\r\n");
+    for (uint8_t i = 0; APP_GetCommandLatency(i, &name, &histogram); i++)
+    {
+        if (histogram.count == 0) continue;
+        snprintf(line, sizeof(line), "%-11s n %-7lu min %-6lu p50 %-6lu p99 %-6lu max %-6lu over budget %lu\r\n",
+                 name, (unsigned long)histogram.count, (unsigned long)histogram.min_us,
+                 (unsigned long)LATENCY_Percentile(&histogram, 50), (unsigned long)LATENCY_Percentile(&histogram, 99),
+                 (unsigned long)histogram.max_us, (unsigned long)histogram.violations);
+        USB_TransmitString(line);
+    }
+    USB_Flush();
+}
+
+/**
+  * @brief  Show the ccTalk bus utilisation and the poll statistics per peripheral
+  * @note   Utilisation: time with a request on the line in the last second.
+  *         Latency: request start to parsed response, in ms (HAL tick)
+  * @retval None
+  */
+static void CONSOLE_ShowBus(void)
+{
+    ccbus_device_t device;
+    uint16_t utilisation = APP_GetBusUtilisation();
+    char line[128];
+
+    USB_TransmitString("\r\n=== ccTalk bus ===\r\n");
+    if (!APP_GetBusDevice(0, &device))
+    {
+        USB_TransmitString("Downstream is not a ccTalk bus\r\n");
+        return;
+    }
+    snprintf(line, sizeof(line), "%-22s: %u.%u %%\r\n", "Utilisation", utilisation / 10, utilisation % 10);
+    USB_TransmitString(line);
+    for (uint8_t i = 0; APP_GetBusDevice(i, &device); i++)
+    {
+        snprintf(line, sizeof(line), "%-6s %3u %-7s polls %-7lu timeouts %-5lu collisions %-5lu avg %-3lu max %-3u ms events %-5lu lost %-3lu resets %lu\r\n",
+                 device.config.name, device.config.address, device.online ? "online" : "offline",
+                 (unsigned long)device.polls, (unsigned long)device.timeouts, (unsigned long)device.collisions,
+                 (unsigned long)(device.responses ? device.latency_total_ms / device.responses : 0), device.latency_max_ms,
+                 (unsigned long)device.events, (unsigned long)device.lost_events, (unsigned long)device.resets);
+        USB_TransmitString(line);
+    }
+    USB_Flush();
+}
+
+/**
+  * @brief  Show the acceptor pool: merged bill types and escrow order
+  * @note   Bill table row per validator, "-" if the validator does not take
+  *         the bill type
+  * @retval None
+  */
+static void CONSOLE_ShowPool(void)
+{
+    static const char* const states[] = {"unknown", "failure", "power up", "disabled", "idle", "busy"};
+    pool_t pool;
+    uint8_t running = APP_GetPool(&pool);
+    char line[96];
+
+    USB_TransmitString("\r\n=== Acceptor pool ===\r\n");
+    CONSOLE_ShowCounter("Validators", pool.devices);
+    if (pool.devices > 1)
+    {
+        USB_TransmitString(running ? "Second validator      : running\r\n" : "Second validator      : starting\r\n");
+    }
+    for (uint8_t device = 0; device < pool.devices; device++)
+    {
+        snprintf(line, sizeof(line), "Validator %u state     : %s, escrow %s\r\n", device,
+                 (pool.states[device] < sizeof(states) / sizeof(states[0])) ? states[pool.states[device]] : "?",
+                 (pool.escrow_bill[device] == POOL_NO_BILL) ? "none" : (pool.escrow_owner == device) ? "handled" : "waiting");
+        USB_TransmitString(line);
+    }
+    for (uint8_t type = 0; type < pool.count; type++)
+    {
+        int length = snprintf(line, sizeof(line), "Bill type %-2u %6u    :", type, pool.bill_types[type].value);
+
+        for (uint8_t device = 0; device < pool.devices && length > 0 && length < (int)sizeof(line); device++)
+        {
+            uint8_t row = pool.bill_types[type].device_row[device];
+
+            if (row == POOL_NO_BILL) length += snprintf(&line[length], sizeof(line) - length, "   -");
+            else length += snprintf(&line[length], sizeof(line) - length, " %3u", row);
+        }
+        USB_TransmitString(line);
+        USB_TransmitString("\r\n");
+    }
+    CONSOLE_ShowCounter("Escrow waits", pool.escrow_waits);
+    CONSOLE_ShowCounter("Dropped denominations", pool.dropped);
+    USB_Flush();
+}
+
+/**
+  * @brief  Show the boot steps in ms after reset
+  * @note   HAL tick, started by HAL_Init right after reset
+  * @retval None
+  */
+static void CONSOLE_ShowBoot(void)
+{
+    boot_timing_t timing;
+
+    APP_GetBootTiming(&timing);
+    USB_TransmitString("\r\n=== Boot (ms after reset, 0 = not yet) ===\r\n");
+    CONSOLE_ShowCounter("CCNET answered from", timing.links_ms);
+    CONSOLE_ShowCounter("First CCNET command", timing.first_command_ms);
+    CONSOLE_ShowCounter("First CCNET response", timing.first_response_ms);
+    CONSOLE_ShowCounter("Validator answered", timing.validator_ms);
+    CONSOLE_ShowCounter("Validator bill table", timing.bill_table_ms);
+    CONSOLE_ShowCounter("USB enumerated", timing.usb_ms);
+    CONSOLE_ShowCounter("Banner and tests done", timing.background_ms);
+    USB_Flush();
+}
+
+/**
+  * @brief  Select the own echo handling of the ccTalk downstream bus
+  * @note   Kept until reset, also over auto-discovery. Half duplex needs the
+  *         bus wired to the TX pin only
+  * @param  mode: "count", "verify" or "halfduplex"
+  * @retval None
+  */
+static void CONSOLE_SetEchoMode(const char* mode)
+{
+    uart_echo_mode_t echo_mode;
+
+    if (strcmp(mode, "count") == 0) echo_mode = UART_ECHO_MODE_COUNT;
+    else if (strcmp(mode, "verify") == 0) echo_mode = UART_ECHO_MODE_VERIFY;
+    else if (strcmp(mode, "halfduplex") == 0) echo_mode = UART_ECHO_MODE_HALF_DUPLEX;
+    else
+    {
+        CONSOLE_ShowHelp();
+        return;
+    }
+
+    if (g_config.downstream->protocol != PROTO_CCTALK)
+    {
+        USB_TransmitString("Downstream is not a ccTalk bus\r\n");
+        return;
+    }
+    UART_SetEchoMode(g_config.downstream, echo_mode);
+    USB_TransmitString("ccTalk echo mode set\r\n");
+}
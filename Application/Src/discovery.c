@@ -0,0 +1,234 @@
+/**
+  ******************************************************************************
+  * @file           : discovery.c
+  * @brief          : Downstream auto-discovery implementation
+  *                   Sends an ID003 STATUS_REQ or a ccTalk SIMPLE_POLL for each
+  *                   candidate protocol, baud rate and parity until the
+  *                   validator answers. One probe at a time through the
+  *                   transaction engine, the main loop keeps running. The
+  *                   result is saved to flash.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "discovery.h"
+#include "config.h"
+#include "uart.h"
+#include "log.h"
+#include "message.h"
+#include "proto.h"
+#include "transaction.h"
+#include <string.h> /* For memcmp */
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+  * @brief  Discovery candidate
+  */
+typedef struct {
+    proto_name_t protocol;
+    uint32_t baudrate;
+    unsigned long parity;
+} discovery_candidate_t;
+
+/**
+  * @brief  Discovery state
+  */
+typedef enum {
+    DISCOVERY_IDLE = 0,     /* Not running */
+    DISCOVERY_NEXT,         /* Probe the next candidate on the next run */
+    DISCOVERY_PROBING,      /* Probe on the line, DISCOVERY_ProbeDone advances */
+    DISCOVERY_FOUND         /* The current candidate answered */
+} discovery_state_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Most common settings first. ID003 is on UART2, ccTalk on UART3 */
+static const discovery_candidate_t candidates[] = {
+    {PROTO_ID003,  9600,  UART_PARITY_EVEN},
+    {PROTO_CCTALK, 9600,  UART_PARITY_NONE},
+    {PROTO_ID003,  19200, UART_PARITY_EVEN},
+    {PROTO_ID003,  38400, UART_PARITY_EVEN},
+    {PROTO_CCTALK, 19200, UART_PARITY_NONE},
+    {PROTO_ID003,  9600,  UART_PARITY_NONE},
+};
+#define DISCOVERY_CANDIDATES (sizeof(candidates) / sizeof(candidates[0]))
+
+static discovery_state_t state = DISCOVERY_IDLE;
+static transaction_engine_t* discovery_engine = NULL;
+static interface_config_t* discovery_interface = NULL;
+static message_t* discovery_message = NULL;
+static discovery_candidate_t configured;    /* Settings before discovery, probed first */
+static uint8_t next_candidate = 0;          /* 0: configured settings, then candidates[n - 1] */
+static uint8_t skip_cctalk = 0;             /* UART3 carries the second ID003 validator */
+static message_t probe;                     /* Probe request, an echo of it is no answer */
+static uint32_t start_tick = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static const discovery_candidate_t* DISCOVERY_NextCandidate(void);
+static void DISCOVERY_Apply(const discovery_candidate_t* candidate);
+static void DISCOVERY_ProbeDone(transaction_result_t result, const message_t* response);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start looking for the protocol, baud rate and parity the downstream validator answers on
+  * @note   Non-blocking: DISCOVERY_Process sends one probe per run through the
+  *         transaction engine. The caller drops its own pending requests first.
+  *         The configured settings are tried first
+  * @param  engine: Transaction engine of the downstream interface
+  * @param  interface: Downstream interface configuration
+  * @param  message: Downstream message structure
+  * @param  id003_only: 1 to skip the ccTalk candidates, UART3 is in use
+  * @retval None
+  */
+void DISCOVERY_Start(transaction_engine_t* engine, interface_config_t* interface, message_t* message, uint8_t id003_only)
+{
+    discovery_engine = engine;
+    skip_cctalk = id003_only;
+    discovery_interface = interface;
+    discovery_message = message;
+    configured.protocol = interface->protocol;
+    configured.baudrate = interface->phy.baudrate;
+    configured.parity = interface->phy.parity;
+    next_candidate = 0;
+    start_tick = HAL_GetTick();
+    state = DISCOVERY_NEXT;
+
+    LOG_Info("Downstream auto-discovery started");
+}
+
+/**
+  * @brief  Run the discovery
+  * @note   Called from the main loop. Switches the downstream interface to the
+  *         next candidate and queues its probe once the previous probe is done.
+  *         On success the settings are saved to flash if they changed,
+  *         otherwise the configured settings are restored
+  * @retval uint8_t: 1 once, when the discovery has finished
+  */
+uint8_t DISCOVERY_Process(void)
+{
+    const discovery_candidate_t* candidate;
+    uint8_t opcode;
+
+    switch (state)
+    {
+        case DISCOVERY_NEXT:
+            candidate = DISCOVERY_NextCandidate();
+            if (candidate == NULL)
+            {
+                LOG_Warn("Downstream auto-discovery: no response, keeping configured settings");
+                DISCOVERY_Apply(&configured);
+                state = DISCOVERY_IDLE;
+                return 1;
+            }
+
+            DISCOVERY_Apply(candidate);
+            opcode = (candidate->protocol == PROTO_CCTALK) ? CCTALK_SIMPLE_POLL : ID003_STATUS_REQ;
+            probe = MESSAGE_Create(candidate->protocol, MSG_DIR_TX, opcode, NULL, 0);
+            state = DISCOVERY_PROBING;
+            if (!TRANSACTION_Submit(discovery_engine, opcode, NULL, 0, TRANSACTION_ANY_OPCODE,
+                                    TRANSACTION_ANY_LENGTH, DISCOVERY_PROBE_TIMEOUT_MS, DISCOVERY_ProbeDone))
+            {
+                state = DISCOVERY_NEXT;
+            }
+            break;
+
+        case DISCOVERY_FOUND:
+            state = DISCOVERY_IDLE;
+            if (next_candidate == 1)
+            {
+                LOG_InfoUint("Downstream validator found on configured settings, ms: ", HAL_GetTick() - start_tick);
+                return 1;
+            }
+            LOG_InfoUint("Downstream validator found, ms: ", HAL_GetTick() - start_tick);
+            LOG_Info(discovery_interface->protocol == PROTO_ID003 ? "Protocol: ID003" : "Protocol: ccTalk");
+            LOG_InfoUint("Baudrate: ", discovery_interface->phy.baudrate);
+            CONFIG_RequestSave();
+            return 1;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+/**
+  * @brief  Check if the discovery owns the downstream interface
+  * @retval uint8_t: 1 while running
+  */
+uint8_t DISCOVERY_IsRunning(void)
+{
+    return (state != DISCOVERY_IDLE);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Get the next candidate to probe
+  * @note   The configured settings first, then the candidate table without them
+  *         (and without ccTalk while UART3 carries the second validator)
+  * @retval const discovery_candidate_t*: Candidate, NULL if all were probed
+  */
+static const discovery_candidate_t* DISCOVERY_NextCandidate(void)
+{
+    if (next_candidate == 0)
+    {
+        next_candidate++;
+        return &configured;
+    }
+
+    while (next_candidate <= DISCOVERY_CANDIDATES)
+    {
+        const discovery_candidate_t* candidate = &candidates[next_candidate++ - 1];
+
+        if (candidate->protocol == configured.protocol && candidate->baudrate == configured.baudrate &&
+            candidate->parity == configured.parity) continue;
+        if (skip_cctalk && candidate->protocol == PROTO_CCTALK) continue;
+        return candidate;
+    }
+    return NULL;
+}
+
+/**
+  * @brief  Switch the downstream interface to a candidate
+  * @param  candidate: Protocol, baud rate and parity
+  * @retval None
+  */
+static void DISCOVERY_Apply(const discovery_candidate_t* candidate)
+{
+    discovery_interface->protocol = candidate->protocol;
+    discovery_interface->phy.baudrate = candidate->baudrate;
+    discovery_interface->phy.parity = candidate->parity;
+    CONFIG_ApplyProtocol(discovery_interface);
+
+    MESSAGE_Init(discovery_message, candidate->protocol, MSG_DIR_RX);
+    UART_Init(discovery_interface, discovery_message);
+}
+
+/**
+  * @brief  Probe completion
+  * @note   Any valid frame answers, except the own request echoed on a single
+  *         wire line. Otherwise the next candidate is probed on the next run
+  * @param  result: Transaction result
+  * @param  response: Parsed response, NULL on a timeout
+  * @retval None
+  */
+static void DISCOVERY_ProbeDone(transaction_result_t result, const message_t* response)
+{
+    if (state != DISCOVERY_PROBING) return;
+
+    if (result == TRANSACTION_OK &&
+        !(response->length == probe.length && memcmp(response->raw, probe.raw, probe.length) == 0))
+    {
+        state = DISCOVERY_FOUND;
+        return;
+    }
+    state = DISCOVERY_NEXT;
+}
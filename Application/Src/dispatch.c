@@ -0,0 +1,125 @@
+/**
+  ******************************************************************************
+  * @file           : dispatch.c
+  * @brief          : Command dispatcher implementation
+  *                   Looks up the handler of an opcode in a const table,
+  *                   checks the state rules and times the response against
+  *                   the deadline of the command. Handlers respond directly
+  *                   or from a transaction callback: the response time runs
+  *                   until DISPATCH_Responded.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "dispatch.h"
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize a dispatcher and clear its statistics
+  * @param  dispatcher: Dispatcher
+  * @param  lut: Opcode to command index table, 256 entries
+  * @param  commands: Command table, entry 0 for unsupported opcodes
+  * @param  stats: Statistics, one entry per command
+  * @param  count: Number of commands
+  * @retval None
+  */
+void DISPATCH_Init(dispatcher_t* dispatcher, const uint8_t* lut, const dispatch_command_t* commands,
+                   dispatch_stats_t* stats, uint8_t count)
+{
+    dispatcher->lut = lut;
+    dispatcher->commands = commands;
+    dispatcher->stats = stats;
+    dispatcher->count = count;
+    DISPATCH_ResetStats(dispatcher);
+}
+
+/**
+  * @brief  Dispatch a received command
+  * @note   A command that is still waiting for its response is counted as
+  *         unanswered. On DISPATCH_NOT_SUPPORTED and DISPATCH_ILLEGAL the
+  *         caller responds itself, that response is timed as well.
+  *         Unknown opcodes are counted in the DISPATCH_UNSUPPORTED entry
+  * @param  dispatcher: Dispatcher
+  * @param  opcode: Command opcode
+  * @param  state: Current state, one bit of the allowed_states mask
+  * @param  now: Reception time in ms
+  * @retval dispatch_result_t: Dispatch result
+  */
+dispatch_result_t DISPATCH_Run(dispatcher_t* dispatcher, uint8_t opcode, uint8_t state, uint32_t now)
+{
+    uint8_t index = dispatcher->lut[opcode];
+    const dispatch_command_t* command;
+
+    if (index >= dispatcher->count) index = DISPATCH_UNSUPPORTED;
+    command = &dispatcher->commands[index];
+
+    if (dispatcher->waiting) dispatcher->stats[dispatcher->pending].unanswered++;
+    dispatcher->stats[index].calls++;
+    dispatcher->pending = index;
+    dispatcher->waiting = 1;
+    dispatcher->start_time = now;
+
+    if (command->handler == NULL)
+    {
+        return DISPATCH_NOT_SUPPORTED;
+    }
+    if (!(command->allowed_states & state))
+    {
+        dispatcher->stats[index].illegal++;
+        return DISPATCH_ILLEGAL;
+    }
+
+    /* a command without response is complete when the handler returns */
+    if (command->deadline_ms == 0) dispatcher->waiting = 0;
+    command->handler();
+    return DISPATCH_OK;
+}
+
+/**
+  * @brief  Record the response to the pending command
+  * @note   Responses without a pending command (repeated sends) are ignored
+  * @param  dispatcher: Dispatcher
+  * @param  now: Time the response was queued in ms
+  * @retval None
+  */
+void DISPATCH_Responded(dispatcher_t* dispatcher, uint32_t now)
+{
+    uint16_t deadline_ms = dispatcher->commands[dispatcher->pending].deadline_ms;
+    uint32_t elapsed = now - dispatcher->start_time;
+    dispatch_stats_t* stats = &dispatcher->stats[dispatcher->pending];
+
+    if (!dispatcher->waiting) return;
+
+    stats->responses++;
+    if (elapsed > stats->response_max_ms) stats->response_max_ms = elapsed;
+    if (deadline_ms != 0 && elapsed > deadline_ms) stats->overruns++;
+    dispatcher->waiting = 0;
+}
+
+/**
+  * @brief  Clear all command statistics
+  * @param  dispatcher: Dispatcher
+  * @retval None
+  */
+void DISPATCH_ResetStats(dispatcher_t* dispatcher)
+{
+    for (uint8_t i = 0; i < dispatcher->count; i++)
+    {
+        dispatcher->stats[i].calls = 0;
+        dispatcher->stats[i].illegal = 0;
+        dispatcher->stats[i].responses = 0;
+        dispatcher->stats[i].overruns = 0;
+        dispatcher->stats[i].unanswered = 0;
+        dispatcher->stats[i].response_max_ms = 0;
+    }
+    dispatcher->pending = DISPATCH_UNSUPPORTED;
+    dispatcher->waiting = 0;
+    dispatcher->start_time = 0;
+}
@@ -0,0 +1,140 @@
+/**
+  ******************************************************************************
+  * @file           : events.c
+  * @brief          : Upstream event queue implementation
+  *                   Short-lived validator states (bill stacked, returned,
+  *                   rejected) are queued when the downstream status changes
+  *                   and drained in order by CCNET POLL. An event is only
+  *                   retired after the controller acknowledged it, so it
+  *                   survives a slow or lost controller poll.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "events.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t EVENTS_EvictLow(event_queue_t* queue);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize (empty) an event queue and clear its statistics
+  * @param  queue: Event queue
+  * @retval None
+  */
+void EVENTS_Init(event_queue_t* queue)
+{
+    queue->head = 0;
+    queue->tail = 0;
+    queue->queued = 0;
+    queue->retired = 0;
+    queue->evicted = 0;
+    queue->dropped = 0;
+}
+
+/**
+  * @brief  Queue an event
+  * @note   When the queue is full a high priority event replaces the oldest
+  *         low priority event, except the one at the front (it may be on the
+  *         line already). Otherwise the new event is dropped.
+  * @param  queue: Event queue
+  * @param  opcode: CCNET status code
+  * @param  data: Status data (NULL if no data), copied
+  * @param  data_length: Data length, at most EVENTS_MAX_DATA
+  * @param  priority: Event priority
+  * @retval uint8_t: 1 if queued, 0 if dropped
+  */
+uint8_t EVENTS_Push(event_queue_t* queue, uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                    event_priority_t priority)
+{
+    upstream_event_t* event;
+
+    if (data_length > EVENTS_MAX_DATA)
+    {
+        queue->dropped++;
+        return 0;
+    }
+
+    if (EVENTS_Pending(queue) >= EVENTS_QUEUE_SLOTS)
+    {
+        if (priority == EVENT_PRIORITY_LOW || !EVENTS_EvictLow(queue))
+        {
+            queue->dropped++;
+            return 0;
+        }
+    }
+
+    event = &queue->slots[queue->head % EVENTS_QUEUE_SLOTS];
+    event->opcode = opcode;
+    event->data_length = data_length;
+    for (uint8_t i = 0; i < data_length; i++) event->data[i] = data[i];
+    event->priority = priority;
+    queue->head++;
+    queue->queued++;
+    return 1;
+}
+
+/**
+  * @brief  Get the oldest event without removing it
+  * @param  queue: Event queue
+  * @retval const upstream_event_t*: Oldest event, NULL if the queue is empty
+  */
+const upstream_event_t* EVENTS_Peek(const event_queue_t* queue)
+{
+    if (queue->head == queue->tail) return NULL;
+    return &queue->slots[queue->tail % EVENTS_QUEUE_SLOTS];
+}
+
+/**
+  * @brief  Remove the oldest event once the controller acknowledged it
+  * @param  queue: Event queue
+  * @retval None
+  */
+void EVENTS_Retire(event_queue_t* queue)
+{
+    if (queue->head == queue->tail) return;
+    queue->tail++;
+    queue->retired++;
+}
+
+/**
+  * @brief  Number of events waiting for delivery
+  * @param  queue: Event queue
+  * @retval uint8_t: Pending events
+  */
+uint8_t EVENTS_Pending(const event_queue_t* queue)
+{
+    return (uint8_t)(queue->head - queue->tail);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Remove the oldest low priority event behind the front event
+  * @note   Later events move up one slot, so the delivery order is kept
+  * @param  queue: Event queue
+  * @retval uint8_t: 1 if an event was removed, 0 if all are high priority
+  */
+static uint8_t EVENTS_EvictLow(event_queue_t* queue)
+{
+    for (uint8_t index = queue->tail + 1; index != queue->head; index++)
+    {
+        if (queue->slots[index % EVENTS_QUEUE_SLOTS].priority != EVENT_PRIORITY_LOW) continue;
+
+        for (uint8_t next = index + 1; next != queue->head; next++)
+        {
+            queue->slots[(uint8_t)(next - 1) % EVENTS_QUEUE_SLOTS] = queue->slots[next % EVENTS_QUEUE_SLOTS];
+        }
+        queue->head--;
+        queue->evicted++;
+        return 1;
+    }
+    return 0;
+}
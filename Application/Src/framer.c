@@ -0,0 +1,364 @@
+/**
+  ******************************************************************************
+  * @file           : framer.c
+  * @brief          : Sync/length frame extractor implementation
+  *                   Splits a received byte stream into CCNET, ID003 and ccTalk
+  *                   frames. No HAL dependencies so it can be run on a host.
+  *
+  *                   Resync: a frame with an invalid length byte or a failed
+  *                   check is not simply dropped. Its bytes after the first
+  *                   sync byte are scanned again, so a real frame whose header
+  *                   was swallowed by the bad one is still found.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "framer.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define FRAMER_STEP_NONE      0     /* Byte consumed */
+#define FRAMER_STEP_COMPLETE  1     /* Byte completed a frame */
+#define FRAMER_STEP_REJECT    2     /* Buffered bytes are not a valid frame */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t FRAMER_Step(framer_t* framer, uint8_t byte);
+static uint8_t FRAMER_Resync(framer_t* framer);
+static uint8_t FRAMER_Complete(framer_t* framer);
+static uint8_t* FRAME_RING_GetWriteBuffer(frame_ring_t* ring);
+static uint8_t FRAME_RING_Commit(frame_ring_t* ring, uint16_t length);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize framer with datalink parameters
+  * @param  framer: Framer instance
+  * @param  sync_length: Number of sync bytes (1 or 2)
+  * @param  sync_byte1: First sync byte
+  * @param  sync_byte2: Second sync byte (ignored if sync_length is 1)
+  * @param  length_offset: Added to the length byte to get the total frame length
+  * @param  ring: Frame ring that receives the complete frames
+  * @retval None
+  */
+void FRAMER_Init(framer_t* framer, uint8_t sync_length, uint8_t sync_byte1, uint8_t sync_byte2,
+                 int8_t length_offset, frame_ring_t* ring)
+{
+    framer->sync_length = sync_length;
+    framer->sync_bytes[0] = sync_byte1;
+    framer->sync_bytes[1] = sync_byte2;
+    framer->length_offset = length_offset;
+    framer->ring = ring;
+    framer->check = NULL;
+    framer->sync_drops = 0;
+    framer->length_errors = 0;
+    framer->check_errors = 0;
+    framer->resyncs = 0;
+    FRAMER_Reset(framer);
+}
+
+/**
+  * @brief  Set the frame check function
+  * @note   Without a check every frame with a plausible length is accepted
+  * @param  framer: Framer instance
+  * @param  check: Check function, NULL to disable
+  * @retval None
+  */
+void FRAMER_SetCheck(framer_t* framer, framer_check_t check)
+{
+    framer->check = check;
+}
+
+/**
+  * @brief  Drop any partial frame and wait for the first sync byte
+  * @param  framer: Framer instance
+  * @retval None
+  */
+void FRAMER_Reset(framer_t* framer)
+{
+    framer->state = FRAMER_STATE_WAIT_SYNC1;
+    framer->index = 0;
+    framer->length = 0;
+}
+
+/**
+  * @brief  Push a single received byte into the framer
+  * @param  framer: Framer instance
+  * @param  byte: Received byte
+  * @retval uint8_t: Number of frames completed by this byte (also when dropped on overrun).
+  *         More than 1 if a resync found frames in the bytes of a rejected one.
+  */
+uint8_t FRAMER_PushByte(framer_t* framer, uint8_t byte)
+{
+    uint8_t result = FRAMER_Step(framer, byte);
+
+    if (result == FRAMER_STEP_REJECT) return FRAMER_Resync(framer);
+    return result;
+}
+
+/**
+  * @brief  Feed a chunk of received bytes into the framer
+  * @param  framer: Framer instance
+  * @param  data: Received bytes
+  * @param  length: Number of bytes
+  * @retval uint16_t: Number of frames completed by this chunk
+  */
+uint16_t FRAMER_Feed(framer_t* framer, const uint8_t* data, uint16_t length)
+{
+    uint16_t frames = 0;
+
+    for (uint16_t i = 0; i < length; i++) {
+        frames += FRAMER_PushByte(framer, data[i]);
+    }
+    return frames;
+}
+
+/**
+  * @brief  Line went idle: finish with the buffered partial frame
+  * @note   The partial frame will never complete, but a frame swallowed by a
+  *         bad length byte may be complete inside it. Without a check function
+  *         nothing can be validated and the bytes are just dropped.
+  * @param  framer: Framer instance
+  * @retval uint8_t: Number of frames found in the buffered bytes
+  */
+uint8_t FRAMER_Flush(framer_t* framer)
+{
+    uint8_t frames = 0;
+
+    if (framer->check == NULL) {
+        FRAMER_Reset(framer);
+        return 0;
+    }
+
+    while (!FRAMER_IsIdle(framer)) {
+        frames += FRAMER_Resync(framer);
+    }
+    return frames;
+}
+
+/**
+  * @brief  Check if the framer is between frames
+  * @param  framer: Framer instance
+  * @retval uint8_t: 1 if no partial frame is buffered
+  */
+uint8_t FRAMER_IsIdle(const framer_t* framer)
+{
+    return (framer->state == FRAMER_STATE_WAIT_SYNC1);
+}
+
+/**
+  * @brief  Initialize an empty frame ring
+  * @param  ring: Frame ring
+  * @retval None
+  */
+void FRAME_RING_Init(frame_ring_t* ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->frames = 0;
+    ring->overruns = 0;
+    ring->high_water = 0;
+}
+
+/**
+  * @brief  Borrow the oldest complete frame
+  * @note   The slot stays reserved until FRAME_RING_Release is called
+  * @param  ring: Frame ring
+  * @retval const frame_slot_t*: Oldest frame, NULL if no frame pending
+  */
+const frame_slot_t* FRAME_RING_Borrow(frame_ring_t* ring)
+{
+    if (ring->tail == ring->head) return NULL;
+    return &ring->slots[ring->tail % FRAME_RING_SLOTS];
+}
+
+/**
+  * @brief  Release the frame returned by FRAME_RING_Borrow
+  * @param  ring: Frame ring
+  * @retval None
+  */
+void FRAME_RING_Release(frame_ring_t* ring)
+{
+    if (ring->tail != ring->head) ring->tail++;
+}
+
+/**
+  * @brief  Number of complete frames waiting to be borrowed
+  * @param  ring: Frame ring
+  * @retval uint8_t: Pending frames
+  */
+uint8_t FRAME_RING_Pending(const frame_ring_t* ring)
+{
+    return (uint8_t)(ring->head - ring->tail);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Run the receive state machine for one byte
+  * @param  framer: Framer instance
+  * @param  byte: Received byte
+  * @retval uint8_t: FRAMER_STEP_NONE, FRAMER_STEP_COMPLETE or FRAMER_STEP_REJECT
+  */
+static uint8_t FRAMER_Step(framer_t* framer, uint8_t byte)
+{
+    uint8_t* buffer = FRAME_RING_GetWriteBuffer(framer->ring);
+
+    switch (framer->state) {
+    case FRAMER_STATE_WAIT_SYNC1:
+        if (byte == framer->sync_bytes[0]) {
+            buffer[0] = byte;
+            framer->index = 1;
+            if (framer->sync_length == 1) {
+                framer->state = FRAMER_STATE_WAIT_LENGTH;
+            } else {
+                framer->state = FRAMER_STATE_WAIT_SYNC2;
+            }
+        } else {
+            /* Discard and stay in state */
+            framer->sync_drops++;
+        }
+        break;
+
+    case FRAMER_STATE_WAIT_SYNC2:
+        if (byte == framer->sync_bytes[1]) {
+            buffer[1] = byte;
+            framer->index = 2;
+            framer->state = FRAMER_STATE_WAIT_LENGTH;
+        } else if (byte == framer->sync_bytes[0]) {
+            /* Handle potential sync overlap/start */
+            buffer[0] = byte;
+            framer->index = 1;
+            framer->sync_drops++;
+        } else {
+            framer->sync_drops += 2;
+            FRAMER_Reset(framer);
+        }
+        break;
+
+    case FRAMER_STATE_WAIT_LENGTH:
+        framer->length = byte + framer->length_offset;  /* offset is +5 for ccTalk */
+        buffer[framer->index++] = byte;
+
+        /* Validate length */
+        if (framer->length < (framer->sync_length + 1) || framer->length > FRAMER_MAX_FRAME_LENGTH) {
+            framer->length_errors++;
+            return FRAMER_STEP_REJECT;
+        } else if (framer->index == framer->length) {
+            /* Message is already complete (no data bytes) */
+            return FRAMER_Complete(framer);
+        } else {
+            framer->state = FRAMER_STATE_WAIT_DATA;
+        }
+        break;
+
+    case FRAMER_STATE_WAIT_DATA:
+        buffer[framer->index++] = byte;
+        if (framer->index == framer->length) {
+            return FRAMER_Complete(framer);
+        }
+        break;
+    }
+
+    return FRAMER_STEP_NONE;
+}
+
+/**
+  * @brief  Scan the bytes of a rejected frame again for the next frame
+  * @note   The rejected bytes after its first sync byte are replayed from the
+  *         resync buffer. If the replay is rejected too, its bytes after the
+  *         first one are put back in front of the bytes not yet replayed. Every
+  *         round drops at least one byte, so this always ends.
+  * @param  framer: Framer instance
+  * @retval uint8_t: Number of frames completed by the replay
+  */
+static uint8_t FRAMER_Resync(framer_t* framer)
+{
+    uint8_t* buffer = FRAME_RING_GetWriteBuffer(framer->ring);
+    uint16_t count = framer->index - 1;
+    uint16_t pos = 0;
+    uint8_t frames = 0;
+
+    for (uint16_t i = 0; i < count; i++) framer->resync[i] = buffer[i + 1];
+    framer->resyncs++;
+    framer->sync_drops++;
+    FRAMER_Reset(framer);
+
+    while (pos < count) {
+        uint8_t result = FRAMER_Step(framer, framer->resync[pos++]);
+
+        if (result == FRAMER_STEP_COMPLETE) {
+            frames++;
+        } else if (result == FRAMER_STEP_REJECT) {
+            /* Rejected bytes came from resync[..pos), so moving the rest down is safe */
+            uint16_t rejected = framer->index - 1;
+            uint16_t remaining = count - pos;
+
+            buffer = FRAME_RING_GetWriteBuffer(framer->ring);
+            for (uint16_t i = 0; i < remaining; i++) framer->resync[rejected + i] = framer->resync[pos + i];
+            for (uint16_t i = 0; i < rejected; i++) framer->resync[i] = buffer[i + 1];
+            count = rejected + remaining;
+            pos = 0;
+            framer->resyncs++;
+            framer->sync_drops++;
+            FRAMER_Reset(framer);
+        }
+    }
+    return frames;
+}
+
+/**
+  * @brief  Hand completed frame to the ring and wait for the next one
+  * @param  framer: Framer instance
+  * @retval uint8_t: FRAMER_STEP_COMPLETE, or FRAMER_STEP_REJECT if the check failed
+  */
+static uint8_t FRAMER_Complete(framer_t* framer)
+{
+    if (framer->check != NULL &&
+        !framer->check(FRAME_RING_GetWriteBuffer(framer->ring), framer->length)) {
+        framer->check_errors++;
+        return FRAMER_STEP_REJECT;
+    }
+
+    FRAME_RING_Commit(framer->ring, framer->length);
+    FRAMER_Reset(framer);
+    return FRAMER_STEP_COMPLETE;
+}
+
+/**
+  * @brief  Slot the framer assembles the next frame in
+  * @param  ring: Frame ring
+  * @retval uint8_t*: Data buffer of the write slot
+  */
+static uint8_t* FRAME_RING_GetWriteBuffer(frame_ring_t* ring)
+{
+    return ring->slots[ring->head % FRAME_RING_SLOTS].data;
+}
+
+/**
+  * @brief  Publish the write slot as a complete frame
+  * @note   If all other slots are pending or borrowed the frame is dropped and
+  *         the write slot is reused, so frames already queued are never overwritten
+  * @param  ring: Frame ring
+  * @param  length: Frame length
+  * @retval uint8_t: 1 if committed, 0 on overrun
+  */
+static uint8_t FRAME_RING_Commit(frame_ring_t* ring, uint16_t length)
+{
+    uint8_t pending = (uint8_t)(ring->head - ring->tail);
+
+    if (pending >= FRAME_RING_SLOTS - 1) {
+        ring->overruns++;
+        return 0;
+    }
+
+    ring->slots[ring->head % FRAME_RING_SLOTS].length = length;
+    ring->head++;   /* publish after the length is written */
+    ring->frames++;
+    if (pending + 1 > ring->high_water) ring->high_water = pending + 1;
+    return 1;
+}
@@ -0,0 +1,119 @@
+/**
+  ******************************************************************************
+  * @file           : latency.c
+  * @brief          : Latency histogram implementation
+  *                   Fine buckets where the responses normally are, coarse
+  *                   buckets up to twice the CCNET response budget. Exact
+  *                   minimum and maximum are kept beside the buckets.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "latency.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t LATENCY_GetBucket(uint32_t latency_us);
+static uint32_t LATENCY_GetBucketEnd(uint8_t bucket);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Clear a histogram
+  * @param  histogram: Latency histogram
+  * @retval None
+  */
+void LATENCY_Reset(latency_histogram_t* histogram)
+{
+    histogram->count = 0;
+    histogram->min_us = UINT32_MAX;
+    histogram->max_us = 0;
+    histogram->violations = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) histogram->buckets[i] = 0;
+}
+
+/**
+  * @brief  Record a latency
+  * @param  histogram: Latency histogram
+  * @param  latency_us: Latency in us
+  * @param  budget_us: Allowed latency, longer ones count as violation
+  * @retval None
+  */
+void LATENCY_Record(latency_histogram_t* histogram, uint32_t latency_us, uint32_t budget_us)
+{
+    histogram->buckets[LATENCY_GetBucket(latency_us)]++;
+    histogram->count++;
+    if (latency_us < histogram->min_us) histogram->min_us = latency_us;
+    if (latency_us > histogram->max_us) histogram->max_us = latency_us;
+    if (latency_us > budget_us) histogram->violations++;
+}
+
+/**
+  * @brief  Get a percentile of the recorded latencies
+  * @note   Resolution is the bucket width: the end of the bucket that holds the
+  *         percentile is returned, limited to the exact minimum and maximum
+  * @param  histogram: Latency histogram
+  * @param  percent: Percentile, 1-100
+  * @retval uint32_t: Latency in us, 0 if nothing was recorded
+  */
+uint32_t LATENCY_Percentile(const latency_histogram_t* histogram, uint8_t percent)
+{
+    uint32_t rank;
+    uint32_t seen = 0;
+    uint32_t latency_us = 0;
+
+    if (histogram->count == 0) return 0;
+
+    /* nearest rank, rounded up */
+    rank = (uint32_t)(((uint64_t)histogram->count * percent + 99) / 100);
+    if (rank == 0) rank = 1;
+
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            latency_us = LATENCY_GetBucketEnd(i);
+            break;
+        }
+    }
+
+    if (latency_us > histogram->max_us) latency_us = histogram->max_us;
+    if (latency_us < histogram->min_us) latency_us = histogram->min_us;
+    return latency_us;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Bucket of a latency
+  * @param  latency_us: Latency in us
+  * @retval uint8_t: Bucket index
+  */
+static uint8_t LATENCY_GetBucket(uint32_t latency_us)
+{
+    uint32_t coarse;
+
+    if (latency_us < LATENCY_FINE_BUCKETS * LATENCY_FINE_US) return (uint8_t)(latency_us / LATENCY_FINE_US);
+
+    coarse = (latency_us - LATENCY_FINE_BUCKETS * LATENCY_FINE_US) / LATENCY_COARSE_US;
+    if (coarse >= LATENCY_COARSE_BUCKETS) coarse = LATENCY_COARSE_BUCKETS - 1;
+    return (uint8_t)(LATENCY_FINE_BUCKETS + coarse);
+}
+
+/**
+  * @brief  Upper end of a bucket
+  * @param  bucket: Bucket index
+  * @retval uint32_t: Latency in us, UINT32_MAX for the open-ended last bucket
+  */
+static uint32_t LATENCY_GetBucketEnd(uint8_t bucket)
+{
+    if (bucket == LATENCY_BUCKETS - 1) return UINT32_MAX;
+    if (bucket < LATENCY_FINE_BUCKETS) return (bucket + 1) * LATENCY_FINE_US;
+    return LATENCY_FINE_BUCKETS * LATENCY_FINE_US + (uint32_t)(bucket - LATENCY_FINE_BUCKETS + 1) * LATENCY_COARSE_US;
+}
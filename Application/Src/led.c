@@ -16,9 +16,16 @@
 #include "led.h"
 #include "tim.h"
 
+/* Private defines -----------------------------------------------------------*/
+#define LED_SELF_TEST_STEP_MS 500   /* Each LED on in turn for this long */
+#define LED_SELF_TEST_STEPS   3
+
 /* Private variables ---------------------------------------------------------*/
 extern TIM_HandleTypeDef htim16;  /* Timer16 handle from main.c */
 extern TIM_HandleTypeDef htim17;  /* Timer17 handle from main.c */
+static LED_HandleTypeDef* const self_test_leds[LED_SELF_TEST_STEPS] = {&hled1, &hled2, &hled3};
+static uint8_t self_test_step = LED_SELF_TEST_STEPS;   /* LED_SELF_TEST_STEPS: not running */
+static uint32_t self_test_tick = 0;
 
 /* Private function prototypes -----------------------------------------------*/
 static void LED_TimerCallback(void);
@@ -33,19 +40,40 @@ void LED_Init(void)
 { 
   LED_AllOff();
   LED_InitTimer();
+}
 
-  /* test the LEDs */
-  uint32_t delay = 500;
-  LED_On(&hled1);
-  HAL_Delay(delay);
-  LED_Off(&hled1);
-  LED_On(&hled2);
-  HAL_Delay(delay);
-  LED_Off(&hled2);
-  LED_On(&hled3);
-  HAL_Delay(delay);
-  LED_Off(&hled3);
-  LED_Flash(&hled1, 200);
+/**
+  * @brief  Start the LED self-test: each LED on in turn, then a flash of LED1
+  * @note   Runs in the background from LED_Process, the boot does not wait for it
+  * @retval None
+  */
+void LED_StartSelfTest(void)
+{
+  self_test_step = 0;
+  self_test_tick = HAL_GetTick();
+  LED_On(self_test_leds[0]);
+}
+
+/**
+  * @brief  Advance the LED self-test
+  * @note   Called from the main loop
+  * @retval None
+  */
+void LED_Process(void)
+{
+  if (self_test_step >= LED_SELF_TEST_STEPS) return;
+  if (HAL_GetTick() - self_test_tick < LED_SELF_TEST_STEP_MS) return;
+
+  self_test_tick += LED_SELF_TEST_STEP_MS;
+  LED_Off(self_test_leds[self_test_step]);
+  if (++self_test_step < LED_SELF_TEST_STEPS)
+  {
+    LED_On(self_test_leds[self_test_step]);
+  }
+  else
+  {
+    LED_Flash(&hled1, 200);
+  }
 }
 
   /**
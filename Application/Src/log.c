@@ -41,10 +41,6 @@ void LOG_Init(void)
     log_counter = 0;
     current_log_level = LOG_LEVEL_DEBUG;
     log_initialized = 1;
-    
-    // Wait a bit more to ensure USB is fully ready
-    HAL_Delay(100);
-    
 }
 
 /**
@@ -23,8 +23,11 @@
 #define MESSAGE_MAX_DATA_LENGTH 250
 
 /* Private variables ---------------------------------------------------------*/
+static uint8_t cctalk_peers[MESSAGE_CCTALK_PEERS_MAX];  /* Source addresses of a multi-drop ccTalk bus */
+static uint8_t cctalk_peer_count = 0;                   /* 0: only the configured destination answers */
 
 /* Private function prototypes -----------------------------------------------*/
+static uint8_t MESSAGE_IsCctalkPeer(uint8_t address);
 static void MESSAGE_SetOpcode(message_t* msg, uint8_t opcode);
 static void MESSAGE_SetData(message_t* msg, uint8_t* data, uint8_t data_length);
 static void MESSAGE_SetRaw(message_t* msg);
@@ -59,6 +62,94 @@ static void MESSAGE_SetRaw(message_t* msg);
       return msg;
   }
   
+/**
+  * @brief  Build a frame ready for transmission, without a message structure
+  * @note   Used for frames that are built once and sent many times
+  * @param  protocol: protocol type
+  * @param  direction: message direction (TX/RX)
+  * @param  opcode: command/response opcode
+  * @param  data: pointer to data buffer (NULL if no data)
+  * @param  data_length: length of data buffer (0 if no data)
+  * @param  raw: frame buffer, at least data_length + 6 bytes
+  * @retval uint8_t: frame length
+  */
+uint8_t MESSAGE_BuildFrame(proto_name_t protocol, message_direction_t direction, uint8_t opcode,
+                           const uint8_t* data, uint8_t data_length, uint8_t* raw)
+{
+    uint16_t pos = 0;
+    uint8_t header_length;
+    uint8_t skip_opcode = 0; /* Flag to skip opcode field */
+    uint16_t crc;
+    
+    /* Set header bytes */
+    switch (protocol)
+    {
+        case PROTO_ID003:           
+            /* Header byte */
+            raw[pos++] = 0xFC;
+            header_length = 1;
+            break;
+            
+        case PROTO_CCNET:
+            /* Header bytes */
+            raw[pos++] = 0x02;
+            raw[pos++] = 0x03;
+            header_length = 2;
+            
+            /* CCNET Bill Table, Status and Identification response has no opcode field */
+            if ((opcode == CCNET_BILL_TABLE || opcode == CCNET_STATUS_REQUEST || opcode == CCNET_IDENTIFICATION) 
+                && direction == MSG_DIR_RX)
+            {
+                skip_opcode = 1;
+            }
+            break;
+
+        case PROTO_CCTALK:
+            /* dest | data len | source | data | checksum */
+            raw[pos++] = g_config.downstream->datalink.cctalk_dest_address;
+            raw[pos++] = data_length;  
+            raw[pos++] = g_config.downstream->datalink.cctalk_source_address;
+            raw[pos++] = opcode;
+            /* add data */
+            for (uint8_t i = 0; i < data_length; i++)
+            {
+                raw[pos++] = data[i];
+            }
+            /* add checksum */
+            raw[pos] = CRC_ChecksumCctalk(raw, pos);
+            return pos + 1; /* code below is for CCNET and ID003 only */
+    } /* switch */
+   
+    /* for CCNET and ID003: */
+    /* Set length field */
+    if (!skip_opcode)
+    {
+        raw[pos++] = header_length + 1 + 1 + data_length + 2; /* header(1 or 2) + length + opcode + data + crc */
+    }
+    else
+    {
+        raw[pos++] = header_length + 1 + data_length + 2; /* header(2) + length + data + crc (no opcode) */
+    }
+    
+    /* Set opcode (skip for CCNET Bill Table response and others) */
+    if (!skip_opcode)
+    {
+        raw[pos++] = opcode;
+    }
+    
+    /* Add data */
+    for (uint8_t i = 0; i < data_length; i++)
+    {
+        raw[pos++] = data[i];
+    }
+
+    /* Add CRC */
+    crc = CRC_Calculate(raw, protocol, pos);
+    raw[pos++] = (uint8_t)(crc & 0xFF);
+    raw[pos++] = (uint8_t)((crc >> 8) & 0xFF);
+    return pos;
+}
+
 /**
   * @brief  Initialize message structure
   * @param  msg: pointer to message structure
@@ -128,79 +219,25 @@ static void MESSAGE_SetOpcode(message_t* msg, uint8_t opcode)
   */
 static void MESSAGE_SetRaw(message_t* msg)
 {
-    uint16_t pos = 0;
-    uint8_t header_length;
-    uint8_t skip_opcode = 0; /* Flag to skip opcode field */
-    
-    /* Set header bytes */
-    switch (msg->protocol)
-    {
-        case PROTO_ID003:           
-            /* Header byte */
-            msg->raw[pos++] = 0xFC;
-            header_length = 1;
-            break;
-            
-        case PROTO_CCNET:
-            /* Header bytes */
-            msg->raw[pos++] = 0x02;
-            msg->raw[pos++] = 0x03;
-            header_length = 2;
-            
-            /* CCNET Bill Table, Status and Identification response has no opcode field */
-            if ((msg->opcode == CCNET_BILL_TABLE || msg->opcode == CCNET_STATUS_REQUEST || msg->opcode == CCNET_IDENTIFICATION) 
-                && msg->direction == MSG_DIR_RX)
-            {
-                skip_opcode = 1;
-            }
-            break;
+    msg->length = MESSAGE_BuildFrame(msg->protocol, msg->direction, msg->opcode, msg->data, msg->data_length, msg->raw);
+}
 
-        case PROTO_CCTALK:
-            /* dest | data len | source | data | checksum */
-            msg->raw[pos++] = g_config.downstream->datalink.cctalk_dest_address;
-            msg->raw[pos++] = msg->data_length;  
-            msg->raw[pos++] = g_config.downstream->datalink.cctalk_source_address;
-            msg->raw[pos++] = msg->opcode;
-            /* add data */
-            for (uint8_t i = 0; i < msg->data_length; i++)
-            {
-                msg->raw[pos++] = msg->data[i];
-            }
-            /* add checksum */
-            msg->raw[pos++] = CRC_ChecksumCctalk(msg->raw, pos);
-            msg->length = pos;
-            return; /* code below is for CCNET and ID003 only */
-    } /* switch */
-   
-    /* for CCNET and ID003: */
-    /* Set length field */
-    if (!skip_opcode)
-    {
-        msg->raw[pos++] = header_length + 1 + 1 + msg->data_length + 2; /* header(1 or 2) + length + opcode + data + crc */
-    }
-    else
-    {
-        msg->raw[pos++] = header_length + 1 + msg->data_length + 2; /* header(2) + length + data + crc (no opcode) */
-    }
-    
-    /* Set opcode (skip for CCNET Bill Table response and others) */
-    if (!skip_opcode)
-    {
-        msg->raw[pos++] = msg->opcode;
-    }
-    
-    /* Add data */
-    for (uint8_t i = 0; i < msg->data_length; i++)
-    {
-        msg->raw[pos++] = msg->data[i];
-    }
 
-    /* Add CRC */
-    pos = CRC_AppendCRC(msg, pos);
-    msg->length = pos;
+/**
+  * @brief  Set the ccTalk peripherals whose responses are parsed
+  * @note   Multi-drop bus: the responses come from several source addresses.
+  *         Without peers only the configured destination address answers
+  * @param  addresses: Peripheral addresses, copied. NULL to clear
+  * @param  count: Number of addresses, at most MESSAGE_CCTALK_PEERS_MAX
+  * @retval None
+  */
+void MESSAGE_SetCctalkPeers(const uint8_t* addresses, uint8_t count)
+{
+    if (addresses == NULL || count > MESSAGE_CCTALK_PEERS_MAX) count = 0;
+    for (uint8_t i = 0; i < count; i++) cctalk_peers[i] = addresses[i];
+    cctalk_peer_count = count;
 }
 
-
 /**
   * @brief  Parse raw UART data and populate message structure
   * @param  msg: pointer to message structure containing raw data (input/output)
@@ -222,7 +259,7 @@ message_parse_result_t MESSAGE_Parse(message_t* msg)
     /* Detect protocol and validate header */
     /* detect cctalk pattern: src|length|dest */
     if (msg->length >= 4 && msg->raw[0] == g_config.downstream->datalink.cctalk_source_address && 
-        msg->raw[1] == msg->length -5 && msg->raw[2] == g_config.downstream->datalink.cctalk_dest_address)
+        msg->raw[1] == msg->length -5 && MESSAGE_IsCctalkPeer(msg->raw[2]))
     {
         msg->protocol = PROTO_CCTALK;
         expected_length = msg->raw[1] + 5;
@@ -602,3 +639,18 @@ message_parse_result_t MESSAGE_ValidateOpcode(message_t* msg)
 }
 
 /* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check if a ccTalk response comes from an expected source address
+  * @param  address: Source address of the response
+  * @retval uint8_t: 1 if a bus peer, or the configured destination without peers
+  */
+static uint8_t MESSAGE_IsCctalkPeer(uint8_t address)
+{
+    if (cctalk_peer_count == 0) return (address == g_config.downstream->datalink.cctalk_dest_address);
+    for (uint8_t i = 0; i < cctalk_peer_count; i++)
+    {
+        if (cctalk_peers[i] == address) return 1;
+    }
+    return 0;
+}
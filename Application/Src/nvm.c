@@ -38,10 +38,10 @@ static nvm_result_t NVM_EraseConfig(void);
 static nvm_result_t NVM_UnlockFlash(void);
 static nvm_result_t NVM_LockFlash(void);
 static uint32_t NVM_GetSequenceNumber(uint32_t address);
-static nvm_result_t NVM_ValidateStorage(const nvm_data_storage_t* storage);
+static nvm_result_t NVM_ValidateStorage(const nvm_data_storage_t* storage, uint32_t magic);
 static uint16_t NVM_CalculateCRC16(const uint8_t* data, uint32_t length);
-static nvm_result_t NVM_WriteDataToBank(uint32_t address, const uint8_t* data, uint32_t data_size, uint32_t sequence);
-static nvm_result_t NVM_ReadDataFromBank(uint32_t address, uint8_t* data, uint32_t max_size, uint32_t* actual_size);
+static nvm_result_t NVM_WriteDataToBank(uint32_t address, uint32_t magic, const uint8_t* data, uint32_t data_size, uint32_t sequence);
+static nvm_result_t NVM_ReadDataFromBank(uint32_t address, uint32_t magic, uint8_t* data, uint32_t max_size, uint32_t* actual_size);
 static void NVM_MemCpy(uint8_t* dest, const uint8_t* src, uint32_t length);
 
 /* Exported functions --------------------------------------------------------*/
@@ -240,7 +240,7 @@ nvm_result_t NVM_ReadConfigData(uint8_t* data, uint32_t max_size, uint32_t* actu
     }
     
     /* Validate selected storage */
-    result = NVM_ValidateStorage(selected_storage);
+    result = NVM_ValidateStorage(selected_storage, CONFIG_MAGIC_NUMBER);
     if (result != NVM_OK)
     {
         LOG_Error("Data validation failed for bank");
@@ -250,13 +250,13 @@ nvm_result_t NVM_ReadConfigData(uint8_t* data, uint32_t max_size, uint32_t* actu
         {
             selected_bank = FLASH_CONFIG_BANK2;
             selected_storage = &bank2_storage;
-            result = NVM_ValidateStorage(selected_storage);
+            result = NVM_ValidateStorage(selected_storage, CONFIG_MAGIC_NUMBER);
         }
         else if (selected_bank == FLASH_CONFIG_BANK2 && bank1_result == NVM_OK)
         {
             selected_bank = FLASH_CONFIG_BANK1;
             selected_storage = &bank1_storage;
-            result = NVM_ValidateStorage(selected_storage);
+            result = NVM_ValidateStorage(selected_storage, CONFIG_MAGIC_NUMBER);
         }
         
         if (result != NVM_OK)
@@ -336,7 +336,7 @@ nvm_result_t NVM_WriteConfigData(const uint8_t* data, uint32_t data_size)
     }
     
     /* Write data to target bank */
-    result = NVM_WriteDataToBank(target_bank, data, data_size, new_sequence);
+    result = NVM_WriteDataToBank(target_bank, CONFIG_MAGIC_NUMBER, data, data_size, new_sequence);
     if (result != NVM_OK)
     {
         LOG_Error("Failed to write data to bank");
@@ -362,6 +362,64 @@ uint32_t NVM_GetCurrentSequenceNumber(void)
     return (bank1_sequence >= bank2_sequence) ? bank1_sequence : bank2_sequence;
 }
 
+/**
+  * @brief  Read the warm-start snapshot
+  * @note   An erased page is a cold start, not an error: nothing is logged
+  * @param  data: Pointer to buffer to fill with the snapshot
+  * @param  max_size: Maximum size of the buffer
+  * @param  actual_size: Pointer to receive the snapshot size
+  * @retval NVM operation result, NVM_ERROR if no snapshot was saved yet
+  */
+nvm_result_t NVM_ReadSnapshot(uint8_t* data, uint32_t max_size, uint32_t* actual_size)
+{
+    if (data == NULL || actual_size == NULL)
+    {
+        LOG_Error("Invalid parameter for snapshot read");
+        return NVM_INVALID_PARAM;
+    }
+
+    if (((const nvm_data_storage_t*)FLASH_SNAPSHOT_PAGE)->magic != SNAPSHOT_MAGIC_NUMBER)
+    {
+        return NVM_ERROR;
+    }
+
+    return NVM_ReadDataFromBank(FLASH_SNAPSHOT_PAGE, SNAPSHOT_MAGIC_NUMBER, data, max_size, actual_size);
+}
+
+/**
+  * @brief  Write the warm-start snapshot
+  * @note   Single page without bank rotation: a snapshot lost during the write
+  *         only costs one cold start. The caller writes only changed content,
+  *         so the page is erased at most once per validator change
+  * @param  data: Pointer to snapshot data
+  * @param  data_size: Size of the snapshot
+  * @retval NVM operation result
+  */
+nvm_result_t NVM_WriteSnapshot(const uint8_t* data, uint32_t data_size)
+{
+    nvm_result_t result;
+
+    if (data == NULL || data_size == 0 || data_size > 512)
+    {
+        LOG_Error("Invalid parameter for snapshot write");
+        return NVM_INVALID_PARAM;
+    }
+
+    result = NVM_EraseFlashPage(FLASH_SNAPSHOT_PAGE);
+    if (result != NVM_OK)
+    {
+        LOG_Error("Failed to erase snapshot page");
+        return result;
+    }
+
+    result = NVM_WriteDataToBank(FLASH_SNAPSHOT_PAGE, SNAPSHOT_MAGIC_NUMBER, data, data_size, 1);
+    if (result != NVM_OK)
+    {
+        LOG_Error("Failed to write snapshot");
+    }
+    return result;
+}
+
 /**
   * @brief  Erase all configuration data (private function)
   * @retval NVM operation result
@@ -438,9 +496,10 @@ static uint32_t NVM_GetSequenceNumber(uint32_t address)
 /**
   * @brief  Validate configuration storage structure
   * @param  storage: Pointer to storage structure to validate
+  * @param  magic: Expected magic number (configuration or snapshot)
   * @retval NVM operation result
   */
-static nvm_result_t NVM_ValidateStorage(const nvm_data_storage_t* storage)
+static nvm_result_t NVM_ValidateStorage(const nvm_data_storage_t* storage, uint32_t magic)
 {
     if (storage == NULL)
     {
@@ -448,7 +507,7 @@ static nvm_result_t NVM_ValidateStorage(const nvm_data_storage_t* storage)
     }
     
     /* Check magic number */
-    if (storage->magic != CONFIG_MAGIC_NUMBER)
+    if (storage->magic != magic)
     {
         LOG_Error("Invalid magic number");
         return NVM_CORRUPTED_DATA;
@@ -494,16 +553,17 @@ static uint16_t NVM_CalculateCRC16(const uint8_t* data, uint32_t length)
 /**
   * @brief  Write configuration to specific bank
   * @param  address: Bank address to write to
+  * @param  magic: Magic number of the stored data (configuration or snapshot)
   * @param  config: Pointer to configuration to write
   * @param  sequence: Sequence number to assign
   * @retval NVM operation result
   */
-static nvm_result_t NVM_WriteDataToBank(uint32_t address, const uint8_t* data, uint32_t data_size, uint32_t sequence)
+static nvm_result_t NVM_WriteDataToBank(uint32_t address, uint32_t magic, const uint8_t* data, uint32_t data_size, uint32_t sequence)
 {
     nvm_data_storage_t storage;
     
     /* Fill storage structure */
-    storage.magic = CONFIG_MAGIC_NUMBER;
+    storage.magic = magic;
     storage.version = CONFIG_VERSION;
     storage.sequence = sequence;
     storage.data_size = data_size;
@@ -522,12 +582,13 @@ static nvm_result_t NVM_WriteDataToBank(uint32_t address, const uint8_t* data, u
 /**
   * @brief  Read data from specific bank (private function)
   * @param  address: Bank address to read from
+  * @param  magic: Expected magic number (configuration or snapshot)
   * @param  data: Pointer to buffer to fill with data
   * @param  max_size: Maximum size of the buffer
   * @param  actual_size: Pointer to receive actual data size read
   * @retval NVM operation result
   */
-static nvm_result_t NVM_ReadDataFromBank(uint32_t address, uint8_t* data, uint32_t max_size, uint32_t* actual_size)
+static nvm_result_t NVM_ReadDataFromBank(uint32_t address, uint32_t magic, uint8_t* data, uint32_t max_size, uint32_t* actual_size)
 {
     nvm_data_storage_t storage;
     nvm_result_t result;
@@ -540,7 +601,7 @@ static nvm_result_t NVM_ReadDataFromBank(uint32_t address, uint8_t* data, uint32
     }
     
     /* Validate storage */
-    result = NVM_ValidateStorage(&storage);
+    result = NVM_ValidateStorage(&storage, magic);
     if (result != NVM_OK)
     {
         return result;
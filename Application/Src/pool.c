@@ -0,0 +1,286 @@
+/**
+  ******************************************************************************
+  * @file           : pool.c
+  * @brief          : Downstream acceptor pool implementation
+  *                   The denominations of two downstream validators are merged
+  *                   into the 24 CCNET bill types. A CCNET enable mask is
+  *                   split into a bill table row mask per device, the bills in
+  *                   escrow are handed to the controller one at a time, in
+  *                   arrival order, and one device status is chosen for POLL,
+  *                   so the controller sees one bill validator.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "pool.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t POOL_FindValue(const pool_t* pool, uint8_t device, uint16_t value);
+static uint8_t POOL_FirstEscrow(const pool_t* pool);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize an empty pool: no denominations, no escrow
+  * @param  pool: Acceptor pool
+  * @param  devices: Devices in the pool, 1 or 2
+  * @retval None
+  */
+void POOL_Init(pool_t* pool, uint8_t devices)
+{
+    pool->devices = (devices == 0 || devices > POOL_MAX_DEVICES) ? 1 : devices;
+    for (uint8_t device = 0; device < POOL_MAX_DEVICES; device++)
+    {
+        for (uint8_t row = 0; row < POOL_DEVICE_ROWS; row++) pool->values[device][row] = 0;
+        pool->states[device] = POOL_STATE_UNKNOWN;
+        pool->escrow_bill[device] = POOL_NO_BILL;
+        pool->escrow_order[device] = 0;
+    }
+    pool->count = 0;
+    pool->escrow_arrivals = 0;
+    pool->escrow_owner = POOL_NO_DEVICE;
+    pool->escrow_waits = 0;
+    pool->dropped = 0;
+}
+
+/**
+  * @brief  Set the denominations of a device
+  * @note   Call POOL_Merge once all devices are set
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @param  values: Value per bill table row, 0 = row not used. NULL: device removed
+  * @param  count: Number of values, at most POOL_DEVICE_ROWS
+  * @retval None
+  */
+void POOL_SetDevice(pool_t* pool, uint8_t device, const uint16_t* values, uint8_t count)
+{
+    if (device >= POOL_MAX_DEVICES) return;
+
+    for (uint8_t row = 0; row < POOL_DEVICE_ROWS; row++)
+    {
+        pool->values[device][row] = (values != NULL && row < count) ? values[row] : 0;
+    }
+}
+
+/**
+  * @brief  Map the device denominations to CCNET bill types
+  * @note   Device 0 keeps its row order, so a single device gets the same
+  *         bill types as without the pool, and a second device only adds bill
+  *         types after them. A value that is already a bill type of another
+  *         device shares that bill type
+  * @param  pool: Acceptor pool
+  * @retval None
+  */
+void POOL_Merge(pool_t* pool)
+{
+    pool->count = 0;
+    pool->dropped = 0;
+
+    for (uint8_t device = 0; device < POOL_MAX_DEVICES; device++)
+    {
+        for (uint8_t row = 0; row < POOL_DEVICE_ROWS; row++)
+        {
+            uint16_t value = pool->values[device][row];
+            uint8_t type;
+
+            if (value == 0) continue;
+
+            type = POOL_FindValue(pool, device, value);
+            if (type == POOL_NO_BILL)
+            {
+                if (pool->count >= POOL_BILL_TYPES)
+                {
+                    pool->dropped++;
+                    continue;
+                }
+                type = pool->count++;
+                pool->bill_types[type].value = value;
+                for (uint8_t d = 0; d < POOL_MAX_DEVICES; d++) pool->bill_types[type].device_row[d] = POOL_NO_BILL;
+            }
+            pool->bill_types[type].device_row[device] = row;
+        }
+    }
+}
+
+/**
+  * @brief  CCNET bill type of a bill table row of a device
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @param  row: Bill table row of the device
+  * @retval uint8_t: Bill type 0-23, POOL_NO_BILL if the row is not merged
+  */
+uint8_t POOL_ToBillType(const pool_t* pool, uint8_t device, uint8_t row)
+{
+    if (device >= POOL_MAX_DEVICES) return POOL_NO_BILL;
+
+    for (uint8_t type = 0; type < pool->count; type++)
+    {
+        if (pool->bill_types[type].device_row[device] == row) return type;
+    }
+    return POOL_NO_BILL;
+}
+
+/**
+  * @brief  Row enable mask of a device for a CCNET enable mask
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @param  bill_types: CCNET enabled bill types, bit 0 is bill type 0
+  * @retval uint32_t: Enabled rows of the device, bit n is bill table row n
+  */
+uint32_t POOL_RouteEnable(const pool_t* pool, uint8_t device, uint32_t bill_types)
+{
+    uint32_t mask = 0;
+
+    if (device >= POOL_MAX_DEVICES) return 0;
+
+    for (uint8_t type = 0; type < pool->count; type++)
+    {
+        uint8_t row = pool->bill_types[type].device_row[device];
+
+        if ((bill_types & (1UL << type)) && row != POOL_NO_BILL) mask |= (1UL << row);
+    }
+    return mask;
+}
+
+/**
+  * @brief  CCNET bill types enabled by the row enable mask of a device
+  * @note   The reverse of POOL_RouteEnable, for GET STATUS. OR the result of
+  *         all devices for the bill types the pool accepts
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @param  rows: Enabled rows of the device, bit n is bill table row n
+  * @retval uint32_t: CCNET enabled bill types, bit 0 is bill type 0
+  */
+uint32_t POOL_MergeEnable(const pool_t* pool, uint8_t device, uint32_t rows)
+{
+    uint32_t bill_types = 0;
+
+    if (device >= POOL_MAX_DEVICES) return 0;
+
+    for (uint8_t type = 0; type < pool->count; type++)
+    {
+        uint8_t row = pool->bill_types[type].device_row[device];
+
+        if (row != POOL_NO_BILL && (rows & (1UL << row))) bill_types |= (1UL << type);
+    }
+    return bill_types;
+}
+
+/**
+  * @brief  Offer the bill a device holds in escrow to the controller
+  * @note   The first bill offered is handled first. A bill offered while the
+  *         controller handles the bill of the other device stays in escrow
+  *         and follows once that one is released. Repeated offers of the same
+  *         bill (every escrow status) keep its place
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @param  bill_type: CCNET bill type of the bill
+  * @retval uint8_t: 1 if the controller handles the bill of this device now
+  */
+uint8_t POOL_OfferEscrow(pool_t* pool, uint8_t device, uint8_t bill_type)
+{
+    if (device >= pool->devices) return 0;
+
+    if (pool->escrow_bill[device] == POOL_NO_BILL)
+    {
+        pool->escrow_bill[device] = bill_type;
+        pool->escrow_order[device] = pool->escrow_arrivals++;
+        if (pool->escrow_owner == POOL_NO_DEVICE) pool->escrow_owner = device;
+        else if (pool->escrow_owner != device) pool->escrow_waits++;
+    }
+    return (pool->escrow_owner == device);
+}
+
+/**
+  * @brief  Release the escrow of a device once its bill is stacked or returned
+  * @note   The bill that waited longest is handed to the controller next
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @retval None
+  */
+void POOL_ReleaseEscrow(pool_t* pool, uint8_t device)
+{
+    if (device >= POOL_MAX_DEVICES) return;
+
+    pool->escrow_bill[device] = POOL_NO_BILL;
+    if (pool->escrow_owner == device) pool->escrow_owner = POOL_FirstEscrow(pool);
+}
+
+/**
+  * @brief  Set the state class of a device
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @param  state: State class of the last device status
+  * @retval None
+  */
+void POOL_SetState(pool_t* pool, uint8_t device, pool_state_t state)
+{
+    if (device < POOL_MAX_DEVICES) pool->states[device] = (uint8_t)state;
+}
+
+/**
+  * @brief  Device whose status is answered to the controller
+  * @note   The device whose bill the controller handles, from escrow until
+  *         released. Otherwise the device in the highest state: a bill being
+  *         accepted first, a working device before a failed one. Ties go to
+  *         device 0
+  * @param  pool: Acceptor pool
+  * @retval uint8_t: Device index
+  */
+uint8_t POOL_Select(const pool_t* pool)
+{
+    uint8_t selected = 0;
+
+    if (pool->escrow_owner != POOL_NO_DEVICE) return pool->escrow_owner;
+
+    for (uint8_t device = 1; device < pool->devices; device++)
+    {
+        if (pool->states[device] > pool->states[selected]) selected = device;
+    }
+    return selected;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Find a merged bill type of the value that the device does not use yet
+  * @param  pool: Acceptor pool
+  * @param  device: Device index
+  * @param  value: Denomination value
+  * @retval uint8_t: Bill type, POOL_NO_BILL if none
+  */
+static uint8_t POOL_FindValue(const pool_t* pool, uint8_t device, uint16_t value)
+{
+    for (uint8_t type = 0; type < pool->count; type++)
+    {
+        if (pool->bill_types[type].value == value && pool->bill_types[type].device_row[device] == POOL_NO_BILL)
+        {
+            return type;
+        }
+    }
+    return POOL_NO_BILL;
+}
+
+/**
+  * @brief  Device with the oldest bill in escrow
+  * @param  pool: Acceptor pool
+  * @retval uint8_t: Device index, POOL_NO_DEVICE if no bill is in escrow
+  */
+static uint8_t POOL_FirstEscrow(const pool_t* pool)
+{
+    uint8_t first = POOL_NO_DEVICE;
+
+    for (uint8_t device = 0; device < pool->devices; device++)
+    {
+        if (pool->escrow_bill[device] == POOL_NO_BILL) continue;
+        if (first == POOL_NO_DEVICE ||
+            (int32_t)(pool->escrow_order[device] - pool->escrow_order[first]) < 0) first = device;
+    }
+    return first;
+}
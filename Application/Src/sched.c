@@ -0,0 +1,288 @@
+/**
+  ******************************************************************************
+  * @file           : sched.c
+  * @brief          : Main loop scheduler implementation
+  *                   Every pass runs all tasks in priority order. A task that
+  *                   is notified from an interrupt (frame received) runs
+  *                   again before the next lower priority task, so its
+  *                   latency is bounded by the longest single task run, not
+  *                   by a full pass of the loop.
+  *                   Each task runs on its own stack (PSP), interrupts on the
+  *                   main stack (MSP). All stacks are painted and scanned
+  *                   periodically for their high-water marks.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sched.h"
+#include "uart.h"
+#include "utils.h"
+
+/* Private variables ---------------------------------------------------------*/
+extern uint8_t _estack;             /* Linker script: top of RAM */
+extern uint32_t _Min_Stack_Size;    /* Linker script: reserved MSP stack */
+
+static const sched_task_t* sched_tasks = NULL;
+static uint8_t sched_count = 0;
+static sched_task_stats_t sched_stats[SCHED_MAX_TASKS];
+static volatile uint8_t sched_notified[SCHED_MAX_TASKS];    /* Set by interrupts, byte access only */
+static uint32_t* task_low[SCHED_MAX_TASKS];                 /* Deepest used word of each task stack */
+static uint32_t* stack_bottom = NULL;   /* Lowest word of the reserved main stack */
+static uint32_t* stack_low = NULL;      /* Deepest used main stack word found so far */
+static uint32_t scan_tick = 0;
+static uint8_t reset_pending = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SCHED_RunTask(uint8_t task);
+static void SCHED_CallOnStack(sched_task_fn_t run, uint32_t* stack_top);
+static void SCHED_ClearStats(void);
+static void SCHED_ScanStacks(void);
+static void SCHED_PaintStack(void);
+static uint32_t* SCHED_ScanStack(uint32_t* bottom, uint32_t* low);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the scheduler and paint the stacks
+  * @param  tasks: Task table, highest priority first
+  * @param  count: Number of tasks, at most SCHED_MAX_TASKS
+  * @retval None
+  */
+void SCHED_Init(const sched_task_t* tasks, uint8_t count)
+{
+    sched_tasks = tasks;
+    sched_count = (count > SCHED_MAX_TASKS) ? SCHED_MAX_TASKS : count;
+    for (uint8_t i = 0; i < SCHED_MAX_TASKS; i++) sched_notified[i] = 0;
+    reset_pending = 0;
+    scan_tick = HAL_GetTick();
+    SCHED_ClearStats();
+}
+
+/**
+  * @brief  Run one pass of all tasks
+  * @note   Called from the main loop. Notified higher priority tasks run again
+  *         between the lower priority tasks
+  * @retval None
+  */
+void SCHED_Run(void)
+{
+    /* no task is running: every task stack can be painted again */
+    if (reset_pending)
+    {
+        reset_pending = 0;
+        SCHED_ClearStats();
+    }
+
+    for (uint8_t i = 0; i < sched_count; i++)
+    {
+        SCHED_RunTask(i);
+
+        for (uint8_t higher = 0; higher < i; higher++)
+        {
+            if (!sched_notified[higher]) continue;
+            sched_stats[higher].preemptions++;
+            SCHED_RunTask(higher);
+        }
+    }
+
+    if (HAL_GetTick() - scan_tick >= SCHED_SCAN_PERIOD_MS)
+    {
+        scan_tick = HAL_GetTick();
+        SCHED_ScanStacks();
+    }
+}
+
+/**
+  * @brief  Notify a task that it has work
+  * @note   Interrupt safe
+  * @param  task: Task index
+  * @retval None
+  */
+void SCHED_Notify(uint8_t task)
+{
+    if (task >= sched_count) return;
+    sched_notified[task] = 1;
+    sched_stats[task].notifications++;
+}
+
+/**
+  * @brief  Get the statistics of a task
+  * @param  task: Task index
+  * @param  name: Set to the task name
+  * @param  stats: Filled with the task statistics
+  * @retval uint8_t: 1 if task is valid, 0 past the last task
+  */
+uint8_t SCHED_GetTaskStats(uint8_t task, const char** name, sched_task_stats_t* stats)
+{
+    if (task >= sched_count) return 0;
+    *name = sched_tasks[task].name;
+    *stats = sched_stats[task];
+    stats->stack_size = sched_tasks[task].stack_size;
+    return 1;
+}
+
+/**
+  * @brief  Clear the task statistics and the stack high-water marks
+  * @note   Applied before the next pass: the caller runs on a task stack,
+  *         which cannot be painted while it is in use
+  * @retval None
+  */
+void SCHED_ResetStats(void)
+{
+    reset_pending = 1;
+}
+
+/**
+  * @brief  Deepest main stack use since the last reset
+  * @note   Interrupt handlers, init and the main loop outside the tasks
+  * @retval uint32_t: Bytes, equal to SCHED_GetStackSize if the stack may have overflowed
+  */
+uint32_t SCHED_GetStackHighWater(void)
+{
+    stack_low = SCHED_ScanStack(stack_bottom, stack_low);
+    return (uint32_t)&_estack - (uint32_t)stack_low;
+}
+
+/**
+  * @brief  Size of the reserved MSP stack
+  * @retval uint32_t: Bytes
+  */
+uint32_t SCHED_GetStackSize(void)
+{
+    return (uint32_t)&_Min_Stack_Size;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Run a task on its stack and record its run time
+  * @note   The notification is cleared before the run: a frame received while
+  *         the task runs notifies it again
+  * @param  task: Task index
+  * @retval None
+  */
+static void SCHED_RunTask(uint8_t task)
+{
+    const sched_task_t* entry = &sched_tasks[task];
+    sched_task_stats_t* stats = &sched_stats[task];
+    uint32_t start_tick;
+    uint32_t start_cycles;
+
+    sched_notified[task] = 0;
+    start_tick = HAL_GetTick();
+    start_cycles = UART_CYCLES_START();
+
+    SCHED_CallOnStack(entry->run, entry->stack + entry->stack_size / sizeof(uint32_t));
+
+#if UART_PROFILE_CYCLES
+    if (DWT->CYCCNT - start_cycles > stats->cycles_max) stats->cycles_max = DWT->CYCCNT - start_cycles;
+#else
+    (void)start_cycles;
+#endif
+    if (HAL_GetTick() - start_tick > stats->time_max_ms) stats->time_max_ms = HAL_GetTick() - start_tick;
+    stats->runs++;
+}
+
+/**
+  * @brief  Call a task function on its own stack
+  * @note   Thread mode switches to the process stack (CONTROL.SPSEL) for the
+  *         call and back to the main stack after it. The task runs to
+  *         completion, no context is saved. Exception entry stacks the frame
+  *         on the task stack, the handler itself runs on the main stack
+  * @param  run: Task function (r0)
+  * @param  stack_top: First word above the task stack, 8 byte aligned (r1)
+  * @retval None
+  */
+__attribute__((naked)) static void SCHED_CallOnStack(sched_task_fn_t run, uint32_t* stack_top)
+{
+    __ASM volatile(
+        "push   {r4, lr}        \n"
+        "msr    psp, r1         \n"
+        "mrs    r4, control     \n"
+        "orr    r4, r4, #2      \n"
+        "msr    control, r4     \n"
+        "isb                    \n"
+        "blx    r0              \n"
+        "mrs    r4, control     \n"
+        "bic    r4, r4, #2      \n"
+        "msr    control, r4     \n"
+        "isb                    \n"
+        "pop    {r4, pc}        \n"
+    );
+}
+
+/**
+  * @brief  Clear the statistics and paint all stacks again
+  * @note   Runs on the main stack while no task is running
+  * @retval None
+  */
+static void SCHED_ClearStats(void)
+{
+    utils_zero((uint8_t*)sched_stats, sizeof(sched_stats));
+
+    for (uint8_t i = 0; i < sched_count; i++)
+    {
+        uint32_t words = sched_tasks[i].stack_size / sizeof(uint32_t);
+
+        for (uint32_t word = 0; word < words; word++) sched_tasks[i].stack[word] = SCHED_STACK_PAINT;
+        task_low[i] = sched_tasks[i].stack + words;
+    }
+    SCHED_PaintStack();
+}
+
+/**
+  * @brief  Update the stack high-water marks
+  * @note   Every SCHED_SCAN_PERIOD_MS, only the painted part below each mark
+  *         is scanned
+  * @retval None
+  */
+static void SCHED_ScanStacks(void)
+{
+    for (uint8_t i = 0; i < sched_count; i++)
+    {
+        uint32_t* low = SCHED_ScanStack(sched_tasks[i].stack, task_low[i]);
+
+        if (low < task_low[i])
+        {
+            task_low[i] = low;
+            sched_stats[i].stack_max = sched_tasks[i].stack_size - (uint32_t)(low - sched_tasks[i].stack) * sizeof(uint32_t);
+        }
+    }
+    stack_low = SCHED_ScanStack(stack_bottom, stack_low);
+}
+
+/**
+  * @brief  Fill the unused part of the reserved main stack with SCHED_STACK_PAINT
+  * @note   The heap never grows into the reserved stack (_sbrk)
+  * @retval None
+  */
+static void SCHED_PaintStack(void)
+{
+    uint32_t* top = (uint32_t*)((__get_MSP() - SCHED_STACK_MARGIN) & ~3UL);
+
+    stack_bottom = (uint32_t*)(((uint32_t)&_estack - (uint32_t)&_Min_Stack_Size + 3) & ~3UL);
+    for (uint32_t* word = stack_bottom; word < top; word++) *word = SCHED_STACK_PAINT;
+    stack_low = top;
+}
+
+/**
+  * @brief  Find the deepest used word of a stack
+  * @note   Scans up from the bottom: locals that are never written leave paint
+  *         above the deepest use, they do not end the scan
+  * @param  bottom: Lowest word of the stack
+  * @param  low: Deepest used word found so far
+  * @retval uint32_t*: Lowest word that is not painted, at most low
+  */
+static uint32_t* SCHED_ScanStack(uint32_t* bottom, uint32_t* low)
+{
+    uint32_t* word = bottom;
+
+    while (word < low && *word == SCHED_STACK_PAINT) word++;
+    return word;
+}
@@ -29,6 +29,7 @@ static void TABLE_UI_DisplayHeader(void);
 static void TABLE_UI_DisplayRow(uint8_t ccnet_bit, const char* currency, uint16_t value, uint8_t id003_denom, uint8_t country_code);
 static char TABLE_UI_GetEnabledStatus(uint32_t enabled_bills, uint32_t escrowed_bills, uint8_t bit);
 static void TABLE_UI_DisplaySeparator(void);
+static void TABLE_UI_DisplaySettings(void);
 
 /* Exported functions --------------------------------------------------------*/
 
@@ -75,6 +76,7 @@ void TABLE_UI_DisplayBillTable(void)
     
     /* Display legend */
     USB_TransmitString("Bill Type Status: N = not enabled, Y = enabled, E = enabled with Escrow\r\n");
+    TABLE_UI_DisplaySettings();
     USB_TransmitString("======================================================================\r\n\r\n");
 
     snprintf(buffer, BUFFER_SIZE, "g_bill_table.enabled_bills: 0x%02X, g_bill_table.escrowed: 0x%02X, g_bill_table.ds_enabled_bills: 0x%02X, g_bill_table.ds_escrowed_bills: 0x%02X", 
@@ -156,3 +158,28 @@ static char TABLE_UI_GetEnabledStatus(uint32_t enabled_bills, uint32_t escrowed_
     }
 }
 
+/**
+  * @brief  Display the cached downstream settings
+  * @note   From RAM, no downstream request. '?' = not known yet
+  * @retval None
+  */
+static void TABLE_UI_DisplaySettings(void)
+{
+    const ds_settings_t* settings = &g_bill_table.ds_settings;
+    char buffer[BUFFER_SIZE];
+    char inhibit = '?';
+
+    if (settings->valid & DS_SETTING_INHIBIT) inhibit = settings->inhibit ? 'Y' : 'N';
+
+    snprintf(buffer, BUFFER_SIZE, "Downstream: inhibit %c, enable 0x%02X, security 0x%02X, comm mode 0x%02X, direction 0x%02X\r\n",
+             inhibit,
+             (settings->valid & DS_SETTING_ENABLE) ? settings->enable[0] : 0,
+             (settings->valid & DS_SETTING_SECURITY) ? settings->security[0] : 0,
+             (settings->valid & DS_SETTING_COMM_MODE) ? settings->comm_mode : 0,
+             (settings->valid & DS_SETTING_DIRECTION) ? settings->direction : 0);
+    USB_TransmitString(buffer);
+    if (settings->valid != DS_SETTING_ALL)
+    {
+        USB_TransmitString("Downstream settings not all known yet, unknown values shown as 0x00\r\n");
+    }
+}
@@ -0,0 +1,226 @@
+/**
+  ******************************************************************************
+  * @file           : transaction.c
+  * @brief          : Downstream transaction engine implementation
+  *                   Requests are queued with their expected response and a
+  *                   deadline. The main loop sends them one at a time, matches
+  *                   the parsed responses and calls the completion callback,
+  *                   so waiting for the validator never blocks the upstream bus.
+  *                   Each downstream link has its own engine.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "transaction.h"
+#include "uart.h"
+#include "log.h"
+#include "utils.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static void TRANSACTION_StartNext(transaction_engine_t* engine);
+static void TRANSACTION_CheckSent(transaction_engine_t* engine);
+static void TRANSACTION_Complete(transaction_engine_t* engine, transaction_result_t result, const message_t* response);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Initialize a transaction engine
+  * @param  engine: Transaction engine
+  * @param  interface: Downstream interface configuration
+  * @param  send: Function that queues a request for transmission
+  * @retval None
+  */
+void TRANSACTION_Init(transaction_engine_t* engine, interface_config_t* interface, transaction_send_t send)
+{
+    engine->interface = interface;
+    engine->send = send;
+    engine->head = 0;
+    engine->tail = 0;
+    engine->start_tick = 0;
+    engine->hold = 0;
+    TRANSACTION_Abort(engine);
+}
+
+/**
+  * @brief  Queue a request, sent as soon as the line is free
+  * @param  engine: Transaction engine
+  * @param  opcode: Request opcode
+  * @param  data: Request payload (NULL if no data), copied
+  * @param  data_length: Payload length, at most TRANSACTION_MAX_DATA
+  * @param  expected_opcode: Response opcode or TRANSACTION_ANY_OPCODE
+  * @param  expected_length: Response data length or TRANSACTION_ANY_LENGTH
+  * @param  timeout_ms: Response deadline after the request has been sent
+  * @param  callback: Completion callback, NULL if the response is not needed
+  * @retval uint8_t: 1 if queued, 0 if the queue is full or the payload too long
+  */
+uint8_t TRANSACTION_Submit(transaction_engine_t* engine, uint8_t opcode, const uint8_t* data, uint8_t data_length,
+                           uint8_t expected_opcode, uint8_t expected_length,
+                           uint16_t timeout_ms, transaction_callback_t callback)
+{
+    transaction_t* transaction;
+
+    if ((uint8_t)(engine->head - engine->tail) >= TRANSACTION_QUEUE_SLOTS || data_length > TRANSACTION_MAX_DATA)
+    {
+        LOG_Warn("Downstream request dropped, transaction queue full");
+        return 0;
+    }
+
+    transaction = &engine->queue[engine->head % TRANSACTION_QUEUE_SLOTS];
+    transaction->opcode = opcode;
+    transaction->data_length = data_length;
+    if (data != NULL && data_length > 0) utils_memcpy(transaction->data, data, data_length);
+    transaction->expected_opcode = expected_opcode;
+    transaction->expected_length = expected_length;
+    transaction->timeout_ms = timeout_ms;
+    transaction->callback = callback;
+    engine->head++;
+
+    if (engine->state == TRANSACTION_STATE_IDLE) TRANSACTION_StartNext(engine);
+    return 1;
+}
+
+/**
+  * @brief  Run a transaction engine
+  * @note   Called from the main loop: starts the deadline once the request is
+  *         on the wire, completes timed out requests and sends the next one
+  * @param  engine: Transaction engine
+  * @retval None
+  */
+void TRANSACTION_Process(transaction_engine_t* engine)
+{
+    TRANSACTION_CheckSent(engine);
+
+    if (engine->state == TRANSACTION_STATE_WAITING &&
+        HAL_GetTick() - engine->start_tick >= engine->queue[engine->tail % TRANSACTION_QUEUE_SLOTS].timeout_ms)
+    {
+        TRANSACTION_Complete(engine, TRANSACTION_TIMEOUT, NULL);
+    }
+
+    if (engine->state == TRANSACTION_STATE_IDLE) TRANSACTION_StartNext(engine);
+}
+
+/**
+  * @brief  Offer a parsed downstream message to the active request
+  * @note   A message that does not match the expected opcode and length (a late
+  *         answer to a timed out request) is ignored, the deadline keeps running
+  * @param  engine: Transaction engine of the link the message came from
+  * @param  response: Parsed downstream message
+  * @param  result: Parse result of the message
+  * @retval uint8_t: 1 if the message completed the active request
+  */
+uint8_t TRANSACTION_HandleResponse(transaction_engine_t* engine, const message_t* response, message_parse_result_t result)
+{
+    const transaction_t* transaction = &engine->queue[engine->tail % TRANSACTION_QUEUE_SLOTS];
+
+    TRANSACTION_CheckSent(engine);
+    if (engine->state != TRANSACTION_STATE_WAITING) return 0;
+
+    if (result == MSG_CRC_INVALID || result == MSG_DATA_MISSING_FOR_OPCODE)
+    {
+        TRANSACTION_Complete(engine, TRANSACTION_ERROR, response);
+        return 1;
+    }
+    if (result != MSG_OK) return 0;
+
+    if (transaction->expected_opcode != TRANSACTION_ANY_OPCODE && response->opcode != transaction->expected_opcode) return 0;
+    if (transaction->expected_length != TRANSACTION_ANY_LENGTH && response->data_length != transaction->expected_length) return 0;
+
+    TRANSACTION_Complete(engine, TRANSACTION_OK, response);
+    return 1;
+}
+
+/**
+  * @brief  Check if no request is queued or on the line
+  * @param  engine: Transaction engine
+  * @retval uint8_t: 1 if idle
+  */
+uint8_t TRANSACTION_IsIdle(const transaction_engine_t* engine)
+{
+    return (engine->state == TRANSACTION_STATE_IDLE && engine->head == engine->tail);
+}
+
+/**
+  * @brief  Hold or release the queued requests
+  * @note   For another sender on the same line (the ccTalk bus owner): while
+  *         held no request is started, a request already on the line is not
+  *         affected. Released requests are sent by TRANSACTION_Process
+  * @param  engine: Transaction engine
+  * @param  held: 1 to hold, 0 to release
+  * @retval None
+  */
+void TRANSACTION_SetHold(transaction_engine_t* engine, uint8_t held)
+{
+    engine->hold = held;
+}
+
+/**
+  * @brief  Drop all requests without calling their callbacks
+  * @note   Used before the downstream interface is taken over (discovery)
+  * @param  engine: Transaction engine
+  * @retval None
+  */
+void TRANSACTION_Abort(transaction_engine_t* engine)
+{
+    engine->tail = engine->head;
+    engine->state = TRANSACTION_STATE_IDLE;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Send the oldest queued request
+  * @param  engine: Transaction engine
+  * @retval None
+  */
+static void TRANSACTION_StartNext(transaction_engine_t* engine)
+{
+    transaction_t* transaction;
+
+    if (engine->head == engine->tail || engine->send == NULL || engine->hold) return;
+
+    transaction = &engine->queue[engine->tail % TRANSACTION_QUEUE_SLOTS];
+    engine->state = TRANSACTION_STATE_SENDING;
+    engine->start_tick = HAL_GetTick();
+    engine->send(transaction->opcode, transaction->data_length ? transaction->data : NULL, transaction->data_length);
+    TRANSACTION_CheckSent(engine);
+}
+
+/**
+  * @brief  Start the response deadline once the request has left the UART
+  * @param  engine: Transaction engine
+  * @retval None
+  */
+static void TRANSACTION_CheckSent(transaction_engine_t* engine)
+{
+    if (engine->state == TRANSACTION_STATE_SENDING && !UART_IsTxBusy(engine->interface))
+    {
+        engine->state = TRANSACTION_STATE_WAITING;
+        engine->start_tick = HAL_GetTick();
+    }
+}
+
+/**
+  * @brief  Retire the active request and report the result
+  * @note   The request is retired before the callback runs, so the callback can
+  *         submit the next step of a sequence
+  * @param  engine: Transaction engine
+  * @param  result: Completion result
+  * @param  response: Parsed response, NULL on timeout
+  * @retval None
+  */
+static void TRANSACTION_Complete(transaction_engine_t* engine, transaction_result_t result, const message_t* response)
+{
+    transaction_callback_t callback = engine->queue[engine->tail % TRANSACTION_QUEUE_SLOTS].callback;
+
+    engine->tail++;
+    engine->state = TRANSACTION_STATE_IDLE;
+
+    if (callback != NULL) callback(result, response);
+    if (engine->state == TRANSACTION_STATE_IDLE) TRANSACTION_StartNext(engine);
+}
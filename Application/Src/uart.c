@@ -16,35 +16,62 @@
 #include "log.h"
 #include "app.h"
 #include "message.h"
+#include "framer.h"
+#include "utils.h"
+#include "crc.h"
+#include "uart_ll.h"
 #include "stm32g4xx_hal_uart.h"
 
-/* Private variables ---------------------------------------------------------*/
+/* Private defines -----------------------------------------------------------*/
 
-/**
-  * @brief  UART receive state enumeration
-  */
-typedef enum {
-    UART_STATE_WAIT_SYNC1,
-    UART_STATE_WAIT_SYNC2,
-    UART_STATE_WAIT_LENGTH,
-    UART_STATE_WAIT_DATA
-} UART_State_t;
+/* Backend calls on the hot paths. The LL backend supports DMA reception only */
+#if UART_BACKEND == UART_BACKEND_LL
+#define UART_BACKEND_ABORT(huart)                   UART_LL_Abort(huart)
+#define UART_BACKEND_ABORT_RX(huart)                UART_LL_AbortReception(huart)
+#define UART_BACKEND_START_RX_DMA(huart, buf, size) UART_LL_StartReception(huart, buf, size)
+#define UART_BACKEND_TRANSMIT_DMA(huart, buf, len)  UART_LL_Transmit(huart, buf, len)
+#else
+#define UART_BACKEND_ABORT(huart)                   HAL_UART_Abort(huart)
+#define UART_BACKEND_ABORT_RX(huart)                HAL_UART_AbortReceive(huart)
+#define UART_BACKEND_START_RX_DMA(huart, buf, size) HAL_UARTEx_ReceiveToIdle_DMA(huart, buf, size)
+#define UART_BACKEND_TRANSMIT_DMA(huart, buf, len)  HAL_UART_Transmit_DMA(huart, buf, len)
+#endif
+
+/* Private variables ---------------------------------------------------------*/
 
 /**
   * @brief  UART interface structure
   */
 typedef struct {
     UART_HandleTypeDef *huart;
-    uint8_t sync_length;              /* Number of sync bytes (1 or 2) */
-    uint8_t length_offset;            /* Length offset (5 for cctalk (positive nr))*/
-    uint8_t sync_bytes[2];         /* Sync bytes */
-    UART_State_t state;
-    uint8_t rx_buffer[256];        /* Receive buffer */
-    uint16_t rx_index;
-    uint8_t length;
-    uint32_t last_tick;
-    uint8_t rx_byte;
-    uint8_t data_ready;            /* Flag for main loop to process received data */
+    uart_rx_mode_t rx_mode;        /* Per byte interrupt or DMA circular reception */
+    framer_t framer;               /* Sync/length frame extractor */
+    frame_ring_t rx_ring;          /* Received frames, filled in place by the framer */
+    uint32_t reported_overruns;    /* Overruns already logged by the main loop */
+    uint32_t reported_restarts;    /* Restarts already logged by the main loop */
+    uart_link_stats_t stats;       /* Link statistics, framer and ring counters are added on read */
+    uint32_t rx_timeout_bits;      /* Receiver timeout programmed in RTOR */
+    uint32_t bit_cycles;           /* One bit time in DWT cycles */
+    uint32_t char_cycles;          /* One character time in DWT cycles */
+    uint32_t rx_frame_cycles;      /* DWT time of the last byte of the last received frame */
+    volatile uint8_t response_pending; /* Frame received, next transmission is its response */
+    volatile uint8_t restart_pending;  /* Reception aborted by an error, restarted by the main loop */
+    uint8_t rx_byte;               /* Interrupt mode receive byte */
+    uint8_t dma_rx_buffer[UART_DMA_RX_BUFFER_SIZE]; /* DMA circular receive buffer */
+    uint16_t dma_rx_pos;           /* Read position in DMA receive buffer */
+    frame_slot_t tx_slots[UART_TX_QUEUE_SLOTS]; /* DMA transmit descriptors */
+    volatile uint8_t tx_head;      /* Free running count of queued frames */
+    volatile uint8_t tx_tail;      /* Free running count of completed frames */
+    volatile uint8_t tx_busy;      /* DMA transfer of slot tx_tail in progress */
+    volatile uint8_t reconfigure_pending; /* UART_Init settings wait for the frames queued before them */
+    uint8_t reconfigure_tail;      /* tx_tail once the frames queued before UART_Init are sent */
+    uart_tx_stats_t tx_stats;      /* Transmit queue statistics */
+    uart_cycle_stats_t cycles[UART_IRQ_SOURCES]; /* Interrupt handler cycles (UART_PROFILE_CYCLES) */
+    uart_echo_mode_t echo_mode;    /* ccTalk echo handling */
+    uint8_t echo_expected[UART_ECHO_BUFFER_SIZE]; /* Verified echo: transmitted bytes, ring */
+    uint8_t echo_head;             /* Verified echo: free running write index */
+    volatile uint8_t echo_collision; /* Verified echo: mismatch seen since last check */
+    uint32_t echo_collisions;      /* Verified echo: frames with a mismatching echo */
     interface_config_t* interface; /* Reference to interface configuration */
     message_t* message;            /* Message structure to populate */
 } UART_Interface_t;
@@ -54,237 +81,616 @@ UART_Interface_t uart_intf1;
 UART_Interface_t uart_intf2;
 UART_Interface_t uart_intf3;
 
+/* ccTalk echo mode selected on the console, kept when the interface is initialized again */
+static uart_echo_mode_t cctalk_echo_mode = UART_CCTALK_ECHO_MODE_DEFAULT;
+
 /* Exported variables --------------------------------------------------------*/
 uint8_t downstream_rx_flag = 0;
 
+/* Private function prototypes -----------------------------------------------*/
+static UART_Interface_t* UART_GetInterface(UART_HandleTypeDef *huart);
+static void UART_StartReception(UART_Interface_t *intf);
+static void UART_ProcessRxBytes(UART_Interface_t *intf, const uint8_t* data, uint16_t length);
+static void UART_ProcessDmaRx(UART_Interface_t *intf, uint16_t pos);
+static void UART_ConfigureReceiverTimeout(UART_Interface_t *intf);
+static uint8_t UART_CopyFrameToMessage(UART_Interface_t *intf);
+static void UART_StartNextTx(UART_Interface_t *intf);
+static void UART_QueueEcho(UART_Interface_t *intf, const uint8_t* data, uint16_t length);
+static void UART_ApplyEchoMode(UART_Interface_t *intf);
+static void UART_ApplyPhy(UART_Interface_t *intf);
+static void UART_KeepCounters(UART_Interface_t *intf);
+static void UART_Reconfigure(UART_Interface_t *intf);
+static void UART_Detach(interface_config_t* interface, UART_Interface_t *keep);
+static uint8_t UART_CheckFrameCcitt(const uint8_t* frame, uint16_t length);
+static uint8_t UART_CheckFrameCctalk(const uint8_t* frame, uint16_t length);
+static void UART_RestartReception(UART_Interface_t *intf);
+static void UART_CheckReception(UART_Interface_t *intf);
+static void UART_FrameReceived(UART_Interface_t *intf, uint32_t detect_cycles);
 
 /* Exported functions --------------------------------------------------------*/
 
 /**
   * @brief  UART receive complete callback (called from HAL interrupt)
+  * @note   Interrupt mode only: one call per received byte
   * @param  huart: UART handle
   * @retval None
   */
 void UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
-    datalink_config_t datalink;
-    UART_Interface_t *intf = NULL;  /* used for context */
-    if (huart == uart_intf1.huart) {
-        intf = &uart_intf1; /* Upstream */
-        datalink = if_upstream.datalink;
-    } else if (huart == uart_intf2.huart) { /* Downstream */
-        intf = &uart_intf2;
-        datalink = if_downstream.datalink;
-    } else if (huart == uart_intf3.huart) { /* CCTALK */
-        intf = &uart_intf3;
-        datalink = if_downstream.datalink;
-    }
-    if (intf == NULL) return;
-    /* set datalink parameters in context */
-    intf->sync_length = datalink.sync_length;
-    intf->sync_bytes[0] = datalink.sync_byte1;
-    intf->sync_bytes[1] = datalink.sync_byte2;
-    intf->length_offset = datalink.length_offset;
-
-    uint32_t current_tick = HAL_GetTick();
-    uint32_t timeout_ms = datalink.inter_byte_timeout_ms;
-    
-    /* Check for timeout */
-    if (intf->state != UART_STATE_WAIT_SYNC1 && (current_tick - intf->last_tick > timeout_ms)) {
-        intf->state = UART_STATE_WAIT_SYNC1;
-        intf->rx_index = 0;
-    }
-    intf->last_tick = current_tick;
+    UART_Interface_t *intf = UART_GetInterface(huart);
+    if (intf == NULL || intf->rx_mode != UART_RX_MODE_IT) return;
 
-    /* Handle CCTALK echo bytes - ignore transmitted bytes */
-    if (intf->interface->protocol == PROTO_CCTALK && datalink.cctalk_echo_byte_count > 0) {
+    UART_ProcessRxBytes(intf, &intf->rx_byte, 1);
+
+    /* Restart reception for next byte */
+    HAL_UART_Receive_IT(huart, &intf->rx_byte, 1);
+}
+
+/**
+  * @brief  UART receive event callback (called from HAL interrupt)
+  * @note   DMA mode only: called on idle line, half transfer and transfer complete.
+  *         Everything between the last read position and pos is new data.
+  * @param  huart: UART handle
+  * @param  pos: Current write position of the DMA in the receive buffer
+  * @retval None
+  */
+void UART_RxEventCallback(UART_HandleTypeDef *huart, uint16_t pos)
+{
+    UART_Interface_t *intf = UART_GetInterface(huart);
+    if (intf == NULL || intf->rx_mode != UART_RX_MODE_DMA) return;
+
+    UART_ProcessDmaRx(intf, pos);
+}
+
+/**
+  * @brief  UART transmit complete callback (called from HAL interrupt)
+  * @note   Retires the transmitted DMA descriptor and starts the next queued one
+  * @param  huart: UART handle
+  * @retval None
+  */
+void UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    UART_Interface_t *intf = UART_GetInterface(huart);
+    if (intf == NULL || !intf->tx_busy) return;
 
-        datalink.cctalk_echo_byte_count--;
-        intf->interface->datalink.cctalk_echo_byte_count = datalink.cctalk_echo_byte_count;
+    intf->stats.bytes_out += intf->tx_slots[intf->tx_tail % UART_TX_QUEUE_SLOTS].length;
+    intf->tx_stats.frames_sent++;
+    intf->tx_tail++;
+    intf->tx_busy = 0;
 
-		/* Restart reception for next byte */
-		HAL_UART_Receive_IT(huart, &intf->rx_byte, 1);
-        return; /* Ignore this byte */
+    /* Half duplex: TC is set after the last stop bit, the bus is free to listen again */
+    if (intf->echo_mode == UART_ECHO_MODE_HALF_DUPLEX) {
+        ATOMIC_SET_BIT(huart->Instance->CR1, USART_CR1_RE);
     }
+    UART_StartNextTx(intf);
+}
 
-    uint8_t byte = intf->rx_byte;
+/**
+  * @brief  USART receiver timeout handler
+  * @note   Called from the USARTx_IRQHandler before the backend handler. Clears RTOF
+  *         so HAL does not treat it as a blocking error. The line has been idle for
+  *         rx_timeout_bits: the partial frame will not complete, rescan it and resync.
+  * @param  huart: UART handle
+  * @retval None
+  */
+void UART_ReceiverTimeoutHandler(UART_HandleTypeDef *huart)
+{
+    UART_Interface_t *intf = UART_GetInterface(huart);
 
-    switch (intf->state) {
-    case UART_STATE_WAIT_SYNC1:
-        if (byte == intf->sync_bytes[0]) {
-            intf->rx_buffer[0] = byte;
-            intf->rx_index = 1;
-            if (intf->sync_length == 1) {
-                intf->state = UART_STATE_WAIT_LENGTH;
-            } else {
-                intf->state = UART_STATE_WAIT_SYNC2;
-            }
-        }
-        /* Else discard and stay in state */
-        break;
-
-    case UART_STATE_WAIT_SYNC2:
-        if (byte == intf->sync_bytes[1]) {
-            intf->rx_buffer[1] = byte;
-            intf->rx_index = 2;
-            intf->state = UART_STATE_WAIT_LENGTH;
-        } else {
-            /* Handle potential sync overlap/start */
-            if (byte == intf->sync_bytes[0]) {
-                intf->rx_buffer[0] = byte;
-                intf->rx_index = 1;
-                intf->state = UART_STATE_WAIT_SYNC2;
-            } else {
-                intf->state = UART_STATE_WAIT_SYNC1;
-                intf->rx_index = 0;
-            }
-        }
-        break;
-
-    case UART_STATE_WAIT_LENGTH:
-        intf->length = byte + intf->interface->datalink.length_offset;  /* offset is +5 for ccTalk*/
-
-        intf->rx_buffer[intf->rx_index++] = byte;
-        
-        /* Validate length */
-        if (intf->length < (intf->sync_length + 1)) {
-            /* Invalid length (too small) */
-            intf->state = UART_STATE_WAIT_SYNC1;
-            intf->rx_index = 0;
-        } else {
-            intf->state = UART_STATE_WAIT_DATA;
-            /* Check if message is already complete (no data bytes) */
-            if (intf->rx_index == intf->length) {
-                /* Copy received data to message structure */
-                if (intf->message != NULL) {
-                    /* Clear the entire message buffer first */
-                    for (int i = 0; i < 256; i++) {
-                        intf->message->raw[i] = 0;
-                    }
-                    /* Copy only the received bytes */
-                    intf->message->length = intf->length;
-                    for (uint16_t i = 0; i < intf->length; i++) {
-                        intf->message->raw[i] = intf->rx_buffer[i];
-                    }
-                }
-                intf->data_ready = 1;
-                intf->state = UART_STATE_WAIT_SYNC1;
-                intf->rx_index = 0;
-            }
+    if (__HAL_UART_GET_FLAG(huart, UART_FLAG_RTOF) == RESET) return;
+    __HAL_UART_CLEAR_FLAG(huart, UART_CLEAR_RTOF);
+
+    if (intf == NULL || intf->interface == NULL) return;
+
+    /* DMA mode: bytes since the last idle/half transfer event are still in the buffer */
+    if (intf->rx_mode == UART_RX_MODE_DMA && huart->hdmarx != NULL) {
+        UART_ProcessDmaRx(intf, UART_DMA_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart->hdmarx));
+    }
+
+    if (!FRAMER_IsIdle(&intf->framer)) {
+        intf->stats.rx_timeouts++;
+        /* A frame swallowed by a bad length byte may be complete in the buffered bytes */
+        if (FRAMER_Flush(&intf->framer)) {
+            UART_FrameReceived(intf, intf->rx_timeout_bits * intf->bit_cycles);
         }
-        break;
-
-    case UART_STATE_WAIT_DATA:
-        intf->rx_buffer[intf->rx_index++] = byte;
-        if (intf->rx_index == intf->length) {
-            /* Copy received data to message structure */
-            if (intf->length == 0x25)
-            	{
-            	__NOP(); // debugging
-            	}
-            if (intf->message != NULL) {
-                /* Clear the entire message buffer first */
-                for (int i = 0; i < 256; i++) {
-                    intf->message->raw[i] = 0;
-                }
-                /* Copy only the received bytes */
-                intf->message->length = intf->length;
-                for (uint16_t i = 0; i < intf->length; i++) {
-                    intf->message->raw[i] = intf->rx_buffer[i];
-                }
-            }
-            intf->data_ready = 1;
-            intf->state = UART_STATE_WAIT_SYNC1;
-            intf->rx_index = 0;
+    }
+}
+
+/**
+  * @brief  UART error callback (called from HAL interrupt)
+  * @note   In DMA mode every receive error, in IT mode an overrun, aborts the
+  *         reception. Without a restart the interface stays deaf until reset.
+  *         The restart is left to the main loop (UART_CheckReception): it may
+  *         log and has to wait for the HAL handle. A failed transmit DMA would
+  *         leave the transmit queue blocked.
+  * @param  huart: UART handle
+  * @retval None
+  */
+void UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    UART_Interface_t *intf = UART_GetInterface(huart);
+    uint32_t error = huart->ErrorCode;
+
+    if (intf == NULL || intf->interface == NULL) return;
+
+    if (error & HAL_UART_ERROR_PE)  intf->stats.parity_errors++;
+    if (error & HAL_UART_ERROR_FE)  intf->stats.framing_errors++;
+    if (error & HAL_UART_ERROR_NE)  intf->stats.noise_errors++;
+    if (error & HAL_UART_ERROR_ORE) intf->stats.overrun_errors++;
+    if (error & HAL_UART_ERROR_DMA) intf->stats.dma_errors++;
+
+    /* Transmit DMA aborted: retire the descriptor so the queue keeps moving */
+    if (intf->tx_busy && huart->gState == HAL_UART_STATE_READY) {
+        intf->tx_busy = 0;
+        intf->tx_stats.errors++;
+        intf->tx_stats.frames_dropped++;
+        intf->tx_tail++;
+        if (intf->echo_mode == UART_ECHO_MODE_HALF_DUPLEX) {
+            ATOMIC_SET_BIT(huart->Instance->CR1, USART_CR1_RE);
         }
-        break;
+        UART_StartNextTx(intf);
+    }
 
+    /* Reception aborted (blocking error) */
+    if (huart->RxState == HAL_UART_STATE_READY) {
+        intf->restart_pending = 1;
     }
+}
 
-    /* Restart reception for next byte */
-    HAL_UART_Receive_IT(huart, &intf->rx_byte, 1);
+/**
+  * @brief  Frame received callback (called from interrupt context)
+  * @note   A complete frame is waiting in the frame slots of the interface.
+  *         Overridden by the application to wake the task that reads it
+  * @param  interface: Interface configuration
+  * @retval None
+  */
+__weak void UART_FrameReceivedCallback(interface_config_t* interface)
+{
+    (void)interface;
+}
+
+/**
+  * @brief  Response started callback (called from interrupt or main loop context)
+  * @note   The first transmission after a received frame started. Overridden by
+  *         the application to collect the response latency
+  * @param  interface: Interface configuration
+  * @param  latency_us: Last received byte to first transmitted byte in us
+  * @retval None
+  */
+__weak void UART_ResponseStartedCallback(interface_config_t* interface, uint32_t latency_us)
+{
+    (void)interface;
+    (void)latency_us;
 }
 
 /**
   * @brief  Check for upstream received data
+  * @note   Copies the oldest received frame into the upstream message
   * @retval uint8_t: 1 if data ready, 0 if no data
   */
 uint8_t UART_CheckForUpstreamData(void)
 {
+    UART_CheckReception(&uart_intf1);
+
     /* Process upstream messages */
-    if (uart_intf1.data_ready) {
-        uart_intf1.data_ready = 0;
-        return 1; /* Data ready */
-    }
-    return 0; /* No data */
+    return UART_CopyFrameToMessage(&uart_intf1);
 }
 
 /**
   * @brief  Check for downstream received data
+  * @note   Copies the oldest received frame of the interface into its message.
+  *         Each downstream link is read on its own: ID003 on UART2, ccTalk or
+  *         the second ID003 validator on UART3
+  * @param  interface: Downstream interface configuration
   * @retval uint8_t: 1 if data ready, 0 if no data
   */
-uint8_t UART_CheckForDownstreamData(void)
+uint8_t UART_CheckForDownstreamData(interface_config_t* interface)
 {
-    /* Process downstream messages */
-    if (uart_intf2.data_ready) {
-        uart_intf2.data_ready = 0;
-        LOG_Debug("UART2 data received");
-        return 1; /* Data ready */
-    }
-    
-    /* Process CCTALK messages */
-    if (uart_intf3.data_ready) {
-        uart_intf3.data_ready = 0;
-        LOG_Debug("UART3 CCTALK data received");
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL || intf->interface != interface) return 0;
+    UART_CheckReception(intf);
+
+    if (UART_CopyFrameToMessage(intf)) {
+        LOG_Debug((intf == &uart_intf3) ? "UART3 data received" : "UART2 data received");
         return 1; /* Data ready */
     }
     
     return 0; /* No data */
 }
 
+/**
+  * @brief  Select how the own transmitted bytes are handled on a single wire bus
+  * @note   Only meaningful for ccTalk. Half duplex needs the bus on the TX pin
+  *         (open drain with pull-up), the RX pin is not used. The mode also
+  *         applies to later UART_Init calls. The wiring is not switched in the
+  *         middle of a transfer: the interface is set up again like UART_Init
+  * @param  interface: Interface configuration
+  * @param  mode: UART_ECHO_MODE_COUNT, UART_ECHO_MODE_HALF_DUPLEX or UART_ECHO_MODE_VERIFY
+  * @retval None
+  */
+void UART_SetEchoMode(interface_config_t* interface, uart_echo_mode_t mode)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL || intf->interface != interface || interface->protocol != PROTO_CCTALK) return;
+
+    cctalk_echo_mode = mode;
+    UART_Init(interface, intf->message);
+}
+
+/**
+  * @brief  Check and clear the echo collision flag (verified echo mode)
+  * @param  interface: Interface configuration
+  * @retval uint8_t: 1 if an echoed byte differed from the transmitted byte
+  */
+uint8_t UART_CheckEchoCollision(interface_config_t* interface)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+    uint8_t collision;
+
+    if (intf == NULL) return 0;
+    collision = intf->echo_collision;
+    intf->echo_collision = 0;
+    return collision;
+}
+
+/**
+  * @brief  Get number of transmitted frames with a mismatching echo
+  * @param  interface: Interface configuration
+  * @retval uint32_t: Collision count
+  */
+uint32_t UART_GetEchoCollisions(interface_config_t* interface)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL) return 0;
+    return intf->echo_collisions;
+}
+
+/**
+  * @brief  Get number of frames dropped because the receive ring was full
+  * @param  interface: Interface configuration
+  * @retval uint32_t: Overrun count
+  */
+uint32_t UART_GetRxOverruns(interface_config_t* interface)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL) return 0;
+    return intf->stats.ring_overruns + intf->rx_ring.overruns;
+}
+
 /**
   * @brief  Initialize UART interface using datalink configuration
+  * @note   Link statistics and cycle counters survive a new initialization
+  *         (auto-discovery probes), only UART_ResetStats clears them. Frames
+  *         still queued are sent with the old settings first: until then
+  *         reception is stopped and new frames wait (UART_Reconfigure)
   * @param  interface: Interface configuration
   * @param  message: Message structure to populate with received data
   * @retval None
   */
 void UART_Init(interface_config_t* interface, message_t* message)
 {
-    UART_Interface_t *intf = NULL;
-    
-    /* Determine which interface to initialize */
-    if (interface->phy.uart_handle == &huart1) {
-        intf = &uart_intf1;
-    } else if (interface->phy.uart_handle == &huart2) {
-        intf = &uart_intf2;
-    } else if (interface->phy.uart_handle == &huart3) {
-        intf = &uart_intf3;
-    }
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
     
     if (intf == NULL) return;
+
+    /* Protocol changed to another UART: stop the previous one from filling the message */
+    UART_Detach(interface, intf);
     
     /* Initialize interface structure */
     intf->huart = interface->phy.uart_handle;
-    intf->sync_length = interface->datalink.sync_length;
-    intf->sync_bytes[0] = interface->datalink.sync_byte1;
-    intf->sync_bytes[1] = interface->datalink.sync_byte2;
-    intf->state = UART_STATE_WAIT_SYNC1;
-    intf->rx_index = 0;
-    intf->data_ready = 0;
-    intf->last_tick = HAL_GetTick();
+    intf->rx_mode = UART_RX_MODE_DEFAULT;
     intf->interface = interface;
     intf->message = message;
+
+    /* DWT cycle counter, also running without a debugger attached. Response latency clock */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    intf->reconfigure_tail = intf->tx_head;
+    intf->reconfigure_pending = 1;
+    UART_Reconfigure(intf);
+    if (intf->reconfigure_pending) {
+        UART_BACKEND_ABORT_RX(intf->huart);
+    }
+}
+
+/**
+  * @brief  Select receive mode of an interface and restart reception
+  * @param  interface: Interface configuration
+  * @param  mode: UART_RX_MODE_IT (byte interrupts) or UART_RX_MODE_DMA (circular DMA)
+  * @retval None
+  */
+void UART_SetRxMode(interface_config_t* interface, uart_rx_mode_t mode)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+    
+    if (intf == NULL || intf->interface == NULL) return;
     
-    /* Clear receive buffer with zeros */
-    for (int i = 0; i < 256; i++) {
-        intf->rx_buffer[i] = 0;
+    intf->rx_mode = mode;
+    FRAMER_Reset(&intf->framer);
+    UART_StartReception(intf);
+}
+
+/**
+  * @brief  Queue message for DMA transmission via UART
+  * @note   Returns as soon as the message is copied into a transmit descriptor.
+  *         Never waits: with all descriptors in use the message is dropped
+  * @param  interface: Interface configuration
+  * @param  message: Message structure containing raw data to transmit
+  * @retval uint8_t: 1 if queued, 0 if dropped
+  */
+uint8_t UART_TransmitMessage(interface_config_t* interface, message_t* message)
+{
+    if (message == NULL) {
+        LOG_Error("UART_TransmitMessage: Invalid parameters");
+        return 0;
+    }
+    return UART_TransmitFrame(interface, message->raw, message->length);
+}
+
+/**
+  * @brief  Queue a ready-to-send frame for DMA transmission via UART
+  * @note   Same as UART_TransmitMessage for frames built once and sent many
+  *         times: only the copy into the transmit descriptor and the DMA start
+  * @param  interface: Interface configuration
+  * @param  frame: Complete frame bytes (header to CRC)
+  * @param  length: Frame length
+  * @retval uint8_t: 1 if queued, 0 if dropped
+  */
+uint8_t UART_TransmitFrame(interface_config_t* interface, const uint8_t* frame, uint8_t length)
+{
+    UART_Interface_t *intf;
+    uint8_t depth;
+    uint32_t primask;
+
+    if (interface == NULL || frame == NULL) {
+        LOG_Error("UART_TransmitFrame: Invalid parameters");
+        return 0;
     }
     
-    /* Abort any ongoing reception and reset UART state */
-    HAL_UART_AbortReceive(intf->huart);
+    intf = UART_GetInterface(interface->phy.uart_handle);
+    if (intf == NULL || intf->huart == NULL) {
+        LOG_Error("UART_TransmitFrame: Invalid UART handle");
+        return 0;
+    }
     
+    if (length == 0) {
+        LOG_Warn("UART_TransmitFrame: Message length is zero");
+        return 0;
+    }
+
+    /* Queue full: drop, the caller decides (the peer repeats or the request times out) */
+    if ((uint8_t)(intf->tx_head - intf->tx_tail) >= UART_TX_QUEUE_SLOTS) {
+        intf->tx_stats.queue_full++;
+        intf->tx_stats.frames_dropped++;
+        LOG_Warn("UART_TransmitFrame: TX queue full, message dropped");
+        return 0;
+    }
+
+    /* Copy into the free descriptor and publish it */
+    frame_slot_t *slot = &intf->tx_slots[intf->tx_head % UART_TX_QUEUE_SLOTS];
+    utils_memcpy(slot->data, frame, length);
+    slot->length = length;
+    intf->tx_head++;
+    intf->tx_stats.frames_queued++;
+
+    depth = (uint8_t)(intf->tx_head - intf->tx_tail);
+    if (depth > intf->tx_stats.max_depth) intf->tx_stats.max_depth = depth;
+
+    /* Kick the DMA if it is idle. Interrupts off: TxCplt may start the next one too */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (!intf->tx_busy) {
+        UART_StartNextTx(intf);
+    }
+    __set_PRIMASK(primask);
+    LOG_Debug("uart: UART_TransmitFrame: queued");
+    return 1;
+}
+
+/**
+  * @brief  Check if the transmit queue of an interface still has data to send
+  * @param  interface: Interface configuration
+  * @retval uint8_t: 1 if a transfer is queued or in progress
+  */
+uint8_t UART_IsTxBusy(interface_config_t* interface)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL) return 0;
+    return (intf->tx_head != intf->tx_tail);
+}
+
+/**
+  * @brief  Get transmit queue statistics of an interface
+  * @param  interface: Interface configuration
+  * @param  stats: Receives a copy of the statistics
+  * @retval None
+  */
+void UART_GetTxStats(interface_config_t* interface, uart_tx_stats_t* stats)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL || stats == NULL) return;
+    *stats = intf->tx_stats;
+    stats->depth = (uint8_t)(intf->tx_head - intf->tx_tail);
+}
+
+/**
+  * @brief  Get link statistics of an interface
+  * @param  interface: Interface configuration
+  * @param  stats: Receives a copy of the statistics
+  * @retval None
+  */
+void UART_GetLinkStats(interface_config_t* interface, uart_link_stats_t* stats)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL || stats == NULL) return;
+    *stats = intf->stats;
+    stats->sync_drops += intf->framer.sync_drops;
+    stats->length_errors += intf->framer.length_errors;
+    stats->crc_errors += intf->framer.check_errors;
+    stats->resyncs += intf->framer.resyncs;
+    stats->ring_overruns += intf->rx_ring.overruns;
+    stats->echo_collisions = intf->echo_collisions;
+}
+
+/**
+  * @brief  Clear link and transmit queue statistics of an interface
+  * @param  interface: Interface configuration
+  * @retval None
+  */
+void UART_ResetStats(interface_config_t* interface)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+    uint32_t primask;
+
+    if (intf == NULL) return;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    utils_zero((uint8_t*)&intf->stats, sizeof(intf->stats));
+    utils_zero((uint8_t*)&intf->tx_stats, sizeof(intf->tx_stats));
+    intf->framer.sync_drops = 0;
+    intf->framer.length_errors = 0;
+    intf->framer.check_errors = 0;
+    intf->framer.resyncs = 0;
+    intf->rx_ring.overruns = 0;
+    intf->rx_ring.frames = 0;
+    intf->rx_ring.high_water = 0;
+    intf->echo_collisions = 0;
+    intf->reported_overruns = 0;
+    intf->reported_restarts = 0;
+    utils_zero((uint8_t*)intf->cycles, sizeof(intf->cycles));
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Count the result of parsing a frame received on an interface
+  * @param  interface: Interface configuration
+  * @param  result: Result of MESSAGE_Parse
+  * @retval None
+  */
+void UART_CountParseResult(interface_config_t* interface, message_parse_result_t result)
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+
+    if (intf == NULL) return;
+
+    switch (result) {
+        case MSG_NO_MESSAGE:     break;
+        case MSG_OK:             intf->stats.frames_ok++; break;
+        case MSG_CRC_INVALID:    intf->stats.crc_errors++; break;
+        case MSG_INVALID_LENGTH: intf->stats.length_errors++; break;
+        default:                 intf->stats.parse_errors++; break;
+    }
+}
+
+/**
+  * @brief  Account the cycles of one interrupt handler run
+  * @note   Called at the end of the USART and DMA interrupt handlers when
+  *         UART_PROFILE_CYCLES is set, start is DWT->CYCCNT at handler entry
+  * @param  huart: UART handle
+  * @param  source: Interrupt source
+  * @param  start: Cycle counter at handler entry
+  * @retval None
+  */
+void UART_RecordCycles(UART_HandleTypeDef *huart, uart_irq_source_t source, uint32_t start)
+{
+#if UART_PROFILE_CYCLES
+    UART_Interface_t *intf = UART_GetInterface(huart);
+    uint32_t cycles = DWT->CYCCNT - start;
+
+    if (intf == NULL || source >= UART_IRQ_SOURCES) return;
+    intf->cycles[source].calls++;
+    intf->cycles[source].cycles_total += cycles;
+    if (cycles > intf->cycles[source].cycles_max) intf->cycles[source].cycles_max = cycles;
+#else
+    (void)huart;
+    (void)source;
+    (void)start;
+#endif
+}
+
+/**
+  * @brief  Get the interrupt handler cycle counters of an interface
+  * @param  interface: Interface configuration
+  * @param  stats: Receives UART_IRQ_SOURCES counters, all zero without UART_PROFILE_CYCLES
+  * @retval None
+  */
+void UART_GetCycleStats(interface_config_t* interface, uart_cycle_stats_t stats[UART_IRQ_SOURCES])
+{
+    UART_Interface_t *intf = UART_GetInterface(interface->phy.uart_handle);
+    uint32_t primask;
+
+    if (intf == NULL || stats == NULL) return;
+    primask = __get_PRIMASK();
+    __disable_irq();
+    utils_memcpy((uint8_t*)stats, (uint8_t*)intf->cycles, sizeof(intf->cycles));
+    __set_PRIMASK(primask);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Find interface context belonging to a UART handle
+  * @param  huart: UART handle
+  * @retval UART_Interface_t*: Interface context, NULL if not found
+  */
+static UART_Interface_t* UART_GetInterface(UART_HandleTypeDef *huart)
+{
+    if (huart == NULL) return NULL;
+    if (huart == &huart1) return &uart_intf1;  /* Upstream */
+    if (huart == &huart2) return &uart_intf2;  /* Downstream */
+    if (huart == &huart3) return &uart_intf3;  /* CCTALK */
+    return NULL;
+}
+
+/**
+  * @brief  (Re)start reception in the configured receive mode
+  * @note   Falls back to interrupt mode if DMA reception cannot be started
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_StartReception(UART_Interface_t *intf)
+{
+    HAL_StatusTypeDef status;
+
+    /* Abort any ongoing reception and reset UART state */
+    UART_BACKEND_ABORT_RX(intf->huart);
+
+    /* The abort disabled the receiver timeout interrupt, RTOR and RTOEN are kept */
+    if (READ_BIT(intf->huart->Instance->CR2, USART_CR2_RTOEN)) {
+        __HAL_UART_CLEAR_FLAG(intf->huart, UART_CLEAR_RTOF);
+        ATOMIC_SET_BIT(intf->huart->Instance->CR1, USART_CR1_RTOIE);
+    }
+
+#if UART_BACKEND == UART_BACKEND_LL
+    intf->rx_mode = UART_RX_MODE_DMA;
+#endif
+    if (intf->rx_mode == UART_RX_MODE_DMA) {
+        intf->dma_rx_pos = 0;
+        if (intf->huart->hdmarx != NULL) {
+            /* DMA is in circular mode: reception never stops, events report the write position */
+            status = UART_BACKEND_START_RX_DMA(intf->huart, intf->dma_rx_buffer, UART_DMA_RX_BUFFER_SIZE);
+            if (status == HAL_OK) return;
+        }
+#if UART_BACKEND == UART_BACKEND_LL
+        LOG_Error("UART DMA reception not available, LL backend has no interrupt mode");
+        return;
+#else
+        LOG_Warn("UART DMA reception not available, using interrupt mode");
+        intf->rx_mode = UART_RX_MODE_IT;
+#endif
+    }
+
     /* Start receiving first byte */
-    HAL_StatusTypeDef status = HAL_UART_Receive_IT(intf->huart, &intf->rx_byte, 1);
+    status = HAL_UART_Receive_IT(intf->huart, &intf->rx_byte, 1);
     
     /* If failed to start reception, try to recover */
     if (status != HAL_OK) {
@@ -296,60 +702,422 @@ void UART_Init(interface_config_t* interface, message_t* message)
 }
 
 /**
-  * @brief  Transmit message via UART
-  * @param  interface: Interface configuration
-  * @param  message: Message structure containing raw data to transmit
+  * @brief  Pass received bytes to the framer
+  * @note   Called from interrupt context with one byte (IT mode) or a chunk (DMA mode)
+  * @param  intf: Interface context
+  * @param  data: Received bytes
+  * @param  length: Number of bytes
   * @retval None
   */
-void UART_TransmitMessage(interface_config_t* interface, message_t* message, uint8_t use_dma, uint8_t* dma_buffer)
+static void UART_ProcessRxBytes(UART_Interface_t *intf, const uint8_t* data, uint16_t length)
 {
-    if (interface == NULL || message == NULL) {
-        LOG_Error("UART_TransmitMessage: Invalid parameters");
-        return;
+    datalink_config_t* datalink;
+
+    if (length == 0 || intf->interface == NULL) return;
+    datalink = &intf->interface->datalink;
+    intf->stats.bytes_in += length;
+
+    /* No inter-byte timeout check here: gaps are detected by the USART receiver timeout */
+
+    /* Handle CCTALK echo bytes - ignore transmitted bytes */
+    if (intf->interface->protocol == PROTO_CCTALK) {
+        while (length > 0 && datalink->cctalk_echo_byte_count > 0) {
+            if (intf->echo_mode == UART_ECHO_MODE_VERIFY) {
+                /* Another device driving the bus at the same time corrupts the echo */
+                uint8_t expected = intf->echo_expected[(uint8_t)(intf->echo_head - datalink->cctalk_echo_byte_count)];
+
+                if (*data != expected && !intf->echo_collision) {
+                    intf->echo_collision = 1;
+                    intf->echo_collisions++;
+                }
+            }
+            datalink->cctalk_echo_byte_count--;
+            data++;
+            length--;
+        }
     }
-    
-    if (interface->phy.uart_handle == NULL) {
-        LOG_Error("UART_TransmitMessage: Invalid UART handle");
-        return;
+
+    if (FRAMER_Feed(&intf->framer, data, length)) {
+        /* DMA mode: bytes are handed over on the idle line, one character after the last one */
+        UART_FrameReceived(intf, (intf->rx_mode == UART_RX_MODE_DMA) ? intf->char_cycles : 0);
     }
-    
-    if (message->length == 0) {
-        LOG_Warn("UART_TransmitMessage: Message length is zero");
-        return;
+}
+
+/**
+  * @brief  Pass the DMA receive buffer up to pos to the framer
+  * @note   Everything between the last read position and pos is new data
+  * @param  intf: Interface context
+  * @param  pos: Current write position of the DMA in the receive buffer
+  * @retval None
+  */
+static void UART_ProcessDmaRx(UART_Interface_t *intf, uint16_t pos)
+{
+    if (pos > UART_DMA_RX_BUFFER_SIZE) return;
+
+    if (pos != intf->dma_rx_pos) {
+        if (pos > intf->dma_rx_pos) {
+            /* Linear part */
+            UART_ProcessRxBytes(intf, &intf->dma_rx_buffer[intf->dma_rx_pos], pos - intf->dma_rx_pos);
+        } else {
+            /* Buffer wrapped: tail first, then head */
+            UART_ProcessRxBytes(intf, &intf->dma_rx_buffer[intf->dma_rx_pos], UART_DMA_RX_BUFFER_SIZE - intf->dma_rx_pos);
+            UART_ProcessRxBytes(intf, &intf->dma_rx_buffer[0], pos);
+        }
     }
+    intf->dma_rx_pos = (pos == UART_DMA_RX_BUFFER_SIZE) ? 0 : pos;
+}
 
-    /* For CCTALK protocol, set echo byte count to ignore transmitted bytes */
-    if (interface->protocol == PROTO_CCTALK) {
-        interface->datalink.cctalk_echo_byte_count = message->length;
+/**
+  * @brief  Program the USART receiver timeout for the interface protocol
+  * @note   RTOR counts bit times, so the timeout follows the baud rate. The character
+  *         length is taken from the UART init (start + word length incl. parity + stop).
+  *         At 9600 baud 3.5 characters is 3.6 ms (10 bit) or 4.0 ms (11 bit).
+  *         Once per UART_Init, after the PHY settings: a reception restart only
+  *         re-enables the interrupt
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_ConfigureReceiverTimeout(UART_Interface_t *intf)
+{
+    UART_HandleTypeDef *huart = intf->huart;
+    uint32_t bits_per_char = 1 + 8 + 1;     /* start + 8 data + 1 stop */
+    uint32_t chars_x2;
+
+    if (huart->Init.WordLength == UART_WORDLENGTH_9B) bits_per_char++;
+    if (huart->Init.WordLength == UART_WORDLENGTH_7B) bits_per_char--;
+    if (huart->Init.StopBits == UART_STOPBITS_2) bits_per_char++;
+
+    switch (intf->interface->protocol) {
+        case PROTO_CCNET:  chars_x2 = UART_RX_TIMEOUT_CCNET_CHARS_X2; break;
+        case PROTO_ID003:  chars_x2 = UART_RX_TIMEOUT_ID003_CHARS_X2; break;
+        case PROTO_CCTALK: chars_x2 = UART_RX_TIMEOUT_CCTALK_CHARS_X2; break;
+        default:           chars_x2 = UART_RX_TIMEOUT_CCNET_CHARS_X2; break;
     }
-    
-    if (!use_dma) {
-        /* Transmit raw message data using blocking mode */
-        uint32_t timeout_ms = message->length + 50;  /* transmission at 9600 about 1 byte per s. Longest message is 125 bytes and takes 132ms on scope*/
-        HAL_StatusTypeDef status = HAL_UART_Transmit(interface->phy.uart_handle, message->raw, message->length, timeout_ms);
-
-        if (status != HAL_OK) {
-            if (status == HAL_BUSY) LOG_Error("UART_TransmitMessage: Transmission failed - HAL BUSY");
-            else LOG_Error("UART_TransmitMessage: Transmission failed");
-        } else {
-            LOG_Debug("uart: UART_TransmitMessage: OK");
+    intf->rx_timeout_bits = (chars_x2 * bits_per_char + 1) / 2;
+    intf->bit_cycles = SystemCoreClock / huart->Init.BaudRate;
+    intf->char_cycles = bits_per_char * intf->bit_cycles;
+
+    HAL_UART_ReceiverTimeout_Config(huart, intf->rx_timeout_bits);
+    if (HAL_UART_EnableReceiverTimeout(huart) != HAL_OK) {
+        LOG_Warn("UART receiver timeout could not be enabled");
+    }
+}
+
+/**
+  * @brief  Start DMA transfer of the oldest queued descriptor
+  * @note   Called from the main loop (interrupts disabled) or from TxCplt
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_StartNextTx(UART_Interface_t *intf)
+{
+    while (intf->tx_tail != intf->tx_head) {
+        frame_slot_t *slot = &intf->tx_slots[intf->tx_tail % UART_TX_QUEUE_SLOTS];
+
+        /* Frames queued after UART_Init wait for the new settings */
+        if (intf->reconfigure_pending && intf->tx_tail == intf->reconfigure_tail) return;
+
+        if (intf->interface != NULL && intf->interface->protocol == PROTO_CCTALK) {
+            if (intf->echo_mode == UART_ECHO_MODE_HALF_DUPLEX) {
+                /* Receiver gated during TX: no echo to skip */
+                intf->interface->datalink.cctalk_echo_byte_count = 0;
+                ATOMIC_CLEAR_BIT(intf->huart->Instance->CR1, USART_CR1_RE);
+            } else {
+                UART_QueueEcho(intf, slot->data, slot->length);
+            }
         }
-    } else {
-        /* Transmit using DMA mode */
-        if (dma_buffer == NULL) {
-            LOG_Error("UART_TransmitMessage: DMA buffer is NULL");
+
+        intf->tx_busy = 1;
+        if (UART_BACKEND_TRANSMIT_DMA(intf->huart, slot->data, slot->length) == HAL_OK) {
+            if (intf->response_pending) {
+                intf->response_pending = 0;
+                UART_ResponseStartedCallback(intf->interface,
+                                             (DWT->CYCCNT - intf->rx_frame_cycles) / (SystemCoreClock / 1000000U));
+            }
             return;
         }
-        utils_memcpy(dma_buffer, message->raw, message->length);
-        HAL_StatusTypeDef status = HAL_UART_Transmit_DMA(interface->phy.uart_handle, dma_buffer, message->length);
 
-        if (status != HAL_OK) {
-            if (status == HAL_BUSY) LOG_Error("UART_TransmitMessage: DMA Transmission failed - HAL BUSY");
-            else LOG_Error("UART_TransmitMessage: DMA Transmission failed");
-        } else {
-            LOG_Debug("uart: UART_TransmitMessage: DMA OK");
+        /* Could not start (HAL busy): drop this descriptor and try the next */
+        intf->tx_busy = 0;
+        if (intf->echo_mode == UART_ECHO_MODE_HALF_DUPLEX) {
+            ATOMIC_SET_BIT(intf->huart->Instance->CR1, USART_CR1_RE);
         }
+        intf->tx_stats.errors++;
+        intf->tx_stats.frames_dropped++;
+        intf->tx_tail++;
     }
 }
 
-/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Add the bytes of a ccTalk frame to the echo still expected
+  * @note   The echo of the previous frame may not be received yet when the next
+  *         frame starts, so the count adds up. The expected bytes are kept per
+  *         interface: the TX descriptor may be reused before its echo arrives.
+  *         The count is shared with the receive interrupt, the caller may run
+  *         with interrupts already disabled
+  * @param  intf: Interface context
+  * @param  data: Transmitted bytes
+  * @param  length: Number of bytes
+  * @retval None
+  */
+static void UART_QueueEcho(UART_Interface_t *intf, const uint8_t* data, uint16_t length)
+{
+    datalink_config_t* datalink = &intf->interface->datalink;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    /* Echo beyond the counter range is passed to the framer and rejected there */
+    if (length > UART_ECHO_MAX_PENDING - datalink->cctalk_echo_byte_count) {
+        length = UART_ECHO_MAX_PENDING - datalink->cctalk_echo_byte_count;
+    }
+    datalink->cctalk_echo_byte_count += length;
+    if (intf->echo_mode == UART_ECHO_MODE_VERIFY) {
+        for (uint16_t i = 0; i < length; i++) {
+            intf->echo_expected[intf->echo_head++] = data[i];
+        }
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  A frame was completed by the framer
+  * @note   Called from interrupt context. Timestamps the last byte of the frame
+  *         for the response latency and wakes the reader
+  * @param  intf: Interface context
+  * @param  detect_cycles: Time between the last byte and its detection (idle line, receiver timeout)
+  * @retval None
+  */
+static void UART_FrameReceived(UART_Interface_t *intf, uint32_t detect_cycles)
+{
+    intf->rx_frame_cycles = DWT->CYCCNT - detect_cycles;
+    intf->response_pending = 1;
+    UART_FrameReceivedCallback(intf->interface);
+}
+
+/**
+  * @brief  Apply baud rate and parity of the interface configuration to the USART
+  * @note   Parity is sent as the 9th bit, the data stays 8 bits. The UART is only
+  *         reinitialized when the settings differ from the current ones.
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_ApplyPhy(UART_Interface_t *intf)
+{
+    UART_HandleTypeDef *huart = intf->huart;
+    phy_config_t *phy = &intf->interface->phy;
+    uint32_t word_length = (phy->parity == UART_PARITY_NONE) ? UART_WORDLENGTH_8B : UART_WORDLENGTH_9B;
+
+    if (phy->baudrate == 0 || !IS_UART_PARITY(phy->parity)) return;
+    if (huart->Init.BaudRate == phy->baudrate &&
+        huart->Init.Parity == phy->parity &&
+        huart->Init.WordLength == word_length) return;
+
+    /* The transmitter is idle (UART_Reconfigure), frames queued meanwhile stay queued */
+    UART_BACKEND_ABORT(huart);
+
+    huart->Init.BaudRate = phy->baudrate;
+    huart->Init.Parity = phy->parity;
+    huart->Init.WordLength = word_length;
+    if (HAL_UART_Init(huart) != HAL_OK) {
+        LOG_Error("UART reconfiguration failed");
+    }
+}
+
+/**
+  * @brief  Move the framer and receive ring counters into the link statistics
+  * @note   Called before the framer and the ring are initialized again
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_KeepCounters(UART_Interface_t *intf)
+{
+    intf->stats.sync_drops += intf->framer.sync_drops;
+    intf->stats.length_errors += intf->framer.length_errors;
+    intf->stats.crc_errors += intf->framer.check_errors;
+    intf->stats.resyncs += intf->framer.resyncs;
+    intf->stats.ring_overruns += intf->rx_ring.overruns;
+}
+
+/**
+  * @brief  Apply the settings of UART_Init once the transmitter is idle
+  * @note   Called from UART_Init and from the main loop (UART_CheckReception).
+  *         Baud rate, parity and wiring never change in the middle of a
+  *         transfer, and nothing waits for the transfer to end
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_Reconfigure(UART_Interface_t *intf)
+{
+    interface_config_t *interface = intf->interface;
+    uint32_t primask;
+
+    if (!intf->reconfigure_pending || intf->tx_busy || intf->tx_tail != intf->reconfigure_tail) return;
+
+    /* Datalink parameters are copied once here instead of on every received byte */
+    UART_KeepCounters(intf);
+    FRAME_RING_Init(&intf->rx_ring);
+    intf->reported_overruns = 0;
+    intf->response_pending = 0;
+    intf->restart_pending = 0;
+    intf->echo_mode = (interface->protocol == PROTO_CCTALK) ? cctalk_echo_mode : UART_ECHO_MODE_COUNT;
+    intf->echo_head = 0;
+    interface->datalink.cctalk_echo_byte_count = 0;
+    UART_ApplyPhy(intf);
+    UART_ApplyEchoMode(intf);
+    UART_ConfigureReceiverTimeout(intf);
+    FRAMER_Init(&intf->framer,
+                interface->datalink.sync_length,
+                interface->datalink.sync_byte1,
+                interface->datalink.sync_byte2,
+                interface->datalink.length_offset,
+                &intf->rx_ring);
+
+    /* CRC check in the framer: a bad frame is rescanned for a real header instead of dropped */
+    FRAMER_SetCheck(&intf->framer, (interface->protocol == PROTO_CCTALK) ? UART_CheckFrameCctalk : UART_CheckFrameCcitt);
+
+    UART_StartReception(intf);
+
+    /* Frames queued while waiting go out with the new settings */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    intf->reconfigure_pending = 0;
+    if (!intf->tx_busy) {
+        UART_StartNextTx(intf);
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Frame check for CCNET and ID003 (CRC-CCITT over the frame incl. CRC is 0)
+  * @param  frame: Complete frame
+  * @param  length: Frame length
+  * @retval uint8_t: 1 if the CRC is valid
+  */
+static uint8_t UART_CheckFrameCcitt(const uint8_t* frame, uint16_t length)
+{
+    return (CRC_Calculate((uint8_t*)frame, PROTO_CCNET, length) == 0);
+}
+
+/**
+  * @brief  Frame check for ccTalk (sum of all bytes incl. checksum is 0)
+  * @param  frame: Complete frame
+  * @param  length: Frame length
+  * @retval uint8_t: 1 if the checksum is valid
+  */
+static uint8_t UART_CheckFrameCctalk(const uint8_t* frame, uint16_t length)
+{
+    return (CRC_ChecksumCctalk((uint8_t*)frame, length) == 0);
+}
+
+/**
+  * @brief  Release an interface configuration from every UART except one
+  * @param  interface: Interface configuration
+  * @param  keep: Interface context that keeps the configuration
+  * @retval None
+  */
+static void UART_Detach(interface_config_t* interface, UART_Interface_t *keep)
+{
+    UART_Interface_t *intfs[] = {&uart_intf1, &uart_intf2, &uart_intf3};
+
+    for (uint8_t i = 0; i < 3; i++) {
+        if (intfs[i] == keep || intfs[i]->interface != interface) continue;
+        UART_BACKEND_ABORT_RX(intfs[i]->huart);
+        intfs[i]->interface = NULL;
+        intfs[i]->message = NULL;
+        FRAME_RING_Init(&intfs[i]->rx_ring);
+    }
+}
+
+/**
+  * @brief  Switch the USART between full duplex and single wire half duplex
+  * @note   HDSEL can only be changed with the USART disabled
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_ApplyEchoMode(UART_Interface_t *intf)
+{
+    UART_HandleTypeDef *huart = intf->huart;
+    uint8_t half_duplex = (intf->echo_mode == UART_ECHO_MODE_HALF_DUPLEX);
+
+    if (half_duplex == (READ_BIT(huart->Instance->CR3, USART_CR3_HDSEL) != 0)) return;
+
+    __HAL_UART_DISABLE(huart);
+    if (half_duplex) {
+        SET_BIT(huart->Instance->CR3, USART_CR3_HDSEL);
+    } else {
+        CLEAR_BIT(huart->Instance->CR3, USART_CR3_HDSEL);
+    }
+    __HAL_UART_ENABLE(huart);
+}
+
+/**
+  * @brief  Restart reception after it was aborted by an error
+  * @note   Bytes the DMA stored before the error are still passed on, the
+  *         partial frame is dropped: the errored byte is part of it
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_RestartReception(UART_Interface_t *intf)
+{
+    if (intf->rx_mode == UART_RX_MODE_DMA && intf->huart->hdmarx != NULL) {
+        UART_ProcessDmaRx(intf, UART_DMA_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(intf->huart->hdmarx));
+    }
+    FRAMER_Reset(&intf->framer);
+    intf->stats.restarts++;
+    UART_StartReception(intf);
+}
+
+/**
+  * @brief  Restart reception after an error or if it stopped otherwise
+  * @note   Runs in the main loop, never from the error interrupt
+  * @param  intf: Interface context
+  * @retval None
+  */
+static void UART_CheckReception(UART_Interface_t *intf)
+{
+    uint32_t primask;
+
+    if (intf->interface == NULL) return;
+
+    /* Reception stays stopped until the new settings are applied */
+    UART_Reconfigure(intf);
+    if (intf->reconfigure_pending) return;
+
+    if (intf->restart_pending || intf->huart->RxState == HAL_UART_STATE_READY) {
+        primask = __get_PRIMASK();
+        __disable_irq();
+        intf->restart_pending = 0;
+        UART_RestartReception(intf);
+        __set_PRIMASK(primask);
+    }
+
+    if (intf->stats.restarts != intf->reported_restarts) {
+        intf->reported_restarts = intf->stats.restarts;
+        LOG_Warn("UART receive error, reception restarted");
+    }
+}
+
+/**
+  * @brief  Copy oldest received frame to the message structure and release it
+  * @note   Runs in the main loop. Only the received bytes are copied.
+  * @param  intf: Interface context
+  * @retval uint8_t: 1 if a frame was copied, 0 if no frame pending
+  */
+static uint8_t UART_CopyFrameToMessage(UART_Interface_t *intf)
+{
+    const frame_slot_t* frame = FRAME_RING_Borrow(&intf->rx_ring);
+
+    if (intf->rx_ring.overruns != intf->reported_overruns) {
+        intf->reported_overruns = intf->rx_ring.overruns;
+        LOG_Warn("UART receive frame ring overrun, frame dropped");
+    }
+
+    if (frame == NULL) return 0;
+
+    if (intf->message != NULL) {
+        intf->message->length = frame->length;
+        utils_memcpy(intf->message->raw, frame->data, frame->length);
+    }
+    FRAME_RING_Release(&intf->rx_ring);
+    return 1;
+}
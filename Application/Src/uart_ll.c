@@ -0,0 +1,325 @@
+/**
+  ******************************************************************************
+  * @file           : uart_ll.c
+  * @brief          : Register level UART/DMA backend
+  *                   Circular DMA reception with idle line events and DMA
+  *                   transmission, driving the uart.c callbacks directly.
+  *                   The handles, DMA channels and DMAMUX requests are set up
+  *                   by CubeMX (HAL_UART_Init / HAL_DMA_Init) as before; only
+  *                   starting, stopping and the interrupt handlers bypass HAL
+  *                   and use the LL drivers. The DMA channel flags are the
+  *                   exception: LL only names them per channel, so they are
+  *                   read and cleared through ISR/IFCR shifted by the channel.
+  *                   Receive errors are counted but do not stop the DMA, so
+  *                   reception does not have to be restarted after noise.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "uart.h"
+#include "uart_ll.h"
+
+#if UART_BACKEND == UART_BACKEND_LL
+
+#include "stm32g4xx_ll_usart.h"
+#include "stm32g4xx_ll_dma.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define UART_LL_DMA_FLAGS       (DMA_ISR_GIF1 | DMA_ISR_TCIF1 | DMA_ISR_HTIF1 | DMA_ISR_TEIF1)
+#define UART_LL_ERROR_FLAGS     (USART_ISR_PE | USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE)
+#define UART_LL_ERROR_CLEAR     (USART_ICR_PECF | USART_ICR_FECF | USART_ICR_NECF | USART_ICR_ORECF)
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t UART_LL_DmaShift(const DMA_HandleTypeDef *hdma);
+static uint32_t UART_LL_DmaChannel(const DMA_HandleTypeDef *hdma);
+static void UART_LL_DmaStop(DMA_HandleTypeDef *hdma);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start circular DMA reception with idle line events
+  * @note   Same contract as HAL_UARTEx_ReceiveToIdle_DMA: UART_RxEventCallback
+  *         is called with the DMA write position on idle, half and full transfer
+  * @param  huart: UART handle, hdmarx must be linked and in circular mode
+  * @param  buffer: Receive buffer
+  * @param  size: Receive buffer size
+  * @retval HAL_OK, HAL_BUSY if reception is running, HAL_ERROR without DMA
+  */
+HAL_StatusTypeDef UART_LL_StartReception(UART_HandleTypeDef *huart, uint8_t *buffer, uint16_t size)
+{
+    DMA_HandleTypeDef *hdma = huart->hdmarx;
+    USART_TypeDef *usart = huart->Instance;
+    DMA_TypeDef *dma;
+    uint32_t channel;
+
+    if (hdma == NULL || buffer == NULL || size == 0) return HAL_ERROR;
+    if (huart->RxState != HAL_UART_STATE_READY) return HAL_BUSY;
+
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    huart->RxXferSize = size;
+    huart->ReceptionType = HAL_UART_RECEPTION_TOIDLE;
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+
+    dma = hdma->DmaBaseAddress;
+    channel = UART_LL_DmaChannel(hdma);
+    UART_LL_DmaStop(hdma);
+    LL_DMA_SetPeriphAddress(dma, channel, LL_USART_DMA_GetRegAddr(usart, LL_USART_DMA_REG_DATA_RECEIVE));
+    LL_DMA_SetMemoryAddress(dma, channel, (uint32_t)buffer);
+    LL_DMA_SetDataLength(dma, channel, size);
+    LL_DMA_EnableIT_HT(dma, channel);
+    LL_DMA_EnableIT_TC(dma, channel);
+    LL_DMA_EnableIT_TE(dma, channel);
+    LL_DMA_EnableChannel(dma, channel);
+
+    LL_USART_WriteReg(usart, ICR, UART_LL_ERROR_CLEAR | USART_ICR_IDLECF);
+    if (huart->Init.Parity != UART_PARITY_NONE) {
+        LL_USART_EnableIT_PE(usart);
+    }
+    LL_USART_EnableIT_ERROR(usart);
+    LL_USART_EnableDMAReq_RX(usart);
+    LL_USART_EnableIT_IDLE(usart);
+    return HAL_OK;
+}
+
+/**
+  * @brief  Stop reception
+  * @param  huart: UART handle
+  * @retval HAL_OK
+  */
+HAL_StatusTypeDef UART_LL_AbortReception(UART_HandleTypeDef *huart)
+{
+    USART_TypeDef *usart = huart->Instance;
+
+    LL_USART_DisableIT_RXNE_RXFNE(usart);
+    LL_USART_DisableIT_PE(usart);
+    LL_USART_DisableIT_IDLE(usart);
+    LL_USART_DisableIT_ERROR(usart);
+    LL_USART_DisableDMAReq_RX(usart);
+    if (huart->hdmarx != NULL) {
+        UART_LL_DmaStop(huart->hdmarx);
+    }
+    LL_USART_WriteReg(usart, ICR, UART_LL_ERROR_CLEAR | USART_ICR_IDLECF);
+
+    huart->ReceptionType = HAL_UART_RECEPTION_STANDARD;
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+/**
+  * @brief  Stop reception and transmission
+  * @note   Like HAL_UART_Abort, no transmit complete callback is called
+  * @param  huart: UART handle
+  * @retval HAL_OK
+  */
+HAL_StatusTypeDef UART_LL_Abort(UART_HandleTypeDef *huart)
+{
+    LL_USART_DisableIT_TC(huart->Instance);
+    LL_USART_DisableDMAReq_TX(huart->Instance);
+    if (huart->hdmatx != NULL) {
+        UART_LL_DmaStop(huart->hdmatx);
+    }
+    LL_USART_ClearFlag_TC(huart->Instance);
+    huart->gState = HAL_UART_STATE_READY;
+
+    return UART_LL_AbortReception(huart);
+}
+
+/**
+  * @brief  Start a DMA transmission
+  * @note   UART_TxCpltCallback is called once the last stop bit has been sent
+  * @param  huart: UART handle, hdmatx must be linked
+  * @param  data: Data to send, must stay valid until the callback
+  * @param  length: Number of bytes
+  * @retval HAL_OK, HAL_BUSY if a transmission is running, HAL_ERROR without DMA
+  */
+HAL_StatusTypeDef UART_LL_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t length)
+{
+    DMA_HandleTypeDef *hdma = huart->hdmatx;
+    USART_TypeDef *usart = huart->Instance;
+    DMA_TypeDef *dma;
+    uint32_t channel;
+
+    if (hdma == NULL || data == NULL || length == 0) return HAL_ERROR;
+    if (huart->gState != HAL_UART_STATE_READY) return HAL_BUSY;
+
+    huart->TxXferSize = length;
+    huart->gState = HAL_UART_STATE_BUSY_TX;
+
+    dma = hdma->DmaBaseAddress;
+    channel = UART_LL_DmaChannel(hdma);
+    UART_LL_DmaStop(hdma);
+    LL_DMA_SetPeriphAddress(dma, channel, LL_USART_DMA_GetRegAddr(usart, LL_USART_DMA_REG_DATA_TRANSMIT));
+    LL_DMA_SetMemoryAddress(dma, channel, (uint32_t)data);
+    LL_DMA_SetDataLength(dma, channel, length);
+    LL_DMA_EnableIT_TC(dma, channel);
+    LL_DMA_EnableIT_TE(dma, channel);
+    LL_DMA_EnableChannel(dma, channel);
+
+    LL_USART_ClearFlag_TC(usart);
+    LL_USART_EnableDMAReq_TX(usart);
+    return HAL_OK;
+}
+
+/**
+  * @brief  USART global interrupt handler
+  * @note   Replaces HAL_UART_IRQHandler. The receiver timeout is handled before
+  *         by UART_ReceiverTimeoutHandler
+  * @param  huart: UART handle
+  * @retval None
+  */
+void UART_LL_IRQHandler(UART_HandleTypeDef *huart)
+{
+    USART_TypeDef *usart = huart->Instance;
+    uint32_t isr = LL_USART_ReadReg(usart, ISR);
+    uint32_t cr1 = LL_USART_ReadReg(usart, CR1);
+    uint32_t errors = isr & UART_LL_ERROR_FLAGS;
+
+    /* Receive errors: the byte is stored anyway and the DMA keeps running */
+    if (errors != 0) {
+        LL_USART_WriteReg(usart, ICR, UART_LL_ERROR_CLEAR);
+        huart->ErrorCode = HAL_UART_ERROR_NONE;
+        if (errors & USART_ISR_PE)  huart->ErrorCode |= HAL_UART_ERROR_PE;
+        if (errors & USART_ISR_FE)  huart->ErrorCode |= HAL_UART_ERROR_FE;
+        if (errors & USART_ISR_NE)  huart->ErrorCode |= HAL_UART_ERROR_NE;
+        if (errors & USART_ISR_ORE) huart->ErrorCode |= HAL_UART_ERROR_ORE;
+        UART_ErrorCallback(huart);
+        huart->ErrorCode = HAL_UART_ERROR_NONE;
+    }
+
+    if ((isr & USART_ISR_IDLE) && (cr1 & USART_CR1_IDLEIE)) {
+        LL_USART_ClearFlag_IDLE(usart);
+        if (huart->RxState == HAL_UART_STATE_BUSY_RX && huart->hdmarx != NULL) {
+            DMA_HandleTypeDef *hdma = huart->hdmarx;
+
+            UART_RxEventCallback(huart, huart->RxXferSize -
+                                 (uint16_t)LL_DMA_GetDataLength(hdma->DmaBaseAddress, UART_LL_DmaChannel(hdma)));
+        }
+    }
+
+    /* Last byte shifted out after the transmit DMA completed */
+    if ((isr & USART_ISR_TC) && (cr1 & USART_CR1_TCIE)) {
+        LL_USART_DisableIT_TC(usart);
+        huart->gState = HAL_UART_STATE_READY;
+        UART_TxCpltCallback(huart);
+    }
+}
+
+/**
+  * @brief  Receive DMA channel interrupt handler
+  * @note   Replaces HAL_DMA_IRQHandler for the receive channel
+  * @param  huart: UART handle
+  * @retval None
+  */
+void UART_LL_DmaRxIRQHandler(UART_HandleTypeDef *huart)
+{
+    DMA_HandleTypeDef *hdma = huart->hdmarx;
+    uint32_t shift;
+    uint32_t flags;
+
+    if (hdma == NULL) return;
+
+    shift = UART_LL_DmaShift(hdma);
+    flags = (LL_DMA_ReadReg(hdma->DmaBaseAddress, ISR) >> shift) & UART_LL_DMA_FLAGS;
+    LL_DMA_WriteReg(hdma->DmaBaseAddress, IFCR, flags << shift);
+
+    if (flags & DMA_ISR_TEIF1) {
+        /* Channel disabled by hardware: reception stopped, restarted from the main loop */
+        UART_LL_DmaStop(hdma);
+        LL_USART_DisableDMAReq_RX(huart->Instance);
+        huart->RxState = HAL_UART_STATE_READY;
+        huart->ErrorCode = HAL_UART_ERROR_DMA;
+        UART_ErrorCallback(huart);
+        huart->ErrorCode = HAL_UART_ERROR_NONE;
+        return;
+    }
+
+    /* Circular mode: the counter has already reloaded at transfer complete */
+    if (flags & DMA_ISR_HTIF1) {
+        UART_RxEventCallback(huart, huart->RxXferSize / 2U);
+    }
+    if (flags & DMA_ISR_TCIF1) {
+        UART_RxEventCallback(huart, huart->RxXferSize);
+    }
+}
+
+/**
+  * @brief  Transmit DMA channel interrupt handler
+  * @note   Replaces HAL_DMA_IRQHandler for the transmit channel. Completion is
+  *         reported from the USART TC interrupt, not here
+  * @param  huart: UART handle
+  * @retval None
+  */
+void UART_LL_DmaTxIRQHandler(UART_HandleTypeDef *huart)
+{
+    DMA_HandleTypeDef *hdma = huart->hdmatx;
+    uint32_t shift;
+    uint32_t flags;
+
+    if (hdma == NULL) return;
+
+    shift = UART_LL_DmaShift(hdma);
+    flags = (LL_DMA_ReadReg(hdma->DmaBaseAddress, ISR) >> shift) & UART_LL_DMA_FLAGS;
+    LL_DMA_WriteReg(hdma->DmaBaseAddress, IFCR, flags << shift);
+
+    UART_LL_DmaStop(hdma);
+    LL_USART_DisableDMAReq_TX(huart->Instance);
+
+    if (flags & DMA_ISR_TEIF1) {
+        huart->gState = HAL_UART_STATE_READY;
+        huart->ErrorCode = HAL_UART_ERROR_DMA;
+        UART_ErrorCallback(huart);
+        huart->ErrorCode = HAL_UART_ERROR_NONE;
+        return;
+    }
+    if (flags & DMA_ISR_TCIF1) {
+        LL_USART_EnableIT_TC(huart->Instance);
+    }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Bit position of the channel flags in the DMA ISR/IFCR registers
+  * @param  hdma: DMA handle, initialized by HAL_DMA_Init
+  * @retval Shift of the channel global interrupt flag
+  */
+static uint32_t UART_LL_DmaShift(const DMA_HandleTypeDef *hdma)
+{
+    return hdma->ChannelIndex & 0x1FU;
+}
+
+/**
+  * @brief  LL channel number of a DMA handle
+  * @note   HAL_DMA_Init stores four flag bits per channel in ChannelIndex
+  * @param  hdma: DMA handle, initialized by HAL_DMA_Init
+  * @retval LL_DMA_CHANNEL_x
+  */
+static uint32_t UART_LL_DmaChannel(const DMA_HandleTypeDef *hdma)
+{
+    return (hdma->ChannelIndex & 0x1FU) >> 2;
+}
+
+/**
+  * @brief  Disable a DMA channel and its interrupts, clear its flags
+  * @param  hdma: DMA handle
+  * @retval None
+  */
+static void UART_LL_DmaStop(DMA_HandleTypeDef *hdma)
+{
+    DMA_TypeDef *dma = hdma->DmaBaseAddress;
+    uint32_t channel = UART_LL_DmaChannel(hdma);
+
+    LL_DMA_DisableChannel(dma, channel);
+    LL_DMA_DisableIT_HT(dma, channel);
+    LL_DMA_DisableIT_TC(dma, channel);
+    LL_DMA_DisableIT_TE(dma, channel);
+    LL_DMA_WriteReg(dma, IFCR, DMA_ISR_GIF1 << UART_LL_DmaShift(hdma));
+}
+
+#endif /* UART_BACKEND == UART_BACKEND_LL */
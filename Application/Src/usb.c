@@ -30,7 +30,7 @@ static uint16_t usb_tx_head = 0;
 static uint16_t usb_tx_tail = 0;
 static uint8_t hostReadyFlag = 1; /* Start as ready */
 
-/* Input line buffer for configuration menu only */
+/* Input line buffer for configuration menu and console */
 #define USB_INPUT_BUFFER_SIZE 32
 static char usb_input_buffer[USB_INPUT_BUFFER_SIZE];
 static uint8_t usb_input_pos = 0;
@@ -39,6 +39,9 @@ static uint8_t usb_input_ready = 0;
 /* USB status message */
 static uint32_t last_usb_status_message_time = 0;
 
+/* USB device handle - defined in usb_device.c */
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
 /* Private function prototypes -----------------------------------------------*/
 static uint16_t my_strlen(const char* str);
 
@@ -67,7 +70,7 @@ void   USB_CDCTransmitCpltHandler(void)
           return;
       }
       
-      // Process each received character for configuration menu input only
+      // Process each received character for configuration menu and console input
       for (uint32_t i = 0; i < Len; i++)
       {
           uint8_t ch = Buf[i];
@@ -225,6 +228,7 @@ void USB_Tx(uint8_t* buffer, uint16_t length)
   */
 void USB_Flush(void)
 {
+    if (!USB_IsConfigured()) return; /* Not enumerated yet: keep the data buffered */
     if (!hostReadyFlag || usb_tx_head == usb_tx_tail) return; /* Host not ready or no data */
     
     /* Calculate how much data to send */
@@ -251,6 +255,17 @@ void USB_Flush(void)
     }
 }
 
+/**
+  * @brief  Check if the USB host has configured the device
+  * @note   Before that a CDC transmission fails and its completion callback
+  *         never comes, so output stays in the ring buffer until enumeration
+  * @retval uint8_t: 1 if configured
+  */
+uint8_t USB_IsConfigured(void)
+{
+    return (hUsbDeviceFS.dev_state == USBD_STATE_CONFIGURED);
+}
+
 /* Simple strlen implementation */
 static uint16_t my_strlen(const char* str)
 {
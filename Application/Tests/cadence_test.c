@@ -0,0 +1,167 @@
+/**
+  ******************************************************************************
+  * @file           : cadence_test.c
+  * @brief          : Poll cadence tracker test module implementation
+  *                   Feeds POLL arrival times and checks the learned cadence
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Cadence Test Suite Documentation
+ * ================================
+ *
+ * OVERVIEW:
+ * The cadence tracker learns the interval and jitter of the controller's
+ * CCNET POLLs. The application times the downstream status request against
+ * CADENCE_NextExpected once the tracker is locked. These tests feed arrival
+ * times in ms (no timer needed) and check lock, estimates and unlock.
+ *
+ * • Test A: steady 100 ms polls lock after CADENCE_LOCK_SAMPLES intervals
+ * • Test B: 200 ms polls with a +/-3 ms pattern stay locked, jitter 1..3 ms
+ * • Test C: a change from 100 ms to 50 ms unlocks and locks again at 50 ms
+ * • Test D: a pause longer than CADENCE_MAX_INTERVAL_MS and a late POLL unlock
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "cadence_test.h"
+#include "cadence.h"
+
+/* Private variables ---------------------------------------------------------*/
+static cadence_t cadence;
+static uint32_t now;
+
+/* Private function prototypes -----------------------------------------------*/
+static void CADENCE_Test_Feed(uint16_t count, uint16_t interval_ms);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Test A: steady polls lock after CADENCE_LOCK_SAMPLES intervals
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CADENCE_Test_A_SteadyLock(void)
+{
+    uint16_t failures = 0;
+
+    CADENCE_Init(&cadence);
+    now = 1000;
+    CADENCE_Test_Feed(CADENCE_LOCK_SAMPLES, 100);       /* first event has no interval */
+    failures += (CADENCE_IsLocked(&cadence, now) != 0);
+    CADENCE_Test_Feed(1, 100);
+    failures += (CADENCE_IsLocked(&cadence, now) != 1);
+    failures += (CADENCE_GetInterval(&cadence) != 100);
+    failures += (CADENCE_GetJitter(&cadence) != 0);
+    failures += (CADENCE_NextExpected(&cadence) != now + 100);
+    return failures;
+}
+
+/**
+  * @brief  Test B: jittered polls stay locked, the jitter is estimated
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CADENCE_Test_B_Jitter(void)
+{
+    static const int8_t pattern[] = { 3, -3, 1, -1, 2, -2 };
+    uint16_t failures = 0;
+
+    CADENCE_Init(&cadence);
+    now = 0;
+    CADENCE_Test_Feed(2, 200);
+    for (uint16_t i = 0; i < 60; i++)
+    {
+        CADENCE_Test_Feed(1, (uint16_t)(200 + pattern[i % sizeof(pattern)]));
+    }
+    failures += (CADENCE_IsLocked(&cadence, now) != 1);
+    failures += (cadence.unlocks != 0);
+    failures += (CADENCE_GetInterval(&cadence) < 199 || CADENCE_GetInterval(&cadence) > 201);
+    failures += (CADENCE_GetJitter(&cadence) < 1 || CADENCE_GetJitter(&cadence) > 3);
+    return failures;
+}
+
+/**
+  * @brief  Test C: a new poll rate unlocks, then locks at the new rate
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CADENCE_Test_C_RateChange(void)
+{
+    uint16_t failures = 0;
+
+    CADENCE_Init(&cadence);
+    now = 0;
+    CADENCE_Test_Feed(10, 100);
+    failures += (CADENCE_IsLocked(&cadence, now) != 1);
+
+    CADENCE_Test_Feed(1, 50);
+    failures += (CADENCE_IsLocked(&cadence, now) != 0);
+    failures += (cadence.unlocks != 1);
+
+    CADENCE_Test_Feed(CADENCE_LOCK_SAMPLES, 50);
+    failures += (CADENCE_IsLocked(&cadence, now) != 1);
+    failures += (CADENCE_GetInterval(&cadence) != 50);
+    return failures;
+}
+
+/**
+  * @brief  Test D: a pause or a late POLL unlocks
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CADENCE_Test_D_Pause(void)
+{
+    uint16_t failures = 0;
+
+    CADENCE_Init(&cadence);
+    now = 0;
+    CADENCE_Test_Feed(10, 100);
+    failures += (CADENCE_IsLocked(&cadence, now + 150) != 1);
+    failures += (CADENCE_IsLocked(&cadence, now + 151) != 0);   /* expected POLL late by more than half an interval */
+
+    CADENCE_Test_Feed(1, CADENCE_MAX_INTERVAL_MS + 1);
+    failures += (CADENCE_IsLocked(&cadence, now) != 0);
+    CADENCE_Test_Feed(CADENCE_LOCK_SAMPLES, 100);
+    failures += (CADENCE_IsLocked(&cadence, now) != 1);
+
+    /* tick counter wrap */
+    CADENCE_Init(&cadence);
+    now = 0xFFFFFF00UL;
+    CADENCE_Test_Feed(10, 100);
+    failures += (CADENCE_IsLocked(&cadence, now) != 1);
+    failures += (CADENCE_GetInterval(&cadence) != 100);
+    return failures;
+}
+
+/**
+  * @brief  Run all cadence tests
+  * @retval uint16_t: Total number of failed checks
+  */
+uint16_t CADENCE_RunAllTests(void)
+{
+    uint16_t failures = 0;
+
+    failures += CADENCE_Test_A_SteadyLock();
+    failures += CADENCE_Test_B_Jitter();
+    failures += CADENCE_Test_C_RateChange();
+    failures += CADENCE_Test_D_Pause();
+    return failures;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Feed events at a fixed interval, the first one at the current time
+  * @param  count: Number of events
+  * @param  interval_ms: Time between events
+  * @retval None
+  */
+static void CADENCE_Test_Feed(uint16_t count, uint16_t interval_ms)
+{
+    for (uint16_t i = 0; i < count; i++)
+    {
+        now += interval_ms;
+        CADENCE_Update(&cadence, now);
+    }
+}
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file           : cadence_test.h
+  * @brief          : Poll cadence tracker test module header file
+  *                   No HAL dependencies: also builds on a host
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __CADENCE_TEST_H
+#define __CADENCE_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint16_t CADENCE_Test_A_SteadyLock(void);
+uint16_t CADENCE_Test_B_Jitter(void);
+uint16_t CADENCE_Test_C_RateChange(void);
+uint16_t CADENCE_Test_D_Pause(void);
+uint16_t CADENCE_RunAllTests(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CADENCE_TEST_H */
@@ -0,0 +1,336 @@
+/**
+  ******************************************************************************
+  * @file           : ccbus_test.c
+  * @brief          : ccTalk bus scheduler test module implementation
+  *                   Drives the bus owner with simulated time and checks the
+  *                   poll order, the single request on the line, the event
+  *                   counter and the bus utilisation
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* ccTalk Bus Scheduler Test Suite Documentation
+ * =============================================
+ *
+ * OVERVIEW:
+ * Several ccTalk peripherals share the downstream bus. The bus owner polls
+ * them round-robin, each at its own period, and sends the next request only
+ * after the response or the deadline of the current one. These tests run the
+ * scheduler with simulated time (ms) and simulated responses, no UART.
+ *
+ * The event counter of a ccTalk peripheral runs 1..255, wraps to 1 and is 0
+ * only after a reset. The peripheral buffers 5 events, a larger jump means
+ * events were lost between two reads.
+ *
+ * A bus where no device ever answers (wrong baud rate, parity or protocol)
+ * is reported as silent, the application then starts auto-discovery.
+ * A poll corrupted on the line (verified echo mismatch) is repeated right
+ * away, CCBUS_MAX_RETRIES times in a row at most.
+ *
+ * TEST DATA:
+ * • Host address 1
+ * • Bill validator: address 40, READ BUFFERED BILL EVENTS, every 200 ms
+ * • Coin acceptor: address 2, READ BUFFERED CREDIT, every 100 ms
+ * • Hopper: address 3, SIMPLE POLL, every 1000 ms, no event counter
+ * • Response deadline 50 ms for all devices
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ccbus_test.h"
+#include "ccbus.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define TEST_HOST       1
+#define TEST_BILL       0       /* Device indexes in add order */
+#define TEST_COIN       1
+#define TEST_HOPPER     2
+
+/* Private variables ---------------------------------------------------------*/
+static ccbus_t bus;
+static uint8_t frame[CCBUS_FRAME_MAX];
+static const ccbus_device_config_t devices[] = {
+    {"Bill",   40, 159, 1,  200, 50},
+    {"Coin",    2, 229, 1,  100, 50},
+    {"Hopper",  3, 254, 0, 1000, 50},
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void CCBUS_Test_Setup(uint8_t count);
+static uint16_t CCBUS_Test_Counter(uint32_t now, uint8_t counter);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Test A: round-robin poll order and poll frame
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CCBUS_Test_A_RoundRobin(void)
+{
+    uint16_t failures = 0;
+    uint8_t sum = 0;
+
+    CCBUS_Test_Setup(3);
+
+    /* all devices are due at start, in add order */
+    failures += (CCBUS_Next(&bus, 0, frame) != TEST_BILL);
+    failures += (frame[0] != 40 || frame[1] != 0 || frame[2] != TEST_HOST || frame[3] != 159);
+    for (uint8_t i = 0; i < CCBUS_FRAME_MAX; i++) sum += frame[i];
+    failures += (sum != 0);
+    failures += (CCBUS_Response(&bus, 40, NULL, 0, 10) != TEST_BILL);
+    failures += (CCBUS_Next(&bus, 10, frame) != TEST_COIN || frame[0] != 2);
+    failures += (CCBUS_Response(&bus, 2, NULL, 0, 20) != TEST_COIN);
+    failures += (CCBUS_Next(&bus, 20, frame) != TEST_HOPPER || frame[3] != 254);
+    failures += (CCBUS_Response(&bus, 3, NULL, 0, 30) != TEST_HOPPER);
+
+    /* each device at its own period */
+    failures += (CCBUS_Next(&bus, 30, frame) != CCBUS_NO_DEVICE);
+    failures += (CCBUS_Next(&bus, 110, frame) != TEST_COIN);
+    failures += (CCBUS_Response(&bus, 2, NULL, 0, 115) != TEST_COIN);
+    failures += (CCBUS_Next(&bus, 200, frame) != TEST_BILL);
+    failures += (CCBUS_Response(&bus, 40, NULL, 0, 205) != TEST_BILL);
+    failures += (CCBUS_Next(&bus, 205, frame) != CCBUS_NO_DEVICE);
+    failures += (CCBUS_Next(&bus, 210, frame) != TEST_COIN);
+    failures += (CCBUS_Response(&bus, 2, NULL, 0, 215) != TEST_COIN);
+
+    /* all due again: the search starts after the last polled device */
+    failures += (CCBUS_Next(&bus, 1020, frame) != TEST_HOPPER);
+    failures += (CCBUS_Response(&bus, 3, NULL, 0, 1025) != TEST_HOPPER);
+    failures += (CCBUS_Next(&bus, 1025, frame) != TEST_BILL);
+    failures += (CCBUS_Response(&bus, 40, NULL, 0, 1030) != TEST_BILL);
+    failures += (CCBUS_Next(&bus, 1030, frame) != TEST_COIN);
+
+    failures += (bus.devices[TEST_COIN].polls != 4 || bus.devices[TEST_HOPPER].polls != 2);
+    return failures;
+}
+
+/**
+  * @brief  Test B: one request on the line, deadline and late answers
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CCBUS_Test_B_SingleRequest(void)
+{
+    uint16_t failures = 0;
+
+    CCBUS_Test_Setup(2);
+
+    failures += (CCBUS_Next(&bus, 0, frame) != TEST_BILL);
+    /* the coin acceptor is due too, but the bus is taken */
+    failures += (CCBUS_Next(&bus, 0, frame) != CCBUS_NO_DEVICE || !CCBUS_IsBusy(&bus));
+    /* a device that was not asked cannot answer */
+    failures += (CCBUS_Response(&bus, 2, NULL, 0, 5) != CCBUS_NO_DEVICE);
+
+    CCBUS_Process(&bus, 49);
+    failures += (!CCBUS_IsBusy(&bus));
+    CCBUS_Process(&bus, 50);
+    failures += (CCBUS_IsBusy(&bus));
+    failures += (bus.devices[TEST_BILL].timeouts != 1 || bus.devices[TEST_BILL].online);
+
+    /* late answer of the timed out request */
+    failures += (CCBUS_Response(&bus, 40, NULL, 0, 55) != CCBUS_NO_DEVICE);
+    failures += (bus.devices[TEST_BILL].responses != 0);
+
+    /* the next device gets the bus, its latency is counted */
+    failures += (CCBUS_Next(&bus, 55, frame) != TEST_COIN);
+    failures += (CCBUS_Response(&bus, 2, NULL, 0, 67) != TEST_COIN);
+    failures += (bus.devices[TEST_COIN].responses != 1 || !bus.devices[TEST_COIN].online);
+    failures += (bus.devices[TEST_COIN].latency_max_ms != 12 || bus.devices[TEST_COIN].latency_total_ms != 12);
+    failures += (CCBUS_IsBusy(&bus));
+    return failures;
+}
+
+/**
+  * @brief  Test C: events behind the ccTalk event counter
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CCBUS_Test_C_EventCounter(void)
+{
+    uint16_t failures = 0;
+    const ccbus_device_t* bill = &bus.devices[TEST_BILL];
+
+    CCBUS_Test_Setup(1);
+
+    /* first read only synchronises */
+    failures += CCBUS_Test_Counter(0, 7);
+    failures += (bill->new_events != 0 || bill->events != 0);
+    failures += CCBUS_Test_Counter(200, 9);
+    failures += (bill->new_events != 2 || bill->events != 2);
+    failures += CCBUS_Test_Counter(400, 9);
+    failures += (bill->new_events != 0);
+
+    /* more than the peripheral buffers: the rest is lost */
+    failures += CCBUS_Test_Counter(600, 255);
+    failures += (bill->new_events != CCBUS_EVENT_BUFFER || bill->lost_events != 246 - CCBUS_EVENT_BUFFER);
+
+    /* 255 wraps to 1, not to 0 */
+    failures += CCBUS_Test_Counter(800, 2);
+    failures += (bill->new_events != 2 || bill->events != 9);
+
+    /* peripheral reset: counter 0, then counts from 1 */
+    failures += CCBUS_Test_Counter(1000, 0);
+    failures += (bill->resets != 1 || bill->new_events != 0);
+    failures += CCBUS_Test_Counter(1200, 0);
+    failures += (bill->resets != 1);
+    failures += CCBUS_Test_Counter(1400, 3);
+    failures += (bill->new_events != 3 || bill->events != 12);
+    return failures;
+}
+
+/**
+  * @brief  Test D: bus utilisation per window
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CCBUS_Test_D_Utilisation(void)
+{
+    uint16_t failures = 0;
+
+    CCBUS_Test_Setup(1);
+
+    /* bill validator every 200 ms, 40 ms on the line: 200 permille */
+    for (uint32_t now = 0; now < CCBUS_WINDOW_MS; now += 200)
+    {
+        CCBUS_Process(&bus, now);
+        failures += (CCBUS_Next(&bus, now, frame) != TEST_BILL);
+        failures += (CCBUS_Response(&bus, 40, NULL, 0, now + 40) != TEST_BILL);
+    }
+    CCBUS_Process(&bus, CCBUS_WINDOW_MS);
+    failures += (bus.utilisation != 200);
+
+    /* a request on the line at the window end is split between the windows */
+    CCBUS_Test_Setup(1);
+    failures += (CCBUS_Next(&bus, 980, frame) != TEST_BILL);
+    CCBUS_Process(&bus, CCBUS_WINDOW_MS);
+    failures += (bus.utilisation != 20);
+    CCBUS_Process(&bus, 1030);
+    failures += (CCBUS_IsBusy(&bus));
+    CCBUS_Process(&bus, 2 * CCBUS_WINDOW_MS);
+    failures += (bus.utilisation != 30);
+
+    /* idle bus */
+    CCBUS_Process(&bus, 3 * CCBUS_WINDOW_MS);
+    failures += (bus.utilisation != 0);
+
+    CCBUS_ResetStats(&bus, 3 * CCBUS_WINDOW_MS);
+    failures += (bus.devices[TEST_BILL].polls != 0 || bus.devices[TEST_BILL].timeouts != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test E: silent bus detection for auto-discovery
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CCBUS_Test_E_SilentBus(void)
+{
+    uint16_t failures = 0;
+    uint32_t now = 0;
+
+    CCBUS_Init(&bus, TEST_HOST, 0);
+    failures += (CCBUS_IsSilent(&bus, 0));         /* no devices */
+
+    CCBUS_Test_Setup(2);
+    failures += (!CCBUS_IsSilent(&bus, 0));
+
+    /* both devices time out twice */
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        CCBUS_Process(&bus, now);
+        failures += (CCBUS_Next(&bus, now, frame) == CCBUS_NO_DEVICE);
+        now += 50;
+        CCBUS_Process(&bus, now);
+        failures += (i < 3 && CCBUS_IsSilent(&bus, 2));
+        now += 150;
+    }
+    failures += (!CCBUS_IsSilent(&bus, 2) || CCBUS_IsSilent(&bus, 3));
+
+    /* one answer is enough: the settings are right */
+    failures += (CCBUS_Next(&bus, now, frame) != TEST_BILL);
+    failures += (CCBUS_Response(&bus, 40, NULL, 0, now + 10) != TEST_BILL);
+    failures += (CCBUS_IsSilent(&bus, 2));
+    return failures;
+}
+
+/**
+  * @brief  Test F: poll repeated after an echo collision
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t CCBUS_Test_F_Collision(void)
+{
+    uint16_t failures = 0;
+    const ccbus_device_t* bill = &bus.devices[TEST_BILL];
+
+    CCBUS_Test_Setup(2);
+
+    /* no request on the line, nothing to repeat */
+    failures += (CCBUS_Collision(&bus, 0) != CCBUS_NO_DEVICE);
+
+    /* the corrupted poll goes again before the coin acceptor, which is due too */
+    failures += (CCBUS_Next(&bus, 0, frame) != TEST_BILL);
+    failures += (CCBUS_Collision(&bus, 2) != TEST_BILL || CCBUS_IsBusy(&bus));
+    failures += (CCBUS_Next(&bus, 3, frame) != TEST_BILL);
+    failures += (CCBUS_Collision(&bus, 5) != TEST_BILL);
+    failures += (CCBUS_Next(&bus, 6, frame) != TEST_BILL);
+
+    /* retries used up: back to the normal schedule */
+    failures += (CCBUS_Collision(&bus, 8) != TEST_BILL);
+    failures += (CCBUS_Next(&bus, 9, frame) != TEST_COIN);
+    failures += (CCBUS_Response(&bus, 2, NULL, 0, 15) != TEST_COIN);
+    failures += (CCBUS_Next(&bus, 15, frame) != CCBUS_NO_DEVICE);
+    failures += (bill->collisions != 3 || bill->polls != 3 || bill->timeouts != 0);
+
+    /* an answer clears the retries */
+    failures += (CCBUS_Next(&bus, 206, frame) != TEST_BILL);
+    failures += (CCBUS_Collision(&bus, 208) != TEST_BILL);
+    failures += (CCBUS_Next(&bus, 209, frame) != TEST_BILL);
+    failures += (CCBUS_Response(&bus, 40, NULL, 0, 220) != TEST_BILL);
+    failures += (bill->retries != 0 || bill->collisions != 4);
+    return failures;
+}
+
+/**
+  * @brief  Run all ccTalk bus scheduler tests
+  * @retval uint16_t: Total number of failed checks
+  */
+uint16_t CCBUS_RunAllTests(void)
+{
+    uint16_t failures = 0;
+
+    failures += CCBUS_Test_A_RoundRobin();
+    failures += CCBUS_Test_B_SingleRequest();
+    failures += CCBUS_Test_C_EventCounter();
+    failures += CCBUS_Test_D_Utilisation();
+    failures += CCBUS_Test_E_SilentBus();
+    failures += CCBUS_Test_F_Collision();
+    return failures;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Bus with the first count test devices
+  * @param  count: Number of test devices
+  * @retval None
+  */
+static void CCBUS_Test_Setup(uint8_t count)
+{
+    CCBUS_Init(&bus, TEST_HOST, 0);
+    for (uint8_t i = 0; i < count; i++) CCBUS_AddDevice(&bus, &devices[i]);
+}
+
+/**
+  * @brief  Poll the bill validator and answer with an event counter
+  * @param  now: Poll time in ms, the answer follows 10 ms later
+  * @param  counter: Event counter of the answer
+  * @retval uint16_t: Number of failed checks
+  */
+static uint16_t CCBUS_Test_Counter(uint32_t now, uint8_t counter)
+{
+    uint8_t data[11] = {0};
+
+    data[0] = counter;
+    if (CCBUS_Next(&bus, now, frame) != TEST_BILL) return 1;
+    return (CCBUS_Response(&bus, 40, data, sizeof(data), now + 10) != TEST_BILL);
+}
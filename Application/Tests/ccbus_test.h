@@ -0,0 +1,46 @@
+/**
+  ******************************************************************************
+  * @file           : ccbus_test.h
+  * @brief          : ccTalk bus scheduler test module header file
+  *                   No HAL dependencies: also builds on a host
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __CCBUS_TEST_H
+#define __CCBUS_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint16_t CCBUS_Test_A_RoundRobin(void);
+uint16_t CCBUS_Test_B_SingleRequest(void);
+uint16_t CCBUS_Test_C_EventCounter(void);
+uint16_t CCBUS_Test_D_Utilisation(void);
+uint16_t CCBUS_Test_E_SilentBus(void);
+uint16_t CCBUS_Test_F_Collision(void);
+uint16_t CCBUS_RunAllTests(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CCBUS_TEST_H */
@@ -0,0 +1,250 @@
+/**
+  ******************************************************************************
+  * @file           : dispatch_test.c
+  * @brief          : Command dispatcher test module implementation
+  *                   Dispatches opcodes through a small command table and
+  *                   checks handler calls, state rules and response timing
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Command Dispatcher Test Suite Documentation
+ * ===========================================
+ *
+ * OVERVIEW:
+ * The application dispatches CCNET commands through a const table: an opcode
+ * lookup table selects the command entry with its handler, the states in
+ * which the command is legal and its response deadline. These tests use a
+ * table of the same shape with handlers that only count their calls, so the
+ * control flow of every opcode can be checked without a validator.
+ *
+ * Times are passed in explicitly (ms). A response is recorded with
+ * DISPATCH_Responded, as the application does when it queues an upstream
+ * frame. Commands with a deadline of 0 (ACK) expect no response.
+ *
+ * TEST TABLE (CCNET opcodes):
+ * • ACK    0x00: any state, no response
+ * • POLL   0x33: any state, 10 ms
+ * • STACK  0x35: escrow only, 30 ms
+ * • other opcodes: unsupported
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "dispatch_test.h"
+#include "dispatch.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define TEST_ACK            0x00
+#define TEST_POLL           0x33
+#define TEST_STACK          0x35
+#define TEST_HOLD           0x38    /* valid CCNET opcode without handler */
+
+#define TEST_STATE_IDLE     0x01
+#define TEST_STATE_ESCROW   0x02
+
+/* Private types -------------------------------------------------------------*/
+typedef enum {
+    TEST_CMD_UNSUPPORTED = DISPATCH_UNSUPPORTED,
+    TEST_CMD_ACK,
+    TEST_CMD_POLL,
+    TEST_CMD_STACK,
+    TEST_CMD_COUNT
+} test_command_index_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static void DISPATCH_Test_Ack(void);
+static void DISPATCH_Test_Poll(void);
+static void DISPATCH_Test_Stack(void);
+static void DISPATCH_Test_Init(void);
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t test_lut[256] = {
+    [TEST_ACK]   = TEST_CMD_ACK,
+    [TEST_POLL]  = TEST_CMD_POLL,
+    [TEST_STACK] = TEST_CMD_STACK,
+};
+
+static const dispatch_command_t test_commands[TEST_CMD_COUNT] = {
+    [TEST_CMD_UNSUPPORTED] = {"unsupported", NULL,                 DISPATCH_STATE_ANY, 10, 1},
+    [TEST_CMD_ACK]         = {"ACK",         DISPATCH_Test_Ack,    DISPATCH_STATE_ANY, 0,  0},
+    [TEST_CMD_POLL]        = {"POLL",        DISPATCH_Test_Poll,   DISPATCH_STATE_ANY, 10, 0},
+    [TEST_CMD_STACK]       = {"STACK",       DISPATCH_Test_Stack,  TEST_STATE_ESCROW,  30, 1},
+};
+
+static dispatch_stats_t test_stats[TEST_CMD_COUNT];
+static dispatcher_t dispatcher;
+static uint16_t ack_calls;
+static uint16_t poll_calls;
+static uint16_t stack_calls;
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Test A: every opcode reaches its own handler, others are unsupported
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t DISPATCH_Test_A_Lookup(void)
+{
+    uint16_t failures = 0;
+
+    DISPATCH_Test_Init();
+    failures += (DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 0) != DISPATCH_OK);
+    failures += (DISPATCH_Run(&dispatcher, TEST_ACK, TEST_STATE_IDLE, 0) != DISPATCH_OK);
+    failures += (DISPATCH_Run(&dispatcher, TEST_STACK, TEST_STATE_ESCROW, 0) != DISPATCH_OK);
+    failures += (poll_calls != 1 || ack_calls != 1 || stack_calls != 1);
+
+    /* all other opcodes, incl. valid CCNET commands without a handler */
+    for (uint16_t opcode = 0; opcode < 256; opcode++)
+    {
+        if (opcode == TEST_ACK || opcode == TEST_POLL || opcode == TEST_STACK) continue;
+        failures += (DISPATCH_Run(&dispatcher, (uint8_t)opcode, TEST_STATE_ESCROW, 0) != DISPATCH_NOT_SUPPORTED);
+    }
+    failures += (poll_calls != 1 || ack_calls != 1 || stack_calls != 1);
+    failures += (test_stats[TEST_CMD_UNSUPPORTED].calls != 253);
+    failures += (test_stats[TEST_CMD_POLL].calls != 1);
+    return failures;
+}
+
+/**
+  * @brief  Test B: a command outside its allowed states is not handled
+  * @note   Models STACK without a bill in escrow (ILLEGAL COMMAND)
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t DISPATCH_Test_B_IllegalState(void)
+{
+    uint16_t failures = 0;
+
+    DISPATCH_Test_Init();
+    failures += (DISPATCH_Run(&dispatcher, TEST_STACK, TEST_STATE_IDLE, 0) != DISPATCH_ILLEGAL);
+    failures += (stack_calls != 0);
+    failures += (test_stats[TEST_CMD_STACK].calls != 1 || test_stats[TEST_CMD_STACK].illegal != 1);
+
+    /* the ILLEGAL COMMAND response is timed against the command deadline */
+    DISPATCH_Responded(&dispatcher, 2);
+    failures += (test_stats[TEST_CMD_STACK].responses != 1 || test_stats[TEST_CMD_STACK].overruns != 0);
+
+    failures += (DISPATCH_Run(&dispatcher, TEST_STACK, TEST_STATE_ESCROW | TEST_STATE_IDLE, 10) != DISPATCH_OK);
+    failures += (stack_calls != 1);
+    failures += (test_stats[TEST_CMD_STACK].illegal != 1);
+    return failures;
+}
+
+/**
+  * @brief  Test C: response times and deadline overruns
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t DISPATCH_Test_C_Deadline(void)
+{
+    uint16_t failures = 0;
+
+    DISPATCH_Test_Init();
+
+    /* in time, at the deadline, late */
+    DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 1000);
+    DISPATCH_Responded(&dispatcher, 1004);
+    DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 1100);
+    DISPATCH_Responded(&dispatcher, 1110);
+    DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 1200);
+    DISPATCH_Responded(&dispatcher, 1225);
+    failures += (test_stats[TEST_CMD_POLL].responses != 3);
+    failures += (test_stats[TEST_CMD_POLL].overruns != 1);
+    failures += (test_stats[TEST_CMD_POLL].response_max_ms != 25);
+
+    /* a second response to the same command is not counted */
+    DISPATCH_Responded(&dispatcher, 1300);
+    failures += (test_stats[TEST_CMD_POLL].responses != 3);
+
+    /* tick wrap */
+    DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 0xFFFFFFFCUL);
+    DISPATCH_Responded(&dispatcher, 3);
+    failures += (test_stats[TEST_CMD_POLL].responses != 4 || test_stats[TEST_CMD_POLL].overruns != 1);
+
+    /* ACK expects no response: an upstream frame after it is not counted */
+    DISPATCH_Run(&dispatcher, TEST_ACK, TEST_STATE_IDLE, 2000);
+    DISPATCH_Responded(&dispatcher, 2100);
+    failures += (test_stats[TEST_CMD_ACK].responses != 0 || test_stats[TEST_CMD_ACK].overruns != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test D: a command superseded before its response is unanswered
+  * @note   Models a POLL timeout: the controller sends the next POLL
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t DISPATCH_Test_D_Unanswered(void)
+{
+    uint16_t failures = 0;
+
+    DISPATCH_Test_Init();
+    DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 0);
+    DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 200);
+    DISPATCH_Responded(&dispatcher, 205);
+    failures += (test_stats[TEST_CMD_POLL].unanswered != 1);
+    failures += (test_stats[TEST_CMD_POLL].responses != 1 || test_stats[TEST_CMD_POLL].response_max_ms != 5);
+
+    /* ACK after an answered POLL */
+    DISPATCH_Run(&dispatcher, TEST_ACK, TEST_STATE_IDLE, 210);
+    failures += (test_stats[TEST_CMD_POLL].unanswered != 1);
+
+    /* ACK after an unanswered POLL */
+    DISPATCH_Run(&dispatcher, TEST_POLL, TEST_STATE_IDLE, 400);
+    DISPATCH_Run(&dispatcher, TEST_ACK, TEST_STATE_IDLE, 600);
+    failures += (test_stats[TEST_CMD_POLL].unanswered != 2);
+
+    DISPATCH_ResetStats(&dispatcher);
+    failures += (test_stats[TEST_CMD_POLL].calls != 0 || test_stats[TEST_CMD_POLL].unanswered != 0);
+    return failures;
+}
+
+/**
+  * @brief  Run all dispatcher tests
+  * @retval uint16_t: Total number of failed checks
+  */
+uint16_t DISPATCH_RunAllTests(void)
+{
+    uint16_t failures = 0;
+
+    failures += DISPATCH_Test_A_Lookup();
+    failures += DISPATCH_Test_B_IllegalState();
+    failures += DISPATCH_Test_C_Deadline();
+    failures += DISPATCH_Test_D_Unanswered();
+    return failures;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Handlers: count their calls
+  * @retval None
+  */
+static void DISPATCH_Test_Ack(void)
+{
+    ack_calls++;
+}
+
+static void DISPATCH_Test_Poll(void)
+{
+    poll_calls++;
+}
+
+static void DISPATCH_Test_Stack(void)
+{
+    stack_calls++;
+}
+
+/**
+  * @brief  Initialize the dispatcher and the handler call counts
+  * @retval None
+  */
+static void DISPATCH_Test_Init(void)
+{
+    DISPATCH_Init(&dispatcher, test_lut, test_commands, test_stats, TEST_CMD_COUNT);
+    ack_calls = 0;
+    poll_calls = 0;
+    stack_calls = 0;
+}
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file           : dispatch_test.h
+  * @brief          : Command dispatcher test module header file
+  *                   No HAL dependencies: also builds on a host
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __DISPATCH_TEST_H
+#define __DISPATCH_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint16_t DISPATCH_Test_A_Lookup(void);
+uint16_t DISPATCH_Test_B_IllegalState(void);
+uint16_t DISPATCH_Test_C_Deadline(void);
+uint16_t DISPATCH_Test_D_Unanswered(void);
+uint16_t DISPATCH_RunAllTests(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DISPATCH_TEST_H */
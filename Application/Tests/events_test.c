@@ -0,0 +1,225 @@
+/**
+  ******************************************************************************
+  * @file           : events_test.c
+  * @brief          : Upstream event queue test module implementation
+  *                   Queues, delivers and retires events and checks the order
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Event Queue Test Suite Documentation
+ * ====================================
+ *
+ * OVERVIEW:
+ * The event queue holds CCNET poll responses that must not be lost (bill
+ * stacked, bill returned, rejecting). POLL sends the oldest event, the
+ * controller ACK retires it. A POLL without ACK in between sends the same
+ * event again. These tests drive the queue the way the application does.
+ *
+ * When the queue is full a credit event (high priority) replaces the oldest
+ * reject event (low priority) behind the front event. Test C checks that the
+ * front event and the order of the others are kept, test D that credits are
+ * never replaced.
+ *
+ * TEST DATA (CCNET status codes):
+ * • BILL STACKED:        0x81, bill type
+ * • BILL RETURNED:       0x82, bill type
+ * • REJECTING:           0x1C, reject reason
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "events_test.h"
+#include "events.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define TEST_BILL_STACKED   0x81
+#define TEST_BILL_RETURNED  0x82
+#define TEST_REJECTING      0x1C
+
+/* Private variables ---------------------------------------------------------*/
+static event_queue_t queue;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t EVENTS_Test_Front(uint8_t opcode, uint8_t data);
+static void EVENTS_Test_PushOne(uint8_t opcode, uint8_t data, event_priority_t priority);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Test A: events come out in the order they were queued
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t EVENTS_Test_A_Order(void)
+{
+    uint16_t failures = 0;
+
+    EVENTS_Init(&queue);
+    failures += (EVENTS_Peek(&queue) != NULL);
+
+    EVENTS_Test_PushOne(TEST_REJECTING, 0x60, EVENT_PRIORITY_LOW);
+    EVENTS_Test_PushOne(TEST_BILL_STACKED, 3, EVENT_PRIORITY_HIGH);
+    EVENTS_Test_PushOne(TEST_BILL_RETURNED, 4, EVENT_PRIORITY_HIGH);
+    failures += (EVENTS_Pending(&queue) != 3);
+
+    failures += EVENTS_Test_Front(TEST_REJECTING, 0x60);
+    EVENTS_Retire(&queue);
+    failures += EVENTS_Test_Front(TEST_BILL_STACKED, 3);
+    EVENTS_Retire(&queue);
+    failures += EVENTS_Test_Front(TEST_BILL_RETURNED, 4);
+    EVENTS_Retire(&queue);
+
+    failures += (EVENTS_Peek(&queue) != NULL);
+    EVENTS_Retire(&queue);      /* ACK without pending event: no effect */
+    failures += (EVENTS_Pending(&queue) != 0);
+    failures += (queue.queued != 3 || queue.retired != 3);
+    return failures;
+}
+
+/**
+  * @brief  Test B: an event stays at the front until it is retired
+  * @note   Models lost CCNET ACKs: the same event is peeked (sent) again
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t EVENTS_Test_B_RetireOnAck(void)
+{
+    uint16_t failures = 0;
+
+    EVENTS_Init(&queue);
+    EVENTS_Test_PushOne(TEST_BILL_STACKED, 1, EVENT_PRIORITY_HIGH);
+    EVENTS_Test_PushOne(TEST_BILL_STACKED, 2, EVENT_PRIORITY_HIGH);
+
+    for (uint8_t poll = 0; poll < 5; poll++)
+    {
+        failures += EVENTS_Test_Front(TEST_BILL_STACKED, 1);
+    }
+    EVENTS_Retire(&queue);
+    failures += EVENTS_Test_Front(TEST_BILL_STACKED, 2);
+
+    /* wrap the free running counters */
+    for (uint16_t i = 0; i < 300; i++)
+    {
+        EVENTS_Test_PushOne(TEST_REJECTING, (uint8_t)i, EVENT_PRIORITY_LOW);
+        EVENTS_Retire(&queue);
+        failures += EVENTS_Test_Front(TEST_REJECTING, (uint8_t)i);
+    }
+    failures += (EVENTS_Pending(&queue) != 1);
+    failures += (queue.dropped != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test C: a credit replaces the oldest reject behind the front event
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t EVENTS_Test_C_Eviction(void)
+{
+    uint16_t failures = 0;
+
+    EVENTS_Init(&queue);
+    /* front: reject 0 (may be on the line), then rejects 1..3 and credits 4..7 */
+    for (uint8_t i = 0; i < 4; i++) EVENTS_Test_PushOne(TEST_REJECTING, i, EVENT_PRIORITY_LOW);
+    for (uint8_t i = 4; i < EVENTS_QUEUE_SLOTS; i++) EVENTS_Test_PushOne(TEST_BILL_STACKED, i, EVENT_PRIORITY_HIGH);
+    failures += (EVENTS_Pending(&queue) != EVENTS_QUEUE_SLOTS);
+
+    /* a reject on a full queue is dropped */
+    failures += (EVENTS_Push(&queue, TEST_REJECTING, NULL, 0, EVENT_PRIORITY_LOW) != 0);
+    failures += (queue.dropped != 1);
+
+    /* a credit replaces reject 1 */
+    {
+        uint8_t bill = 20;
+        failures += (EVENTS_Push(&queue, TEST_BILL_RETURNED, &bill, 1, EVENT_PRIORITY_HIGH) != 1);
+    }
+    failures += (queue.evicted != 1);
+    failures += (EVENTS_Pending(&queue) != EVENTS_QUEUE_SLOTS);
+
+    failures += EVENTS_Test_Front(TEST_REJECTING, 0);
+    EVENTS_Retire(&queue);
+    failures += EVENTS_Test_Front(TEST_REJECTING, 2);
+    EVENTS_Retire(&queue);
+    failures += EVENTS_Test_Front(TEST_REJECTING, 3);
+    EVENTS_Retire(&queue);
+    for (uint8_t i = 4; i < EVENTS_QUEUE_SLOTS; i++)
+    {
+        failures += EVENTS_Test_Front(TEST_BILL_STACKED, i);
+        EVENTS_Retire(&queue);
+    }
+    failures += EVENTS_Test_Front(TEST_BILL_RETURNED, 20);
+    EVENTS_Retire(&queue);
+    failures += (EVENTS_Pending(&queue) != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test D: credits are never replaced, the new event is dropped
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t EVENTS_Test_D_FullOfCredits(void)
+{
+    uint16_t failures = 0;
+
+    EVENTS_Init(&queue);
+    EVENTS_Test_PushOne(TEST_REJECTING, 0, EVENT_PRIORITY_LOW);     /* front, never evicted */
+    for (uint8_t i = 1; i < EVENTS_QUEUE_SLOTS; i++) EVENTS_Test_PushOne(TEST_BILL_STACKED, i, EVENT_PRIORITY_HIGH);
+
+    failures += (EVENTS_Push(&queue, TEST_BILL_STACKED, NULL, 0, EVENT_PRIORITY_HIGH) != 0);
+    failures += (queue.dropped != 1 || queue.evicted != 0);
+    failures += EVENTS_Test_Front(TEST_REJECTING, 0);
+
+    /* oversized payload */
+    EVENTS_Init(&queue);
+    {
+        uint8_t data[EVENTS_MAX_DATA + 1] = {0};
+        failures += (EVENTS_Push(&queue, TEST_BILL_STACKED, data, sizeof(data), EVENT_PRIORITY_HIGH) != 0);
+    }
+    failures += (EVENTS_Pending(&queue) != 0);
+    return failures;
+}
+
+/**
+  * @brief  Run all event queue tests
+  * @retval uint16_t: Total number of failed checks
+  */
+uint16_t EVENTS_RunAllTests(void)
+{
+    uint16_t failures = 0;
+
+    failures += EVENTS_Test_A_Order();
+    failures += EVENTS_Test_B_RetireOnAck();
+    failures += EVENTS_Test_C_Eviction();
+    failures += EVENTS_Test_D_FullOfCredits();
+    return failures;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check the front event (opcode and one data byte)
+  * @param  opcode: Expected opcode
+  * @param  data: Expected first data byte
+  * @retval uint16_t: 1 if the check failed
+  */
+static uint16_t EVENTS_Test_Front(uint8_t opcode, uint8_t data)
+{
+    const upstream_event_t* event = EVENTS_Peek(&queue);
+
+    if (event == NULL) return 1;
+    return (event->opcode != opcode || event->data_length != 1 || event->data[0] != data);
+}
+
+/**
+  * @brief  Queue an event with one data byte
+  * @param  opcode: CCNET status code
+  * @param  data: Data byte
+  * @param  priority: Event priority
+  * @retval None
+  */
+static void EVENTS_Test_PushOne(uint8_t opcode, uint8_t data, event_priority_t priority)
+{
+    EVENTS_Push(&queue, opcode, &data, 1, priority);
+}
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file           : events_test.h
+  * @brief          : Upstream event queue test module header file
+  *                   No HAL dependencies: also builds on a host
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __EVENTS_TEST_H
+#define __EVENTS_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint16_t EVENTS_Test_A_Order(void);
+uint16_t EVENTS_Test_B_RetireOnAck(void);
+uint16_t EVENTS_Test_C_Eviction(void);
+uint16_t EVENTS_Test_D_FullOfCredits(void);
+uint16_t EVENTS_RunAllTests(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EVENTS_TEST_H */
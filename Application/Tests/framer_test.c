@@ -0,0 +1,537 @@
+/**
+  ******************************************************************************
+  * @file           : framer_test.c
+  * @brief          : Framer test module implementation
+  *                   Feeds byte streams into the framer and checks the frames
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Framer Test Suite Documentation
+ * ===============================
+ *
+ * OVERVIEW:
+ * The framer splits a byte stream into frames using the sync bytes and the
+ * length byte. In the firmware it is fed one byte per interrupt (IT mode) or
+ * in chunks on DMA idle line events (DMA mode). These tests feed the same
+ * streams both ways and check that the same frames come out.
+ *
+ * Complete frames are assembled in place in a frame ring (4 slots, at most 3
+ * pending). Test E pushes frames faster than they are consumed and checks that
+ * the overflow is counted and that queued and borrowed frames stay intact.
+ *
+ * With a check function (CRC) a rejected frame is scanned again for the next
+ * header. Test F checks that a frame hidden behind a truncated one is found.
+ * Test G injects corruption (truncated frames, garbage, fake headers and bit
+ * errors) into a stream of 200 frames and counts the frames with a valid CRC
+ * that come out with and without resync. The line goes idle after every frame:
+ * the plain framer drops its partial frame (FRAMER_Reset), the resync framer
+ * rescans it (FRAMER_Flush). FRAMER_Test_GetRecovery returns the
+ * numbers of the last run.
+ *
+ * TEST DATA:
+ * • CCNET POLL:          02 03 06 33 DA 81
+ * • CCNET ACK:           02 03 06 00 C2 82
+ * • ID003 STATUS_REQ:    FC 05 11 27 56
+ * • ccTalk SIMPLE_POLL:  02 00 01 FE FF  (length byte 0, offset 5)
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "framer_test.h"
+#include "framer.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define MAX_TEST_FRAMES 8
+#define NOISE_FRAMES    200
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t ccnet_poll[] = {0x02, 0x03, 0x06, 0x33, 0xDA, 0x81};
+static const uint8_t ccnet_ack[] = {0x02, 0x03, 0x06, 0x00, 0xC2, 0x82};
+static const uint8_t id003_status_req[] = {0xFC, 0x05, 0x11, 0x27, 0x56};
+static const uint8_t cctalk_simple_poll[] = {0x02, 0x00, 0x01, 0xFE, 0xFF};
+
+/* Frames drained from the ring */
+static frame_ring_t ring;
+static uint8_t captured[MAX_TEST_FRAMES][FRAMER_MAX_FRAME_LENGTH];
+static uint16_t captured_length[MAX_TEST_FRAMES];
+static uint16_t captured_count;
+
+/* Test G results */
+static uint16_t noise_intact;           /* Frames sent without corruption */
+static uint16_t noise_with_resync;      /* Valid frames received with CRC check and resync */
+static uint16_t noise_without_resync;   /* Valid frames received without (previous behaviour) */
+static uint32_t noise_seed;
+
+/* Private function prototypes -----------------------------------------------*/
+static void FRAMER_Test_Drain(void);
+static uint16_t FRAMER_Test_Check(uint16_t index, const uint8_t* expected, uint16_t length);
+static uint16_t FRAMER_Test_Stream(uint16_t chunk_size, uint8_t* stream, uint16_t length);
+static uint16_t FRAMER_Test_Crc(const uint8_t* data, uint16_t length);
+static uint8_t FRAMER_Test_CheckCrc(const uint8_t* frame, uint16_t length);
+static uint8_t FRAMER_Test_Random(void);
+static uint16_t FRAMER_Test_NoiseRun(uint8_t resync);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Test A: CCNET frames surrounded by garbage, fed byte by byte (IT mode)
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t FRAMER_Test_A_ByteByByte(void)
+{
+    uint8_t stream[32];
+    uint16_t n = 0;
+    uint16_t failures = 0;
+
+    /* garbage, a false sync start, POLL, ACK */
+    stream[n++] = 0x55;
+    stream[n++] = 0x02;
+    stream[n++] = 0x02;   /* sync overlap: 02 02 03 still syncs */
+    for (uint16_t i = 1; i < sizeof(ccnet_poll); i++) stream[n++] = ccnet_poll[i];
+    for (uint16_t i = 0; i < sizeof(ccnet_ack); i++) stream[n++] = ccnet_ack[i];
+
+    failures += FRAMER_Test_Stream(1, stream, n);
+    failures += (captured_count != 2);
+    failures += FRAMER_Test_Check(0, ccnet_poll, sizeof(ccnet_poll));
+    failures += FRAMER_Test_Check(1, ccnet_ack, sizeof(ccnet_ack));
+    return failures;
+}
+
+/**
+  * @brief  Test B: same stream fed in chunks of every size (DMA mode)
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t FRAMER_Test_B_Chunks(void)
+{
+    uint8_t stream[32];
+    uint16_t n = 0;
+    uint16_t failures = 0;
+
+    for (uint16_t i = 0; i < sizeof(ccnet_poll); i++) stream[n++] = ccnet_poll[i];
+    stream[n++] = 0xAA;
+    for (uint16_t i = 0; i < sizeof(ccnet_ack); i++) stream[n++] = ccnet_ack[i];
+    for (uint16_t i = 0; i < sizeof(ccnet_poll); i++) stream[n++] = ccnet_poll[i];
+
+    for (uint16_t chunk = 1; chunk <= n; chunk++)
+    {
+        failures += FRAMER_Test_Stream(chunk, stream, n);
+        failures += (captured_count != 3);
+        failures += FRAMER_Test_Check(0, ccnet_poll, sizeof(ccnet_poll));
+        failures += FRAMER_Test_Check(1, ccnet_ack, sizeof(ccnet_ack));
+        failures += FRAMER_Test_Check(2, ccnet_poll, sizeof(ccnet_poll));
+    }
+    return failures;
+}
+
+/**
+  * @brief  Test C: single sync byte (ID003) and length offset (ccTalk)
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t FRAMER_Test_C_SingleSyncAndOffset(void)
+{
+    framer_t framer;
+    uint16_t failures = 0;
+
+    captured_count = 0;
+    FRAME_RING_Init(&ring);
+    FRAMER_Init(&framer, 1, 0xFC, 0x00, 0, &ring);
+    failures += (FRAMER_Feed(&framer, id003_status_req, sizeof(id003_status_req)) != 1);
+    FRAMER_Test_Drain();
+    failures += FRAMER_Test_Check(0, id003_status_req, sizeof(id003_status_req));
+
+    captured_count = 0;
+    FRAME_RING_Init(&ring);
+    FRAMER_Init(&framer, 1, 0x02, 0x00, 5, &ring);
+    failures += (FRAMER_Feed(&framer, cctalk_simple_poll, sizeof(cctalk_simple_poll)) != 1);
+    FRAMER_Test_Drain();
+    failures += FRAMER_Test_Check(0, cctalk_simple_poll, sizeof(cctalk_simple_poll));
+    return failures;
+}
+
+/**
+  * @brief  Test D: length byte too small is dropped and counted, next frame still found
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t FRAMER_Test_D_InvalidLength(void)
+{
+    framer_t framer;
+    const uint8_t bad[] = {0x02, 0x03, 0x01};   /* length 1 < sync + length byte */
+    const uint8_t garbage[] = {0x55, 0x02, 0x55};
+    uint16_t failures = 0;
+
+    captured_count = 0;
+    FRAME_RING_Init(&ring);
+    FRAMER_Init(&framer, 2, 0x02, 0x03, 0, &ring);
+    failures += (FRAMER_Feed(&framer, bad, sizeof(bad)) != 0);
+    failures += (FRAMER_IsIdle(&framer) != 1);
+    failures += (framer.length_errors != 1);
+    failures += (framer.sync_drops != 3);  /* rescanned, no other sync found */
+    failures += (FRAMER_Feed(&framer, ccnet_poll, sizeof(ccnet_poll)) != 1);
+    FRAMER_Test_Drain();
+    failures += FRAMER_Test_Check(0, ccnet_poll, sizeof(ccnet_poll));
+
+    /* Garbage between frames is counted per byte, a broken sync pair as 2 */
+    failures += (FRAMER_Feed(&framer, garbage, sizeof(garbage)) != 0);
+    failures += (framer.sync_drops != 6);
+    return failures;
+}
+
+/**
+  * @brief  Test E: frames arrive faster than the main loop consumes them
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t FRAMER_Test_E_RingOverrun(void)
+{
+    framer_t framer;
+    const frame_slot_t* slot;
+    uint16_t failures = 0;
+
+    FRAME_RING_Init(&ring);
+    FRAMER_Init(&framer, 2, 0x02, 0x03, 0, &ring);
+
+    /* 5 back to back frames, nothing consumed: 3 queued, 2 dropped */
+    FRAMER_Feed(&framer, ccnet_poll, sizeof(ccnet_poll));
+    FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack));
+    FRAMER_Feed(&framer, ccnet_poll, sizeof(ccnet_poll));
+    FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack));
+    FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack));
+    failures += (FRAME_RING_Pending(&ring) != FRAME_RING_SLOTS - 1);
+    failures += (ring.overruns != 2);
+    failures += (ring.frames != 3);
+    failures += (ring.high_water != FRAME_RING_SLOTS - 1);
+
+    /* Borrow the oldest and keep it while more frames arrive */
+    slot = FRAME_RING_Borrow(&ring);
+    failures += (slot == NULL);
+    FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack));
+    failures += (ring.overruns != 3);
+    if (slot != NULL)
+    {
+        failures += (slot->length != sizeof(ccnet_poll));
+        failures += (slot->data[3] != ccnet_poll[3]);   /* not overwritten */
+    }
+    FRAME_RING_Release(&ring);
+
+    /* One slot free again: next frame is queued behind the two pending */
+    FRAMER_Feed(&framer, ccnet_poll, sizeof(ccnet_poll));
+    failures += (ring.overruns != 3);
+
+    captured_count = 0;
+    FRAMER_Test_Drain();
+    failures += (captured_count != 3);
+    failures += FRAMER_Test_Check(0, ccnet_ack, sizeof(ccnet_ack));
+    failures += FRAMER_Test_Check(1, ccnet_poll, sizeof(ccnet_poll));
+    failures += FRAMER_Test_Check(2, ccnet_poll, sizeof(ccnet_poll));
+    failures += (FRAME_RING_Borrow(&ring) != NULL);
+
+    /* Interleaved produce/consume never overruns, also across the slot index wrap */
+    for (uint16_t i = 0; i < 600; i++)
+    {
+        FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack));
+        captured_count = 0;
+        FRAMER_Test_Drain();
+        failures += (captured_count != 1);
+    }
+    failures += (ring.overruns != 3);
+    return failures;
+}
+
+/**
+  * @brief  Test F: a truncated frame swallows the header of the next one
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t FRAMER_Test_F_Resync(void)
+{
+    framer_t framer;
+    const uint8_t bad_header[] = {0x02, 0x03, 0x0C};    /* claims 12 bytes */
+    const uint8_t long_header[] = {0x02, 0x03, 0x20};   /* claims 32 bytes */
+    uint16_t failures = 0;
+
+    /* POLL without its CRC, directly followed by ACK: 02 03 06 33 02 03 fails the CRC */
+    captured_count = 0;
+    FRAME_RING_Init(&ring);
+    FRAMER_Init(&framer, 2, 0x02, 0x03, 0, &ring);
+    FRAMER_SetCheck(&framer, FRAMER_Test_CheckCrc);
+    failures += (FRAMER_Feed(&framer, ccnet_poll, 4) != 0);
+    failures += (FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack)) != 1);
+    FRAMER_Test_Drain();
+    failures += FRAMER_Test_Check(0, ccnet_ack, sizeof(ccnet_ack));
+    failures += (framer.check_errors != 1);
+    failures += (framer.resyncs != 1);
+
+    /* Complete frame inside the bytes of a bad one: found during the rescan itself */
+    captured_count = 0;
+    FRAMER_Feed(&framer, bad_header, sizeof(bad_header));
+    failures += (FRAMER_Feed(&framer, ccnet_poll, sizeof(ccnet_poll)) != 0);
+    failures += (FRAMER_Feed(&framer, &ccnet_ack[0], 3) != 1);       /* 12th byte: CRC fails, POLL found */
+    FRAMER_Feed(&framer, &ccnet_ack[3], sizeof(ccnet_ack) - 3);
+    FRAMER_Test_Drain();
+    failures += (captured_count != 2);
+    failures += FRAMER_Test_Check(0, ccnet_poll, sizeof(ccnet_poll));
+    failures += FRAMER_Test_Check(1, ccnet_ack, sizeof(ccnet_ack));
+    failures += (FRAMER_IsIdle(&framer) != 1);
+
+    /* Fake header claims more bytes than follow: found when the line goes idle */
+    captured_count = 0;
+    FRAMER_Feed(&framer, long_header, sizeof(long_header));
+    failures += (FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack)) != 0);
+    failures += (FRAMER_Flush(&framer) != 1);
+    FRAMER_Test_Drain();
+    failures += FRAMER_Test_Check(0, ccnet_ack, sizeof(ccnet_ack));
+    failures += (FRAMER_IsIdle(&framer) != 1);
+
+    /* Without a check the same stream returns the bad frame instead */
+    captured_count = 0;
+    FRAMER_SetCheck(&framer, NULL);
+    FRAMER_Feed(&framer, ccnet_poll, 4);
+    FRAMER_Feed(&framer, ccnet_ack, sizeof(ccnet_ack));
+    FRAMER_Test_Drain();
+    failures += (captured_count != 1);
+    failures += (FRAMER_Test_Check(0, ccnet_ack, sizeof(ccnet_ack)) == 0);
+    return failures;
+}
+
+/**
+  * @brief  Test G: recovery rate under injected line noise
+  * @note   Same stream with and without resync. Resync must never lose more
+  *         frames and must find at least 95% of the frames sent intact.
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t FRAMER_Test_G_NoiseRecovery(void)
+{
+    uint16_t failures = 0;
+
+    noise_without_resync = FRAMER_Test_NoiseRun(0);
+    noise_with_resync = FRAMER_Test_NoiseRun(1);
+
+    failures += (noise_with_resync < noise_without_resync);
+    failures += (noise_with_resync * 100U < noise_intact * 95U);
+    return failures;
+}
+
+/**
+  * @brief  Get the result of the last noise recovery test
+  * @param  intact: Frames sent without corruption
+  * @param  with_resync: Valid frames received with resync
+  * @param  without_resync: Valid frames received without resync
+  * @retval None
+  */
+void FRAMER_Test_GetRecovery(uint16_t* intact, uint16_t* with_resync, uint16_t* without_resync)
+{
+    *intact = noise_intact;
+    *with_resync = noise_with_resync;
+    *without_resync = noise_without_resync;
+}
+
+/**
+  * @brief  Run all framer tests
+  * @retval uint16_t: Total number of failed checks
+  */
+uint16_t FRAMER_RunAllTests(void)
+{
+    uint16_t failures = 0;
+
+    failures += FRAMER_Test_A_ByteByByte();
+    failures += FRAMER_Test_B_Chunks();
+    failures += FRAMER_Test_C_SingleSyncAndOffset();
+    failures += FRAMER_Test_D_InvalidLength();
+    failures += FRAMER_Test_E_RingOverrun();
+    failures += FRAMER_Test_F_Resync();
+    failures += FRAMER_Test_G_NoiseRecovery();
+    return failures;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Borrow, copy and release all pending frames (main loop side)
+  */
+static void FRAMER_Test_Drain(void)
+{
+    const frame_slot_t* slot;
+
+    while ((slot = FRAME_RING_Borrow(&ring)) != NULL)
+    {
+        if (captured_count < MAX_TEST_FRAMES)
+        {
+            for (uint16_t i = 0; i < slot->length; i++) captured[captured_count][i] = slot->data[i];
+            captured_length[captured_count] = slot->length;
+            captured_count++;
+        }
+        FRAME_RING_Release(&ring);
+    }
+}
+
+/**
+  * @brief  Compare captured frame with expected bytes
+  * @retval uint16_t: 0 if equal, 1 otherwise
+  */
+static uint16_t FRAMER_Test_Check(uint16_t index, const uint8_t* expected, uint16_t length)
+{
+    if (index >= captured_count || captured_length[index] != length) return 1;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (captured[index][i] != expected[i]) return 1;
+    }
+    return 0;
+}
+
+/**
+  * @brief  Feed a CCNET stream in chunks of chunk_size bytes
+  * @retval uint16_t: 1 if frame count returned by FRAMER_Feed does not match drained frames
+  */
+static uint16_t FRAMER_Test_Stream(uint16_t chunk_size, uint8_t* stream, uint16_t length)
+{
+    framer_t framer;
+    uint16_t frames = 0;
+
+    captured_count = 0;
+    FRAME_RING_Init(&ring);
+    FRAMER_Init(&framer, 2, 0x02, 0x03, 0, &ring);
+    for (uint16_t pos = 0; pos < length; pos += chunk_size)
+    {
+        uint16_t n = (length - pos < chunk_size) ? (length - pos) : chunk_size;
+        frames += FRAMER_Feed(&framer, &stream[pos], n);
+        FRAMER_Test_Drain();   /* main loop keeps up */
+    }
+    return (frames != captured_count);
+}
+
+/**
+  * @brief  CCNET/ID003 CRC (CCITT 0x8408 reflected, start 0), bitwise
+  * @retval uint16_t: CRC, 0 over a complete frame with valid CRC
+  */
+static uint16_t FRAMER_Test_Crc(const uint8_t* data, uint16_t length)
+{
+    uint16_t crc = 0;
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+        }
+    }
+    return crc;
+}
+
+/**
+  * @brief  Frame check function for the framer
+  * @retval uint8_t: 1 if the CRC is valid
+  */
+static uint8_t FRAMER_Test_CheckCrc(const uint8_t* frame, uint16_t length)
+{
+    return (FRAMER_Test_Crc(frame, length) == 0);
+}
+
+/**
+  * @brief  Deterministic pseudo random byte (LCG), same sequence on every target
+  * @retval uint8_t: Random byte
+  */
+static uint8_t FRAMER_Test_Random(void)
+{
+    noise_seed = noise_seed * 1103515245U + 12345U;
+    return (uint8_t)(noise_seed >> 16);
+}
+
+/**
+  * @brief  Send NOISE_FRAMES CCNET frames with injected corruption through the framer
+  * @note   One in three frames is hit: truncated, preceded by garbage or a fake
+  *         header, or a bit error. The stream is fed in 16 byte chunks and the
+  *         line goes idle after every frame, as in a request/response exchange.
+  * @param  resync: 1 to use the CRC check (and resync), 0 for the plain framer
+  * @retval uint16_t: Number of received frames with a valid CRC
+  */
+static uint16_t FRAMER_Test_NoiseRun(uint8_t resync)
+{
+    framer_t framer;
+    uint8_t stream[FRAMER_MAX_FRAME_LENGTH];
+    uint8_t frame[32];
+    uint16_t received = 0;
+    const frame_slot_t* slot;
+
+    noise_seed = 1;
+    noise_intact = 0;
+    FRAME_RING_Init(&ring);
+    FRAMER_Init(&framer, 2, 0x02, 0x03, 0, &ring);
+    FRAMER_SetCheck(&framer, resync ? FRAMER_Test_CheckCrc : NULL);
+
+    for (uint16_t f = 0; f < NOISE_FRAMES; f++)
+    {
+        uint8_t data_length = FRAMER_Test_Random() % 20;
+        uint8_t length = 6 + data_length;
+        uint8_t noise = FRAMER_Test_Random() % 12;
+        uint16_t n = 0;
+        uint16_t crc;
+
+        /* 02 03 LNG CMD DATA CRC */
+        frame[0] = 0x02;
+        frame[1] = 0x03;
+        frame[2] = length;
+        for (uint8_t i = 3; i < length - 2; i++) frame[i] = FRAMER_Test_Random();
+        crc = FRAMER_Test_Crc(frame, length - 2);
+        frame[length - 2] = (uint8_t)crc;
+        frame[length - 1] = (uint8_t)(crc >> 8);
+
+        if (noise == 0)
+        {
+            /* Garbage before the frame, may contain sync bytes */
+            uint8_t count = 1 + FRAMER_Test_Random() % 3;
+            for (uint8_t i = 0; i < count; i++) stream[n++] = (FRAMER_Test_Random() & 1) ? 0x02 : FRAMER_Test_Random();
+        }
+        else if (noise == 1)
+        {
+            /* Fake header with a random length */
+            stream[n++] = 0x02;
+            stream[n++] = 0x03;
+            stream[n++] = FRAMER_Test_Random();
+        }
+        for (uint8_t i = 0; i < length; i++) stream[n++] = frame[i];
+        if (noise == 2)
+        {
+            /* Truncated: the tail is lost */
+            n -= 1 + FRAMER_Test_Random() % 3;
+        }
+        else if (noise == 3)
+        {
+            /* Bit error */
+            stream[n - 1 - FRAMER_Test_Random() % length] ^= (uint8_t)(1 << (FRAMER_Test_Random() % 8));
+        }
+        else
+        {
+            noise_intact++;
+        }
+
+        for (uint16_t pos = 0; pos < n; pos += 16)
+        {
+            FRAMER_Feed(&framer, &stream[pos], (n - pos < 16) ? (n - pos) : 16);
+            while ((slot = FRAME_RING_Borrow(&ring)) != NULL)
+            {
+                received += FRAMER_Test_CheckCrc(slot->data, slot->length);
+                FRAME_RING_Release(&ring);
+            }
+        }
+
+        /* Line idle after every frame: receiver timeout */
+        if (resync)
+        {
+            FRAMER_Flush(&framer);
+        }
+        else
+        {
+            FRAMER_Reset(&framer);
+        }
+        while ((slot = FRAME_RING_Borrow(&ring)) != NULL)
+        {
+            received += FRAMER_Test_CheckCrc(slot->data, slot->length);
+            FRAME_RING_Release(&ring);
+        }
+    }
+    return received;
+}
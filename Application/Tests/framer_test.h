@@ -0,0 +1,48 @@
+/**
+  ******************************************************************************
+  * @file           : framer_test.h
+  * @brief          : Framer test module header file
+  *                   No HAL dependencies: also builds on a host
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FRAMER_TEST_H
+#define __FRAMER_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint16_t FRAMER_Test_A_ByteByByte(void);
+uint16_t FRAMER_Test_B_Chunks(void);
+uint16_t FRAMER_Test_C_SingleSyncAndOffset(void);
+uint16_t FRAMER_Test_D_InvalidLength(void);
+uint16_t FRAMER_Test_E_RingOverrun(void);
+uint16_t FRAMER_Test_F_Resync(void);
+uint16_t FRAMER_Test_G_NoiseRecovery(void);
+void FRAMER_Test_GetRecovery(uint16_t* intact, uint16_t* with_resync, uint16_t* without_resync);
+uint16_t FRAMER_RunAllTests(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FRAMER_TEST_H */
@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file           : host_tests.c
+  * @brief          : Host test runner
+  *                   Runs the test suites of the modules without HAL
+  *                   dependencies on a PC
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Host Test Runner Documentation
+ * ==============================
+ *
+ * framer, events, cadence, dispatch, latency, ccbus and pool only depend on
+ * their own source file. Their suites run on the target from tests.c
+ * (ENABLE_xxx_TESTS) and on a host from this runner:
+ *   make -C Application/Tests
+ *
+ * Every test returns the number of failed checks, 0 means pass. The exit code
+ * is the number of failed suites. The firmware build compiles this folder
+ * too: the runner only exists with HOST_TESTS, set by the Makefile.
+ */
+
+#ifdef HOST_TESTS
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "framer_test.h"
+#include "events_test.h"
+#include "cadence_test.h"
+#include "dispatch_test.h"
+#include "latency_test.h"
+#include "ccbus_test.h"
+#include "pool_test.h"
+
+/* Private types -------------------------------------------------------------*/
+
+/**
+  * @brief  Test suite and its runner
+  */
+typedef struct {
+    const char* name;
+    uint16_t (*run)(void);
+} host_suite_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const host_suite_t suites[] = {
+    {"framer",   FRAMER_RunAllTests},
+    {"events",   EVENTS_RunAllTests},
+    {"cadence",  CADENCE_RunAllTests},
+    {"dispatch", DISPATCH_RunAllTests},
+    {"latency",  LATENCY_RunAllTests},
+    {"ccbus",    CCBUS_RunAllTests},
+    {"pool",     POOL_RunAllTests},
+};
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Run all host test suites
+  * @retval int: Number of failed suites
+  */
+int main(void)
+{
+    int failed = 0;
+
+    for (unsigned i = 0; i < sizeof(suites) / sizeof(suites[0]); i++)
+    {
+        uint16_t failures = suites[i].run();
+
+        printf("%-10s %s", suites[i].name, failures ? "FAIL" : "pass");
+        if (failures) printf(" (%u failed checks)", failures);
+        printf("\n");
+        failed += (failures != 0);
+    }
+    return failed;
+}
+
+#endif /* HOST_TESTS */
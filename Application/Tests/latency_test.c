@@ -0,0 +1,143 @@
+/**
+  ******************************************************************************
+  * @file           : latency_test.c
+  * @brief          : Latency histogram test module implementation
+  *                   Records known latency sets and checks the percentiles
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Latency Histogram Test Suite Documentation
+ * ==========================================
+ *
+ * OVERVIEW:
+ * The UART driver timestamps the last byte of a CCNET request and the first
+ * byte of the response, the application records the difference per command
+ * in a histogram. These tests record known latencies and check the reported
+ * minimum, maximum, percentiles and budget violations.
+ *
+ * Buckets are 100 us wide below 3.2 ms and 1 ms wide up to 19.2 ms, the last
+ * bucket is open ended. A percentile is the end of its bucket, never outside
+ * the exact minimum and maximum.
+ *
+ * TEST DATA:
+ * • Budget: 10 ms (CCNET response time)
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "latency_test.h"
+#include "latency.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define TEST_BUDGET_US  10000
+
+/* Private variables ---------------------------------------------------------*/
+static latency_histogram_t histogram;
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Test A: empty histogram and exact minimum and maximum
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t LATENCY_Test_A_MinMax(void)
+{
+    uint16_t failures = 0;
+
+    LATENCY_Reset(&histogram);
+    failures += (histogram.count != 0);
+    failures += (LATENCY_Percentile(&histogram, 50) != 0);
+
+    LATENCY_Record(&histogram, 1234, TEST_BUDGET_US);
+    failures += (histogram.min_us != 1234 || histogram.max_us != 1234);
+    /* a single sample: every percentile is that sample, not the bucket end */
+    failures += (LATENCY_Percentile(&histogram, 50) != 1234);
+    failures += (LATENCY_Percentile(&histogram, 99) != 1234);
+
+    LATENCY_Record(&histogram, 0, TEST_BUDGET_US);
+    LATENCY_Record(&histogram, 4567, TEST_BUDGET_US);
+    failures += (histogram.min_us != 0 || histogram.max_us != 4567 || histogram.count != 3);
+    return failures;
+}
+
+/**
+  * @brief  Test B: percentiles of a known distribution
+  * @note   98 fast POLL answers (0.8 ms) and 2 slow ones (6.5 ms)
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t LATENCY_Test_B_Percentiles(void)
+{
+    uint16_t failures = 0;
+
+    LATENCY_Reset(&histogram);
+    for (uint8_t i = 0; i < 98; i++) LATENCY_Record(&histogram, 750 + i % 40, TEST_BUDGET_US);
+    LATENCY_Record(&histogram, 6500, TEST_BUDGET_US);
+    LATENCY_Record(&histogram, 6600, TEST_BUDGET_US);
+
+    /* 750-789 us fall in the 700-800 us bucket */
+    failures += (LATENCY_Percentile(&histogram, 50) != 800);
+    failures += (LATENCY_Percentile(&histogram, 98) != 800);
+    /* 6500 and 6600 us fall in the 6.2-7.2 ms bucket, limited to the maximum */
+    failures += (LATENCY_Percentile(&histogram, 99) != 6600);
+    failures += (LATENCY_Percentile(&histogram, 100) != 6600);
+    failures += (histogram.violations != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test C: latencies above the budget are violations
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t LATENCY_Test_C_Budget(void)
+{
+    uint16_t failures = 0;
+
+    LATENCY_Reset(&histogram);
+    LATENCY_Record(&histogram, TEST_BUDGET_US, TEST_BUDGET_US);         /* at the budget: allowed */
+    LATENCY_Record(&histogram, TEST_BUDGET_US + 1, TEST_BUDGET_US);
+    LATENCY_Record(&histogram, 110000, TEST_BUDGET_US);                 /* RESET waits for the validator */
+    failures += (histogram.violations != 2);
+
+    LATENCY_Reset(&histogram);
+    failures += (histogram.violations != 0 || histogram.max_us != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test D: latencies beyond the last bucket
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t LATENCY_Test_D_Overflow(void)
+{
+    uint16_t failures = 0;
+
+    LATENCY_Reset(&histogram);
+    LATENCY_Record(&histogram, 100, TEST_BUDGET_US);
+    LATENCY_Record(&histogram, 50000, TEST_BUDGET_US);
+    LATENCY_Record(&histogram, 0xFFFFFFFFUL, TEST_BUDGET_US);
+    failures += (histogram.buckets[LATENCY_BUCKETS - 1] != 2);
+    /* a percentile in the open ended bucket reports the maximum */
+    failures += (LATENCY_Percentile(&histogram, 50) != 0xFFFFFFFFUL);
+    failures += (LATENCY_Percentile(&histogram, 1) != 200);
+    return failures;
+}
+
+/**
+  * @brief  Run all latency histogram tests
+  * @retval uint16_t: Total number of failed checks
+  */
+uint16_t LATENCY_RunAllTests(void)
+{
+    uint16_t failures = 0;
+
+    failures += LATENCY_Test_A_MinMax();
+    failures += LATENCY_Test_B_Percentiles();
+    failures += LATENCY_Test_C_Budget();
+    failures += LATENCY_Test_D_Overflow();
+    return failures;
+}
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file           : latency_test.h
+  * @brief          : Latency histogram test module header file
+  *                   No HAL dependencies: also builds on a host
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __LATENCY_TEST_H
+#define __LATENCY_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint16_t LATENCY_Test_A_MinMax(void);
+uint16_t LATENCY_Test_B_Percentiles(void);
+uint16_t LATENCY_Test_C_Budget(void);
+uint16_t LATENCY_Test_D_Overflow(void);
+uint16_t LATENCY_RunAllTests(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LATENCY_TEST_H */
@@ -0,0 +1,288 @@
+/**
+  ******************************************************************************
+  * @file           : pool_test.c
+  * @brief          : Acceptor pool test module implementation
+  *                   Merges known denomination sets and checks the bill
+  *                   types, enable routing, escrow order and the status
+  *                   answered upstream
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+/* Acceptor Pool Test Suite Documentation
+ * ======================================
+ *
+ * OVERVIEW:
+ * Two downstream validators can stand in for one CCNET bill validator. Their
+ * denominations are merged into the 24 CCNET bill types, a CCNET enable mask
+ * is routed to a bill table row mask per device and merged back for GET
+ * STATUS. Bills in escrow are handed to the controller one at a time, in
+ * arrival order, and one device status is answered to POLL. These tests merge
+ * known denomination sets and check the resulting bill types, masks, escrow
+ * order and selected device.
+ *
+ * Device 0 keeps its own order, so a single device gets the same bill types
+ * as without the pool. Values device 1 adds follow, a value both devices
+ * accept is one bill type.
+ *
+ * Every test returns the number of failed checks, 0 means pass. The module
+ * only depends on pool.c so it can also be compiled and run on a host:
+ *   make -C Application/Tests
+ *
+ * TEST DATA:
+ * • Device 0 (ID003 head on UART2): 5, 10, 20, 50 in rows 0-3
+ * • Device 1 (ID003 head on UART3): 10, 20, 100, 200 in rows 1-4
+ * • Merged bill types: 5, 10, 20, 50, 100, 200
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "pool_test.h"
+#include "pool.h"
+
+/* Private variables ---------------------------------------------------------*/
+static pool_t pool;
+static const uint16_t head0[] = {5, 10, 20, 50};
+static const uint16_t head1[] = {0, 10, 20, 100, 200};
+
+/* Private function prototypes -----------------------------------------------*/
+static void POOL_Test_Setup(void);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Test A: merged bill types of two devices
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t POOL_Test_A_Merge(void)
+{
+    uint16_t failures = 0;
+
+    /* single device: bill types follow the row order */
+    POOL_Init(&pool, 1);
+    POOL_SetDevice(&pool, 0, head0, 4);
+    POOL_Merge(&pool);
+    failures += (pool.count != 4);
+    for (uint8_t row = 0; row < 4; row++) failures += (POOL_ToBillType(&pool, 0, row) != row);
+
+    /* second device: shared values keep their bill type, new values are added */
+    POOL_Test_Setup();
+    failures += (pool.count != 6);
+    failures += (POOL_ToBillType(&pool, 1, 1) != 1);       /* 10 */
+    failures += (POOL_ToBillType(&pool, 1, 2) != 2);       /* 20 */
+    failures += (POOL_ToBillType(&pool, 1, 3) != 4 || pool.bill_types[4].value != 100);
+    failures += (POOL_ToBillType(&pool, 1, 4) != 5 || pool.bill_types[5].value != 200);
+    failures += (pool.bill_types[0].device_row[1] != POOL_NO_BILL);    /* 5 only on device 0 */
+    failures += (POOL_ToBillType(&pool, 1, 0) != POOL_NO_BILL);        /* unused row */
+
+    /* device 0 bill types do not move when device 1 is added */
+    for (uint8_t row = 0; row < 4; row++) failures += (POOL_ToBillType(&pool, 0, row) != row);
+
+    /* device removed: its values are gone after the next merge */
+    POOL_SetDevice(&pool, 1, NULL, 0);
+    POOL_Merge(&pool);
+    failures += (pool.count != 4 || POOL_ToBillType(&pool, 1, 1) != POOL_NO_BILL);
+    return failures;
+}
+
+/**
+  * @brief  Test B: CCNET enable mask routed per device
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t POOL_Test_B_EnableRouting(void)
+{
+    uint16_t failures = 0;
+
+    POOL_Test_Setup();
+    /* all bill types */
+    failures += (POOL_RouteEnable(&pool, 0, 0x3F) != 0x0F);
+    failures += (POOL_RouteEnable(&pool, 1, 0x3F) != 0x1E);
+    /* 10 only: both devices accept it */
+    failures += (POOL_RouteEnable(&pool, 0, 0x02) != 0x02);
+    failures += (POOL_RouteEnable(&pool, 1, 0x02) != 0x02);
+    /* 5 and 200: one device each */
+    failures += (POOL_RouteEnable(&pool, 0, 0x21) != 0x01);
+    failures += (POOL_RouteEnable(&pool, 1, 0x21) != 0x10);
+    /* disable: no rows on either device */
+    failures += (POOL_RouteEnable(&pool, 0, 0) != 0 || POOL_RouteEnable(&pool, 1, 0) != 0);
+    /* bill types beyond the merged ones are ignored */
+    failures += (POOL_RouteEnable(&pool, 0, 0xFFFFC0UL) != 0);
+    failures += (POOL_RouteEnable(&pool, POOL_MAX_DEVICES, 0x3F) != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test C: device enable masks merged back for GET STATUS
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t POOL_Test_C_EnableStatus(void)
+{
+    uint16_t failures = 0;
+    uint32_t masks[] = {0x3F, 0x02, 0x21, 0x30, 0x00};
+
+    POOL_Test_Setup();
+    /* routed and merged again: the controller reads back what it enabled */
+    for (uint8_t i = 0; i < sizeof(masks) / sizeof(masks[0]); i++)
+    {
+        uint32_t merged = POOL_MergeEnable(&pool, 0, POOL_RouteEnable(&pool, 0, masks[i])) |
+                          POOL_MergeEnable(&pool, 1, POOL_RouteEnable(&pool, 1, masks[i]));
+        failures += (merged != masks[i]);
+    }
+
+    /* a bill type counts as enabled if one of the devices accepts it */
+    failures += (POOL_MergeEnable(&pool, 1, 0x02) != 0x02);    /* 10 on device 1 only */
+    failures += (POOL_MergeEnable(&pool, 0, 0x01) != 0x01);    /* 5 */
+    /* rows that are not merged are ignored */
+    failures += (POOL_MergeEnable(&pool, 1, 0x01) != 0);
+    failures += (POOL_MergeEnable(&pool, 0, 0xFFF0) != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test D: bills in escrow handled one at a time, in arrival order
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t POOL_Test_D_EscrowOrder(void)
+{
+    uint16_t failures = 0;
+
+    POOL_Test_Setup();
+    failures += (pool.escrow_owner != POOL_NO_DEVICE);
+
+    /* device 1 first: the controller handles its bill */
+    failures += (POOL_OfferEscrow(&pool, 1, 4) != 1);
+    /* repeated escrow status of the same bill */
+    failures += (POOL_OfferEscrow(&pool, 1, 4) != 1);
+    /* device 0 waits with its bill in escrow */
+    failures += (POOL_OfferEscrow(&pool, 0, 1) != 0);
+    failures += (POOL_OfferEscrow(&pool, 0, 1) != 0);
+    failures += (pool.escrow_waits != 1);
+    failures += (POOL_Select(&pool) != 1);
+
+    /* releasing the waiting device does not change the owner */
+    POOL_ReleaseEscrow(&pool, 0);
+    failures += (pool.escrow_owner != 1);
+    failures += (POOL_OfferEscrow(&pool, 0, 1) != 0);
+
+    /* stacked: the waiting bill is next */
+    POOL_ReleaseEscrow(&pool, 1);
+    failures += (pool.escrow_owner != 0);
+    failures += (POOL_Select(&pool) != 0);
+    failures += (POOL_OfferEscrow(&pool, 0, 1) != 1);
+
+    /* a new bill on device 1 now queues behind device 0 */
+    failures += (POOL_OfferEscrow(&pool, 1, 5) != 0 || pool.escrow_waits != 3);
+    POOL_ReleaseEscrow(&pool, 0);
+    failures += (pool.escrow_owner != 1 || pool.escrow_bill[1] != 5);
+    POOL_ReleaseEscrow(&pool, 1);
+    failures += (pool.escrow_owner != POOL_NO_DEVICE);
+
+    /* single device pool: device 1 is not part of it */
+    POOL_Init(&pool, 1);
+    failures += (POOL_OfferEscrow(&pool, 1, 0) != 0 || pool.escrow_owner != POOL_NO_DEVICE);
+    failures += (POOL_OfferEscrow(&pool, 0, 0) != 1);
+    return failures;
+}
+
+/**
+  * @brief  Test E: device status answered to the controller
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t POOL_Test_E_Status(void)
+{
+    uint16_t failures = 0;
+
+    POOL_Test_Setup();
+    /* nothing known: device 0 */
+    failures += (POOL_Select(&pool) != 0);
+
+    /* a working device hides a failed one */
+    POOL_SetState(&pool, 0, POOL_STATE_FAILURE);
+    POOL_SetState(&pool, 1, POOL_STATE_IDLE);
+    failures += (POOL_Select(&pool) != 1);
+
+    /* both failed, or both idle: device 0 */
+    POOL_SetState(&pool, 1, POOL_STATE_FAILURE);
+    failures += (POOL_Select(&pool) != 0);
+    POOL_SetState(&pool, 0, POOL_STATE_IDLE);
+    POOL_SetState(&pool, 1, POOL_STATE_IDLE);
+    failures += (POOL_Select(&pool) != 0);
+
+    /* a bill being accepted is reported */
+    POOL_SetState(&pool, 1, POOL_STATE_BUSY);
+    failures += (POOL_Select(&pool) != 1);
+
+    /* the escrow owner is answered until released, whatever the other device does */
+    POOL_OfferEscrow(&pool, 0, 0);
+    failures += (POOL_Select(&pool) != 0);
+    POOL_SetState(&pool, 0, POOL_STATE_FAILURE);
+    failures += (POOL_Select(&pool) != 0);
+    POOL_ReleaseEscrow(&pool, 0);
+    failures += (POOL_Select(&pool) != 1);
+
+    /* single device pool: device 1 is never selected */
+    POOL_Init(&pool, 1);
+    POOL_SetState(&pool, 1, POOL_STATE_BUSY);
+    failures += (POOL_Select(&pool) != 0);
+    return failures;
+}
+
+/**
+  * @brief  Test F: more denominations than CCNET bill types
+  * @retval uint16_t: Number of failed checks
+  */
+uint16_t POOL_Test_F_Overflow(void)
+{
+    uint16_t failures = 0;
+    uint16_t values[POOL_DEVICE_ROWS];
+
+    POOL_Init(&pool, 2);
+    for (uint8_t row = 0; row < POOL_DEVICE_ROWS; row++) values[row] = (uint16_t)(row + 1);
+    POOL_SetDevice(&pool, 0, values, POOL_DEVICE_ROWS);
+    for (uint8_t row = 0; row < POOL_DEVICE_ROWS; row++) values[row] = (uint16_t)(100 + row);
+    POOL_SetDevice(&pool, 1, values, POOL_DEVICE_ROWS);
+    POOL_Merge(&pool);
+
+    failures += (pool.count != POOL_BILL_TYPES);
+    failures += (pool.dropped != 2 * POOL_DEVICE_ROWS - POOL_BILL_TYPES);
+    failures += (POOL_ToBillType(&pool, 1, 7) != 23);
+    failures += (POOL_ToBillType(&pool, 1, 8) != POOL_NO_BILL);
+    /* a dropped denomination is never enabled */
+    failures += (POOL_RouteEnable(&pool, 1, 0xFFFFFFUL) != 0xFF);
+    return failures;
+}
+
+/**
+  * @brief  Run all acceptor pool tests
+  * @retval uint16_t: Total number of failed checks
+  */
+uint16_t POOL_RunAllTests(void)
+{
+    uint16_t failures = 0;
+
+    failures += POOL_Test_A_Merge();
+    failures += POOL_Test_B_EnableRouting();
+    failures += POOL_Test_C_EnableStatus();
+    failures += POOL_Test_D_EscrowOrder();
+    failures += POOL_Test_E_Status();
+    failures += POOL_Test_F_Overflow();
+    return failures;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Pool with both test devices merged
+  * @retval None
+  */
+static void POOL_Test_Setup(void)
+{
+    POOL_Init(&pool, 2);
+    POOL_SetDevice(&pool, 0, head0, sizeof(head0) / sizeof(head0[0]));
+    POOL_SetDevice(&pool, 1, head1, sizeof(head1) / sizeof(head1[0]));
+    POOL_Merge(&pool);
+}
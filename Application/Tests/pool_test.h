@@ -0,0 +1,46 @@
+/**
+  ******************************************************************************
+  * @file           : pool_test.h
+  * @brief          : Acceptor pool test module header file
+  *                   No HAL dependencies: also builds on a host
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) pdewit.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __POOL_TEST_H
+#define __POOL_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macro ------------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint16_t POOL_Test_A_Merge(void);
+uint16_t POOL_Test_B_EnableRouting(void);
+uint16_t POOL_Test_C_EnableStatus(void);
+uint16_t POOL_Test_D_EscrowOrder(void);
+uint16_t POOL_Test_E_Status(void);
+uint16_t POOL_Test_F_Overflow(void);
+uint16_t POOL_RunAllTests(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POOL_TEST_H */
@@ -18,6 +18,14 @@
 #include "usb_test.h"
 #include "uart_test.h"
 #include "msg_test.h"
+#include "framer_test.h"
+#include "events_test.h"
+#include "cadence_test.h"
+#include "dispatch_test.h"
+#include "latency_test.h"
+#include "ccbus_test.h"
+#include "pool_test.h"
+#include "log.h"
 
 /* Private variables ---------------------------------------------------------*/
 
@@ -28,44 +36,153 @@
 #define ENABLE_UART_TESTS          0
 #define ENABLE_CCTALK_TESTS        0
 #define ENABLE_MESSAGE_TESTS       0
+#define ENABLE_FRAMER_TESTS        0
+#define ENABLE_EVENTS_TESTS        0
+#define ENABLE_CADENCE_TESTS       0
+#define ENABLE_DISPATCH_TESTS      0
+#define ENABLE_LATENCY_TESTS       0
+#define ENABLE_CCBUS_TESTS         0
+#define ENABLE_POOL_TESTS          0
+
+/**
+  * @brief  Test suites in the order they run, one per TESTS_RunStep call
+  */
+typedef enum {
+    TESTS_STEP_CRC = 0,
+    TESTS_STEP_PROTO_CONVERTER,
+    TESTS_STEP_USB,
+    TESTS_STEP_UART,
+    TESTS_STEP_CCTALK,
+    TESTS_STEP_MESSAGE,
+    TESTS_STEP_FRAMER,
+    TESTS_STEP_EVENTS,
+    TESTS_STEP_CADENCE,
+    TESTS_STEP_DISPATCH,
+    TESTS_STEP_LATENCY,
+    TESTS_STEP_CCBUS,
+    TESTS_STEP_POOL,
+    TESTS_STEP_DONE
+} tests_step_t;
+
+static uint8_t test_step = TESTS_STEP_CRC;     /* Next suite */
 
 /* Exported functions --------------------------------------------------------*/
 
 /**
-  * @brief  Run all enabled test suites
-  * @retval None
+  * @brief  Run the next test suite
+  * @note   One suite per call: the main loop keeps answering CCNET between
+  *         the suites. Disabled suites are empty steps. UART and USB tests
+  *         wait on the hardware and block for their own duration
+  * @retval uint8_t: 1 when all suites have run, 0 if more remain
   */
-void TESTS_RunAll(void)
+uint8_t TESTS_RunStep(void)
 {
+    if (test_step >= TESTS_STEP_DONE) return 1;
+
+    switch (test_step++)
+    {
+        case TESTS_STEP_CRC:
 #if ENABLE_CRC_TESTS
-    /* Run CRC calculation and validation tests */
-    CRC_RunAllTests();
+            /* Run CRC calculation and validation tests */
+            CRC_RunAllTests();
 #endif
+            break;
 
+        case TESTS_STEP_PROTO_CONVERTER:
 #if ENABLE_PROTO_CONVERTER_TESTS
-    /* Run protocol converter tests */
-    PROTO_CONVERTER_Test_CompleteFlow();
+            /* Run protocol converter tests */
+            PROTO_CONVERTER_Test_CompleteFlow();
 #endif
+            break;
 
+        case TESTS_STEP_USB:
 #if ENABLE_USB_TESTS
-    /* Run USB tests */
-    USB_RunAllTests();
+            /* Run USB tests */
+            USB_RunAllTests();
 #endif
+            break;
 
+        case TESTS_STEP_UART:
 #if ENABLE_UART_TESTS
-    /* Run UART test sequence */
-    UART_RunAllTests();
+            /* Run UART test sequence */
+            UART_RunAllTests();
 #endif
+            break;
 
+        case TESTS_STEP_CCTALK:
 #if ENABLE_CCTALK_TESTS
-    /* Run UART test sequence */
-    UART_TEST_E();
+            /* Run UART test sequence */
+            UART_TEST_E();
 #endif
+            break;
 
+        case TESTS_STEP_MESSAGE:
 #if ENABLE_MESSAGE_TESTS
-    /* create msg and transmit it */
-    MSG_TEST_CreateCCTalkMessage();
+            /* create msg and transmit it */
+            MSG_TEST_CreateCCTalkMessage();
+#endif
+            break;
+
+        case TESTS_STEP_FRAMER:
+#if ENABLE_FRAMER_TESTS
+            /* Feed byte streams into the framer. Result 0 means all checks passed */
+            LOG_InfoUint("Framer test failures: ", FRAMER_RunAllTests());
+            {
+                uint16_t intact, with_resync, without_resync;
+                FRAMER_Test_GetRecovery(&intact, &with_resync, &without_resync);
+                LOG_InfoUint("Framer noise test, frames sent intact: ", intact);
+                LOG_InfoUint("Framer noise test, received with resync: ", with_resync);
+                LOG_InfoUint("Framer noise test, received without resync: ", without_resync);
+            }
+#endif
+            break;
+
+        case TESTS_STEP_EVENTS:
+#if ENABLE_EVENTS_TESTS
+            /* Queue, deliver and retire upstream events. Result 0 means all checks passed */
+            LOG_InfoUint("Event queue test failures: ", EVENTS_RunAllTests());
+#endif
+            break;
+
+        case TESTS_STEP_CADENCE:
+#if ENABLE_CADENCE_TESTS
+            /* Learn POLL cadences from arrival times. Result 0 means all checks passed */
+            LOG_InfoUint("Cadence test failures: ", CADENCE_RunAllTests());
+#endif
+            break;
+
+        case TESTS_STEP_DISPATCH:
+#if ENABLE_DISPATCH_TESTS
+            /* Dispatch opcodes through a command table. Result 0 means all checks passed */
+            LOG_InfoUint("Dispatch test failures: ", DISPATCH_RunAllTests());
+#endif
+            break;
+
+        case TESTS_STEP_LATENCY:
+#if ENABLE_LATENCY_TESTS
+            /* Record known latencies and check the percentiles. Result 0 means all checks passed */
+            LOG_InfoUint("Latency test failures: ", LATENCY_RunAllTests());
 #endif
+            break;
+
+        case TESTS_STEP_CCBUS:
+#if ENABLE_CCBUS_TESTS
+            /* Poll simulated ccTalk peripherals on one bus. Result 0 means all checks passed */
+            LOG_InfoUint("ccTalk bus test failures: ", CCBUS_RunAllTests());
+#endif
+            break;
+
+        case TESTS_STEP_POOL:
+#if ENABLE_POOL_TESTS
+            /* Two validators behind one CCNET identity. Result 0 means all checks passed */
+            LOG_InfoUint("Acceptor pool test failures: ", POOL_RunAllTests());
+#endif
+            break;
+
+        default:
+            break;
+    }
+    return 0;
 }
 
 /* Private functions ---------------------------------------------------------*/
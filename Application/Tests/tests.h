@@ -31,7 +31,7 @@ extern "C" {
 /* Exported variables --------------------------------------------------------*/
 
 /* Exported functions prototypes ---------------------------------------------*/
-void TESTS_RunAll(void);
+uint8_t TESTS_RunStep(void);
 
 #ifdef __cplusplus
 }
@@ -48,8 +48,11 @@ TIM_HandleTypeDef htim17;
 UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart2;
 UART_HandleTypeDef huart3;
+DMA_HandleTypeDef hdma_usart1_rx;
 DMA_HandleTypeDef hdma_usart1_tx;
+DMA_HandleTypeDef hdma_usart2_rx;
 DMA_HandleTypeDef hdma_usart2_tx;
+DMA_HandleTypeDef hdma_usart3_rx;
 DMA_HandleTypeDef hdma_usart3_tx;
 
 /* USER CODE BEGIN PV */
@@ -453,6 +456,15 @@ static void MX_DMA_Init(void)
   /* DMA1_Channel3_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+  /* DMA1_Channel4_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+  /* DMA1_Channel5_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+  /* DMA1_Channel6_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
 
 }
 
@@ -554,6 +566,40 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
     UART_RxCpltCallback(huart);
 }
 
+/**
+  * @brief  Tx Transfer completed callback (DMA transmit queue)
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    extern void UART_TxCpltCallback(UART_HandleTypeDef *huart);
+    UART_TxCpltCallback(huart);
+}
+
+/**
+  * @brief  Reception event callback (DMA idle line, half and full transfer)
+  * @param  huart: UART handle
+  * @param  Size: Position of the DMA in the receive buffer
+  * @retval None
+  */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    extern void UART_RxEventCallback(UART_HandleTypeDef *huart, uint16_t pos);
+    UART_RxEventCallback(huart, Size);
+}
+
+/**
+  * @brief  UART error callback (parity, framing, noise, overrun, DMA)
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    extern void UART_ErrorCallback(UART_HandleTypeDef *huart);
+    UART_ErrorCallback(huart);
+}
+
 /* USER CODE END 4 */
 
 /**
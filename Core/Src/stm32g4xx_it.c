@@ -22,6 +22,8 @@
 #include "stm32g4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "uart.h"
+#include "uart_ll.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -58,8 +60,11 @@
 extern PCD_HandleTypeDef hpcd_USB_FS;
 extern TIM_HandleTypeDef htim16;
 extern TIM_HandleTypeDef htim17;
+extern DMA_HandleTypeDef hdma_usart1_rx;
 extern DMA_HandleTypeDef hdma_usart1_tx;
+extern DMA_HandleTypeDef hdma_usart2_rx;
 extern DMA_HandleTypeDef hdma_usart2_tx;
+extern DMA_HandleTypeDef hdma_usart3_rx;
 extern DMA_HandleTypeDef hdma_usart3_tx;
 extern UART_HandleTypeDef huart1;
 extern UART_HandleTypeDef huart2;
@@ -212,11 +217,16 @@ void SysTick_Handler(void)
 void DMA1_Channel1_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel1_IRQn 0 */
-
+  uint32_t cycles_start = UART_CYCLES_START();
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_DmaTxIRQHandler(&huart2);
+  UART_CYCLES_RECORD(&huart2, UART_IRQ_DMA_TX, cycles_start);
+  return;
+#endif
   /* USER CODE END DMA1_Channel1_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart2_tx);
   /* USER CODE BEGIN DMA1_Channel1_IRQn 1 */
-
+  UART_CYCLES_RECORD(&huart2, UART_IRQ_DMA_TX, cycles_start);
   /* USER CODE END DMA1_Channel1_IRQn 1 */
 }
 
@@ -226,11 +236,16 @@ void DMA1_Channel1_IRQHandler(void)
 void DMA1_Channel2_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel2_IRQn 0 */
-
+  uint32_t cycles_start = UART_CYCLES_START();
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_DmaTxIRQHandler(&huart1);
+  UART_CYCLES_RECORD(&huart1, UART_IRQ_DMA_TX, cycles_start);
+  return;
+#endif
   /* USER CODE END DMA1_Channel2_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart1_tx);
   /* USER CODE BEGIN DMA1_Channel2_IRQn 1 */
-
+  UART_CYCLES_RECORD(&huart1, UART_IRQ_DMA_TX, cycles_start);
   /* USER CODE END DMA1_Channel2_IRQn 1 */
 }
 
@@ -240,14 +255,76 @@ void DMA1_Channel2_IRQHandler(void)
 void DMA1_Channel3_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel3_IRQn 0 */
-
+  uint32_t cycles_start = UART_CYCLES_START();
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_DmaTxIRQHandler(&huart3);
+  UART_CYCLES_RECORD(&huart3, UART_IRQ_DMA_TX, cycles_start);
+  return;
+#endif
   /* USER CODE END DMA1_Channel3_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart3_tx);
   /* USER CODE BEGIN DMA1_Channel3_IRQn 1 */
-
+  UART_CYCLES_RECORD(&huart3, UART_IRQ_DMA_TX, cycles_start);
   /* USER CODE END DMA1_Channel3_IRQn 1 */
 }
 
+/**
+  * @brief This function handles DMA1 channel4 global interrupt.
+  */
+void DMA1_Channel4_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Channel4_IRQn 0 */
+  uint32_t cycles_start = UART_CYCLES_START();
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_DmaRxIRQHandler(&huart1);
+  UART_CYCLES_RECORD(&huart1, UART_IRQ_DMA_RX, cycles_start);
+  return;
+#endif
+  /* USER CODE END DMA1_Channel4_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart1_rx);
+  /* USER CODE BEGIN DMA1_Channel4_IRQn 1 */
+  UART_CYCLES_RECORD(&huart1, UART_IRQ_DMA_RX, cycles_start);
+  /* USER CODE END DMA1_Channel4_IRQn 1 */
+}
+
+/**
+  * @brief This function handles DMA1 channel5 global interrupt.
+  */
+void DMA1_Channel5_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Channel5_IRQn 0 */
+  uint32_t cycles_start = UART_CYCLES_START();
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_DmaRxIRQHandler(&huart2);
+  UART_CYCLES_RECORD(&huart2, UART_IRQ_DMA_RX, cycles_start);
+  return;
+#endif
+  /* USER CODE END DMA1_Channel5_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart2_rx);
+  /* USER CODE BEGIN DMA1_Channel5_IRQn 1 */
+  UART_CYCLES_RECORD(&huart2, UART_IRQ_DMA_RX, cycles_start);
+  /* USER CODE END DMA1_Channel5_IRQn 1 */
+}
+
+/**
+  * @brief This function handles DMA1 channel6 global interrupt.
+  */
+void DMA1_Channel6_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Channel6_IRQn 0 */
+  uint32_t cycles_start = UART_CYCLES_START();
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_DmaRxIRQHandler(&huart3);
+  UART_CYCLES_RECORD(&huart3, UART_IRQ_DMA_RX, cycles_start);
+  return;
+#endif
+  /* USER CODE END DMA1_Channel6_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart3_rx);
+  /* USER CODE BEGIN DMA1_Channel6_IRQn 1 */
+  UART_CYCLES_RECORD(&huart3, UART_IRQ_DMA_RX, cycles_start);
+  /* USER CODE END DMA1_Channel6_IRQn 1 */
+}
+
 /**
   * @brief This function handles USB low priority interrupt remap.
   */
@@ -310,11 +387,17 @@ void TIM1_TRG_COM_TIM17_IRQHandler(void)
 void USART1_IRQHandler(void)
 {
   /* USER CODE BEGIN USART1_IRQn 0 */
-
+  uint32_t cycles_start = UART_CYCLES_START();
+  UART_ReceiverTimeoutHandler(&huart1);
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_IRQHandler(&huart1);
+  UART_CYCLES_RECORD(&huart1, UART_IRQ_USART, cycles_start);
+  return;
+#endif
   /* USER CODE END USART1_IRQn 0 */
   HAL_UART_IRQHandler(&huart1);
   /* USER CODE BEGIN USART1_IRQn 1 */
-
+  UART_CYCLES_RECORD(&huart1, UART_IRQ_USART, cycles_start);
   /* USER CODE END USART1_IRQn 1 */
 }
 
@@ -324,11 +407,17 @@ void USART1_IRQHandler(void)
 void USART2_IRQHandler(void)
 {
   /* USER CODE BEGIN USART2_IRQn 0 */
-
+  uint32_t cycles_start = UART_CYCLES_START();
+  UART_ReceiverTimeoutHandler(&huart2);
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_IRQHandler(&huart2);
+  UART_CYCLES_RECORD(&huart2, UART_IRQ_USART, cycles_start);
+  return;
+#endif
   /* USER CODE END USART2_IRQn 0 */
   HAL_UART_IRQHandler(&huart2);
   /* USER CODE BEGIN USART2_IRQn 1 */
-
+  UART_CYCLES_RECORD(&huart2, UART_IRQ_USART, cycles_start);
   /* USER CODE END USART2_IRQn 1 */
 }
 
@@ -338,11 +427,17 @@ void USART2_IRQHandler(void)
 void USART3_IRQHandler(void)
 {
   /* USER CODE BEGIN USART3_IRQn 0 */
-
+  uint32_t cycles_start = UART_CYCLES_START();
+  UART_ReceiverTimeoutHandler(&huart3);
+#if UART_BACKEND == UART_BACKEND_LL
+  UART_LL_IRQHandler(&huart3);
+  UART_CYCLES_RECORD(&huart3, UART_IRQ_USART, cycles_start);
+  return;
+#endif
   /* USER CODE END USART3_IRQn 0 */
   HAL_UART_IRQHandler(&huart3);
   /* USER CODE BEGIN USART3_IRQn 1 */
-
+  UART_CYCLES_RECORD(&huart3, UART_IRQ_USART, cycles_start);
   /* USER CODE END USART3_IRQn 1 */
 }
 